@@ -22,6 +22,7 @@
 #include <WiFiClient.h>
 #include <WebServer.h>
 #include "SX1276.h"
+#include "SX1276Control.h"
 
 /* Set the IP Addresses */
 IPAddress staticIP(192,168,1,40);
@@ -34,9 +35,9 @@ const char* password = "PASSWORD";
 
 // Start webserver on localhost
 WebServer server(80);
-String webPage = "";
 
 SX1276 * lora = NULL;
+SX1276Control * control = NULL;
 
 
 void setup() {
@@ -67,17 +68,13 @@ void setup() {
   Serial.print("IP address: ");
   Serial.println(WiFi.localIP());
   lora->Init(1,1);
+  control = new SX1276Control(lora);
+  control->Start(); // the radio runs in its own thread from here on
 
-   // Set up Webserver Handles
-  server.on("/",      page_root);
-  server.on("/tx",      page_tx);
-  server.on("/rx",      page_rx);
-  server.on("/cad",      page_cad);
-  server.on("/relay",      page_relay);
-  server.on("/set",      page_set);
-  server.on("/get",      page_get);
-  server.on("/init",      page_init);
-  server.onNotFound(  page_notfound);
+   // Set up Webserver Handles. All pages are answered by SX1276Control
+  server.onNotFound(  page_any);
+  const char * headers[] = {"Last-Event-ID"};
+  server.collectHeaders(headers, 1);
 
   server.begin();
 }
@@ -85,6 +82,7 @@ void setup() {
 
 void loop() {
   server.handleClient();
+  EventsLoop();
 
-  delay(100);
+  delay(10);
 }
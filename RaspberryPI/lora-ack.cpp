@@ -0,0 +1,58 @@
+// Acknowledge every packet received, and print the RX to TX turnaround.
+// Every 60 seconds (or as given) prints SPI, TX, RX and mode change latency percentiles.
+// Usage: ack [dump seconds]
+//#define DEBUG_BUILD
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Latency.cpp"
+int main (int argc, char *argv[])
+{
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  char ack  [4] = "ACK";
+  char rcv  [128] = {0};
+  SX1276Latency latency;
+  char table[1024];
+  uint32_t dumpms = 60000;
+  uint32_t lastdump = millis();
+  int rxlen;
+  if (argc > 1) dumpms = atoi(argv[1]) * 1000;
+  lora->Latency(&latency);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+    printf("Init Error\n");
+  lora->SpreadingFactor(7);
+  lora->BwHz(125e3);
+  if (lora->PowerDBm(2)<0)
+    printf("Error power\n");
+  if (lora->Frequency(869.5e6)<0)
+    printf("Error setting freq\n");
+  printf("Waiting for packets..\n");
+  while (true)
+  {
+    if (lora->StageReply(ack,strlen(ack))<0) // each RXReply uses up the staged reply
+    {
+      printf("Error staging reply\n");
+      return 1;
+    }
+    rxlen = lora->RXReply(rcv,sizeof(rcv),10000);
+    if (rxlen > 0)
+    {
+      printf ("RX %d bytes. ", rxlen);
+      if (lora->ReplyTurnaroundUs() > 0)
+        printf ("ACK turnaround: %u us\n", lora->ReplyTurnaroundUs());
+      else
+        printf ("No ACK sent\n");
+    }
+    if (millis() - lastdump >= dumpms)
+    {
+      lastdump = millis();
+      if (latency.Format(table, sizeof(table)) > 0)
+        printf ("%s", table);
+    }
+  }
+  return 0;
+}
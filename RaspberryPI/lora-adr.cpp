@@ -0,0 +1,123 @@
+// Adaptive data rate example. Each received packet is [source address hi, lo][TX power dBm][data];
+// its SNR is recorded for the source, and ADR picks the settings that source should send with.
+// They are printed and sent back to the source as a command frame
+// [source address hi, lo][ADR_COMMAND][SF][Bw() code][CR][TX power dBm]. This radio keeps
+// listening with its own settings: the choice is for the transmitter, not the gateway.
+// "check" runs without packets: BwHz() must round trip every bandwidth, and ADR must never pick
+// a slower Spreading Factor or a higher power as the link SNR improves. Exits 1 on failure.
+// Usage: adr [check]
+// Build: make adr (or make adremu to run on the emulator)
+//#define DEBUG_BUILD
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276ADR.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+#endif
+
+#define ADR_COMMAND 0xAD
+
+static int Check (SX1276 * lora)
+{
+  SX1276ADR adr(lora);
+  uint8_t   sf, cr, lastsf = 12;
+  int32_t   bwhz;
+  int8_t    power, lastpower = ADR_POWER_MAX;
+  int       fail = 0;
+
+  for (int bw = 0; bw < SX1276_BW_CODES; bw++)
+  {
+    lora->BwHz(SX1276_BW_HZ[bw]);
+    if (lora->Bw() != bw || lora->BwHz() != SX1276_BW_HZ[bw])
+    {
+      printf("FAIL: BwHz(%d) set code %d, reads back %d\n", SX1276_BW_HZ[bw], lora->Bw(), lora->BwHz());
+      fail = 1;
+    }
+  }
+  if (lora->BwHz(12345) != -1)
+  {
+    printf("FAIL: BwHz(12345) accepted\n");
+    fail = 1;
+  }
+  for (int snr = -30; snr <= 10; snr += 2)
+  {
+    for (int n = 0; n < ADR_HISTORY; n++)
+    {
+      adr.Observe(snr + 100, snr + (n & 1), -100, ADR_POWER_MAX, 125000);
+    }
+    if (adr.Choose(snr + 100, &sf, &bwhz, &cr, &power) < 0 || sf > lastsf ||
+        (sf == lastsf && power > lastpower))
+    {
+      printf("FAIL: ");
+      fail = 1;
+    }
+    printf("SNR %3d dB: SF%d %d Hz CR 4/%d %d dBm\n", snr, sf, bwhz, cr + 4, power);
+    lastsf = sf;
+    lastpower = power;
+  }
+  printf(fail ? "ADR check failed\n" : "ADR check passed\n");
+  return fail;
+}
+
+int main (int argc, char *argv[])
+{
+#ifdef SX1276_EMULATOR
+  SX1276Emulator::Speed(0);
+  SX1276Emulator emu;
+#endif
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  char rcv [255] = {0};
+  int rxlen;
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+  {
+    printf("Init Error\n");
+    return 1;
+  }
+  if (argc > 1 && strcmp(argv[1], "check") == 0)
+    return Check(lora);
+  SX1276ADR adr(lora);
+  uint8_t sf, cr, bw;
+  int32_t bwhz;
+  int8_t  power;
+  char    cmd[7];
+  lora->SpreadingFactor(12);
+  lora->BwHz(125e3);
+  printf("Waiting for packets..\n");
+  while (true)
+  {
+    rxlen = lora->RXContinuous(rcv,sizeof(rcv),10000);
+    if (rxlen < 3)
+      continue;
+    uint16_t src = (uint8_t) rcv[0] << 8 | (uint8_t) rcv[1];
+    adr.ObservePacket(src, rcv[2]);
+    int ret = adr.Choose(src, &sf, &bwhz, &cr, &power);
+    printf("From %x: SNR %.1f dB, PER %.3f. ", src, lora->PacketSnrDb(), adr.Per(src));
+    if (ret < 0)
+    {
+      printf("Not enough samples yet\n");
+      continue;
+    }
+    printf("Send with SF%d %d Hz CR 4/%d %d dBm%s", sf, bwhz, cr + 4, power,
+           ret == 1 ? " (target PER out of reach)" : "");
+    for (bw = 0; bw < SX1276_BW_CODES && SX1276_BW_HZ[bw] != bwhz; bw++) {}
+    cmd[0] = rcv[0];
+    cmd[1] = rcv[1];
+    cmd[2] = ADR_COMMAND;
+    cmd[3] = sf;
+    cmd[4] = bw;
+    cmd[5] = cr;
+    cmd[6] = power;
+    ret = lora->TX(cmd, sizeof(cmd));
+    if (ret < 0)
+      printf(". Command not sent, TX error %d\n", ret);
+    else
+      printf(". Command sent\n");
+  }
+  return 0;
+}
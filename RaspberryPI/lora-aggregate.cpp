@@ -0,0 +1,43 @@
+// Send sensor readings aggregated into frames, and print the airtime saved.
+// Usage: aggregate [readings] [deadline ms]
+//#define DEBUG_BUILD
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Aggregate.cpp"
+int main (int argc, char *argv[])
+{
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  int readings = 100;
+  int deadline = 2000;
+  if (argc > 1) readings = atoi(argv[1]);
+  if (argc > 2) deadline = atoi(argv[2]);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+    printf("Init Error\n");
+  lora->SpreadingFactor(9);
+  lora->BwHz(125e3);
+  lora->PowerDBm(2);
+  lora->Frequency(869.5e6);
+
+  SX1276Aggregator agg(lora, deadline);
+  char reading [20];
+  for (int n = 0; n < readings; n++)
+  {
+    int len = 5 + rand() % 16; // 5 - 20 byte readings
+    memset(reading, n, len);
+    int ret = agg.Queue(reading, len);
+    if (ret < 0)
+      printf("Queue Error %d\n", ret);
+    agg.Poll();
+    delay(50);
+  }
+  agg.Flush();
+  printf ("%u messages in %u frames. Airtime saved %d ms (%.1f ms per message)\n",
+          agg.Messages(), agg.Frames(), agg.AirtimeSavedMs(),
+          agg.Messages() ? agg.AirtimeSavedMs() / (double) agg.Messages() : 0.0);
+  return 0;
+}
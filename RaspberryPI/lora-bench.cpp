@@ -0,0 +1,215 @@
+// Microbenchmarks for the library: ns and SPI transactions per operation for each
+// class of register accessor, the Frequency() / BwHz() / PowerDBm() helpers, profile
+// switches, TX and RX cycles by payload size, and CAD cycles. Prints a table, and writes the results
+// as JSON (with the library version) so runs can be compared across versions.
+// Usage: bench [json file] [scale]   scale multiplies the iteration counts, default 1
+// Build: make bench     against the radio on the real SPI bus (spidev, via wiringPi)
+//        make benchemu  against the in-process register emulator, no radio needed
+// On the real bus TX, RX and CAD run in real time, so they are few and slow: their
+// ns/op is mostly air and polling time. RX by payload size needs packets to arrive
+// on demand, so it is only run on the emulator; the real bus runs an empty RX window.
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SX1276.cpp"
+#include "SX1276Metrics.cpp"
+#include "SX1276Latency.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+#define BENCH_BUS "emulator"
+#else
+#define BENCH_BUS "spidev"
+#endif
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define SPI_HZ        1000000
+#define MAX_RESULTS   64
+
+struct BenchResult
+{
+  const char * group;
+  char     name[24];
+  uint32_t ops;
+  double   nsPerOp;
+  double   spiPerOp;
+};
+
+static SX1276 * lora = NULL;
+static SX1276Metrics metrics;
+static SX1276Latency latency;
+static BenchResult results[MAX_RESULTS];
+static int nresults = 0;
+static volatile uint32_t sink;
+static constexpr SX1276Profile profileA(868.1e6, 7, 125e3, 1, 14, OUTPUT_PA_BOOST, 8, 0x12, 0);
+static constexpr SX1276Profile profileB(868.3e6, 9, 125e3, 1, 10, OUTPUT_PA_BOOST, 8, 0x34, 0);
+static uint32_t txErrors = 0;
+static uint32_t rxErrors = 0;
+
+static void Add (const char *group, const char *name, uint32_t ops, uint64_t ns, uint64_t spi)
+{
+  BenchResult * r;
+  if (nresults == MAX_RESULTS || ops == 0)
+    return;
+  r = &results[nresults++];
+  r->group = group;
+  snprintf(r->name, sizeof(r->name), "%s", name);
+  r->ops = ops;
+  r->nsPerOp = (double) ns / ops;
+  r->spiPerOp = (double) spi / ops;
+  printf("%-10s %-16s %8u %14.1f %10.2f\n", group, name, ops, r->nsPerOp, r->spiPerOp);
+}
+
+// Run op(i) ops times and record the average wall time and SPI transactions
+template <typename F>
+static void Bench (const char *group, const char *name, uint32_t ops, F op)
+{
+  uint64_t spi = metrics.SpiTransactions();
+  uint64_t start = SX1276Latency::NowNs();
+  for (uint32_t i = 0; i < ops; i++)
+    op(i);
+  Add(group, name, ops, SX1276Latency::NowNs() - start, metrics.SpiTransactions() - spi);
+}
+
+static int WriteJson (const char *path)
+{
+  FILE * f = fopen(path, "w");
+  if (f == NULL)
+    return -1;
+  fprintf(f, "{\"version\":\"%s\",\"bus\":\"%s\",\"spi_hz\":%d,\"time\":%ld,\"results\":[",
+          BENCH_VERSION, BENCH_BUS, SPI_HZ, (long) time(NULL));
+  for (int n = 0; n < nresults; n++)
+  {
+    fprintf(f, "%s\n {\"group\":\"%s\",\"name\":\"%s\",\"ops\":%u,\"ns_per_op\":%.1f,\"spi_per_op\":%.3f}",
+            n ? "," : "", results[n].group, results[n].name, results[n].ops,
+            results[n].nsPerOp, results[n].spiPerOp);
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f);
+}
+
+int main (int argc, char *argv[])
+{
+#ifdef SX1276_EMULATOR
+  SX1276Emulator emu;
+  SX1276Packet pkt;
+  const uint32_t cycles = 1000;      // TX / RX cycles per payload size
+  const uint16_t cadMs = 1000;       // CAD run, emulated time
+#else
+  const uint32_t cycles = 3;
+  const uint16_t cadMs = 2000;
+#endif
+  static const uint8_t sizes[] = {1, 16, 64, 128, 255};
+  const char * json = "bench.json";
+  uint32_t scale = 1;
+  uint32_t accessOps, frf;
+  char data[255], rcv[255], name[24];
+  SX1276Histogram * cad;
+  uint64_t spi, start;
+
+  if (argc > 1) json = argv[1];
+  if (argc > 2) scale = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+#ifdef SX1276_EMULATOR
+  SX1276Emulator::Speed(0);
+  emu.MatchConfig(0);
+  accessOps = 100000 * scale;
+#else
+  accessOps = 10000 * scale;
+#endif
+  lora = new SX1276(SPI_HZ,6,0);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_NONE)<0)
+  {
+    printf("Init Error\n");
+    return 1;
+  }
+  lora->Metrics(&metrics);
+  lora->Latency(&latency);
+  lora->ModemConfig(7, 500e3, 1, 10);   // Shortest airtime, for the real bus
+  frf = lora->Frf();
+  for (int n = 0; n < (int) sizeof(data); n++) data[n] = n;
+
+  printf("Library %s, %s bus at %d Hz\n", BENCH_VERSION, BENCH_BUS, SPI_HZ);
+  printf("%-10s %-16s %8s %14s %10s\n", "group", "name", "ops", "ns/op", "spi/op");
+
+/* Register accessors: 8 bit, bitfield (read-modify-write), 16 bit and 24 bit */
+  Bench("accessor", "read8", accessOps, [](uint32_t) { sink = lora->SyncWord(); });
+  Bench("accessor", "write8", accessOps, [](uint32_t i) { lora->SyncWord(i & 1 ? 0x34 : 0x12); });
+  Bench("accessor", "bitfield_read", accessOps, [](uint32_t) { sink = lora->SpreadingFactor(); });
+  Bench("accessor", "bitfield_write", accessOps, [](uint32_t i) { lora->SpreadingFactor(i & 1 ? 8 : 7); });
+  Bench("accessor", "read16", accessOps, [](uint32_t) { sink = lora->PreambleLength(); });
+  Bench("accessor", "write16", accessOps, [](uint32_t) { lora->PreambleLength(8); });
+  Bench("accessor", "frf_read", accessOps, [](uint32_t) { sink = lora->Frf(); });
+  Bench("accessor", "frf_write", accessOps, [frf](uint32_t) { lora->Frf(frf); });
+  lora->SyncWord(0x12);
+  lora->SpreadingFactor(7);
+
+/* Helpers that convert units and check limits */
+  Bench("helper", "frequency", accessOps, [](uint32_t i) { lora->Frequency(i & 1 ? 868.3e6 : 868.1e6); });
+  Bench("helper", "bwhz", accessOps, [](uint32_t i) { lora->BwHz(i & 1 ? 250e3 : 500e3); });
+  Bench("helper", "powerdbm", accessOps, [](uint32_t i) { lora->PowerDBm(i & 1 ? 14 : 10); });
+  lora->Frf(frf);
+  lora->BwHz(500e3);
+  lora->PowerDBm(10);
+
+/* Switching between two profiles, against the setter calls that do the same */
+  Bench("config", "profile_switch", accessOps, [](uint32_t i) { lora->Apply(i & 1 ? &profileB : &profileA); });
+  Bench("config", "setter_switch", accessOps, [](uint32_t i) {
+    lora->ModemConfig(i & 1 ? 9 : 7, 125e3, 1, i & 1 ? 10 : 14);
+    lora->Frequency(i & 1 ? 868.3e6 : 868.1e6);
+    lora->SyncWord(i & 1 ? 0x34 : 0x12);
+  });
+  lora->Apply(&profileA);
+
+/* TX: FIFO load to TxDone */
+  for (unsigned s = 0; s < sizeof(sizes); s++)
+  {
+    snprintf(name, sizeof(name), "tx_%u", sizes[s]);
+    Bench("cycle", name, cycles * scale, [&data, s](uint32_t) {
+      if (lora->TX(data, sizes[s]) < 0) txErrors++;
+    });
+  }
+
+/* RX: a packet arriving to it being in rcv */
+#ifdef SX1276_EMULATOR
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.crcOn = 1;
+  pkt.cr = 1;
+  for (unsigned s = 0; s < sizeof(sizes); s++)
+  {
+    pkt.len = sizes[s];
+    memcpy(pkt.data, data, pkt.len);
+    snprintf(name, sizeof(name), "rx_%u", sizes[s]);
+    Bench("cycle", name, cycles * scale, [&emu, &pkt, &rcv](uint32_t) {
+      emu.Inject(&pkt);
+      if (lora->RXContinuous(rcv, sizeof(rcv), 1000) != pkt.len) rxErrors++;
+    });
+  }
+#endif
+  Bench("cycle", "rx_timeout_10ms", cycles * scale, [&rcv](uint32_t) { lora->RXContinuous(rcv, sizeof(rcv), 10); });
+
+/* CAD: cycles completed in one CAD() call, from the latency histogram's count */
+  latency.Clear();
+  spi = metrics.SpiTransactions();
+  start = SX1276Latency::NowNs();
+  lora->CAD(rcv, sizeof(rcv), cadMs);
+  cad = latency.Stage(LATENCY_CAD);
+  Add("cycle", "cad", cad->Count(), SX1276Latency::NowNs() - start, metrics.SpiTransactions() - spi);
+
+  if (txErrors)
+    printf("%u transmissions failed\n", txErrors);
+  if (rxErrors)
+    printf("%u packets not received intact\n", rxErrors);
+  if (WriteJson(json) != 0)
+  {
+    printf("Can't write %s\n", json);
+    return 1;
+  }
+  printf("Results written to %s\n", json);
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Benchmark back to back transmission: TX() per frame vs TXBurst()
+// Reports mean inter-frame gap and sustained goodput.
+// Usage: burst [frames] [payload bytes]
+// Caution: transmits continuously. Use a dummy load or check your band plan.
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+int main (int argc, char *argv[])
+{
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  int frames = 20;
+  int paylen = 32;
+  if (argc > 1) frames = atoi(argv[1]);
+  if (argc > 2) paylen = atoi(argv[2]);
+  if (frames < 1 || frames > 256 || paylen < 1 || paylen > 255)
+  {
+    printf("Usage: burst [frames 1-256] [payload bytes 1-255]\n");
+    return 1;
+  }
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_NONE)<0)
+    printf("Init Error\n");
+  lora->Frequency(869.5e6);
+  lora->SpreadingFactor(7);
+  lora->BwHz(125e3);
+  lora->PowerDBm(2);
+
+  static char   data [256][255];
+  static char * frame [256];
+  static size_t len [256];
+  for (int n = 0; n < frames; n++)
+  {
+    memset(data[n], 'A' + n % 26, paylen);
+    frame[n] = data[n];
+    len[n] = paylen;
+  }
+
+  /* Baseline: one TX() call per frame */
+  uint32_t t = micros();
+  uint32_t airtime = 0;
+  for (int n = 0; n < frames; n++)
+  {
+    int ret = lora->TX(frame[n],len[n]);
+    if (ret < 0)
+    {
+      printf("TX Error %d\n",ret);
+      return 1;
+    }
+    airtime += ret;
+  }
+  t = micros() - t;
+  airtime *= 1000; // TX() rounds to ms, so this can come out longer than t
+  printf ("TX:      %d frames x %d bytes in %u us. gap %u us/frame. goodput %.1f bytes/s\n",
+          frames, paylen, t, t > airtime ? (t - airtime) / frames : 0, frames * paylen * 1e6 / t);
+
+  /* Burst */
+  t = micros();
+  int sent = lora->TXBurst(frame,len,frames);
+  t = micros() - t;
+  if (sent < 0)
+  {
+    printf("TXBurst Error %d\n",sent);
+    return 1;
+  }
+  printf ("TXBurst: %d frames x %d bytes in %u us. gap %u us/frame. goodput %.1f bytes/s\n",
+          sent, paylen, t, lora->BurstGapUs(), sent * paylen * 1e6 / t);
+  if (lora->BurstTimeouts())
+    printf ("TXBurst: %u frames timed out waiting for TxDone\n", lora->BurstTimeouts());
+  return 0;
+}
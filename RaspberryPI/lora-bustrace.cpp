@@ -0,0 +1,147 @@
+// Record the SPI traffic of scripted scenarios on an emulated radio, and check it
+// against stored golden traces, so changes in bus efficiency show up in review.
+// Scenarios: init, config, tx64, rx, cad, snapshot, warm, profile (see below).
+// Usage: bustrace record [dir]   write dir/<scenario>.trace (default dir golden)
+//        bustrace check [dir]    compare each scenario with dir/<scenario>.trace,
+//                                exit status 1 if any differs
+//        bustrace diff a b       compare two trace files
+// Build: make bustrace (no radio or wiringPi needed). make buscheck builds and checks.
+// After a deliberate change to bus traffic, re-record and commit the golden traces.
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Emulator.cpp"
+#include "SX1276BusRecorder.cpp"
+
+#define SCENARIOS 8
+static const char * scenario[SCENARIOS] = {"init", "config", "tx64", "rx", "cad", "snapshot", "warm",
+                                           "profile"};
+static constexpr SX1276Profile uplink(868.1e6, 9, 125e3, 1, 14, OUTPUT_PA_BOOST);
+static constexpr SX1276Profile beacon(869.525e6, 12, 125e3, 1, 14, OUTPUT_PA_BOOST, 10, 0x34);
+
+// Run scenario n on a fresh emulated radio, recording its traffic (not its setup)
+static void Run (int n, SX1276BusRecorder *rec)
+{
+  SX1276Emulator emu;
+  SX1276 lora(1000000,6,0);
+  SX1276Packet pkt;
+  SX1276Snapshot snap;
+  SX1276 * warm;
+  char data[255];
+
+  emu.MatchConfig(0);
+  for (int b = 0; b < (int) sizeof(data); b++) data[b] = b;
+  rec->Clear();
+  if (n != 0)
+  {
+    lora.Init(OUTPUT_PA_BOOST,BANDPLAN_EU868);
+    lora.ModemConfig(7, 125e3, 1, 14);
+  }
+  lora.BusRecorder(rec);
+  switch (n)
+  {
+    case 0: // Modem reset and band plan setup
+      lora.Init(OUTPUT_PA_BOOST,BANDPLAN_EU868);
+      break;
+    case 1: // Typical reconfiguration
+      lora.ModemConfig(9, 125e3, 1, 10);
+      lora.Frequency(868.1e6);
+      lora.SyncWord(0x34);
+      break;
+    case 2: // One 64 byte frame
+      lora.TX(data, 64);
+      break;
+    case 3: // Two packets received with their metadata, then an empty window
+      memset(&pkt, 0, sizeof(pkt));
+      pkt.crcOn = 1;
+      pkt.cr = 1;
+      for (int p = 0; p < 2; p++)
+      {
+        pkt.len = p ? 64 : 16;
+        memcpy(pkt.data, data, pkt.len);
+        emu.Inject(&pkt);
+        lora.RXContinuous(data, sizeof(data), 1000);
+        lora.PacketInfo(&pkt);
+      }
+      lora.RXContinuous(data, sizeof(data), 100);
+      break;
+    case 4: // 100ms of CAD with nothing on air
+      lora.CAD(data, sizeof(data), 100);
+      break;
+    case 5: // Register map for the control pages
+      lora.Snapshot(&snap);
+      break;
+    case 6: // Host restart: a new driver restores a saved configuration to the running modem
+      lora.BusRecorder(NULL);
+      lora.ModemConfig(9, 125e3, 1, 10);
+      lora.SyncWord(0x34);
+      lora.Snapshot(&snap);
+      lora.ModemConfig(7, 125e3, 1, 14);
+      lora.SyncWord(0x12);
+      warm = new SX1276(1000000,6,0);
+      warm->BusRecorder(rec);
+      warm->WarmStart(OUTPUT_PA_BOOST,BANDPLAN_EU868,&snap);
+      warm->BusRecorder(NULL);
+      delete warm;
+      break;
+    case 7: // Switching between two profiles, after the first reads the registers
+      lora.Apply(&uplink);
+      lora.Apply(&beacon);
+      lora.Apply(&uplink);
+      break;
+  }
+  lora.BusRecorder(NULL);
+}
+
+int main (int argc, char *argv[])
+{
+  SX1276BusRecorder now, golden;
+  const char * dir = "golden";
+  char path[256];
+  int diffs, failed = 0;
+
+  if (argc < 2 || (strcmp(argv[1], "diff") == 0 && argc < 4))
+  {
+    printf("Usage: bustrace record [dir] | check [dir] | diff a b\n");
+    return 2;
+  }
+  if (strcmp(argv[1], "diff") == 0)
+  {
+    if (golden.Load(argv[2]) < 0 || now.Load(argv[3]) < 0)
+    {
+      printf("Can't read %s or %s\n", argv[2], argv[3]);
+      return 2;
+    }
+    return SX1276BusRecorder::Compare(&golden, &now, stdout) == 0 ? 0 : 1;
+  }
+  if (argc > 2) dir = argv[2];
+  SX1276Emulator::Speed(0);
+  for (int n = 0; n < SCENARIOS; n++)
+  {
+    snprintf(path, sizeof(path), "%s/%s.trace", dir, scenario[n]);
+    Run(n, &now);
+    if (strcmp(argv[1], "record") == 0)
+    {
+      if (now.Save(path) < 0)
+      {
+        printf("Can't write %s\n", path);
+        return 2;
+      }
+      printf("%-7s %6u transactions -> %s\n", scenario[n], now.Count(), path);
+      continue;
+    }
+    if (golden.Load(path) < 0)
+    {
+      printf("%-7s can't read %s\n", scenario[n], path);
+      failed++;
+      continue;
+    }
+    printf("%-7s ", scenario[n]);
+    diffs = SX1276BusRecorder::Compare(&golden, &now, stdout);
+    if (diffs != 0) failed++;
+  }
+  if (strcmp(argv[1], "check") == 0)
+    printf("%s\n", failed ? "Bus traffic differs from the golden traces" : "Bus traffic matches");
+  return failed ? 1 : 0;
+}
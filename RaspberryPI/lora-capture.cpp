@@ -0,0 +1,45 @@
+// Capture received packets to a pcap file or named pipe for Wireshark.
+// Usage: capture [file]   e.g. mkfifo /tmp/lora; capture /tmp/lora & wireshark -k -i /tmp/lora
+//#define DEBUG_BUILD
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <iostream>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Capture.cpp"
+int main (int argc, char *argv[])
+{
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  SX1276Capture capture;
+  SX1276Packet pkt;
+  const char * path = "lora.pcap";
+  int rxlen;
+  if (argc > 1) path = argv[1];
+  if (capture.Open(path)<0)
+  {
+    printf("Error opening %s\n",path);
+    return 1;
+  }
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+    printf("Init Error\n");
+  lora->SpreadingFactor(10);
+  if (lora->Frequency(869.5e6)<0)
+    printf("Error setting freq\n");
+  lora->BwHz(125e3);
+  printf("Capturing to %s..\n",path);
+  while (true)
+  {
+    rxlen = lora->RXContinuous((char *) pkt.data,sizeof(pkt.data),21000);
+    if (rxlen > 0)
+    {
+      lora->PacketInfo(&pkt);
+      pkt.timeUs = 0; // now
+      pkt.len = rxlen;
+      capture.Capture(&pkt);
+      printf("%d bytes, RSSI %d. Written %llu, dropped %u\n",rxlen,pkt.rssi,
+             (unsigned long long) capture.Written(),capture.Dropped());
+    }
+  }
+  return 0;
+}
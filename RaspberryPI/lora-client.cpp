@@ -0,0 +1,71 @@
+// Client of the local radio daemon (see SX1276Daemon.h, and daemon).
+// Usage: client listen [oldest]    print packets as they are received, from the next
+//                                  one, or with oldest from the oldest in the ring
+//        client send text [radio]  send text on a radio, default 0, and print the
+//                                  result once it has been sent
+// Build: make client     on a Pi
+//        make clientemu  without wiringPi, for daemonemu. Either works with either
+//                        daemon: the client never uses a radio itself.
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "SX1276.cpp"
+#include "SX1276Daemon.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+#endif
+
+int main (int argc, char *argv[])
+{
+  SX1276DaemonReader reader;
+  const SX1276Packet * pkt;
+  SX1276Packet copy;
+  uint8_t radio;
+  uint64_t lost = 0;
+  int n;
+
+  if (argc > 2 && strcmp(argv[1], "send") == 0)
+  {
+    n = SX1276Daemon::Send(argc > 3 ? atoi(argv[3]) : 0, argv[2], strlen(argv[2]));
+    printf("%d\n", n);
+    return n < 0;
+  }
+  if (argc < 2 || strcmp(argv[1], "listen") != 0)
+  {
+    printf("Usage: client listen [oldest] | client send text [radio]\n");
+    return 1;
+  }
+  if (reader.Open(DAEMON_SHM_NAME, argc > 2 && strcmp(argv[2], "oldest") == 0) < 0)
+  {
+    printf("No daemon running\n");
+    return 1;
+  }
+  while (true)
+  {
+    n = reader.Next(&pkt, &radio);
+    if (n == 0)
+    {
+      usleep(1000);
+      continue;
+    }
+    memcpy(&copy, pkt, offsetof(SX1276Packet, data));
+    memcpy(copy.data, pkt->data, copy.len);
+    if (!reader.Valid())
+    {
+      continue;
+    }
+    if (reader.Lost() != lost)
+    {
+      printf("(%llu lost)\n", (unsigned long long) (reader.Lost() - lost));
+      lost = reader.Lost();
+    }
+    printf("%llu radio %u %ddBm %.2fdB %s %.*s\n", (unsigned long long) copy.timeUs, radio,
+           copy.rssi, copy.snr / 4.0, copy.crcError ? "CRC error" : "", copy.len, copy.data);
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,53 @@
+// Web control server: the control pages (see SX1276Control.h) on Linux, with the
+// radio run by its own thread and events streamed to any number of browsers.
+// Browse to http://host:port/, fetch /json for the register map, or stream /events.
+// Usage: control [port]   default 8080
+// Build: make control     for the radio on a Pi
+//        make controlemu  against the emulator, no radio needed. Frames sent are
+//                         looped back and received, so /tx shows a tx then an rx event.
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include "SX1276.cpp"
+#include "SX1276Snapshot.cpp"
+#include "SX1276Control.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+
+// Emulator: receive every frame sent (called from the radio thread, which owns the emulator)
+static void Loopback (void *ctx, const SX1276Packet *pkt)
+{
+  ((SX1276Emulator *) ctx)->Inject(pkt);
+}
+#endif
+
+int main (int argc, char *argv[])
+{
+#ifdef SX1276_EMULATOR
+  SX1276Emulator emu;
+  emu.MatchConfig(0);
+  emu.OnTransmit(Loopback, &emu);
+#endif
+  SX1276 * lora = NULL;
+  SX1276Control * control = NULL;
+  int port = 8080;
+  if (argc > 1) port = atoi(argv[1]);
+  lora = new SX1276(1000000,6,0);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+    printf("Init Error\n");
+  control = new SX1276Control(lora);
+  if (control->Listen(port)<0)
+  {
+    printf("Can't listen on port %d\n",port);
+    return 1;
+  }
+  control->Start();
+  printf("Serving on port %d\n",port);
+  while (true)
+  {
+    control->Serve(1000);
+  }
+}
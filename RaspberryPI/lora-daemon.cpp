@@ -0,0 +1,79 @@
+// Local radio daemon (see SX1276Daemon.h): owns the radios, publishes every packet
+// received to a shared memory ring that any number of programs read at once, and
+// sends packets asked for on a Unix socket. Read and send with client.
+// Usage: daemon [nss:reset ...]  one radio per pair of NSS and reset pins, default one
+//                                radio on 6:0. Each radio needs a reset pin of its own.
+// Build: make daemon     for the radios on a Pi
+//        make daemonemu  against emulated radios, no radio needed. A frame sent on
+//                        one radio is received by the others, or by itself if alone:
+//                        daemonemu 6:0 7:1
+// Radios already set up are taken over as they are (WarmStart), so restarting the
+// daemon doesn't disturb them.
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include "SX1276.cpp"
+#include "SX1276Snapshot.cpp"
+#include "SX1276Daemon.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+
+static SX1276Emulator * emu[DAEMON_RADIOS];
+static int emus;
+
+// Emulator: the other radios receive every frame sent (called from the radio thread,
+// which owns the emulators)
+static void Loopback (void *ctx, const SX1276Packet *pkt)
+{
+  for (int e = 0; e < emus; e++)
+    if (emu[e] != ctx || emus == 1) emu[e]->Inject(pkt);
+}
+#endif
+
+int main (int argc, char *argv[])
+{
+  SX1276 * lora[DAEMON_RADIOS];
+  SX1276Daemon daemon;
+  int nss[DAEMON_RADIOS] = {6};
+  int reset[DAEMON_RADIOS] = {0};
+  int radios = argc > 1 ? argc - 1 : 1;
+  char * end;
+  if (radios > DAEMON_RADIOS) radios = DAEMON_RADIOS;
+  for (int r = 0; r < radios && argc > 1; r++)
+  {
+    nss[r] = strtol(argv[r + 1], &end, 10);
+    reset[r] = *end == ':' ? atoi(end + 1) : 0;
+  }
+#ifdef SX1276_EMULATOR
+  for (int r = 0; r < radios; r++)
+  {
+    emu[r] = new SX1276Emulator(nss[r], reset[r]);
+    emu[r]->MatchConfig(0);
+    emu[r]->OnTransmit(Loopback, emu[r]);
+  }
+  emus = radios;
+#endif
+  for (int r = 0; r < radios; r++)
+    lora[r] = new SX1276(1000000, nss[r], reset[r]);
+  for (int r = 0; r < radios; r++)
+  {
+    if (lora[r]->WarmStart(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+      printf("Radio %d: Init Error\n",r);
+    daemon.Add(lora[r]);
+  }
+  if (daemon.Start()<0)
+  {
+    printf("Can't create %s or %s\n",DAEMON_SHM_NAME,DAEMON_SOCKET);
+    return 1;
+  }
+  printf("%d radio%s, ring %s, TX socket %s\n",radios,radios == 1 ? "" : "s",
+         DAEMON_SHM_NAME,DAEMON_SOCKET);
+  fflush(stdout);
+  while (true)
+  {
+    daemon.Serve(1000);
+  }
+}
@@ -0,0 +1,22 @@
+// Print a binary debug log written by SX1276DebugLog::StartFile() (see SX1276DebugLog.h).
+// Usage: debugdump file
+// Build: make debugdump (no radio or wiringPi needed)
+#include <stdio.h>
+#include "SX1276DebugLog.cpp"
+int main (int argc, char *argv[])
+{
+  int count;
+  if (argc < 2)
+  {
+    printf("Usage: debugdump file\n");
+    return 1;
+  }
+  count = SX1276DebugLog::Decode(argv[1], stdout);
+  if (count < 0)
+  {
+    printf("Can't read debug log %s\n", argv[1]);
+    return 1;
+  }
+  printf("%d messages\n", count);
+  return 0;
+}
@@ -1,20 +1,33 @@
+// Listen at SF12 stepping through sync words, and log received packets to loralog.bin.
+// Usage: listen [min length]  with a length, shorter packets are dropped without being read
 #define DEBUG_BUILD
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 #include <fstream>
 #include <iostream>
+#include <stdlib.h>
 #include <string.h>
 #include "SX1276.cpp"
-int main ()
+#include "SX1276DebugLog.cpp"
+#include "SX1276Log.cpp"
+int main (int argc, char *argv[])
 {
   //  std::cout << "Return: " << ret << std::endl;
-  FILE *  logfile;
+  SX1276LogWriter logfile;
+  SX1276Packet pkt;
   int counter,rcvlen,repeat,sync,freq;
   //  printf ("chars (hex): %x   %x\n",s[0],s[1]);
   SX1276 * lora = NULL;
+  SX1276DebugLog::Start(stdout); // library DEBUG messages, printed off the radio thread
   lora = new SX1276(1000000,6,0);
 //  char send [30] = "Test cpp\0";
   char rcv [255] = {0};
+  SX1276PacketFilter filter;
+  int minlen = argc > 1 ? atoi(argv[1]) : 0;
+  if (minlen > 0)
+    filter.Length(minlen,255); // ignore short packets without reading them
+  if (logfile.Open("loralog.bin")<0)
+    printf("Error opening log\n");
   lora->Init(1,1);
   lora->PowerDBm(2);
   sync=0x34;
@@ -30,17 +43,21 @@ int main ()
     {
       lora->SpreadingFactor(spread);
       printf ("RXing at spread %d:\n",spread);
-      rcvlen = lora->RXContinuous(rcv,sizeof(rcv),2050);
+      if (minlen > 0)
+        rcvlen = lora->RXFiltered(rcv,sizeof(rcv),&filter,2050);
+      else
+        rcvlen = lora->RXContinuous(rcv,sizeof(rcv),2050);
       if (rcvlen > 0)
       {
         printf ("saving to log\n");
-        logfile = fopen ("loralog.txt","a");
-        fprintf (logfile, "\n\nData Rcvd (SF:%d, Sync:0x%x, Freq:%d)\n",spread,sync,freq);
-        for (counter=0;counter<rcvlen;counter++)
-          fprintf (logfile, "%c", rcv[counter] );
-        fclose (logfile);
+        lora->PacketInfo(&pkt);
+        pkt.timeUs = 0; // now
+        pkt.len = rcvlen;
+        memcpy(pkt.data, rcv, rcvlen);
+        logfile.Append(&pkt);
       }
    }
+   logfile.Flush();
    sync+=0x04;
    if (sync>0xfd)
      sync=0x00;
@@ -0,0 +1,41 @@
+// Print packets from a binary log (see SX1276Log.h), optionally for a time range.
+// Usage: logdump logfile [start time] [end time]   (times in seconds since the epoch)
+#include <wiringPi.h>
+#include <iostream>
+#include <stdlib.h>
+#include "SX1276.cpp"
+#include "SX1276Log.cpp"
+int main (int argc, char *argv[])
+{
+  SX1276LogReader log;
+  SX1276Packet pkt;
+  uint64_t start = 0;
+  uint64_t end = 0xFFFFFFFFFFFFFFFFULL;
+  int ret;
+  if (argc < 2)
+  {
+    printf("Usage: logdump logfile [start time] [end time]\n");
+    return 1;
+  }
+  if (argc > 2) start = strtoull(argv[2], NULL, 10) * 1000000;
+  if (argc > 3) end = strtoull(argv[3], NULL, 10) * 1000000;
+  if (log.Open(argv[1]) < 0)
+  {
+    printf("Can't open log %s\n", argv[1]);
+    return 1;
+  }
+  log.Seek(start);
+  while ((ret = log.Next(&pkt, end)) > 0)
+  {
+    printf ("%llu.%06llu Freq:%u SF:%d BW:%d CR:%d Sync:0x%x RSSI:%d SNR:%.2f%s Len:%d ",
+            (unsigned long long) (pkt.timeUs / 1000000), (unsigned long long) (pkt.timeUs % 1000000),
+            pkt.frequency, pkt.sf, pkt.bw, pkt.cr, pkt.syncWord, pkt.rssi, pkt.snr / 4.0,
+            pkt.crcError ? " CRC-ERROR" : "", pkt.len);
+    for (int n = 0; n < pkt.len; n++)
+      printf ("%02x", pkt.data[n]);
+    printf ("\n");
+  }
+  if (ret < 0)
+    printf("Log corrupt\n");
+  return 0;
+}
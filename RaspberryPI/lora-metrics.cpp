@@ -0,0 +1,76 @@
+// Receive packets and export radio metrics in Prometheus text format.
+// Metrics are served on a Unix socket (read with: socat - UNIX-CONNECT:/tmp/sx1276.metrics)
+// and written to a file for the node_exporter textfile collector.
+// "check" pins what the RX counters mean without a radio, and exits 1 if they change.
+// Usage: metrics [socket] [file]
+//        metrics check
+//#define DEBUG_BUILD
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <iostream>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Metrics.cpp"
+
+static int Check ()
+{
+  SX1276Metrics metrics;
+  SX1276MetricsExporter exporter;
+  char text[METRICS_BUFFER_SIZE];
+  int  fail = 0;
+  exporter.Add(&metrics, "0");
+  metrics.RxDone(0x40, 1, 1); // one header, its packet
+  metrics.RxDone(0x60, 1, 0); // one header, its packet with a CRC error
+  metrics.RxDone(0x40, 3, 1); // two headers lost their payload before this packet
+  metrics.RxDone(0x40, 0, 1); // header counter restarted (e.g. RX re-entered)
+  if (metrics.RxPackets() != 4 || metrics.RxCrcErrors() != 1 || metrics.RxHeadersNoRxDone() != 2)
+  {
+    printf("FAIL: packets %llu, CRC errors %llu, headers with no RxDone %llu. Expected 4, 1, 2\n",
+           (unsigned long long) metrics.RxPackets(), (unsigned long long) metrics.RxCrcErrors(),
+           (unsigned long long) metrics.RxHeadersNoRxDone());
+    fail = 1;
+  }
+  if (exporter.Format(text, sizeof(text)) < 0 ||
+      strstr(text, "sx1276_rx_headers_no_rxdone_total{radio=\"0\"} 2\n") == NULL ||
+      strstr(text, "sx1276_rx_crc_errors_total{radio=\"0\"} 1\n") == NULL)
+  {
+    printf("FAIL: exported text\n%s", text);
+    fail = 1;
+  }
+  printf(fail ? "Metrics check failed\n" : "Metrics check passed\n");
+  return fail;
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "check") == 0)
+    return Check();
+  SX1276 * lora = NULL;
+  lora = new SX1276(1000000,6,0);
+  SX1276Metrics metrics;
+  SX1276MetricsExporter exporter;
+  const char * sock = "/tmp/sx1276.metrics";
+  const char * file = "sx1276.prom";
+  char rcv [255] = {0};
+  int rxlen;
+  if (argc > 1) sock = argv[1];
+  if (argc > 2) file = argv[2];
+  lora->Metrics(&metrics);
+  exporter.Add(&metrics, "0");
+  if (exporter.Listen(sock)<0)
+    printf("Error listening on %s\n",sock);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
+    printf("Init Error\n");
+  lora->SpreadingFactor(10);
+  lora->BwHz(125e3);
+  printf("Starting RX..\n");
+  while (true)
+  {
+    rxlen = lora->RXContinuous(rcv,sizeof(rcv),10000);
+    if (rxlen > 0)
+      printf("%d bytes. RX %llu, CRC errors %llu\n",rxlen,
+             (unsigned long long) metrics.RxPackets(),(unsigned long long) metrics.RxCrcErrors());
+    exporter.WriteFile(file);
+  }
+  return 0;
+}
@@ -0,0 +1,579 @@
+// Link test in the manner of iperf: sends numbered, timestamped packets for a while
+// and reports goodput, packet error rate, RSSI and SNR distributions, one-way and
+// round trip latency percentiles, and how much of the duty cycle budget the test used.
+// Prints a summary, and writes the results as JSON so runs can be compared.
+// Usage: perf send|recv|loop [name=value ...]
+//   send  transmit test packets         recv  receive them, on another radio
+//   loop  both ends in one process, on two radios
+//   sf=7 bw=125000 cr=1 (4/5) payload=32 (16-255 bytes) power=14 freq=868100000
+//   plan=eu868|none seconds=60 count=0 (packets, 0: until seconds) gap=0 (ms between)
+//   rtt=0  1: recv echoes every packet back and send times the round trip
+//   timeout=0 (ms send waits for an echo, 0: twice the time on air + 100)
+//   idle=10 (s recv waits after the last packet) pins=6:0 (loop: 6:0,7:1) json=file
+//   Emulator only: loss=0 (%) rssi=-90 snr=8 (dB, each with up to 3dB of jitter) seed=1
+// Build: make perf     on a Pi: recv on one radio, then send on another, or loop with
+//                      two radios on one Pi
+//        make perfemu  two emulated radios in one process on virtual time, loop only:
+//                      perfemu loop seconds=3600 rtt=1 loss=5
+// One-way latency is from the sender's clock to the receiver's, so across two hosts it
+// is only as good as their clock synchronisation (NTP, PTP). Round trip uses one clock.
+// A test stops when the packet marked last is received; if it is lost, recv stops
+// after idle seconds and packets lost after the last one received aren't counted.
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SX1276.cpp"
+#include "SX1276Profile.h"
+#include "SX1276Latency.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+#define PERF_BUS "emulator"
+#else
+#define PERF_BUS "spidev"
+#endif
+#ifndef PERF_VERSION
+#define PERF_VERSION "unknown"
+#endif
+
+#define PERF_HEADER   16     // Bytes of each test packet used by PerfHeader
+#define PERF_DATA     0      // PerfHeader type
+#define PERF_ECHO     1
+#define PERF_LAST     0x01   // PerfHeader flags: last packet of the test
+#define PERF_MAX_SEQ  0x1000000 // Packets tracked, far more than a test can send
+
+// Start of every test packet, in host byte order. The rest is a fill pattern.
+struct PerfHeader
+{
+  uint8_t  magic[2];         // "LP"
+  uint8_t  type;
+  uint8_t  flags;
+  uint32_t seq;              // From 0
+  uint64_t txUs;             // Sender's clock when the data packet was sent
+};
+static_assert(sizeof(PerfHeader) == PERF_HEADER, "PerfHeader layout");
+
+// Distribution of small integers: RSSI in dBm, SNR in 0.25dB steps (-128 to 127)
+struct Dist
+{
+  uint32_t count[328];       // -200 to 127
+  uint32_t n;
+  int64_t  sum;
+
+  void Record (int v)
+  {
+    v = v < -200 ? -200 : v > 127 ? 127 : v;
+    count[v + 200]++;
+    n++;
+    sum += v;
+  }
+  int Percentile (float p)
+  {
+    uint32_t want = (uint32_t) (n * p / 100 + 0.5), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < 328; i++)
+    {
+      seen += count[i];
+      if (seen >= want) return i - 200;
+    }
+    return 0;
+  }
+  double Mean ()
+  { return n ? (double) sum / n : 0; }
+};
+
+// One end of the link
+struct Side
+{
+  SX1276 * lora;
+  const char * name;
+  uint32_t sent;
+  uint32_t blockedMs;        // Waiting for the holdoff and duty cycle rules to allow a TX
+  uint32_t airtimeMs;
+  int32_t  budgetMs;         // DutyBudgetMs() before the test: TX time allowed an hour
+  std::deque<std::pair<uint64_t, uint32_t> > hour; // Start and airtime of each TX in the last hour
+  uint32_t hourMs;           // Airtime in the last hour
+  uint32_t received;         // Test packets, not counting duplicates
+  uint32_t crcErrors;
+  uint32_t duplicates;
+  uint32_t seqEnd;           // Highest seq received + 1
+  uint64_t bytes;
+  uint64_t firstUs, lastUs;  // First and last reception
+  uint32_t firstLen;
+  std::vector<uint8_t> seen;
+  Dist     rssi, snr;
+  SX1276Histogram latency;   // ns: one way on the receiver, round trip on the sender
+};
+
+static struct
+{
+  uint8_t  sf = 7;
+  int32_t  bw = 125000;
+  uint8_t  cr = 1;
+  uint32_t payload = 32;
+  int8_t   power = 14;
+  uint32_t freq = 868100000;
+  uint8_t  plan = BANDPLAN_EU868;
+  uint32_t seconds = 60;
+  uint32_t count = 0;
+  uint32_t gapMs = 0;
+  uint8_t  rtt = 0;
+  uint32_t timeoutMs = 0;
+  uint32_t idleS = 10;
+  float    loss = 0;
+  int      rssi = -90;
+  int      snr = 8;
+  uint32_t seed = 1;
+} cfg;
+
+static const char * mode;
+static Side a, b;            // send (a), recv (b), loop (both)
+static uint64_t startUs, endUs;
+static char rxbuf[2][255];
+
+static uint64_t NowUs ()
+{
+#ifdef SX1276_EMULATOR
+  return SX1276Emulator::NowUs();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifdef SX1276_EMULATOR
+// Emulator: the other radio receives what is sent, unless it is lost on the way
+static void Link (void *ctx, const SX1276Packet *sent)
+{
+  SX1276Packet pkt = *sent;
+  if (rand() % 10000 < cfg.loss * 100) return;
+  pkt.rssi = cfg.rssi + rand() % 7 - 3;
+  pkt.snr = (cfg.snr + rand() % 7 - 3) * 4;
+  ((SX1276Emulator *) ctx)->Inject(&pkt);
+}
+#endif
+
+// TX time still allowed: the library's window only approximates an hour (see TxTimer),
+// so the test's own airtime over the last hour is held to the budget as well
+static int32_t Room (Side *s)
+{
+  uint64_t now = NowUs();
+  while (!s->hour.empty() && now - s->hour.front().first >= 3600000000ULL)
+  {
+    s->hourMs -= s->hour.front().second;
+    s->hour.pop_front();
+  }
+  int32_t left = s->lora->DutyBudgetMs();
+  return left < s->budgetMs - (int32_t) s->hourMs ? left : s->budgetMs - (int32_t) s->hourMs;
+}
+
+// Transmit, waiting out the holdoff and duty cycle rules until untilUs. TX() only
+// refuses once the budget is spent, so a packet that would overrun Room() waits
+// as if refused. A data packet is stamped with the time it is sent.
+// Returns TX()'s result, or -3 if the budget has no room for the packet by untilUs.
+static int Send (Side *s, PerfHeader *h, uint8_t len, uint64_t untilUs)
+{
+  char data[255];
+  int  ret;
+  uint32_t t = millis();
+  uint32_t air = s->lora->TimeOnAirMs(len);
+  for (int n = PERF_HEADER; n < len; n++) data[n] = h->seq + n;
+  for (;;)
+  {
+    if (h->type == PERF_DATA) h->txUs = NowUs();
+    memcpy(data, h, PERF_HEADER);
+    ret = Room(s) > (int32_t) air ? s->lora->TX(data, len) : -3;
+    if ((ret != -2 && ret != -3) || NowUs() >= untilUs) break;
+    delay(5);
+  }
+  s->blockedMs += millis() - t - (ret > 0 ? ret : 0);
+  if (ret >= 0)
+  {
+    s->sent++;
+    s->airtimeMs += ret;
+    s->hourMs += ret;
+    s->hour.push_back(std::make_pair(NowUs() - ret * 1000ULL, (uint32_t) ret));
+  }
+  return ret;
+}
+
+// Wait up to timeoutMs for a packet, after RXContStart(). Returns as RXContPoll().
+static int Wait (Side *s, SX1276Packet *pkt, uint32_t timeoutMs)
+{
+  uint32_t t = millis();
+  int      ret;
+  while ((ret = s->lora->RXContPoll(pkt)) == 0 && (uint32_t) (millis() - t) < timeoutMs)
+  {
+    delay(1);
+  }
+  if (ret < 0) s->crcErrors++;
+  return ret;
+}
+
+// Record a test packet received at atUs. Returns its header, or NULL if it isn't one.
+static const PerfHeader * Received (Side *s, const SX1276Packet *pkt, uint64_t atUs, uint8_t type)
+{
+  static PerfHeader h;
+  if (pkt->len < PERF_HEADER) return NULL;
+  memcpy(&h, pkt->data, PERF_HEADER);
+  if (h.magic[0] != 'L' || h.magic[1] != 'P' || h.type != type || h.seq >= PERF_MAX_SEQ) return NULL;
+  if (h.seq >= s->seen.size()) s->seen.resize(h.seq + 1024);
+  if (s->seen[h.seq])
+  {
+    s->duplicates++;
+    return &h;
+  }
+  s->seen[h.seq] = 1;
+  if (s->received++ == 0)
+  {
+    s->firstUs = atUs;
+    s->firstLen = pkt->len;
+  }
+  s->lastUs = atUs;
+  s->bytes += pkt->len;
+  if (h.seq >= s->seqEnd) s->seqEnd = h.seq + 1;
+  s->rssi.Record(pkt->rssi);
+  s->snr.Record(pkt->snr);
+  if (atUs >= h.txUs) s->latency.Record((atUs - h.txUs) * 1000);
+  return &h;
+}
+
+// Echo a data packet back, as soon as the rules allow
+static void Echo (Side *s, const PerfHeader *data, uint8_t len)
+{
+  PerfHeader h = *data;
+  h.type = PERF_ECHO;
+  Send(s, &h, len, NowUs() + cfg.timeoutMs * 1000ULL);
+  s->lora->RXContStart(rxbuf[s == &a ? 0 : 1], sizeof(rxbuf[0]));
+}
+
+// Wait for the echo of seq, after RXContStart(), and time the round trip
+static void WaitEcho (Side *s, uint32_t seq)
+{
+  SX1276Packet pkt;
+  const PerfHeader * h;
+  uint64_t until = NowUs() + cfg.timeoutMs * 1000ULL;
+  while (NowUs() < until)
+  {
+    if (Wait(s, &pkt, (until - NowUs()) / 1000 + 1) <= 0) continue;
+    h = Received(s, &pkt, NowUs(), PERF_ECHO);
+    if (h && h->seq == seq) break;
+  }
+}
+
+// Whether packet seq should be the last, from the time the ones before it took
+static uint8_t Last (uint32_t seq)
+{
+  uint64_t now = NowUs();
+  uint64_t each = seq ? (now - startUs) / seq : a.lora->TimeOnAirMs(cfg.payload) * 1000ULL;
+  if (cfg.count) return seq + 1 >= cfg.count;
+  return now + each >= endUs;
+}
+
+static void RunSend ()
+{
+  PerfHeader h = {{'L', 'P'}, PERF_DATA, 0, 0, 0};
+  int ret;
+  for (h.seq = 0; ; h.seq++)
+  {
+    h.flags = Last(h.seq) ? PERF_LAST : 0;
+    ret = Send(&a, &h, cfg.payload, endUs);
+    if (ret == -2 || ret == -3) break;   // Out of time waiting for the rules
+    if (ret < 0)
+    {
+      printf("TX error %d\n", ret);
+      return;
+    }
+    if (cfg.rtt)
+    {
+      a.lora->RXContStart(rxbuf[0], sizeof(rxbuf[0]));
+      WaitEcho(&a, h.seq);
+    }
+    if (h.flags & PERF_LAST) break;
+    delay(cfg.gapMs);
+  }
+}
+
+static void RunRecv ()
+{
+  SX1276Packet pkt;
+  const PerfHeader * h;
+  int ret;
+  b.lora->RXContStart(rxbuf[1], sizeof(rxbuf[1]));
+  printf("Waiting for packets\n");
+  for (;;)
+  {
+    ret = Wait(&b, &pkt, b.received ? cfg.idleS * 1000 : 1000);
+    if (ret == 0 && b.received) break;
+    if (ret <= 0) continue;
+    h = Received(&b, &pkt, NowUs(), PERF_DATA);
+    if (h == NULL) continue;
+    if (cfg.rtt) Echo(&b, h, pkt.len);
+    if (h->flags & PERF_LAST) break;
+  }
+}
+
+static void RunLoop ()
+{
+  SX1276Packet pkt;
+  PerfHeader h = {{'L', 'P'}, PERF_DATA, 0, 0, 0};
+  const PerfHeader * got;
+  int ret;
+  b.lora->RXContStart(rxbuf[1], sizeof(rxbuf[1]));
+  for (h.seq = 0; ; h.seq++)
+  {
+    h.flags = Last(h.seq) ? PERF_LAST : 0;
+    ret = Send(&a, &h, cfg.payload, endUs);
+    if (ret == -2 || ret == -3) break;   // Out of time waiting for the rules
+    if (ret < 0)
+    {
+      printf("TX error %d\n", ret);
+      return;
+    }
+    got = Wait(&b, &pkt, 100) > 0 ? Received(&b, &pkt, NowUs(), PERF_DATA) : NULL;
+    if (got && cfg.rtt)
+    {
+      a.lora->RXContStart(rxbuf[0], sizeof(rxbuf[0]));
+      Echo(&b, got, pkt.len);
+      WaitEcho(&a, h.seq);
+    }
+    if (h.flags & PERF_LAST) break;
+    delay(cfg.gapMs);
+  }
+}
+
+/*  Reporting  */
+
+static double Ms (SX1276Histogram *hist, float p)
+{ return (p == 100 ? hist->Max() : hist->Percentile(p)) / 1e6; }
+
+static void PrintTx (Side *s, double elapsed)
+{
+  int32_t left = Room(s);
+  int32_t used = s->budgetMs > left ? s->budgetMs - left : 0;
+  printf("%-6s TX      %u sent, %u ms on air, %u ms held by the rules, duty %.2f%%\n", s->name,
+         s->sent, s->airtimeMs, s->blockedMs, elapsed > 0 ? s->airtimeMs / 10.0 / elapsed : 0);
+  printf("%-6s budget  %.1f%% of the %d ms an hour used, %d ms left\n", s->name,
+         s->budgetMs > 0 ? 100.0 * used / s->budgetMs : 0, s->budgetMs, left);
+}
+
+static void PrintRx (Side *s, const char *what, uint32_t expected)
+{
+  uint32_t lost = expected > s->received ? expected - s->received : 0;
+  printf("%-6s %-7s %u of %u received, PER %.4f, %u CRC errors, %u duplicates\n", s->name, what,
+         s->received, expected, expected ? (double) lost / expected : 0, s->crcErrors, s->duplicates);
+  if (s->received == 0) return;
+  printf("%-6s RSSI    dBm  min %d  p10 %d  p50 %d  p90 %d  max %d\n", s->name,
+         s->rssi.Percentile(0), s->rssi.Percentile(10), s->rssi.Percentile(50),
+         s->rssi.Percentile(90), s->rssi.Percentile(100));
+  printf("%-6s SNR     dB   min %.2f  p10 %.2f  p50 %.2f  p90 %.2f  max %.2f\n", s->name,
+         s->snr.Percentile(0) / 4.0, s->snr.Percentile(10) / 4.0, s->snr.Percentile(50) / 4.0,
+         s->snr.Percentile(90) / 4.0, s->snr.Percentile(100) / 4.0);
+  printf("%-6s %-7s ms   p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", s->name,
+         s == &a ? "RTT" : "1-way", Ms(&s->latency, 50), Ms(&s->latency, 90),
+         Ms(&s->latency, 99), Ms(&s->latency, 100));
+}
+
+// Over the whole test, including time the duty cycle rules held the sender
+static double GoodputBps (Side *s, double elapsed)
+{
+  return elapsed > 0 ? s->bytes * 8 / elapsed : 0;
+}
+
+// While packets were arriving: from the first reception to the last
+static double ArrivalBps (Side *s)
+{
+  if (s->received < 2 || s->lastUs <= s->firstUs) return 0;
+  return (s->bytes - s->firstLen) * 8e6 / (s->lastUs - s->firstUs);
+}
+
+static void JsonTx (FILE *f, const char *name, Side *s, double elapsed)
+{
+  int32_t left = Room(s);
+  int32_t used = s->budgetMs > left ? s->budgetMs - left : 0;
+  fprintf(f, ",\n \"%s\":{\"sent\":%u,\"airtime_ms\":%u,\"blocked_ms\":%u,\"duty_pct\":%.4f,"
+             "\"budget_ms\":%d,\"budget_used_pct\":%.2f,\"budget_left_ms\":%d}",
+          name, s->sent, s->airtimeMs, s->blockedMs, elapsed > 0 ? s->airtimeMs / 10.0 / elapsed : 0,
+          s->budgetMs, s->budgetMs > 0 ? 100.0 * used / s->budgetMs : 0, left);
+}
+
+static void JsonDist (FILE *f, const char *name, Dist *d, double scale)
+{
+  fprintf(f, ",\"%s\":{\"min\":%.2f,\"p10\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"max\":%.2f,\"mean\":%.2f}",
+          name, d->Percentile(0) * scale, d->Percentile(10) * scale, d->Percentile(50) * scale,
+          d->Percentile(90) * scale, d->Percentile(100) * scale, d->Mean() * scale);
+}
+
+static void JsonRx (FILE *f, const char *name, Side *s, uint32_t expected, double elapsed)
+{
+  uint32_t lost = expected > s->received ? expected - s->received : 0;
+  fprintf(f, ",\n \"%s\":{\"expected\":%u,\"received\":%u,\"lost\":%u,\"per\":%.6f,"
+             "\"crc_errors\":%u,\"duplicates\":%u",
+          name, expected, s->received, lost, expected ? (double) lost / expected : 0,
+          s->crcErrors, s->duplicates);
+  if (s == &b) fprintf(f, ",\"goodput_bps\":%.1f,\"arrival_bps\":%.1f", GoodputBps(s, elapsed), ArrivalBps(s));
+  if (s->received)
+  {
+    JsonDist(f, "rssi_dbm", &s->rssi, 1);
+    JsonDist(f, "snr_db", &s->snr, 0.25);
+    fprintf(f, ",\"%s\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f,\"mean\":%.3f}",
+            s == &a ? "rtt_ms" : "one_way_ms", Ms(&s->latency, 50), Ms(&s->latency, 90),
+            Ms(&s->latency, 99), Ms(&s->latency, 100), s->latency.Mean() / 1e6);
+  }
+  fprintf(f, "}");
+}
+
+static int WriteJson (const char *path, double elapsed)
+{
+  FILE * f = fopen(path, "w");
+  if (f == NULL)
+    return -1;
+  fprintf(f, "{\"version\":\"%s\",\"bus\":\"%s\",\"mode\":\"%s\",\"time\":%ld,\"elapsed_s\":%.3f,\n"
+             " \"config\":{\"sf\":%u,\"bw\":%d,\"cr\":%u,\"payload\":%u,\"power\":%d,\"freq\":%u,"
+             "\"plan\":\"%s\",\"seconds\":%u,\"count\":%u,\"gap_ms\":%u,\"rtt\":%u}",
+          PERF_VERSION, PERF_BUS, mode, (long) time(NULL), elapsed, cfg.sf, cfg.bw, cfg.cr,
+          cfg.payload, cfg.power, cfg.freq, cfg.plan == BANDPLAN_EU868 ? "eu868" : "none",
+          cfg.seconds, cfg.count, cfg.gapMs, cfg.rtt);
+  if (a.lora) JsonTx(f, "tx", &a, elapsed);
+  if (b.lora) JsonRx(f, "rx", &b, a.lora ? a.sent : b.seqEnd, elapsed);
+  if (a.lora && cfg.rtt) JsonRx(f, "rtt", &a, a.sent, elapsed);
+  if (b.lora && cfg.rtt) JsonTx(f, "echo_tx", &b, elapsed);
+  fprintf(f, "\n}\n");
+  return fclose(f);
+}
+
+static int Open (Side *s, const char *name, const char *pins, const SX1276Profile *profile)
+{
+  char * end;
+  int nss = strtol(pins, &end, 10);
+  int reset = *end == ':' ? atoi(end + 1) : 0;
+  s->name = name;
+  s->lora = new SX1276(1000000, nss, reset);
+  if (s->lora->Init(OUTPUT_PA_BOOST, cfg.plan) < 0 || s->lora->Apply(profile) < 0)
+  {
+    printf("%s: Init Error on %d:%d\n", name, nss, reset);
+    return -1;
+  }
+  s->budgetMs = s->lora->DutyBudgetMs();
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  const char * json = NULL;
+  const char * pins = NULL;
+  const char * pinsB;
+  double elapsed;
+  char * v;
+
+  mode = argc > 1 ? argv[1] : "";
+  if (strcmp(mode, "send") != 0 && strcmp(mode, "recv") != 0 && strcmp(mode, "loop") != 0)
+  {
+    printf("Usage: perf send|recv|loop [name=value ...]   see lora-perf.cpp\n");
+    return 1;
+  }
+  for (int n = 2; n < argc; n++)
+  {
+    v = strchr(argv[n], '=');
+    if (v == NULL)
+    {
+      printf("Settings are name=value: %s\n", argv[n]);
+      return 1;
+    }
+    *v++ = 0;
+    if      (strcmp(argv[n], "sf") == 0)      cfg.sf = atoi(v);
+    else if (strcmp(argv[n], "bw") == 0)      cfg.bw = atoi(v);
+    else if (strcmp(argv[n], "cr") == 0)      cfg.cr = atoi(v);
+    else if (strcmp(argv[n], "payload") == 0) cfg.payload = atoi(v);
+    else if (strcmp(argv[n], "power") == 0)   cfg.power = atoi(v);
+    else if (strcmp(argv[n], "freq") == 0)    cfg.freq = atof(v);
+    else if (strcmp(argv[n], "plan") == 0)    cfg.plan = strcmp(v, "none") == 0 ? BANDPLAN_NONE : BANDPLAN_EU868;
+    else if (strcmp(argv[n], "seconds") == 0) cfg.seconds = atoi(v);
+    else if (strcmp(argv[n], "count") == 0)   cfg.count = atoi(v);
+    else if (strcmp(argv[n], "gap") == 0)     cfg.gapMs = atoi(v);
+    else if (strcmp(argv[n], "rtt") == 0)     cfg.rtt = atoi(v);
+    else if (strcmp(argv[n], "timeout") == 0) cfg.timeoutMs = atoi(v);
+    else if (strcmp(argv[n], "idle") == 0)    cfg.idleS = atoi(v);
+    else if (strcmp(argv[n], "loss") == 0)    cfg.loss = atof(v);
+    else if (strcmp(argv[n], "rssi") == 0)    cfg.rssi = atoi(v);
+    else if (strcmp(argv[n], "snr") == 0)     cfg.snr = atoi(v);
+    else if (strcmp(argv[n], "seed") == 0)    cfg.seed = atoi(v);
+    else if (strcmp(argv[n], "pins") == 0)    pins = v;
+    else if (strcmp(argv[n], "json") == 0)    json = v;
+    else
+    {
+      printf("Unknown setting %s\n", argv[n]);
+      return 1;
+    }
+  }
+  if (cfg.payload < PERF_HEADER || cfg.payload > 255)
+  {
+    printf("payload is %d to 255 bytes\n", PERF_HEADER);
+    return 1;
+  }
+  SX1276Profile profile(cfg.freq, cfg.sf, cfg.bw, cfg.cr, cfg.power, OUTPUT_PA_BOOST);
+  if (!profile.valid)
+  {
+    printf("Invalid sf, bw, cr or freq\n");
+    return 1;
+  }
+  if (pins == NULL) pins = mode[0] == 'l' ? "6:0,7:1" : "6:0";
+  pinsB = strchr(pins, ',');
+
+#ifdef SX1276_EMULATOR
+  if (mode[0] != 'l' || pinsB == NULL)
+  {
+    printf("The emulator build only runs loop, on two radios\n");
+    return 1;
+  }
+  SX1276Emulator::Speed(0);
+  srand(cfg.seed);
+  int nss = atoi(pins), nssB = atoi(pinsB + 1);
+  SX1276Emulator emuA(nss, atoi(strchr(pins, ':') ? strchr(pins, ':') + 1 : "0"));
+  SX1276Emulator emuB(nssB, atoi(strchr(pinsB, ':') ? strchr(pinsB, ':') + 1 : "0"));
+  emuA.OnTransmit(Link, &emuB);
+  emuB.OnTransmit(Link, &emuA);
+#endif
+  if (mode[0] == 'l' && pinsB == NULL)
+  {
+    printf("loop needs two radios: pins=nss:reset,nss:reset\n");
+    return 1;
+  }
+  if (mode[0] != 'r' && Open(&a, "send", pins, &profile) < 0) return 1;
+  if (mode[0] != 's' && Open(&b, "recv", mode[0] == 'l' ? pinsB + 1 : pins, &profile) < 0) return 1;
+  if (cfg.timeoutMs == 0)
+    cfg.timeoutMs = 2 * (a.lora ? a.lora : b.lora)->TimeOnAirMs(cfg.payload) + 100;
+
+  printf("%s: SF%u, %d Hz, CR 4/%u, %u byte payload, %d dBm, %.1f MHz, %s\n", mode, cfg.sf,
+         cfg.bw, cfg.cr + 4, cfg.payload, cfg.power, cfg.freq / 1e6,
+         cfg.plan == BANDPLAN_EU868 ? "EU868 rules" : "no band plan");
+  startUs = NowUs();
+  endUs = startUs + cfg.seconds * 1000000ULL;
+  if (mode[0] == 's') RunSend();
+  if (mode[0] == 'r') RunRecv();
+  if (mode[0] == 'l') RunLoop();
+  elapsed = (double) (NowUs() - startUs) / 1e6;
+  if (mode[0] == 'r') elapsed = (double) (b.lastUs - b.firstUs) / 1e6;
+
+  printf("%.1fs", elapsed);
+  if (b.lora) printf(", goodput %.1f bit/s over the test, %.1f bit/s from first packet to last",
+                     GoodputBps(&b, elapsed), ArrivalBps(&b));
+  printf("\n");
+  if (a.lora) PrintTx(&a, elapsed);
+  if (b.lora) PrintRx(&b, "data", a.lora ? a.sent : b.seqEnd);
+  if (a.lora && cfg.rtt) PrintRx(&a, "echoes", a.sent);
+  if (b.lora && cfg.rtt) PrintTx(&b, elapsed);
+  if (json && WriteJson(json, elapsed) < 0)
+  {
+    printf("Can't write %s\n", json);
+    return 1;
+  }
+  return 0;
+}
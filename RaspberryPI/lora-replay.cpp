@@ -0,0 +1,113 @@
+// Replay a capture (binary log or LoRaTap pcap) through the receive pipeline on an
+// emulated radio: RXContinuous, PacketInfo, duplicate check, binary log.
+// Prints throughput and latency of each stage.
+// Usage: replay capture [speed] [output log]   speed: 1 real time, n times, 0 (default) as fast as possible
+// Build: make replay (no radio or wiringPi needed)
+//        make replaytrace also writes an event trace to replay.json (see SX1276Trace.h)
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Emulator.cpp"
+#include "SX1276Log.cpp"
+#include "SX1276Relay.cpp"
+#include "SX1276Replay.cpp"
+#include "SX1276Latency.cpp"
+#ifdef SX1276_TRACE
+#include "SX1276Trace.cpp"
+#endif
+
+#define STAGES 5
+static const char * stagename[STAGES] = {"rx", "info", "dedup", "log", "total"};
+
+int main (int argc, char *argv[])
+{
+  SX1276Emulator emu;
+  SX1276 * lora = NULL;
+  SX1276Replay replay(&emu);
+  SX1276LogWriter log;
+  RelayCache cache;
+  SX1276Packet pkt;
+  SX1276Latency latency;
+  char table[1024];
+  std::vector<uint32_t> ns[STAGES];
+  uint64_t t[5], start, elapsed, bytes = 0;
+  uint32_t spi;
+  float speed = 0;
+  const char * out = "replay.bin";
+  int rxlen, dups = 0;
+  if (argc < 2)
+  {
+    printf("Usage: replay capture [speed] [output log]\n");
+    return 1;
+  }
+  if (argc > 2) speed = atof(argv[2]);
+  if (argc > 3) out = argv[3];
+  lora = new SX1276(1000000,6,0);
+  if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_NONE)<0)
+    printf("Init Error\n");
+  if (replay.Open(argv[1])<0)
+  {
+    printf("Can't open capture %s\n",argv[1]);
+    return 1;
+  }
+  unlink(out);
+  if (log.Open(out)<0)
+  {
+    printf("Can't open output log %s\n",out);
+    return 1;
+  }
+  replay.Speed(speed);
+  lora->Latency(&latency);
+  spi = emu.Transactions();
+  start = SX1276Emulator::RealNs();
+  while (replay.Pump() >= 0 || emu.Pending() > 0)
+  {
+    rxlen = lora->RXContinuous((char *) pkt.data,sizeof(pkt.data),1000);
+    t[1] = SX1276Emulator::RealNs();
+    if (rxlen <= 0)
+      continue;
+    t[0] = emu.DeliveredNs();
+    lora->PacketInfo(&pkt);
+    pkt.len = rxlen;
+    pkt.timeUs = 0;
+    t[2] = SX1276Emulator::RealNs();
+    if (cache.Seen(pkt.data[0] << 8 | pkt.data[1], pkt.data[2] << 8 | pkt.data[3], millis()))
+      dups++;
+    t[3] = SX1276Emulator::RealNs();
+    log.Append(&pkt);
+    t[4] = SX1276Emulator::RealNs();
+    for (int s = 0; s < STAGES - 1; s++)
+      ns[s].push_back(t[s + 1] - t[s]);
+    ns[STAGES - 1].push_back(t[4] - t[0]);
+    bytes += rxlen;
+  }
+  log.Close();
+  elapsed = SX1276Emulator::RealNs() - start;
+  spi = emu.Transactions() - spi;
+
+  printf("Packets: %u replayed, %u received, %u missed, %d duplicates\n",
+         replay.Injected(), emu.Delivered(), emu.Missed(), dups);
+  printf("Time: %.3f s. Throughput: %.0f packets/s, %.3f MB/s. SPI transactions/packet: %.1f\n",
+         elapsed / 1e9, emu.Delivered() / (elapsed / 1e9), bytes / (elapsed / 1e3),
+         emu.Delivered() ? (float) spi / emu.Delivered() : 0);
+  printf("%-6s %10s %10s %10s %10s  (us)\n", "stage", "mean", "p50", "p99", "max");
+  for (int s = 0; s < STAGES; s++)
+  {
+    std::vector<uint32_t> & v = ns[s];
+    double sum = 0;
+    if (v.empty()) continue;
+    std::sort(v.begin(), v.end());
+    for (size_t n = 0; n < v.size(); n++) sum += v[n];
+    printf("%-6s %10.2f %10.2f %10.2f %10.2f\n", stagename[s], sum / v.size() / 1e3,
+           v[v.size() / 2] / 1e3, v[v.size() * 99 / 100] / 1e3, v.back() / 1e3);
+  }
+  if (latency.Format(table, sizeof(table)) > 0)
+    printf("\nLibrary latency (tx, cad: emulator time)\n%s", table);
+#ifdef SX1276_TRACE
+  printf("Trace: %d events written to replay.json\n", SX1276Trace::Export("replay.json"));
+#endif
+  return 0;
+}
@@ -5,6 +5,10 @@
 #include <iostream>
 #include <string.h>
 #include "SX1276.cpp"
+
+// SF10, 125kHz, 4/5, 2dBm on 869.5MHz, sync word 42
+static constexpr SX1276Profile rxlog(869.5e6, 10, 125e3, 1, 2, OUTPUT_PA_BOOST, 8, 42);
+
 int main ()
 {
   SX1276 * lora = NULL;
@@ -14,13 +18,8 @@ int main ()
   int rxlen;
   if (lora->Init(OUTPUT_PA_BOOST,BANDPLAN_EU868)<0)
     printf("Init Error\n");
-  lora->SpreadingFactor(10);
-  if (lora->PowerDBm(2)<0)
-    printf("Error power\n");
-  if (lora->Frequency(869.5e6)<0)
-    printf("Error setting freq\n");
-  lora->BwHz(125e3);
-  lora->SyncWord(42);
+  if (lora->Apply(&rxlog)<0)
+    printf("Error applying profile\n");
   printf("Starting RX..\n");
   int z=0;
   int hrs, mins, secs;
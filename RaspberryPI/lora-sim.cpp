@@ -0,0 +1,141 @@
+// LoRa network simulator (see SX1276Sim.h): thousands of nodes, each the driver on
+// an emulated radio, sending uplinks to gateways on virtual time. Prints delivery,
+// latency and airtime overall and by SF, and writes them per node as CSV.
+// Usage: sim [name=value ...]
+//   nodes=10000 gateways=1 radius=5000 (m) seconds=3600 period=600 (s between uplinks)
+//   payload=20 sf=0 (0: ADR) mac=aloha|lbt|tdma channels=3 power=14 pathexp=2.32
+//   shadowing=7.8 (dB) threads=0 (0: one per core) window=100 (ms) seed=1
+//   csv=file  per node results
+// Build: make sim   (no radio needed)
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SX1276.cpp"
+#include "SX1276Profile.h"
+#include "SX1276Sim.cpp"
+#include "SX1276Emulator.cpp"
+
+static const char * _Mac[] = {"aloha", "lbt", "tdma"};
+
+int main (int argc, char *argv[])
+{
+  SX1276SimConfig cfg;
+  const SX1276SimNode * n;
+  const char * csv = NULL;
+  struct timespec t0, t1;
+  uint64_t gen = 0, sent = 0, delivered = 0, collided = 0, weak = 0, dropped = 0;
+  uint64_t blocked = 0, busy = 0, air = 0, maxAir = 0;
+  uint32_t bySf[13][3] = {{0}};   // nodes, generated, delivered
+  double   real;
+  char   * v;
+
+  SX1276Sim::Defaults(&cfg);
+  for (int a = 1; a < argc; a++)
+  {
+    v = strchr(argv[a], '=');
+    if (v == NULL)
+    {
+      printf("Usage: sim [name=value ...]   see lora-sim.cpp\n");
+      return 1;
+    }
+    *v++ = 0;
+    if      (strcmp(argv[a], "nodes") == 0)     cfg.nodes = atoi(v);
+    else if (strcmp(argv[a], "gateways") == 0)  cfg.gateways = atoi(v);
+    else if (strcmp(argv[a], "radius") == 0)    cfg.radiusM = atoi(v);
+    else if (strcmp(argv[a], "seconds") == 0)   cfg.seconds = atoi(v);
+    else if (strcmp(argv[a], "period") == 0)    cfg.periodS = atoi(v);
+    else if (strcmp(argv[a], "payload") == 0)   cfg.payload = atoi(v);
+    else if (strcmp(argv[a], "sf") == 0)        cfg.sf = atoi(v);
+    else if (strcmp(argv[a], "channels") == 0)  cfg.channels = atoi(v);
+    else if (strcmp(argv[a], "power") == 0)     cfg.power = atoi(v);
+    else if (strcmp(argv[a], "pathexp") == 0)   cfg.pathExponent = atof(v);
+    else if (strcmp(argv[a], "shadowing") == 0) cfg.shadowingDb = atof(v);
+    else if (strcmp(argv[a], "threads") == 0)   cfg.threads = atoi(v);
+    else if (strcmp(argv[a], "window") == 0)    cfg.windowMs = atoi(v);
+    else if (strcmp(argv[a], "seed") == 0)      cfg.seed = atoi(v);
+    else if (strcmp(argv[a], "csv") == 0)       csv = v;
+    else if (strcmp(argv[a], "mac") == 0)
+    {
+      cfg.mac = 0xFF;
+      for (int m = 0; m < 3; m++)
+        if (strcmp(v, _Mac[m]) == 0) cfg.mac = m;
+      if (cfg.mac == 0xFF)
+      {
+        printf("mac is aloha, lbt or tdma\n");
+        return 1;
+      }
+    }
+    else
+    {
+      printf("Unknown setting %s\n", argv[a]);
+      return 1;
+    }
+  }
+
+  SX1276Sim sim(&cfg);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  sim.Run();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  real = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  FILE * f = csv ? fopen(csv, "w") : NULL;
+  if (csv && f == NULL)
+  {
+    printf("Can't write %s\n", csv);
+  }
+  if (f) fprintf(f, "node,x,y,loss_db,sf,channel,generated,sent,delivered,collided,weak,dropped,"
+                    "blocked,busy,pdr,airtime_ms,duty_pct,latency_avg_ms,latency_max_ms\n");
+  for (uint32_t i = 0; i < sim.Nodes(); i++)
+  {
+    n = sim.Node(i);
+    gen += n->generated;
+    sent += n->sent;
+    delivered += n->delivered;
+    collided += n->collided;
+    weak += n->weak;
+    dropped += n->dropped;
+    blocked += n->blocked;
+    busy += n->busy;
+    air += n->airtimeUs;
+    if (n->airtimeUs > maxAir) maxAir = n->airtimeUs;
+    bySf[n->sf][0]++;
+    bySf[n->sf][1] += n->generated;
+    bySf[n->sf][2] += n->delivered;
+    if (f) fprintf(f, "%u,%.0f,%.0f,%.1f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.3f,%.1f,%.4f,%.1f,%.1f\n",
+                   i, n->x, n->y, n->lossDb, n->sf, n->channel, n->generated, n->sent,
+                   n->delivered, n->collided, n->weak, n->dropped, n->blocked, n->busy,
+                   n->generated ? (double) n->delivered / n->generated : 0.0, n->airtimeUs / 1e3,
+                   n->airtimeUs / 1e4 / cfg.seconds,
+                   n->delivered ? n->latencyUs / 1e3 / n->delivered : 0.0, n->latencyMaxUs / 1e3);
+  }
+  if (f) fclose(f);
+
+  printf("%u nodes, %u gateway%s, %s, %u channel%s, %us simulated in %.1fs on %u thread%s (%.0fx)\n",
+         cfg.nodes, cfg.gateways, cfg.gateways == 1 ? "" : "s", _Mac[cfg.mac], cfg.channels,
+         cfg.channels == 1 ? "" : "s", cfg.seconds, real, sim.Threads(),
+         sim.Threads() == 1 ? "" : "s", cfg.seconds / real);
+  printf("Packets      %llu generated, %llu sent, %llu delivered\n", (unsigned long long) gen,
+         (unsigned long long) sent, (unsigned long long) delivered);
+  printf("Delivery     %.2f%% of generated, %.2f%% of sent\n", gen ? 100.0 * delivered / gen : 0,
+         sent ? 100.0 * delivered / sent : 0);
+  printf("Lost         %llu collided, %llu below sensitivity, %llu dropped unsent\n",
+         (unsigned long long) collided, (unsigned long long) weak, (unsigned long long) dropped);
+  printf("MAC          %llu refused by the duty cycle, %llu LBT backoffs\n",
+         (unsigned long long) blocked, (unsigned long long) busy);
+  printf("Latency ms   p50 %u  p90 %u  p99 %u  max %u\n", sim.LatencyMs(50), sim.LatencyMs(90),
+         sim.LatencyMs(99), sim.LatencyMs(100));
+  printf("Airtime      %.1fs, mean node duty %.4f%%, max %.4f%%\n", air / 1e6,
+         air / 1e4 / cfg.seconds / cfg.nodes, maxAir / 1e4 / cfg.seconds);
+  for (int c = 0; c < cfg.channels; c++)
+  {
+    printf("  channel %d  load %.3f Erlang\n", c, sim.ChannelAirtimeUs(c) / 1e6 / cfg.seconds);
+  }
+  printf("SF  nodes  delivery\n");
+  for (int s = 7; s <= 12; s++)
+  {
+    if (bySf[s][0] == 0) continue;
+    printf("%2d  %5u  %6.2f%%\n", s, bySf[s][0], bySf[s][1] ? 100.0 * bySf[s][2] / bySf[s][1] : 0);
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+// Find the fastest SPI clock this board's wiring takes (SX1276::TuneSpi), and keep
+// it in a file for other programs to pass to the SX1276 constructor as spiClk.
+// Each clock is checked with register patterns and FIFO burst round trips; the
+// clock kept is one step below the fastest clean one.
+// Usage: spitune [file] [max Hz]   default file spi.hz, max SPI_TUNE_MAX_HZ
+// Build: make spitune     for the radio on a Pi
+//        make spituneemu  against the emulator, with wiring that fails above 6MHz
+// Read the file back with: int clk = 1000000; FILE *f = fopen("spi.hz", "r");
+//                          if (f) { fscanf(f, "%d", &clk); fclose(f); }
+#ifndef SX1276_EMULATOR
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include "SX1276.cpp"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.cpp"
+#endif
+
+int main (int argc, char *argv[])
+{
+#ifdef SX1276_EMULATOR
+  SX1276Emulator::Speed(0);
+  SX1276Emulator emu;
+  SX1276Emulator::MaxSpiHz(6000000);
+#endif
+  const char * path = "spi.hz";
+  int maxHz = SPI_TUNE_MAX_HZ;
+  int errors[SPI_TUNE_STEPS];
+  int clk;
+  FILE * f;
+
+  if (argc > 1) path = argv[1];
+  if (argc > 2) maxHz = atoi(argv[2]);
+  SX1276 lora(1000000,6,0);
+  if (lora.Version() != 0x12)
+  {
+    printf("No SX1276 found at 1MHz\n");
+    return 1;
+  }
+  clk = lora.TuneSpi(maxHz, SPI_TUNE_ROUNDS, errors);
+  for (int s = 0; s < SPI_TUNE_STEPS && errors[s] >= 0; s++)
+  {
+    printf("%9d Hz  %s", SX1276::SpiTuneHz[s], errors[s] ? "errors" : "clean");
+    if (errors[s]) printf(" (%d bytes)", errors[s]);
+    printf("%s\n", SX1276::SpiTuneHz[s] == clk ? "  <- chosen" : "");
+  }
+  if (clk < 0)
+  {
+    printf("No clean SPI clock, check the wiring\n");
+    return 1;
+  }
+  f = fopen(path, "w");
+  if (f == NULL || fprintf(f, "%d\n", clk) < 0)
+  {
+    printf("Can't write %s\n", path);
+    return 1;
+  }
+  fclose(f);
+  printf("SPI clock %d Hz -> %s\n", clk, path);
+  return 0;
+}
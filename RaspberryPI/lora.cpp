@@ -4,9 +4,11 @@
 #include <iostream>
 #include <string.h>
 #include "SX1276.cpp"
+#include "SX1276DebugLog.cpp"
 int main ()
 {
   SX1276 * lora = NULL;
+  SX1276DebugLog::Start(stdout); // library DEBUG messages, printed off the radio thread
   lora = new SX1276(1000000,6,0);
   char send [255] = "Test cpp\0";
   char rcv  [255] = {0};
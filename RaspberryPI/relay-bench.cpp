@@ -0,0 +1,155 @@
+// Benchmark the relay duplicate cache, and flood messages over a grid of nodes, each
+// an SX1276Relay on an emulated radio (SX1276Emulator) on virtual time. Each node hears
+// its 8 neighbours; a node that is transmitting, or between receive calls, misses what
+// is sent to it. Nodes take turns in steps of RELAY_BENCH_STEP ms of virtual time, so a
+// frame can arrive up to one step late.
+// Usage: relaybench [grid width] [messages] [hops]
+// Build: make relaybench   (no radio needed)
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276.cpp"
+#include "SX1276Relay.cpp"
+#include "SX1276Emulator.cpp"
+
+#define RELAY_BENCH_STEP   10     // ms each node runs for in turn
+#define RELAY_BENCH_GAP    5000   // ms between messages
+
+struct Node
+{
+  SX1276Emulator * emu;
+  SX1276 *      lora;
+  SX1276Relay * relay;
+  uint64_t      nowUs;       // Node's own time: how far it has run
+  int           x, y;
+};
+
+static std::vector<Node> nodes;
+static int width;
+
+// A node transmitted: its neighbours receive the frame when it ends
+static void Transmitted (void *ctx, const SX1276Packet *pkt)
+{
+  Node * n = (Node *) ctx;
+  for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      if ((dx == 0 && dy == 0) || n->x + dx < 0 || n->x + dx >= width ||
+          n->y + dy < 0 || n->y + dy >= width) continue;
+      nodes[(n->y + dy) * width + n->x + dx].emu->Inject(pkt, SX1276Emulator::NowUs());
+    }
+}
+
+int main (int argc, char *argv[])
+{
+  int messages = 50;
+  int hops = 8;
+  width = 10;
+  if (argc > 1) width = atoi(argv[1]);
+  if (argc > 2) messages = atoi(argv[2]);
+  if (argc > 3) hops = atoi(argv[3]);
+  if (width < 2 || width > 255 || messages < 1 || hops < 1)
+  {
+    printf("Usage: relaybench [grid width] [messages] [hops]\n");
+    return 1;
+  }
+  SX1276Emulator::Speed(0);
+
+  /* Raw cache lookup rate. 32 sources, each copy of a frame heard ~8 times, 1000 lookups per ms */
+  static RelayCache cache;
+  const int lookups = 4000000;
+  static uint32_t ids[4096];
+  for (int n = 0; n < 4096; n++)
+  {
+    ids[n] = rand() & 0x3F;
+  }
+  uint32_t dups = 0;
+  uint64_t t = SX1276Emulator::RealNs();
+  for (int n = 0; n < lookups; n++)
+  {
+    uint32_t id = n / 8 + ids[n & 4095];
+    dups += cache.Seen(id & 0x1F, id >> 5, n / 1000);
+  }
+  t = (SX1276Emulator::RealNs() - t) / 1000;
+  printf ("Cache: %d lookups in %u us. %.1f M lookups/s. %u duplicates, %u evictions\n",
+          lookups, (uint32_t) t, lookups / (double) t, dups, cache.Evictions());
+
+  /* Flooding over a grid */
+  int count = width * width;
+  nodes.resize(count);
+  for (int n = 0; n < count; n++)
+  {
+    Node * node = &nodes[n];
+    SX1276Emulator::Clock(0);
+    node->emu = new SX1276Emulator(NSS_PIN_DEFAULT, RESET_PIN_DEFAULT);
+    node->emu->OnTransmit(Transmitted, node);
+    node->lora = new SX1276(1000000, NSS_PIN_DEFAULT, RESET_PIN_DEFAULT);
+    if (node->lora->Init(OUTPUT_PA_BOOST, BANDPLAN_EU868) < 0)
+    {
+      printf("Init Error\n");
+      return 1;
+    }
+    node->lora->SpreadingFactor(7);
+    node->lora->BwHz(125e3);
+    node->lora->Frequency(869.5e6);
+    node->relay = new SX1276Relay(node->lora, n, hops, n + 1);
+    node->nowUs = 0;
+    node->x = n % width;
+    node->y = n / width;
+  }
+
+  char     data[255];
+  uint32_t delivered = 0, sendErrors = 0;
+  uint64_t endUs = (uint64_t) (messages + 2) * RELAY_BENCH_GAP * 1000;
+  int      next = 0;
+  int      ret;
+  t = SX1276Emulator::RealNs();
+  for (uint64_t step = 0; step < endUs; step += RELAY_BENCH_STEP * 1000)
+  {
+    uint64_t stepEnd = step + RELAY_BENCH_STEP * 1000;
+    for (int n = 0; n < count; n++)
+    {
+      Node * node = &nodes[n];
+      if (node->nowUs >= stepEnd) continue; // still busy, e.g. transmitting
+      node->emu->Attach();
+      SX1276Emulator::Clock(node->nowUs > step ? node->nowUs : step);
+      if (next < messages && (uint64_t) next * RELAY_BENCH_GAP * 1000 < stepEnd &&
+          n == (next * 7919) % count)
+      {
+        memset(data, next, 16);
+        if (node->relay->Send(data, 16) < 0) sendErrors++;
+        next++;
+      }
+      while (SX1276Emulator::NowUs() < stepEnd)
+      {
+        ret = node->relay->Poll(data, sizeof(data), (stepEnd - SX1276Emulator::NowUs() + 999) / 1000);
+        if (ret > 0) delivered++;
+      }
+      node->nowUs = SX1276Emulator::NowUs();
+    }
+  }
+  t = (SX1276Emulator::RealNs() - t) / 1000;
+
+  uint32_t forwarded = 0, suppressed = 0, duplicates = 0, dutyDropped = 0, pendingFull = 0;
+  uint32_t transmissions = 0, missed = 0;
+  for (int n = 0; n < count; n++)
+  {
+    forwarded += nodes[n].relay->Forwarded();
+    suppressed += nodes[n].relay->Suppressed();
+    duplicates += nodes[n].relay->Duplicates();
+    dutyDropped += nodes[n].relay->DutyDropped();
+    pendingFull += nodes[n].relay->PendingFull();
+    transmissions += nodes[n].emu->Transmitted();
+    missed += nodes[n].emu->Missed();
+  }
+  printf ("Flood: %d nodes, %d messages, %d hops, %.0f s virtual in %.1f s\n", count, messages, hops,
+          endUs / 1e6, t / 1e6);
+  printf ("  delivered %u of %u (%.1f%%), %u sends failed\n", delivered, messages * (count - 1),
+          100.0 * delivered / (messages * (count - 1)), sendErrors);
+  printf ("  transmissions %u (%.2f per message per node), forwarded %u, suppressed %u, duplicates %u\n",
+          transmissions, transmissions / (double) messages / count, forwarded, suppressed, duplicates);
+  printf ("  dropped: %u by the duty cycle, %u pending list full, %u missed while not receiving\n",
+          dutyDropped, pendingFull, missed);
+  return 0;
+}
@@ -19,30 +19,39 @@
 */
 
 
-/*   Debugging routines - prints debug messages  */
-#ifdef DEBUG_BUILD
-#  define DEBUG(...) { printf("DEBUG:  "); printf(__VA_ARGS__); printf("\r\n"); }
-#else
-#  define DEBUG(...) { do {} while (0); }
-#endif
+/*   Debugging routines (see SX1276Debug.h)  */
+#include "SX1276Debug.h"
 
 /*   Arduino/ESP32 specific includes   */
 #ifdef ESP32
   #include "Arduino.h"
   #include <SPI.h>
+  #include "esp_timer.h"
   
 /*   Raspberry pi specific includes   */
 #else
-  #include <wiringPi.h>
-  #include <wiringPiSPI.h>
+  #ifdef SX1276_EMULATOR
+    #include "SX1276Emulator.h" // wiringPi calls drive an emulated radio
+  #else
+    #include <wiringPi.h>
+    #include <wiringPiSPI.h>
+  #endif
   #include <math.h>
+  #include <time.h>
   using std::round;
 #endif
 
 /*   Includes   */
 
 #include <string>
+#include <string.h>
 #include "SX1276.h"
+#include "SX1276Metrics.h"
+#include "SX1276Trace.h"
+#include "SX1276Latency.h"
+#include "SX1276BusRecorder.h"
+#include "SX1276Snapshot.h"
+#include "SX1276Profile.h"
 
 
 /*  SX1276
@@ -61,34 +70,54 @@ SX1276 (int     spiClk,    // [Optional] Default: 1000000. SPI clock speed in Hz
   _NSS_pin = NSS_Pin;
   _ResetPin = ResetPin;
   _spiClk = spiClk;
+  _TxConfigDirty = 1;
+  _TxPowerClamped = 0;
+  _BurstGapUs = 0;
+  _BurstTimeouts = 0;
+  _ReplyLen = 0;
+  _ReplyTurnaroundUs = 0;
+  _ModeState.ClearCounters(SX1276ModeState::NowUs());
+  _FilterRejected = 0;
+  _FilterBytesSaved = 0;
+  _Metrics = NULL;
+  _Latency = NULL;
+  _Bus = NULL;
+  _RxHeaderCnt = 0;
+  _RxPacketCnt = 0;
+  _TxFrequency = 0;
+  _BandPlan = BANDPLAN_NONE;
+  _RegsValid = 0;
 
   /*   SPI setup   */  
 
-  #ifdef ESP32
-    pinMode (_NSS_pin, OUTPUT);
-    spi = new SPIClass(HSPI);
-    spi->begin(SCK_Pin, MISO_Pin, MOSI_Pin, NSS_Pin);
-  #else
-    wiringPiSetup() ;
-    delay(10);
-    wiringPiSPISetup(0,_spiClk);
-    delay(10); 
-    pinMode (_NSS_pin, OUTPUT);
-  #endif 
-  /*   Reset SX1276   */ 
+  _SpiError = _Spi.Begin(_spiClk, _NSS_pin, SCK_Pin, MISO_Pin, MOSI_Pin) != 0;
+  if (_SpiError)
+  {
+    DEBUG_WARN (DLOG_INIT, "SPI Error: Can't open SPI bus");
+    return; // Init() reports it
+  }
+  /*   Reset SX1276, unless it is already running in LoRa mode (see WarmStart)   */ 
  
-  Reset();
+  if (Version() != 0x12 || LongRangeMode() != SX1276_LORA)
+  {
+    delay(10);
+    Reset();
+  }
   //_FreqLimitLower = 137e6;  // Lowest Frequency Range for SX1276
   //_FreqLimitUpper = 1020e6; // Highest Frequency Range for SX1276
 }
 
 
+/* SPI clocks tried by TuneSpi(), slowest first */
+const int32_t SX1276::SpiTuneHz[SPI_TUNE_STEPS] = {500000, 1000000, 2000000, 4000000,
+                                                 5000000, 8000000, 10000000, 16000000};
+
 /*  Init 
  *   
  *  Set up modem to LoRa mode, and optionally set regional restrictions 
  *  
  *  Returns: 0 if successful:
- *           -1 if modem reset failed. 
+ *           -1 if modem reset failed, or the SPI bus couldn't be opened.
  */
 int SX1276::
 Init (uint8_t PA_Boost, //Optional.
@@ -100,31 +129,35 @@ Init (uint8_t PA_Boost, //Optional.
 { 
   if (PA_Boost != OUTPUT_RFO && PA_Boost != OUTPUT_PA_BOOST)
   {
-    DEBUG ("Init Error: PA_Boost Out of Range");
+    DEBUG_WARN (DLOG_INIT, "Init Error: PA_Boost Out of Range");
     return -1;
   }
-/* Initialise TX Timer  */
-  _TxTimerMs = 0;
-  for (int p=0;p<10;p++)
+  if (BandPlan != BANDPLAN_NONE && BandPlan != BANDPLAN_EU868)
   {
-    _TXwindowTime[p]=0;
+    DEBUG_WARN (DLOG_INIT, "Init Error: Invalid Bandplan");
+    return -1;
   }
-  _TXHoldUntil = millis();
+  if (_SpiError)
+  {
+    DEBUG_WARN (DLOG_INIT, "Init Error: SPI bus not open");
+    return -1;
+  }
+  ClearTxTimer();
 
 /* Initialise Modem  */
   if (Reset() != 0)
   {
-    DEBUG ("Init Error: Modem reset failure");
+    DEBUG_WARN (DLOG_INIT, "Init Error: Modem reset failure");
     return -1;
   }
-  Mode(SX1276_MODE_SLEEP);
+  SetMode(SX1276_MODE_SLEEP);
   delay(10);
   LongRangeMode(SX1276_LORA);
   AutomaticIFOn(0); // Per errata note. (Spurious Reception)
   IfFreq2(0x40);    // Per errata note. (Spurious Reception)
   IfFreq1(0x00);    // Per errata note. (Spurious Reception)
   delay(10);
-  Mode(SX1276_MODE_STDBY);
+  SetMode(SX1276_MODE_STDBY);
   PaSelect(PA_Boost);
 
 /* Configure Band Plan Limits */
@@ -132,25 +165,140 @@ Init (uint8_t PA_Boost, //Optional.
   _BandPlan = BandPlan;
   if (_BandPlan == BANDPLAN_NONE) // No Band Restrictions
   {
-    _TXPowerLimit = 20;       // Max
-    _DutyCycleMsHour = 1800000;    // Seconds, 50% Duty
-    _TXHoldoff = 0;           // Allow continuous Trasmission
-    _BWLimit = 9;
+    BandLimits(0);
   }
-
-  else if (_BandPlan == BANDPLAN_EU868) // EU868 Restrictions ref EN 300 220-2 V3.2.1
+  else // EU868
   {
-    //_FreqLimitLower = 863e6;   // Lowest Frequency 
-    //_FreqLimitUpper = 870e6;  // Highest Frequency
-    _TXHoldoff = 1;           // Times TX period. Need to find figure for this.
     Frequency(869.5e6);        // set Freq for 869.5 Mhz (Centre of band 54)
   }
-  else
+ return 0;
+}
+
+/*  WarmStart
+ *
+ *  Init() without the reset, for a modem that is already set up, e.g. after the
+ *  host restarts: the register map is read in one burst and only the registers that
+ *  differ from the wanted configuration are written, in as few bursts as possible.
+ *  The wanted configuration is a Snapshot() taken once the radio was set up as
+ *  required, or if config is NULL, the settings Init() makes. PA_Boost and the band
+ *  plan's limits are applied either way.
+ *  If the modem does not answer with the SX1276 version in LoRa mode, Init() is run
+ *  first, with its reset and delays, and the config written after it.
+ *  Returns: 0 on a warm start, 1 if the modem had to be initialised, -1 on error.
+ */
+int SX1276::
+WarmStart (uint8_t PA_Boost,   // As Init()
+           uint8_t BandPlan,   // As Init()
+           const SX1276Snapshot *config) // [Optional] Configuration to restore.
+{
+  SX1276Snapshot live;
+  uint8_t  want[SNAPSHOT_LAST + 1];
+  uint32_t frf;
+  int      cold = 0;
+
+  if (PA_Boost != OUTPUT_RFO && PA_Boost != OUTPUT_PA_BOOST)
   {
-    DEBUG ("Init Error: Invalid Bandplan");
+    DEBUG_WARN (DLOG_INIT, "WarmStart Error: PA_Boost Out of Range");
     return -1;
   }
- return 0;
+  if (BandPlan != BANDPLAN_NONE && BandPlan != BANDPLAN_EU868)
+  {
+    DEBUG_WARN (DLOG_INIT, "WarmStart Error: Invalid Bandplan");
+    return -1;
+  }
+  Snapshot(&live);
+  if (live.reg[RegVersion] != 0x12 || !(live.reg[RegOpMode] & 0x80))
+  {
+    DEBUG (DLOG_INIT, "WarmStart: Modem not in LoRa mode, initialising");
+    if (Init(PA_Boost, BandPlan) != 0) return -1;
+    if (config == NULL) return 1;
+    Snapshot(&live);
+    cold = 1;
+  }
+  ClearTxTimer();
+  SetMode(SX1276_MODE_STDBY);
+
+  memcpy(want, live.reg, sizeof(want));
+  if (config != NULL)
+  {
+    for (int r = SNAPSHOT_FIRST; r <= SNAPSHOT_LAST; r++)
+    {
+      if (SX1276Snapshot::Config(r)) want[r] = config->reg[r];
+    }
+    want[RegOpMode] = (want[RegOpMode] & ~0x08) | (config->reg[RegOpMode] & 0x08);
+  }
+  else
+  {
+    want[RegDetectOptimize] &= 0x7F; // AutomaticIFOn(0), per errata note, as Init()
+    want[RegIfFreq2] = 0x40;
+    want[RegIfFreq1] = 0x00;
+    if (BandPlan == BANDPLAN_EU868)
+    {
+      frf = round(869.5e6 / 61.035);
+      want[RegFrMsb] = frf >> 16;
+      want[RegFrMid] = frf >> 8;
+      want[RegFrLsb] = frf;
+      want[RegOpMode] &= ~0x08;      // LowFrequencyModeOn(0), as Frequency()
+    }
+  }
+  want[RegPaConfig] = (want[RegPaConfig] & 0x7F) | (PA_Boost << 7);
+
+  WriteConfig(want, live.reg);
+  if (want[RegOpMode] != live.reg[RegOpMode])
+  {
+    spi_tx(RegOpMode, (_RegOpMode & ~0x08) | (want[RegOpMode] & 0x08));
+  }
+  _TxConfigDirty = 1;
+  _BandPlan = BandPlan;
+  BandLimits((uint64_t) (want[RegFrMsb] << 16 | want[RegFrMid] << 8 | want[RegFrLsb]) * 61035 / 1000);
+  return cold;
+}
+
+/*  WriteConfig
+ *
+ *  Write the configuration registers (SX1276Snapshot::Config) of register image want
+ *  that differ from have. A burst runs on over up to SNAPSHOT_BURST_GAP unchanged
+ *  registers, configuration or read only, rather than start a new transaction, so
+ *  e.g. RegModemConfig1 to RegModemConfig3 take one. RegOpMode is not written.
+ *  Returns: number of registers that differed.
+ */
+int SX1276::
+WriteConfig (const uint8_t *want, // Register images indexed by address, as
+             const uint8_t *have) // SX1276Snapshot::reg
+{
+  int changed = 0;
+  int first, last, r;
+  for (r = SNAPSHOT_FIRST + 1; r <= SNAPSHOT_LAST; r++)
+  {
+    if (!SX1276Snapshot::Config(r) || want[r] == have[r]) continue;
+    first = last = r;
+    changed++;
+    for (r++; r <= SNAPSHOT_LAST && r <= last + SNAPSHOT_BURST_GAP + 1; r++)
+    {
+      if (!SX1276Snapshot::Config(r) && !SX1276Snapshot::ReadOnly(r)) break;
+      if (SX1276Snapshot::Config(r) && want[r] != have[r])
+      {
+        last = r;
+        changed++;
+      }
+    }
+    spi_burst_tx(first, want + first, last - first + 1);
+    r = last;
+  }
+  return changed;
+}
+
+/*  ClearTxTimer
+ *  Clear the duty cycle record, as at Init().
+ */
+void SX1276::ClearTxTimer()
+{
+  _TxTimerMs = 0;
+  for (int p=0;p<10;p++)
+  {
+    _TXwindowTime[p]=0;
+  }
+  _TXHoldUntil = millis();
 }
 
 
@@ -167,37 +315,80 @@ CAD (char *    rxdata,     //char array to write data to.
     uint32_t t = millis() + timeout; 
     int rx = 1;
     int cadcount=0;
-    Mode(SX1276_MODE_STDBY); 
+    uint32_t cadstart;
+    TRACE_SCOPE(TRACE_CAD, timeout);
+    ReplyRelease();
+    SetMode(SX1276_MODE_STDBY); 
     ClearFlags();
-    Mode(SX1276_MODE_CAD);
-    DEBUG ("CAD");
+    SetMode(SX1276_MODE_CAD);
+    cadstart = micros();
+    DEBUG (DLOG_CAD, "CAD");
     while (rx == 1 && millis() < t) // Monitor IRQ flags and wait until timer is up
     {
       if (CadDetected() == 1)
       {
-       DEBUG ("Cad Detected..");
+       DEBUG (DLOG_CAD, "Cad Detected..");
+       TRACE_INSTANT(TRACE_IRQ, 0x01);
        ClearFlags(); 
        rx = RXContinuous(rxdata,200); //try and RX detected signal. Unlikely to work. remove this?
       }
       else if (CadDone() == 1)
       {
         cadcount++;
+        TRACE_INSTANT(TRACE_IRQ, 0x04);
+        if (_Latency) _Latency->Record(LATENCY_CAD, (micros() - cadstart) * 1000ULL);
+        ModeEntered(SX1276_MODE_STDBY); // modem returns to Standby on CadDone
         CadDone(1); // Clear CadDone Flag
-        Mode(SX1276_MODE_CAD); 
+        SetMode(SX1276_MODE_CAD); 
+        cadstart = micros();
       }
       else
       {
+        TRACE_SCOPE(TRACE_WAIT, 3000);
         delay (3); // stop cpu hogging
       }
     }
 
-    DEBUG ("End CAD. cad calls: %d",cadcount);
+    DEBUG (DLOG_CAD, "End CAD. cad calls: %d",cadcount);
 
     ClearFlags();
-    Mode(SX1276_MODE_STDBY); 
+    SetMode(SX1276_MODE_STDBY); 
     return 0;
 }
 
+/*  CADOnce
+ *
+ *  Run a single channel activity detection (about two symbols) and report whether
+ *  a LoRa preamble was seen, for listen before talk. Returns in Standby.
+ *  Returns: 1 if activity was detected, 0 if the channel is clear, -1 on timeout.
+ */
+int SX1276::
+CADOnce ()
+{
+    uint32_t t = millis();
+    uint32_t cadstart;
+    uint8_t  irq;
+    TRACE_SCOPE(TRACE_CAD, 0);
+    SetMode(SX1276_MODE_STDBY);
+    ClearFlags();
+    SetMode(SX1276_MODE_CAD);
+    cadstart = micros();
+    while (((irq = spi_rx(RegIrqFlags)) & 0x04) == 0) // CadDone
+    {
+      if ((uint32_t) (millis() - t) > TIMEOUT_DEFAULT)
+      {
+        SetMode(SX1276_MODE_STDBY);
+        return -1;
+      }
+      delay(1);
+    }
+    TRACE_INSTANT(TRACE_IRQ, irq);
+    if (_Latency) _Latency->Record(LATENCY_CAD, (micros() - cadstart) * 1000ULL);
+    ModeEntered(SX1276_MODE_STDBY); // modem returns to Standby on CadDone
+    ClearFlags();
+    return (irq & 0x01) ? 1 : 0;
+}
+
 /*  RXContinuous 
  *   
  *  Initiate Receive mode. and attempt to decode data.
@@ -213,39 +404,46 @@ RXContinuous (char *    rxdata,    //char array to write data to.
 {
     uint8_t rxbytes;
     int ret;
+    uint64_t rxdone = 0;
     uint32_t t = millis() + timeout ; // 
-    Mode(SX1276_MODE_STDBY);
+    TRACE_SCOPE(TRACE_RX_CONTINUOUS, timeout);
+    ReplyRelease();
+    SetMode(SX1276_MODE_STDBY);
     uint8_t FifoRxAddress;
     FifoAddrPtr(FifoRxBaseAddr()); // set Set FifoPtrAddr to FifoRxBaseAddr
     ClearFlags();
-    Mode(SX1276_MODE_RXCONTINUOUS); 
-    DEBUG ("Rxing.."); 
+    SetMode(SX1276_MODE_RXCONTINUOUS); 
+    DEBUG (DLOG_RX, "Rxing.."); 
     while (RxDone() == 0 && (millis() < t || timeout == 0 )) {// Monitor IRQ flags and wait until TxDone Flag is set
       if (ModemStatus() & 1 == 1)
       {
-        DEBUG ("Sig Detected..");
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, "Sig Detected..");
         t += 4; //extend timeout if signal detected
       }
       if (ModemStatus() & 2 == 1)
       {
-        DEBUG ("Sig Synced..");
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, "Sig Synced..");
       }
        if (ModemStatus() & 4 == 1)
       {
-        DEBUG ("RX ongoing..");
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, "RX ongoing..");
       }
        if (ModemStatus() & 8 == 1)
       {
-        DEBUG ("Header info valid..");
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, "Header info valid..");
       }
       if (ModemStatus() & 16 == 1)
       {
-        DEBUG ("Modem Clear..");
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, "Modem Clear..");
       }
+      TRACE_SCOPE(TRACE_WAIT, 3000);
       delay(3); // stop cpu hogging
     }
     if (RxDone()) 
     {
+      if (_Latency) rxdone = SX1276Latency::NowNs();
+      TRACE_INSTANT(TRACE_IRQ, 0x40);
+      if (_Metrics) RxMetrics(spi_rx(RegIrqFlags));
       rxbytes = FifoRxBytesNb();
       if (rxbytes > datalen) 
       {
@@ -254,31 +452,31 @@ RXContinuous (char *    rxdata,    //char array to write data to.
       }
       else ret = rxbytes;
       FifoRxAddress = FifoRxCurrentAddr(); // get start address of last packet 
-      DEBUG ("Fifo address ptr=%d", FifoAddrPtr());
+      DEBUG (DLOG_RX, "Fifo address ptr=%d", FifoAddrPtr());
       FifoAddrPtr(FifoRxAddress); // set Set FifoPtrAddr to FifoRxCurrentAddr
-      DEBUG ("RX Success. Rxbytes = %d", rxbytes);
-      DEBUG ("FifoRxAddress=%d", FifoRxAddress);
-      DEBUG ("RXDATA HEX:");
+      DEBUG (DLOG_RX, "RX Success. Rxbytes = %d", rxbytes);
+      DEBUG (DLOG_RX, "FifoRxAddress=%d", FifoRxAddress);
+      DEBUG (DLOG_RX, "RXDATA HEX:");
       for (int x = 0; x < rxbytes; x++)
       {
         rxdata[x] = Fifo(); 
-        DEBUG (" %x",rxdata[x]);
+        DEBUG_LEVEL (DLOG_VERBOSE, DLOG_RX, " %x",rxdata[x]);
       }
-      DEBUG (rxdata);
 //      delay(500);
 //      TX(rxdata, rxbytes); //Relay back data *TESTING**
 
     }
     else
     {
-      DEBUG ("Normal RX Timeout.");
+      DEBUG (DLOG_RX, "Normal RX Timeout.");
       ret = 0;
     }
-    if (RxTimeout()) DEBUG ("RxTimeout.");
-    if (PayloadCrcError()) DEBUG ("PayloadCrcError");
-    if (ValidHeader()) DEBUG ("ValidHeader");
-    if (CadDetected()) DEBUG ("CadDetected");
-    Mode(SX1276_MODE_STDBY); 
+    if (RxTimeout()) DEBUG (DLOG_RX, "RxTimeout.");
+    if (PayloadCrcError()) DEBUG_WARN (DLOG_RX, "PayloadCrcError");
+    if (ValidHeader()) DEBUG (DLOG_RX, "ValidHeader");
+    if (CadDetected()) DEBUG (DLOG_RX, "CadDetected");
+    SetMode(SX1276_MODE_STDBY); 
+    if (_Latency && rxdone) _Latency->Record(LATENCY_RX, SX1276Latency::NowNs() - rxdone);
     return ret;
 }
 
@@ -295,22 +493,46 @@ int SX1276::
 RXContStart (char *  rxdata,     //char array to write data to. 
              size_t  datalen)    //set to sizeof(rxdata)                   
 {
+    ReplyRelease();
     _RxDataPtr = rxdata;
     _RxDataLen = datalen;
     int ret;
-    Mode(SX1276_MODE_STDBY);
+    SetMode(SX1276_MODE_STDBY);
     uint8_t FifoRxAddress;
     FifoAddrPtr(FifoRxBaseAddr()); // set Set FifoPtrAddr to FifoRxBaseAddr
     Dio0Mapping(0x00); //Set DIO0 Interrupt Pin to RxDone
+    ClearFlags();
     
-    Mode(SX1276_MODE_RXCONTINUOUS); 
-    DEBUG ("Rxing Continuously.."); 
+    SetMode(SX1276_MODE_RXCONTINUOUS); 
+    DEBUG (DLOG_RX, "Rxing Continuously.."); 
 
 
 
     return 0;
 }
 
+/*  RXContPoll
+ *
+ *  After RXContStart(), check for a received packet without leaving receive mode,
+ *  so receiving never stops between packets. Costs one register read when there is
+ *  nothing. A packet is read with its metadata, as PacketInfo(), into pkt.
+ *  Returns: packet length, 0 if nothing was received, -1 if the packet failed its CRC.
+ */
+int SX1276::
+RXContPoll (SX1276Packet *pkt) // Packet to fill in
+{
+    uint8_t irq = spi_rx(RegIrqFlags);
+    if ((irq & 0x40) == 0) return 0; // RxDone
+    TRACE_INSTANT(TRACE_IRQ, 0x40);
+    if (_Metrics) RxMetrics(irq);
+    PacketInfo(pkt);
+    pkt->timeUs = 0;
+    spi_tx(RegFifoAddrPtr, spi_rx(RegFifoRxCurrentAddr));
+    spi_burst_rx(RegFifo, pkt->data, pkt->len);
+    spi_tx(RegIrqFlags, irq); // Clear only the flags read: the next packet may have set others since
+    return pkt->crcError ? -1 : pkt->len;
+}
+
 /*  TxTimer
  *  Manage Transmit duty cycle.
  *  We are allowed to Transmit for _DutyCycleMsHour milliseconds per hour.
@@ -347,118 +569,1101 @@ TxTimer (uint32_t  TXTimeToAdd) // TX time to add to counter
     //DEBUG ("shiftnumber=%d",shiftnumber);
     while (shiftnumber > 1)
     {
-      shiftnumber--;
-      //shift window time values.
-      for (p=9;p>0;p--)
+      shiftnumber--;
+      //shift window time values.
+      for (p=9;p>0;p--)
+      {
+        _TXwindowTime[p] = _TXwindowTime[p-1];
+      }
+      //zero most recent window
+      _TXwindowTime[0]=0;
+      //shift windows by 1/10 hour
+      _TXTimerWindowRef += 360000; // 3600ms(debug). Should be 360000ms (360s or 1/10 hour)
+    }
+  }
+  _TXwindowTime[0]+=TXTimeToAdd;
+
+ /*  Calculate _TXTimer */
+  _TxTimerMs=0;
+  for (p=0;p<10;p++)
+  {
+     //DEBUG ("_TXwindowTime[%d]=%d\n",p,_TXwindowTime[p]);
+    _TxTimerMs += _TXwindowTime[p];
+  }
+  if (_Metrics)
+  {
+    if (TXTimeToAdd > 0) _Metrics->TxDone(_TxFrequency, TXTimeToAdd);
+    _Metrics->DutyBudget((int32_t) (_DutyCycleMsHour - _TxTimerMs));
+  }
+
+ /* if we have exceeded our quota */
+  if (_TxTimerMs >= _DutyCycleMsHour)
+  {
+     DEBUG_WARN (DLOG_TX, "TXTimer Error: Quota Exceeded");
+     return -1;
+  }
+  return _TxTimerMs;
+}
+
+/*  TXCheck
+ *  Check a transmission of datalen bytes is allowed by the band plan, holdoff and duty cycle.
+ *  With timing 0 holdoff and duty cycle are left out, for a caller that checks them at TX time.
+ *  Power and Bandwidth are only re-read from the modem if a register affecting them
+ *  has been written since the last check (see spi_tx), so repeated TX with an unchanged
+ *  configuration costs no extra SPI reads.
+ *  If the power exceeds the band plan limit it is reduced, and _TxPowerClamped is set
+ *  so the caller can restore it afterwards.
+ *
+ *  Returns: 0 if TX is allowed, otherwise the TX error codes below.
+ */
+int SX1276::
+TXCheck (size_t  datalen,    // Length of data to transmit
+         uint8_t timing)     // Check holdoff and duty cycle too. Default: 1
+{
+    uint8_t frf[3];
+    if (_TxConfigDirty)
+    {
+      _TxPowerDBm = PowerDBm();
+      _TxBw = Bw();
+      spi_burst_rx(RegFrMsb, frf, 3);
+      _TxFrequency = (uint64_t) (frf[0] * 0x10000 + frf[1] * 0x100 + frf[2]) * 61035 / 1000; // Assumes 32Mhz Oscillator
+      _TxConfigDirty = 0;
+    }
+    _TxPowerClamped = 0;
+    if (_TXPowerLimit <= -99) // If Tx prohibited on this freq by Band Plan
+    {
+      DEBUG_WARN (DLOG_TX, "Error: TX Frequency not in band.");      
+      return -5;
+    }
+    if (_TxBw > _BWLimit)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: BW Limit Exceeded.");
+      return -4;
+    }
+    if (datalen == 0 || datalen > 255) {
+      DEBUG_WARN (DLOG_TX, "Error TX data too long");
+      return -1;
+    }
+    if  (timing && (int32_t) (_TXHoldUntil - millis()) > 0)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: Holdoff"); 
+      return -2;
+    }
+    if (timing && TxTimer() < 0)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: TX Time limit exceeded"); 
+      return -3;
+    }
+    if (_TxPowerDBm > _TXPowerLimit)
+    {
+      DEBUG_WARN (DLOG_TX, "Warning: TX Power %ddB Exceeds Limit of %ddB. Power reduced", _TxPowerDBm, _TXPowerLimit);
+      PowerDBm(_TXPowerLimit);
+      _TxPowerClamped = 1;
+    }
+    return 0;
+}
+
+/*  TX 
+ *  Transmit string of characters.
+ *  If no new frequency is provided, the previous Frequency in Hz is returned
+ *  If the transmission failed, -1 is returned
+ *  If the transmission was successful, the transmission duration in ms is returned
+ *  String length limit is 255 bytes
+ *  TX Frequency, SF, Bandwidth, Power, CRC, Header mode, and Coding Rate must be set using:
+ *  Frequency(), SpreadingFactor(), BandwidthHz, PowerDBm() RxPayloadCrcOn(), 
+ *  ImplicitHeaderModeOn(), and CodingRate().
+ *  
+ *  Returns: Time taken to TX in ms on success
+ *           -1 if data to TX is too long
+ *           -2 if prevented by holdoff period.
+ *           -3 if Duty cycle budget exceeded
+ *           -4 if Bandwidth Prohibited by Band Plan
+ *           -5 if Tx on Frequency Prohibited by Band Plan
+ *
+ *  ToDo: If time since last TX is > ~ 25 days then holdoff function may break?
+ *  
+ */
+int SX1276::
+TX (char *  datain,     // Array of chars to transmit
+    size_t  datalen)    // Length of array (number of chars to transmit)
+{
+    uint32_t txtime;
+    uint32_t loadtime;
+    uint8_t  done;
+    int      ret;
+    TRACE_SCOPE(TRACE_TX, datalen);
+    ReplyRelease(); // FIFO TX region is about to be overwritten
+    ret = TXCheck(datalen);
+    if (ret < 0)
+    {
+      return ret;
+    }
+    SetMode(SX1276_MODE_STDBY); 
+    PayloadLength(datalen); // write payload length (bytes)
+    FifoAddrPtr(FifoTxBaseAddr()); 
+    
+    // push data onto FIFO in a single burst
+    loadtime = micros();
+    spi_burst_tx(RegFifo, (const uint8_t *) datain, datalen);
+    ClearFlags();
+    txtime = millis(); 
+    SetMode(SX1276_MODE_TX); 
+    DEBUG (DLOG_TX, "Txing..");
+
+    // Monitor IRQ flags and wait until TxDone Flag is set or timeout reached
+    while ((done = TxDone()) == 0 && (uint32_t) (millis() - txtime) < TIMEOUT_DEFAULT ) {
+      TRACE_SCOPE(TRACE_WAIT, 10000);
+      delay(10);
+    }
+    if (done) TRACE_INSTANT(TRACE_IRQ, 0x08); // not on timeout
+    if (_Latency && done) _Latency->Record(LATENCY_TX, (micros() - loadtime) * 1000ULL);
+    else if (_Latency) _Latency->Timeout(LATENCY_TX);
+    txtime = millis() - txtime;
+    TxStandby(done);
+    TxTimer(txtime); 
+    _TXHoldUntil = millis() + txtime * _TXHoldoff;
+    TxDone(1); // clear TxDone flag
+    DEBUG (DLOG_TX, "TX Done.");
+    SetMode(SX1276_MODE_STDBY); // set LORA mode, STBY
+    if (_TxPowerClamped)
+    {
+      PowerDBm(_TxPowerDBm);
+    }
+    return txtime;
+}
+
+/*  TXBurst
+ *  Transmit a sequence of frames back to back.
+ *  datain[n] / datalen[n] give each frame, as for TX().
+ *  The band plan, power and bandwidth checks are made once for the whole burst.
+ *  As many frames as fit are packed into the 256 byte FIFO in one SPI transaction
+ *  (the FIFO can only be filled in Standby), then each frame is sent by moving
+ *  FifoTxBaseAddr and PayloadLength and re-entering TX as soon as TxDone is seen.
+ *  The modem drops to Standby by itself on TxDone, so while waiting for a holdoff
+ *  period it is parked in FSTX to keep the synthesizer locked for the next frame.
+ *  Holdoff and duty cycle are still applied to every frame.
+ *  The mean gap between TxDone and the next TX request is available from BurstGapUs().
+ *  A frame whose TxDone times out is charged to the duty cycle as TX() does, but not
+ *  counted as sent; BurstTimeouts() gives how many did. FifoTxBaseAddr is restored on exit.
+ *
+ *  Returns: Number of frames transmitted (stops early if the duty cycle budget runs out)
+ *           Negative TX error code if no frame could be sent, -3 if none completed.
+ */
+int SX1276::
+TXBurst (char **  datain,     // Array of frames to transmit
+         size_t * datalen,    // Length of each frame
+         int      count)      // Number of frames
+{
+    uint8_t  offset[256];
+    uint8_t  fifo[256];
+    uint32_t txtime;
+    uint32_t txdone = 0;
+    uint32_t gaptotal = 0;
+    uint8_t  done;
+    int      gaps = 0;
+    int      sent = 0;
+    int      first, last, n;
+    size_t   used;
+    uint8_t  txbase;
+    int      ret;
+    TRACE_SCOPE(TRACE_TX_BURST, count);
+
+    if (count <= 0)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: No frames to TX");
+      return -1;
+    }
+    for (n = 0; n < count; n++)
+    {
+      if (datalen[n] == 0 || datalen[n] > 255) {
+        DEBUG_WARN (DLOG_TX, "Error TX data too long");
+        return -1;
+      }
+    }
+    ReplyRelease(); // FIFO TX region is about to be overwritten
+    ret = TXCheck(datalen[0]);
+    if (ret < 0)
+    {
+      return ret;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    txbase = FifoTxBaseAddr(); // moved per frame, put back afterwards
+    _BurstTimeouts = 0;
+    first = 0;
+    while (first < count)
+    {
+      /* Pack as many frames as will fit into the FIFO */
+      used = 0;
+      for (last = first; last < count && used + datalen[last] <= sizeof(fifo); last++)
+      {
+        offset[last - first] = used;
+        memcpy(fifo + used, datain[last], datalen[last]);
+        used += datalen[last];
+      }
+      SetMode(SX1276_MODE_STDBY);
+      FifoAddrPtr(0);
+      spi_burst_tx(RegFifo, fifo, used);
+      SetMode(SX1276_MODE_FSTX); // lock synthesizer while the first frame is set up
+
+      for (n = first; n < last; n++)
+      {
+        if (TxTimer() < 0)
+        {
+          DEBUG_WARN (DLOG_TX, "Error: TX Time limit exceeded"); 
+          first = count;
+          break;
+        }
+        spi_tx(RegFifoTxBaseAddr, offset[n - first]);
+        spi_tx(RegPayloadLength, datalen[n]);
+        while ((int32_t) (_TXHoldUntil - millis()) > 0)
+        {
+          TRACE_SCOPE(TRACE_WAIT, 100);
+          delayMicroseconds(100);
+        }
+        spi_tx(RegIrqFlags, 0xFF);
+        txtime = micros();
+        if (sent > 0 && txdone != 0)
+        {
+          gaptotal += txtime - txdone;
+          gaps++;
+        }
+        SetMode(SX1276_MODE_TX);
+        DEBUG (DLOG_TX, "Txing burst frame %d..", n);
+
+        // Monitor TxDone flag, polling finely so the next frame follows quickly
+        while ((done = spi_rx(RegIrqFlags) & 0x08) == 0 && (uint32_t) (micros() - txtime) < TIMEOUT_DEFAULT * 1000UL) {
+          TRACE_SCOPE(TRACE_WAIT, 100);
+          delayMicroseconds(100);
+        }
+        if (done) TRACE_INSTANT(TRACE_IRQ, 0x08);
+        txdone = micros();
+        if (_Latency && done) _Latency->Record(LATENCY_TX, (txdone - txtime) * 1000ULL);
+        else if (_Latency) _Latency->Timeout(LATENCY_TX);
+        TxStandby(done);
+        txtime = (txdone - txtime + 999) / 1000; // round up so the duty cycle is not underestimated
+        TxTimer(txtime);
+        _TXHoldUntil = millis() + txtime * _TXHoldoff;
+        if (done)
+        {
+          sent++;
+        }
+        else
+        {
+          DEBUG_WARN (DLOG_TX, "Error: TxDone timeout on burst frame %d", n);
+          _BurstTimeouts++;
+        }
+        if (_TXHoldoff != 0 && n + 1 < count)
+        {
+          SetMode(SX1276_MODE_FSTX); // keep synthesizer locked during holdoff
+        }
+      }
+      if (first < count)
+      {
+        first = last;
+      }
+    }
+    spi_tx(RegIrqFlags, 0xFF);
+    SetMode(SX1276_MODE_STDBY);
+    FifoTxBaseAddr(txbase);
+    if (_TxPowerClamped)
+    {
+      PowerDBm(_TxPowerDBm);
+    }
+    _BurstGapUs = gaps ? gaptotal / gaps : 0;
+    DEBUG (DLOG_TX, "TX Burst Done. %d frames, %u timeouts, mean gap %uus", sent, _BurstTimeouts, _BurstGapUs);
+    if (sent == 0)
+    {
+      return -3;
+    }
+    return sent;
+}
+
+/*  BurstGapUs
+ *  Returns: Mean time in us between TxDone and the next TX request during the last TXBurst().
+ */
+uint32_t SX1276::
+BurstGapUs ()
+{
+    return _BurstGapUs;
+}
+
+/*  BurstTimeouts
+ *  Returns: Number of frames in the last TXBurst() whose TxDone timed out.
+ */
+uint32_t SX1276::
+BurstTimeouts ()
+{
+    return _BurstTimeouts;
+}
+
+
+/*  StageReply
+ *  Load a reply (e.g. an ACK) into the FIFO ahead of time, ready for RXReply().
+ *  The FIFO is split so received packets (0x00-0x7F) can't overwrite the reply (0x80-0xFF),
+ *  which limits both received packets and the reply to 128 bytes.
+ *  The band plan, length and power checks are made here, and mode changes use the cached
+ *  RegOpMode (see SetMode), so RXReply() needs no configuration reads between RxDone and TX.
+ *  Staging sends nothing, so holdoff and duty cycle are left to RXReply(): a reply can be
+ *  staged straight after the last one was sent.
+ *  The reply is used by the next RXReply(), or dropped by TX(), TXBurst() or another
+ *  receive call. Either way the FIFO split, the payload lengths and any reduction of
+ *  the power to the band plan limit are then undone (see ReplyRelease).
+ *
+ *  Returns: 0 on success
+ *           Negative TX error code if the reply could not be staged.
+ */
+int SX1276::
+StageReply (char *  datain,     // Array of chars to reply with
+            size_t  datalen)    // Length of reply. 128 bytes max.
+{
+    int ret;
+    ReplyRelease();
+    if (datalen > 0x80)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: Reply too long");
+      return -1;
+    }
+    ret = TXCheck(datalen, 0);
+    if (ret < 0)
+    {
+      return ret;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    spi_burst_rx(RegFifoTxBaseAddr, _ReplyRegs, 2);   // and RegFifoRxBaseAddr
+    spi_burst_rx(RegPayloadLength, _ReplyRegs + 2, 2); // and RegMaxPayloadLength
+    _ReplyPower = _TxPowerClamped ? _TxPowerDBm : -99;
+    FifoRxBaseAddr(0x00);
+    FifoTxBaseAddr(0x80);
+    PayloadMaxLength(0x80);
+    FifoAddrPtr(0x80);
+    spi_burst_tx(RegFifo, (const uint8_t *) datain, datalen);
+    PayloadLength(datalen);
+    _ReplyLen = datalen;
+    DEBUG (DLOG_TX, "Reply staged. %d bytes", _ReplyLen);
+    return 0;
+}
+
+/*  RXReply
+ *  Receive as RXContinuous(), then answer with the reply loaded by StageReply().
+ *  On RxDone the modem is switched straight to FSTX so the synthesizer locks while
+ *  the payload is read out, then to TX. No configuration registers are read.
+ *  No reply is sent if the packet had a CRC error or if holdoff / duty cycle prevent it.
+ *  The time from seeing RxDone to the TX request is available from ReplyTurnaroundUs().
+ *
+ *  The staged reply is released on return, sent or not, so stage it again for the next call.
+ *
+ *  Returns: Number of bytes received, 0 on timeout, -1 if rxdata was too small
+ *           (as RXContinuous), or -6 if no reply is staged.
+ */
+int SX1276::
+RXReply (char *    rxdata,    //char array to write data to. 
+         size_t    datalen,   //set to sizeof(rxdata).
+         uint16_t  timeout)   //Timeout period in ms. Default: 5000.
+{
+    uint8_t  irq;
+    uint8_t  rxbytes;
+    uint32_t rxdone;
+    uint64_t rxdonens = 0;
+    uint32_t txtime;
+    uint8_t  done;
+    int      ret = 0;
+    uint32_t t = millis() + timeout;
+    TRACE_SCOPE(TRACE_RX_REPLY, timeout);
+
+    _ReplyTurnaroundUs = 0;
+    if (_ReplyLen == 0)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: No reply staged");
+      return -6;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    spi_tx(RegFifoAddrPtr, 0x00);
+    spi_tx(RegIrqFlags, 0xFF);
+    SetMode(SX1276_MODE_RXCONTINUOUS);
+    DEBUG (DLOG_RX, "Rxing for reply..");
+    irq = spi_rx(RegIrqFlags);
+    while ((irq & 0x40) == 0 && (millis() < t || timeout == 0)) {
+      {
+        TRACE_SCOPE(TRACE_WAIT, 100);
+        delayMicroseconds(100);
+      }
+      irq = spi_rx(RegIrqFlags);
+    }
+    if ((irq & 0x40) == 0)
+    {
+      DEBUG (DLOG_RX, "Normal RX Timeout.");
+      SetMode(SX1276_MODE_STDBY);
+      ReplyRelease();
+      return 0;
+    }
+    rxdone = micros();
+    if (_Latency) rxdonens = SX1276Latency::NowNs();
+    TRACE_INSTANT(TRACE_IRQ, irq);
+    SetMode(SX1276_MODE_FSTX); // start PLL lock while reading the payload
+
+    rxbytes = spi_rx(RegRxNbBytes);
+    if (rxbytes > datalen)
+    {
+      ret = -1;
+      rxbytes = datalen;
+    }
+    else ret = rxbytes;
+    spi_tx(RegFifoAddrPtr, spi_rx(RegFifoRxCurrentAddr));
+    spi_burst_rx(RegFifo, (uint8_t *) rxdata, rxbytes);
+    if (_Latency) _Latency->Record(LATENCY_RX, SX1276Latency::NowNs() - rxdonens);
+    if (_Metrics) RxMetrics(irq);
+
+    if ((irq & 0x20) != 0)
+    {
+      DEBUG_WARN (DLOG_TX, "PayloadCrcError. No reply sent.");
+    }
+    else if ((int32_t) (_TXHoldUntil - millis()) > 0 || TxTimer() < 0)
+    {
+      DEBUG_WARN (DLOG_TX, "Error: Holdoff or TX Time limit. No reply sent.");
+    }
+    else
+    {
+      spi_tx(RegIrqFlags, 0xFF);
+      SetMode(SX1276_MODE_TX);
+      txtime = micros();
+      _ReplyTurnaroundUs = txtime - rxdone;
+      while ((done = spi_rx(RegIrqFlags) & 0x08) == 0 && (uint32_t) (micros() - txtime) < TIMEOUT_DEFAULT * 1000UL) {
+        TRACE_SCOPE(TRACE_WAIT, 100);
+        delayMicroseconds(100);
+      }
+      if (done) TRACE_INSTANT(TRACE_IRQ, 0x08);
+      if (_Latency && done) _Latency->Record(LATENCY_TX, (micros() - txtime) * 1000ULL);
+      else if (_Latency) _Latency->Timeout(LATENCY_TX);
+      TxStandby(done);
+      txtime = (micros() - txtime + 999) / 1000;
+      TxTimer(txtime);
+      _TXHoldUntil = millis() + txtime * _TXHoldoff;
+      DEBUG (DLOG_TX, "Reply sent. Turnaround %uus", _ReplyTurnaroundUs);
+    }
+    spi_tx(RegIrqFlags, 0xFF);
+    SetMode(SX1276_MODE_STDBY);
+    ReplyRelease();
+    return ret;
+}
+
+/*  ReplyRelease
+ *  Drop the reply staged by StageReply(), if any, and put back the FIFO base addresses,
+ *  payload lengths and power it changed, so later packets of any length are received.
+ */
+void SX1276::
+ReplyRelease ()
+{
+    if (_ReplyLen == 0)
+    {
+      return;
+    }
+    _ReplyLen = 0;
+    spi_tx(RegFifoTxBaseAddr, _ReplyRegs[0]);
+    spi_tx(RegFifoRxBaseAddr, _ReplyRegs[1]);
+    spi_tx(RegPayloadLength, _ReplyRegs[2]);
+    spi_tx(RegMaxPayloadLength, _ReplyRegs[3]);
+    if (_ReplyPower != -99)
+    {
+      PowerDBm(_ReplyPower);
+    }
+}
+
+/*  ReplyTurnaroundUs
+ *  Returns: Time in us from RxDone being seen to the reply TX request in the last RXReply().
+ *           0 if no reply was sent.
+ */
+uint32_t SX1276::
+ReplyTurnaroundUs ()
+{
+    return _ReplyTurnaroundUs;
+}
+
+
+/*  RXFiltered
+ *  Receive as RXContinuous(), but only deliver packets accepted by filter.
+ *  For each packet only filter->HeaderBytes() bytes are read from FifoRxCurrentAddr
+ *  (none if the length alone rejects it). The rest of the payload is read in one burst
+ *  only if the filter matches. Rejected packets and packets with CRC errors are dropped
+ *  and the modem keeps receiving until a packet matches or timeout is reached.
+ *  Counts of rejected packets and FIFO bytes not read are available from
+ *  FilterRejected() and FilterBytesSaved().
+ *
+ *  Returns: Number of bytes received, 0 on timeout, -1 if rxdata was too small (as RXContinuous)
+ *           or can't hold the filter header bytes.
+ */
+int SX1276::
+RXFiltered (char *    rxdata,    //char array to write data to. 
+            size_t    datalen,   //set to sizeof(rxdata).
+            SX1276PacketFilter *filter, // filter to apply
+            uint16_t  timeout)   //Timeout period in ms. Default: 5000.
+{
+    uint8_t  irq;
+    uint8_t  rxbytes;
+    uint8_t  hdrbytes = filter->HeaderBytes();
+    int      accept;
+    int      ret = 0;
+    uint64_t rxdone = 0;
+    uint32_t t = millis() + timeout;
+    TRACE_SCOPE(TRACE_RX_FILTERED, timeout);
+    ReplyRelease();
+
+    if (hdrbytes > datalen)
+    {
+      DEBUG_WARN (DLOG_RX, "Error: rxdata too small for filter header");
+      return -1;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    FifoAddrPtr(FifoRxBaseAddr()); // set Set FifoPtrAddr to FifoRxBaseAddr
+    ClearFlags();
+    SetMode(SX1276_MODE_RXCONTINUOUS);
+    DEBUG (DLOG_RX, "Rxing filtered..");
+    while (millis() < t || timeout == 0)
+    {
+      irq = spi_rx(RegIrqFlags);
+      if ((irq & 0x40) == 0)
+      {
+        TRACE_SCOPE(TRACE_WAIT, 3000);
+        delay(3); // stop cpu hogging
+        continue;
+      }
+      TRACE_INSTANT(TRACE_IRQ, irq);
+      if (_Latency) rxdone = SX1276Latency::NowNs();
+      spi_tx(RegIrqFlags, irq); // only the flags read, as RXContPoll
+      if (_Metrics) RxMetrics(irq);
+      rxbytes = spi_rx(RegRxNbBytes);
+      if (irq & 0x20)
+      {
+        DEBUG_WARN (DLOG_RX, "PayloadCrcError. Packet dropped.");
+        continue;
+      }
+      accept = filter->Match(NULL, rxbytes); // length check needs no FIFO reads
+      if (accept)
+      {
+        spi_tx(RegFifoAddrPtr, spi_rx(RegFifoRxCurrentAddr));
+        spi_burst_rx(RegFifo, (uint8_t *) rxdata, hdrbytes);
+        accept = filter->Match((uint8_t *) rxdata, rxbytes);
+        if (!accept)
+        {
+          _FilterBytesSaved += rxbytes - hdrbytes;
+        }
+      }
+      else
+      {
+        _FilterBytesSaved += rxbytes;
+      }
+      if (!accept)
+      {
+        _FilterRejected++;
+        DEBUG (DLOG_RX, "Packet filtered. %d bytes", rxbytes);
+        continue;
+      }
+      if (rxbytes > datalen)
+      {
+        ret = -1;
+        rxbytes = datalen;
+      }
+      else ret = rxbytes;
+      spi_burst_rx(RegFifo, (uint8_t *) rxdata + hdrbytes, rxbytes - hdrbytes);
+      DEBUG (DLOG_RX, "RX Success. Rxbytes = %d", rxbytes);
+      break;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    if (_Latency && ret != 0) _Latency->Record(LATENCY_RX, SX1276Latency::NowNs() - rxdone);
+    return ret;
+}
+
+uint32_t SX1276::FilterRejected()
+{ return _FilterRejected; }
+
+uint32_t SX1276::FilterBytesSaved()
+{ return _FilterBytesSaved; }
+
+/*  TimeOnAirMs
+ *  Calculate the time on air of a packet with payloadlen bytes, using the current
+ *  SF, Bandwidth, Coding Rate, Preamble, Header mode, CRC and LowDataRateOptimize settings.
+ *  The modem config registers 0x1D-0x26 are read in one burst.
+ *  Returns: Time on air in ms, rounded up.
+ */
+uint32_t SX1276::
+TimeOnAirMs (uint8_t payloadlen) // Payload length in bytes
+{
+    return TimeOnAirMs(&payloadlen, 1);
+}
+
+/*  TimeOnAirMs
+ *  As above, for count packets of payloadlens[0] .. payloadlens[count-1] bytes,
+ *  reading the registers once.
+ *  Returns: Total time on air in ms, each packet rounded up.
+ */
+uint32_t SX1276::
+TimeOnAirMs (const uint8_t * payloadlens, // Payload lengths in bytes
+             uint8_t         count)       // Number of packets
+{
+    uint8_t  cfg[10]; // RegModemConfig1 .. RegModemConfig3
+    uint32_t total = 0;
+
+    spi_burst_rx(RegModemConfig1, cfg, sizeof(cfg));
+    for (uint8_t n = 0; n < count; n++)
+    {
+      total += AirtimeMs(cfg[1] >> 4,                   // SpreadingFactor
+                         cfg[0] >> 4,                   // Bw
+                         (cfg[0] >> 1) & 0x07,          // CodingRate
+                         cfg[RegPreambleMsb - RegModemConfig1] * 0x100 + cfg[RegPreambleLsb - RegModemConfig1],
+                         cfg[0] & 0x01,                 // ImplicitHeaderModeOn
+                         (cfg[1] >> 2) & 0x01,          // RxPayloadCrcOn
+                         (cfg[RegModemConfig3 - RegModemConfig1] >> 3) & 0x01, // LowDataRateOptimize
+                         payloadlens[n]);
+    }
+    return total;
+}
+
+/*  AirtimeMs
+ *  Calculate the time on air of a packet for the given settings, per Semtech AN1200.13.
+ *  Settings use the register encoding: sf 6-12, bw as Bw(), cr as CodingRate() (1 = 4/5).
+ *  Returns: Time on air in ms, rounded up.
+ */
+uint32_t SX1276::
+AirtimeMs (uint8_t  sf,         // SpreadingFactor
+           uint8_t  bw,         // Bw code
+           uint8_t  cr,         // CodingRate
+           uint16_t preamble,   // PreambleLength
+           uint8_t  ih,         // ImplicitHeaderModeOn
+           uint8_t  crc,        // RxPayloadCrcOn
+           uint8_t  ldro,       // LowDataRateOptimize
+           uint8_t  payloadlen) // Payload length in bytes
+{
+    uint32_t tsym;    // Symbol time in us * 16
+    int32_t  n;
+
+    if (bw > 9) bw = 9;
+    if (sf < 6) sf = 6;
+    if (sf > 12) sf = 12;
+    if (cr < 1) cr = 1;
+
+    tsym = ((uint64_t) 16000000 << sf) / SX1276_BW_HZ[bw];
+    n = 8 * payloadlen - 4 * sf + 28 + 16 * crc - 20 * ih;
+    n = (n + 4 * (sf - 2 * ldro) - 1) / (4 * (sf - 2 * ldro));  // ceil
+    if (n < 0) n = 0;
+    n = 8 + n * (cr + 4);
+    /* preamble + 4.25 symbols, plus payload symbols, all in 1/16 us */
+    return (uint32_t) (((uint64_t) tsym * (preamble * 4 + 17) / 4 + (uint64_t) tsym * n + 15999) / 16000);
+}
+
+/*  ModemConfig
+ *  Set Spreading Factor, Bandwidth, Coding Rate and Power together, in Standby,
+ *  so no packet is sent or received with a mix of old and new settings.
+ *  RegModemConfig1/2 are written in one burst, keeping the header, CRC and
+ *  SymbTimeout bits. LowDataRateOptimize is set if the symbol time is 16ms or more,
+ *  and the IF errata settings are applied as BwHz().
+ *  The modem is left in Standby.
+ *
+ *  Returns: 0 on success
+ *           -1 if a setting is out of range. No changes are made.
+ */
+int SX1276::
+ModemConfig (uint8_t sf,    // Spreading Factor 6-12
+             int32_t bwhz,  // Bandwidth in Hz, as BwHz()
+             uint8_t cr,    // Coding Rate 1-4 (4/5 - 4/8)
+             int8_t  power) // Power in dBm, as PowerDBm()
+{
+    uint8_t cfg[2];
+    uint8_t bw;
+    uint8_t ldro;
+
+    for (bw = 0; bw < SX1276_BW_CODES && SX1276_BW_HZ[bw] != bwhz; bw++);
+    if (bw == SX1276_BW_CODES || sf < 6 || sf > 12 || cr < 1 || cr > 4)
+    {
+      DEBUG_WARN (DLOG_CONFIG, "ModemConfig Error: Invalid setting");
+      return -1;
+    }
+    SetMode(SX1276_MODE_STDBY);
+    spi_burst_rx(RegModemConfig1, cfg, 2);
+    cfg[0] = (bw << 4) | (cr << 1) | (cfg[0] & 0x01);
+    cfg[1] = (sf << 4) | (cfg[1] & 0x0F);
+    spi_burst_tx(RegModemConfig1, cfg, 2);
+    ldro = ((1000000UL << sf) / SX1276_BW_HZ[bw]) >= 16000;
+    LowDataRateOptimize(ldro);
+    BwErrata(bw);
+    PowerDBm(power);
+    return 0;
+}
+
+/*  PacketInfo
+ *  Fill in the metadata of the last packet received (everything except timeUs and data).
+ *  pkt->len is set from FifoRxBytesNb. Registers 0x12-0x1E are read in one burst,
+ *  so this takes three SPI transactions in all (with Frf and SyncWord).
+ *  Returns: 0
+ */
+int SX1276::
+PacketInfo (SX1276Packet *pkt) // Packet to fill in
+{
+    uint8_t r[RegModemConfig2 - RegIrqFlags + 1];
+    spi_burst_rx(RegIrqFlags, r, sizeof(r));
+    pkt->crcError = (r[0] >> 5) & 0x01;
+    pkt->implicitHeader = r[RegModemConfig1 - RegIrqFlags] & 0x01;
+    if (pkt->implicitHeader) // No header to say: the receiver's setting applies
+      pkt->crcOn = (r[RegModemConfig2 - RegIrqFlags] >> 2) & 0x01;
+    else
+      pkt->crcOn = (r[RegHopChannel - RegIrqFlags] >> 6) & 0x01;
+    pkt->len = r[RegRxNbBytes - RegIrqFlags];
+    pkt->cr = r[RegModemStat - RegIrqFlags] >> 5;
+    pkt->snr = (int8_t) r[RegPktSnrValue - RegIrqFlags];
+    pkt->rssi = RssiDbm(r[RegPktSnrValue - RegIrqFlags], r[RegPktRssiValue - RegIrqFlags]);
+    pkt->bw = r[RegModemConfig1 - RegIrqFlags] >> 4;
+    pkt->sf = r[RegModemConfig2 - RegIrqFlags] >> 4;
+    spi_burst_rx(RegFrMsb, r, 3);
+    pkt->frequency = (uint64_t) (r[0] * 0x10000 + r[1] * 0x100 + r[2]) * 61035 / 1000; // Assumes 32Mhz Oscillator
+    pkt->syncWord = SyncWord();
+    return 0;
+}
+
+/*  Snapshot
+ *  Read registers SNAPSHOT_FIRST to SNAPSHOT_LAST into snap in one SPI burst, to
+ *  decode any number of fields from (see SX1276Snapshot.h).
+ *  Returns: 0
+ */
+int SX1276::
+Snapshot (SX1276Snapshot *snap)
+{
+    snap->reg[0] = 0;
+    spi_burst_rx(SNAPSHOT_FIRST, snap->reg + SNAPSHOT_FIRST, SNAPSHOT_LEN);
+    _RegOpMode = snap->reg[RegOpMode];
+    ModeEntered(_RegOpMode & 7);
+    if (snap != &_Regs) _Regs = *snap;
+    _RegsValid = 1;
+    return 0;
+}
+
+/*  Apply
+ *
+ *  Configure the modem as profile (see SX1276Profile.h). Only the registers that
+ *  differ from the copy kept of the modem's are written, in bursts, so switching
+ *  profiles takes one or two transactions. The first Apply() after a reset reads the
+ *  copy with Snapshot(). The band plan's limits are set for the profile's frequency.
+ *  Returns: number of registers changed, or -1 if the profile is invalid.
+ */
+int SX1276::
+Apply (const SX1276Profile *profile)
+{
+    uint8_t want[SNAPSHOT_LAST + 1];
+    uint8_t opmode;
+    int     changed;
+
+    if (!profile->valid)
+    {
+      DEBUG_WARN (DLOG_CONFIG, "Apply Error: Invalid profile");
+      return -1;
+    }
+    if (!_RegsValid) Snapshot(&_Regs);
+    SetMode(SX1276_MODE_STDBY);
+    memcpy(want, _Regs.reg, sizeof(want));
+    for (int r = RegFrMsb; r < PROFILE_REGS; r++)
+    {
+      want[r] = (want[r] & ~profile->mask[r]) | profile->value[r];
+    }
+    changed = WriteConfig(want, _Regs.reg);
+    opmode = (_RegOpMode & ~profile->mask[RegOpMode]) | profile->value[RegOpMode];
+    if (opmode != _RegOpMode)
+    {
+      spi_tx(RegOpMode, opmode);
+      changed++;
+    }
+    if (changed) _TxConfigDirty = 1;
+    BandLimits(profile->freq);
+    return changed;
+}
+
+/*  PacketSnrDb
+ *  Returns: SNR of the last packet received in dB.
+ */
+float SX1276::
+PacketSnrDb ()
+{
+    return (int8_t) PacketSnr() / 4.0;
+}
+
+/*  PacketRssiDbm
+ *  RSSI of the last packet received in dBm, per datasheet 5.5.5.
+ *  PacketSnr and PacketRssi are read in one burst.
+ *  Returns: RSSI in dBm.
+ */
+int16_t SX1276::
+PacketRssiDbm ()
+{
+    uint8_t  val[2]; // RegPktSnrValue, RegPktRssiValue
+    spi_burst_rx(RegPktSnrValue, val, 2);
+    return RssiDbm(val[0], val[1]);
+}
+
+/*  RssiDbm
+ *  Convert PacketSnr and PacketRssi register values to RSSI in dBm.
+ *  LowFrequencyModeOn (from the cached RegOpMode) selects the LF port offset.
+ */
+int16_t SX1276::
+RssiDbm (uint8_t snr,  // PacketSnr
+         uint8_t rssi) // PacketRssi
+{
+    int16_t offset = ((_RegOpMode >> 3) & 1) ? -164 : -157;
+    if ((int8_t) snr < 0)
+    {
+      return offset + rssi + (int8_t) snr / 4;
+    }
+    return offset + rssi * 16 / 15;
+}
+
+/*  DutyBudgetMs
+ *  Returns: TX time in ms still available in the current duty cycle window (see TxTimer).
+ */
+int32_t SX1276::
+DutyBudgetMs ()
+{
+    int32_t used = TxTimer();
+    if (used < 0)
+    {
+      return 0;
+    }
+    return (int32_t) _DutyCycleMsHour - used;
+}
+
+/*  DutyCycleMsHour
+ *  Returns: TX time in ms allowed an hour on the current frequency by the band plan.
+ */
+uint32_t SX1276::
+DutyCycleMsHour ()
+{
+    return _DutyCycleMsHour;
+}
+
+/*  SetMode
+ *  Change operating mode. In LoRa mode any mode can be requested from any other
+ *  (see SX1276ModeState), so this is a single RegOpMode write. The current mode and the
+ *  rest of RegOpMode are cached, so no write at all is made if the modem is already
+ *  in the target mode.
+ *  Returns: Number of RegOpMode writes made.
+ */
+int SX1276::
+SetMode (uint8_t target) // SX1276_MODE_xxx
+{
+    uint64_t start = 0;
+    if (!_ModeState.Request(target))
+    {
+      return 0;
+    }
+    if (_Latency) start = SX1276Latency::NowNs();
+    spi_tx(RegOpMode, (_RegOpMode & 0xF8) | (target & 7));
+    if (start) _Latency->Record(LATENCY_MODE, SX1276Latency::NowNs() - start);
+    return 1;
+}
+
+/*  ModeState
+ *  Returns: The mode state machine, for transition counts and time spent in each mode.
+ */
+SX1276ModeState * SX1276::
+ModeState ()
+{
+    return &_ModeState;
+}
+
+/*  Metrics
+ *  Count packets, errors, airtime, SPI traffic and mode transitions in metrics
+ *  (see SX1276Metrics.h). NULL stops counting. metrics is not owned by the radio.
+ *  With metrics attached each RxDone costs one extra 4 byte SPI burst, for the
+ *  ValidHeaderCnt / ValidPacketCnt registers.
+ */
+void SX1276::
+Metrics (SX1276Metrics *metrics)
+{
+    _Metrics = metrics;
+    _TxConfigDirty = 1; // re-read the frequency for airtime by sub-band
+}
+
+/*  Latency
+ *  Record SPI, TX, RX, CAD and mode change latency in latency (see SX1276Latency.h).
+ *  NULL stops recording. latency is not owned by the radio.
+ */
+void SX1276::
+Latency (SX1276Latency *latency)
+{
+    _Latency = latency;
+}
+
+/*  BusRecorder
+ *  Record every SPI transaction in recorder (see SX1276BusRecorder.h). NULL stops
+ *  recording. recorder is not owned by the radio.
+ */
+void SX1276::
+BusRecorder (SX1276BusRecorder *recorder)
+{
+    _Bus = recorder;
+}
+
+/*  SpiClock
+ *
+ *  Change the SPI clock, as set by the constructor's spiClk.
+ *  Returns: the clock in Hz, or -1 if the bus could not be set up at hz.
+ */
+int SX1276::
+SpiClock (int hz) // [Optional] New SPI clock in Hz
+{
+    if (hz == 0) return _spiClk;
+    if (_Spi.Clock(hz) != 0)
+    {
+      DEBUG_WARN (DLOG_INIT, "SPI Error: Can't set clock");
+      return -1;
+    }
+    _spiClk = hz;
+    return _spiClk;
+}
+
+/*  SpiCheck
+ *
+ *  Check the bus at the current clock: RegVersion, write/readback of bit patterns
+ *  on RegFifoAddrPtr, and a 256 byte pseudo-random FIFO burst written and read back,
+ *  rounds times. Only the FIFO and its pointer are written. Leaves the modem in
+ *  standby, as the FIFO needs.
+ *  Returns: number of bytes that read back wrong, 0 if the bus is clean.
+ */
+int SX1276::
+SpiCheck (int rounds) // [Optional] Default: SPI_TUNE_ROUNDS
+{
+    static const uint8_t pattern[] = {0x00, 0xFF, 0x55, 0xAA, 0x01, 0x02, 0x04, 0x08,
+                                      0x10, 0x20, 0x40, 0x80};
+    uint8_t  out[256];
+    uint8_t  in[256];
+    uint16_t lfsr;
+    int      errors = 0;
+
+    SetMode(SX1276_MODE_STDBY);
+    for (int r = 0; r < rounds; r++)
+    {
+      if (spi_rx(RegVersion) != 0x12) errors++;
+      for (size_t p = 0; p < sizeof(pattern); p++)
       {
-        _TXwindowTime[p] = _TXwindowTime[p-1];
+        spi_tx(RegFifoAddrPtr, pattern[p]);
+        if (spi_rx(RegFifoAddrPtr) != pattern[p]) errors++;
+      }
+      lfsr = 0xACE1 + r;
+      for (int n = 0; n < 256; n++)
+      {
+        lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+        out[n] = lfsr;
+      }
+      spi_tx(RegFifoAddrPtr, 0);
+      spi_burst_tx(RegFifo, out, 256);
+      spi_tx(RegFifoAddrPtr, 0);
+      spi_burst_rx(RegFifo, in, 256);
+      for (int n = 0; n < 256; n++)
+      {
+        if (in[n] != out[n]) errors++;
       }
-      //zero most recent window
-      _TXwindowTime[0]=0;
-      //shift windows by 1/10 hour
-      _TXTimerWindowRef += 360000; // 3600ms(debug). Should be 360000ms (360s or 1/10 hour)
     }
-  }
-  _TXwindowTime[0]+=TXTimeToAdd;
-
- /*  Calculate _TXTimer */
-  _TxTimerMs=0;
-  for (p=0;p<10;p++)
-  {
-     //DEBUG ("_TXwindowTime[%d]=%d\n",p,_TXwindowTime[p]);
-    _TxTimerMs += _TXwindowTime[p];
-  }
-
- /* if we have exceeded our quota */
-  if (_TxTimerMs >= _DutyCycleMsHour)
-  {
-     DEBUG ("TXTimer Error: Quota Exceeded");
-     return -1;
-  }
-  return _TxTimerMs;
+    return errors;
 }
 
-/*  TX 
- *  Transmit string of characters.
- *  If no new frequency is provided, the previous Frequency in Hz is returned
- *  If the transmission failed, -1 is returned
- *  If the transmission was successful, the transmission duration in ms is returned
- *  String length limit is 255 bytes
- *  TX Frequency, SF, Bandwidth, Power, CRC, Header mode, and Coding Rate must be set using:
- *  Frequency(), SpreadingFactor(), BandwidthHz, PowerDBm() RxPayloadCrcOn(), 
- *  ImplicitHeaderModeOn(), and CodingRate().
- *  
- *  Returns: Time taken to TX in ms on success
- *           -1 if data to TX is too long
- *           -2 if prevented by holdoff period.
- *           -3 if Duty cycle budget exceeded
- *           -4 if Bandwidth Prohibited by Band Plan
- *           -5 if Tx on Frequency Prohibited by Band Plan
+/*  TuneSpi
  *
- *  ToDo: If time since last TX is > ~ 25 days then holdoff function may break?
- *  
+ *  Find the fastest SPI clock the board's wiring takes. The clock steps up through
+ *  SpiTuneHz, up to maxHz, until SpiCheck() finds an error. The clock one step below
+ *  the fastest clean one is kept, for margin, or the fastest if none failed. The
+ *  registers are snapshot at the starting clock and any a failing step disturbed
+ *  are written back. Keep the result, and pass it as the constructor's spiClk.
+ *  errors, if given, gets SpiCheck()'s result for each step, -1 for steps not tried.
+ *  Returns: the clock chosen in Hz, or -1 if no clock was clean.
  */
 int SX1276::
-TX (char *  datain,     // Array of chars to transmit
-    size_t  datalen)    // Length of array (number of chars to transmit)
+TuneSpi (int  maxHz,   // [Optional] Default: SPI_TUNE_MAX_HZ
+         int  rounds,  // [Optional] Default: SPI_TUNE_ROUNDS
+         int *errors)  // [Optional] SPI_TUNE_STEPS counts
 {
-    uint32_t txtime;
-    int      tempPowerDBm;
-    tempPowerDBm = PowerDBm();
-    if (_TXPowerLimit <= -99) // If Tx prohibited on this freq by Band Plan
+    SX1276Snapshot saved;
+    SX1276Snapshot now;
+    int start = _spiClk;
+    int passed = -1;
+    int best;
+    int step;
+    int e;
+
+    for (step = 0; errors != NULL && step < SPI_TUNE_STEPS; step++) errors[step] = -1;
+    Snapshot(&saved);
+    for (step = 0; step < SPI_TUNE_STEPS && SpiTuneHz[step] <= maxHz; step++)
     {
-      DEBUG ("Error: TX Frequency not in band.");      
-      return -5;
+      if (SpiClock(SpiTuneHz[step]) < 0) break;
+      e = SpiCheck(rounds);
+      if (errors != NULL) errors[step] = e;
+      DEBUG (DLOG_INIT, "TuneSpi: %d Hz, %d errors", SpiTuneHz[step], e);
+      if (e != 0) break;
+      passed = step;
     }
-    if (Bw() > _BWLimit)
+    best = passed;
+    if (passed > 0 && step < SPI_TUNE_STEPS && SpiTuneHz[step] <= maxHz)
     {
-      DEBUG ("Error: BW Limit Exceeded.");
-      return -4;
-    }
-    if (datalen == 0 || datalen > 255) {
-      DEBUG ("Error TX data too long");
-      return -1;
+      best = passed - 1;
     }
-    if  ((int32_t) (_TXHoldUntil - millis()) > 0)
+    if (best < 0 || SpiClock(SpiTuneHz[best]) < 0 || SpiCheck(rounds) != 0)
     {
-      DEBUG ("Error: Holdoff"); 
-      return -2;
+      DEBUG_WARN (DLOG_INIT, "TuneSpi Error: No clean SPI clock");
+      SpiClock(start);
+      return -1;
     }
-    if (TxTimer() < 0)
+    Snapshot(&now);
+    WriteConfig(saved.reg, now.reg);
+    return SpiTuneHz[best];
+}
+
+/*  ModeEntered
+ *  Record that the modem is now in mode: the mode state machine, metrics, and the
+ *  modem clearing its header and packet counts on entering RX.
+ */
+void SX1276::
+ModeEntered (uint8_t mode)
+{
+    uint8_t from = _ModeState.Current();
+    if (mode != from)
     {
-      DEBUG ("Error: TX Time limit exceeded"); 
-      return -3;
+      TRACE_INSTANT(TRACE_MODE, from << 8 | mode);
+      if (_Metrics) _Metrics->Transition(from, mode);
+      if ((mode == SX1276_MODE_RXCONTINUOUS || mode == SX1276_MODE_RXSINGLE) &&
+          from != SX1276_MODE_RXCONTINUOUS && from != SX1276_MODE_RXSINGLE)
+      {
+        _RxHeaderCnt = 0;
+        _RxPacketCnt = 0;
+      }
     }
-    if (tempPowerDBm > _TXPowerLimit)
+    _ModeState.Enter(mode, SX1276ModeState::NowUs());
+}
+
+/*  TxStandby
+ *  After waiting for TxDone: the modem returns to Standby by itself on TxDone, so if it
+ *  was seen (done) that is only recorded. Otherwise the wait timed out with the modem
+ *  possibly still in TX, so Standby is written, rather than trusting the cached mode.
+ */
+void SX1276::
+TxStandby (uint8_t done) // TxDone flag seen
+{
+    if (done)
     {
-      DEBUG ("Warning: TX Power %ddB Exceeds Limit of %ddB. Power reduced", PowerDBm(), _TXPowerLimit)
-      PowerDBm(_TXPowerLimit);
+      ModeEntered(SX1276_MODE_STDBY);
+      return;
     }
-    Mode(SX1276_MODE_STDBY); 
-    PayloadLength(datalen); // write payload length (bytes)
-    FifoAddrPtr(FifoTxBaseAddr()); 
-    
-    // push data byte onto FIFO one byte at a time
-    for (int x = 0; x < datalen; x++) {
-      Fifo(datain[x]);
-    }
-    ClearFlags();
-    txtime = millis(); 
-    Mode(SX1276_MODE_TX); 
-    DEBUG ("Txing..");
+    DEBUG_WARN (DLOG_TX, "Error: TxDone timeout");
+    spi_tx(RegOpMode, (_RegOpMode & 0xF8) | SX1276_MODE_STDBY);
+}
 
-    // Monitor IRQ flags and wait until TxDone Flag is set or timeout reached
-    while (TxDone() == 0 && (uint32_t) (millis() - txtime) < TIMEOUT_DEFAULT ) {
-      delay(10);
-    }
-    txtime = millis() - txtime;
-    TxTimer(txtime); 
-    _TXHoldUntil = millis() + txtime * _TXHoldoff;
-    TxDone(1); // clear TxDone flag
-    DEBUG ("TX Done.");
-    Mode(SX1276_MODE_STDBY); // set LORA mode, STBY
-    PowerDBm(tempPowerDBm);
-    return txtime;
+/*  RxMetrics
+ *  Count a packet received, with IRQ flags irq, and the increase in the modem's
+ *  header and packet counts since the last one.
+ */
+void SX1276::
+RxMetrics (uint8_t irq)
+{
+    uint8_t  c[4];
+    uint16_t headers, packets;
+    spi_burst_rx(RegRxHeaderCntValueMsb, c, 4);
+    headers = c[0] * 0x100 + c[1];
+    packets = c[2] * 0x100 + c[3];
+    _Metrics->RxDone(irq, headers - _RxHeaderCnt, packets - _RxPacketCnt);
+    _RxHeaderCnt = headers;
+    _RxPacketCnt = packets;
 }
 
 
@@ -488,55 +1693,10 @@ Frequency (uint32_t Freq) // [Optional] New Frequency in Hz
   }
   if (Freq < 137e6 || Freq > 1020e6)
   {
-    DEBUG ("Frequency Error: Out of Range");
+    DEBUG_WARN (DLOG_CONFIG, "Frequency Error: Out of Range");
     return -1;
   }
-  if (_BandPlan == BANDPLAN_EU868)     //  EU868
-  {
-    if (Freq >= 863e6 + 62.5e3 && Freq <= 865e6 - 62.5e3) //Band 46a
-    {
-      _TXPowerLimit = 14;            // 25mW
-      _DutyCycleMsHour = 3600;       // 0.1% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else if (Freq >= (865e6 + 62.5e3) && Freq <= (868e6 - 62.5e3)) //Band 47
-    {
-      _TXPowerLimit = 14;            // 25mW
-      _DutyCycleMsHour = 36000;      // 1% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else if (Freq >= (868e6 + 62.5e3) && Freq <= (868.6e6 - 62.5e3)) //Band 48
-    {
-      _TXPowerLimit = 14;            // 25mW
-      _DutyCycleMsHour = 36000;      // 1% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else if (Freq >= (868.7e6 + 62.5e3) && Freq <= (869.2e6 - 62.5e3)) //Band 50
-    {
-      _TXPowerLimit = 14;            // 25mW
-      _DutyCycleMsHour = 3600;       // 0.1% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else if (Freq >= (869.4e6 + 62.5e3) && Freq <= (869.65e6 - 62.5e3)) //Band 54
-    {
-      _TXPowerLimit = 20;            // 100mW
-      _DutyCycleMsHour = 360000;     // 10% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else if (Freq >= (869.7e6 + 62.5e3) && Freq <= (870.e6 - 62.5e3)) //Band 56b
-    {
-      _TXPowerLimit = 20;            // 100mW
-      _DutyCycleMsHour = 36000;      // 1% Duty
-      _BWLimit = 7;                  // 125 Khz Max
-    }
-    else // Outside Band, Disallow TXing 
-    {
-      DEBUG ("Frequency Note: Not in permitted TX Band");
-      _TXPowerLimit = -99;
-      _DutyCycleMsHour = 0;
-      _BWLimit = 0;
-    }
-  }     
+  BandLimits(Freq);
   /*  Set Low frequency mode according to datasheet */
   Frf (round(Freq / 61.035));
    if (Freq < 525000000)
@@ -550,6 +1710,70 @@ Frequency (uint32_t Freq) // [Optional] New Frequency in Hz
   return 0; 
 }
 
+/*  BandLimits
+ *
+ *  Set the TX power, duty cycle and bandwidth limits of the band plan for Freq.
+ */
+void SX1276::
+BandLimits (uint32_t Freq) // Frequency in Hz. Not used without a band plan.
+{
+  if (_BandPlan == BANDPLAN_NONE) // No Band Restrictions
+  {
+    _TXPowerLimit = 20;       // Max
+    _DutyCycleMsHour = 1800000;    // Seconds, 50% Duty
+    _TXHoldoff = 0;           // Allow continuous Trasmission
+    _BWLimit = 9;
+    return;
+  }
+  // EU868 Restrictions ref EN 300 220-2 V3.2.1
+  //_FreqLimitLower = 863e6;   // Lowest Frequency 
+  //_FreqLimitUpper = 870e6;  // Highest Frequency
+  _TXHoldoff = 1;           // Times TX period. Need to find figure for this.
+  if (Freq >= 863e6 + 62.5e3 && Freq <= 865e6 - 62.5e3) //Band 46a
+  {
+    _TXPowerLimit = 14;            // 25mW
+    _DutyCycleMsHour = 3600;       // 0.1% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else if (Freq >= (865e6 + 62.5e3) && Freq <= (868e6 - 62.5e3)) //Band 47
+  {
+    _TXPowerLimit = 14;            // 25mW
+    _DutyCycleMsHour = 36000;      // 1% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else if (Freq >= (868e6 + 62.5e3) && Freq <= (868.6e6 - 62.5e3)) //Band 48
+  {
+    _TXPowerLimit = 14;            // 25mW
+    _DutyCycleMsHour = 36000;      // 1% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else if (Freq >= (868.7e6 + 62.5e3) && Freq <= (869.2e6 - 62.5e3)) //Band 50
+  {
+    _TXPowerLimit = 14;            // 25mW
+    _DutyCycleMsHour = 3600;       // 0.1% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else if (Freq >= (869.4e6 + 62.5e3) && Freq <= (869.65e6 - 62.5e3)) //Band 54
+  {
+    _TXPowerLimit = 20;            // 100mW
+    _DutyCycleMsHour = 360000;     // 10% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else if (Freq >= (869.7e6 + 62.5e3) && Freq <= (870.e6 - 62.5e3)) //Band 56b
+  {
+    _TXPowerLimit = 20;            // 100mW
+    _DutyCycleMsHour = 36000;      // 1% Duty
+    _BWLimit = 7;                  // 125 Khz Max
+  }
+  else // Outside Band, Disallow TXing 
+  {
+    DEBUG_WARN (DLOG_CONFIG, "Frequency Note: Not in permitted TX Band");
+    _TXPowerLimit = -99;
+    _DutyCycleMsHour = 0;
+    _BWLimit = 0;
+  }
+}
+
 
 /*  PowerDBm 
  *   
@@ -617,102 +1841,52 @@ int32_t SX1276::
 BwHz (int32_t BandWidth) //[Optional] New Bandwidth in Hz
 {
   int32_t ret;
+  uint8_t bw;
 
   /* Convert Current Bandwidth to Hz  */
-  switch (Bw())
+  bw = Bw();
+  ret = bw < SX1276_BW_CODES ? SX1276_BW_HZ[bw] : -1;
+  if (BandWidth == 0) // Default: Just return current bandwidth
   {
-    case 0:
-      ret = 7800; 
-      break;
-    case 1:
-      ret = 10400; 
-      break;
-    case 2:
-      ret = 15600; 
-      break;
-    case 3:
-      ret = 20800;
-      break;
-    case 4:
-      ret = 31250;
-      break;
-    case 5:
-      ret = 41700;
-      break;
-    case 6:
-      ret = 62500;
-      break;
-    case 7:
-      ret = 125000;
-      break;
-    case 8:
-      ret = 250000;
-      break;
-    case 9:
-      ret = 500000;
-      break;
-    default: 
-      ret = -1;
+    return ret;
   }
 
   /* Convert Requested Bandwidth from Hz  */
-  switch (BandWidth)
+  for (bw = 0; bw < SX1276_BW_CODES && SX1276_BW_HZ[bw] != BandWidth; bw++);
+  if (bw == SX1276_BW_CODES)
   {
-    case 0: // Default: Just return current bandwidth
-      return ret;
-    case 7800:
-      BandWidth=0; 
-      break;
-    case 10400:
-      BandWidth=1; 
-      break;
-    case 15600:
-      BandWidth=2; 
-      break;
-    case 208003:
-      BandWidth=3; 
-      break;
-    case 31250:
-      BandWidth=4; 
-      break;
-    case 41700:
-      BandWidth=5; 
-      break;
-    case 62500:
-      BandWidth=6; 
-      break;
-    case 125000:
-      BandWidth=7; 
-      break;
-    case 250000:
-      BandWidth=8; 
-      break;
-    case 500000:
-      BandWidth=9; 
-      break;
-    default:
-      DEBUG ("BW Error: Invalid Bandwidth");
-      return -1;
+    DEBUG_WARN (DLOG_CONFIG, "BW Error: Invalid Bandwidth");
+    return -1;
   }
+  BandWidth = bw;
  // if (BandWidth > _BWLimit) BandWidth = _BWLimit; // Move to TX routines
   
   /* Set Bandwidth  */
   Bw(BandWidth);
   
-  /* Per errata note. (Spurious Reception) */
-  if (BandWidth == 0)
+  BwErrata(BandWidth);
+ return ret;
+}
+
+/*  BwErrata
+ *  IF settings for Bandwidth code bw, per errata note. (Spurious Reception)
+ */
+void SX1276::
+BwErrata (uint8_t bw) // Bandwidth code, as Bw()
+{
+  if (bw == 0)
   {
     AutomaticIFOn(0); 
     IfFreq2(0x48);    
     IfFreq1(0x00);    
   }
-  else if (BandWidth < 6) 
+  else if (bw < 6) 
   {
     AutomaticIFOn(0); 
     IfFreq2(0x44);    
     IfFreq1(0x00);    
   }
-  else if (BandWidth < 9) 
+  else if (bw < 9) 
   {
     AutomaticIFOn(0); 
     IfFreq2(0x40);    
@@ -722,7 +1896,6 @@ BwHz (int32_t BandWidth) //[Optional] New Bandwidth in Hz
   {
     AutomaticIFOn(1);    
   }
- return ret;
 }
 
 /*  ClearFlags
@@ -745,14 +1918,231 @@ int SX1276::Reset()
   delay (10);
   pinMode (_ResetPin, INPUT); // Set pin to Hi-Z    
   delay (10);
+  _TxConfigDirty = 1;
+  _RegsValid = 0;
+  _ReplyLen = 0; // the modem's FIFO layout is back to its defaults
   if (Mode() != SX1276_MODE_STDBY)
   {
-    DEBUG ("Reset Error: Modem reset failure");
+    DEBUG_WARN (DLOG_INIT, "Reset Error: Modem reset failure");
+    return -1;
+  }
+  return 0;
+}
+
+/*  SX1276PacketFilter
+ *
+ *  Set up with Length(), AddressOffset()/AddAddress() and MatchByte(), then pass to RXFiltered().
+ *  The filter is kept in compiled form: the address set is a 256 bit map, and the number
+ *  of header bytes needed is updated as rules are added, so Match() is a handful of
+ *  compares and no more of the packet is read than the rules need.
+ */
+SX1276PacketFilter::
+SX1276PacketFilter ()
+{
+  Clear();
+}
+
+void SX1276PacketFilter::Clear()
+{
+  _MinLen = 0;
+  _MaxLen = 255;
+  _HeaderLen = 0;
+  _AddrEnabled = 0;
+  _AddrOffset = 0;
+  memset(_AddrSet, 0, sizeof(_AddrSet));
+  _Rules = 0;
+}
+
+/* Accept only packets with length between min and max bytes inclusive */
+void SX1276PacketFilter::Length(uint8_t min, uint8_t max)
+{ _MinLen = min; _MaxLen = max; }
+
+/* Position of the address byte in the packet */
+void SX1276PacketFilter::AddressOffset(uint8_t offset)
+{
+  _AddrOffset = offset;
+  if (_AddrEnabled && offset + 1 > _HeaderLen) _HeaderLen = offset + 1;
+}
+
+/* Accept packets with this address. Once an address is added, only listed addresses are accepted. */
+void SX1276PacketFilter::AddAddress(uint8_t address)
+{
+  _AddrEnabled = 1;
+  _AddrSet[address >> 5] |= (uint32_t) 1 << (address & 31);
+  if (_AddrOffset + 1 > _HeaderLen) _HeaderLen = _AddrOffset + 1;
+}
+
+/*  MatchByte
+ *  Accept only packets where (packet[offset] & mask) == value.
+ *  Returns 0 on success, -1 if FILTER_MAX_RULES are already set.
+ */
+int SX1276PacketFilter::
+MatchByte (uint8_t offset, // Position of byte in packet
+           uint8_t mask,   // Bits to compare
+           uint8_t value)  // Required value of those bits
+{
+  if (_Rules >= FILTER_MAX_RULES)
+  {
+    DEBUG_WARN (DLOG_RX, "Filter Error: Too many rules");
     return -1;
   }
+  _RuleOffset[_Rules] = offset;
+  _RuleMask[_Rules] = mask;
+  _RuleValue[_Rules] = value & mask;
+  _Rules++;
+  if (offset + 1 > _HeaderLen) _HeaderLen = offset + 1;
   return 0;
 }
 
+/* Number of bytes from the start of a packet the filter needs to see */
+uint8_t SX1276PacketFilter::HeaderBytes()
+{ return _HeaderLen; }
+
+/*  Match
+ *  Returns 1 if a packet of length len, starting with header, is accepted, otherwise 0.
+ *  header must hold HeaderBytes() bytes, or be NULL to check the length only.
+ *  Packets too short to contain a byte a rule refers to are rejected.
+ */
+int SX1276PacketFilter::
+Match (const uint8_t *header, // First HeaderBytes() bytes of packet, or NULL
+       uint8_t        len)    // Packet length
+{
+  if (len < _MinLen || len > _MaxLen || len < _HeaderLen)
+  {
+    return 0;
+  }
+  if (header == NULL)
+  {
+    return 1;
+  }
+  if (_AddrEnabled)
+  {
+    uint8_t a = header[_AddrOffset];
+    if (!(_AddrSet[a >> 5] & ((uint32_t) 1 << (a & 31))))
+    {
+      return 0;
+    }
+  }
+  for (uint8_t r = 0; r < _Rules; r++)
+  {
+    if ((header[_RuleOffset[r]] & _RuleMask[r]) != _RuleValue[r])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*  SX1276ModeState
+ *
+ *  Modes are SX1276_MODE_xxx. In LoRa mode the datasheet (4.1.5 Operating Mode Control,
+ *  Table 16, and the sequences of 4.1.6) puts no order on mode requests: any mode can be
+ *  requested from any other, and the modem goes through frequency synthesis by itself.
+ *  The only constraints are on what else can be done in a mode (LongRangeMode is only
+ *  changed in Sleep, the FIFO only filled in Sleep or Standby), which the callers take
+ *  care of. So every transition is direct, and a single RegOpMode write. Callers that
+ *  want the PLL locked early (RX -> FSTX -> TX) ask for FSTX themselves.
+ *  Automatic transitions made by the modem itself (e.g. TX -> Standby on TxDone) are
+ *  recorded with Enter(), as are modes seen when RegOpMode is read.
+ */
+SX1276ModeState::
+SX1276ModeState ()
+{
+  _Mode = SX1276_MODE_STDBY;
+  ClearCounters(0);
+}
+
+uint8_t SX1276ModeState::Current()
+{ return _Mode; }
+
+/*  Request
+ *  Returns: 1 if RegOpMode has to be written to reach target,
+ *           0 if already in the target mode (counted as a skipped write).
+ */
+int SX1276ModeState::
+Request (uint8_t target) // SX1276_MODE_xxx
+{
+  if ((target & 7) == _Mode)
+  {
+    _Skipped++;
+    return 0;
+  }
+  return 1;
+}
+
+/*  Enter
+ *  Record that the modem is now in mode, at time now (us).
+ */
+void SX1276ModeState::
+Enter (uint8_t  mode, // SX1276_MODE_xxx
+       uint64_t now)  // NowUs()
+{
+  mode &= 7;
+  if (mode == _Mode)
+  {
+    return;
+  }
+  _TimeUs[_Mode] += now - _Since;
+  _Count[_Mode][mode]++;
+  _Mode = mode;
+  _Since = now;
+}
+
+uint32_t SX1276ModeState::Transitions(uint8_t from, uint8_t to)
+{ return _Count[from & 7][to & 7]; }
+
+uint32_t SX1276ModeState::Transitions()
+{
+  uint32_t total = 0;
+  for (int m = 0; m < 8; m++)
+    for (int n = 0; n < 8; n++)
+      total += _Count[m][n];
+  return total;
+}
+
+uint32_t SX1276ModeState::SkippedWrites()
+{ return _Skipped; }
+
+/*  TimeInModeUs
+ *  Returns: Total time spent in mode in us, including the current visit up to now.
+ */
+uint64_t SX1276ModeState::
+TimeInModeUs (uint8_t  mode, // SX1276_MODE_xxx
+              uint64_t now)  // NowUs()
+{
+  mode &= 7;
+  if (mode == _Mode)
+  {
+    return _TimeUs[mode] + (now - _Since);
+  }
+  return _TimeUs[mode];
+}
+
+/*  NowUs
+ *  Returns: Time in us from a 64 bit monotonic clock (the emulator's clock when emulated).
+ */
+uint64_t SX1276ModeState::
+NowUs ()
+{
+#if defined(ESP32)
+  return esp_timer_get_time();
+#elif defined(SX1276_EMULATOR)
+  return SX1276Emulator::NowUs();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+void SX1276ModeState::ClearCounters(uint64_t now)
+{
+  memset(_Count, 0, sizeof(_Count));
+  memset(_TimeUs, 0, sizeof(_TimeUs));
+  _Skipped = 0;
+  _Since = now;
+}
+
 /* Direct Parameter Read/Write Functions
  *  
  *  See SX1276 datasheet for more info on a particular parameter.
@@ -1192,21 +2582,19 @@ uint8_t SX1276::PllBandwidth(uint8_t x)
 
 uint8_t SX1276::spi_rx(uint8_t addr,uint8_t bits,uint8_t bitshift) {
   uint8_t spi_read;
-  #ifdef ESP32  
-    spi->beginTransaction(SPISettings(_spiClk, MSBFIRST, SPI_MODE0));
-    digitalWrite(_NSS_pin, LOW);
-    spi->transfer(addr);
-    spi_read = spi->transfer(0);
-    digitalWrite(_NSS_pin, HIGH);
-    spi->endTransaction();
-  #else
-    uint8_t spi_array[2] = {0, 0};
-    spi_array[0] = addr;
-    digitalWrite(_NSS_pin, LOW);
-    wiringPiSPIDataRW (0, spi_array,2);
-    spi_read = spi_array[1];
-    digitalWrite(_NSS_pin, HIGH);
-  #endif
+  uint64_t start = _Latency ? SX1276Latency::NowNs() : 0;
+  TRACE_SCOPE(TRACE_SPI_RX, addr << 8);
+  uint8_t spi_array[2] = {addr, 0};
+  _Spi.Transfer(spi_array, 2);
+  spi_read = spi_array[1];
+  TRACE_ARG(addr << 8 | spi_read);
+  if (_Latency) _Latency->Record(LATENCY_SPI, SX1276Latency::NowNs() - start);
+  if (_Metrics) _Metrics->Spi(2);
+  if (_Bus) _Bus->Record(BUS_RX, addr, &spi_read, 1, micros());
+  if (addr == RegOpMode) {
+    _RegOpMode = spi_read;
+    ModeEntered(spi_read & 7);
+  }
   if (bits!=8) {
     spi_read >>= bitshift;
     spi_read &= (0xFF >> (8 - bits));
@@ -1228,21 +2616,59 @@ uint8_t SX1276::spi_tx(uint8_t addr, uint8_t spi_data,uint8_t bits,uint8_t bitsh
     spi_read >>= bitshift;
     spi_read &= (0xFF >> (8 - bits));
   }
-  #ifdef ESP32   
-    spi->beginTransaction(SPISettings(_spiClk, MSBFIRST, SPI_MODE0));
-    digitalWrite(_NSS_pin, LOW);
-    spi->transfer((addr | 0x80));
-    spi->transfer(spi_data);
-    digitalWrite(_NSS_pin, HIGH);
-    spi->endTransaction();
-  #else
-    uint8_t spi_array[2] = {0, 0};
-    spi_array[0] = (addr | 0x80);
-    spi_array[1] = spi_data;
-    digitalWrite(_NSS_pin, LOW);
-    wiringPiSPIDataRW (0, spi_array,2);
-    spi_read = spi_array[1];
-    digitalWrite(_NSS_pin, HIGH);
-  #endif
+  if (addr == RegPaConfig || addr == RegPaDAC || addr == RegModemConfig1 ||
+      (addr >= RegFrMsb && addr <= RegFrLsb))
+  {
+    _TxConfigDirty = 1; // Power, Bandwidth or Frequency may have changed. Recheck on next TX.
+  }
+  TRACE_SCOPE(TRACE_SPI_TX, addr << 8 | spi_data);
+  if (addr <= SNAPSHOT_LAST) _Regs.reg[addr] = spi_data;
+  if (addr == RegOpMode) {
+    _RegOpMode = spi_data;
+    ModeEntered(spi_data & 7);
+  }
+  uint64_t start = _Latency ? SX1276Latency::NowNs() : 0;
+  uint8_t spi_array[2] = {(uint8_t) (addr | 0x80), spi_data};
+  _Spi.Transfer(spi_array, 2);
+  spi_read = spi_array[1];
+  if (_Latency) _Latency->Record(LATENCY_SPI, SX1276Latency::NowNs() - start);
+  if (_Metrics) _Metrics->Spi(2);
+  if (_Bus) _Bus->Record(BUS_TX, addr, &spi_data, 1, micros());
   return spi_read;
 }
+
+// Read len bytes in a single SPI transaction. Address auto-increments, except for RegFifo.
+void SX1276::spi_burst_rx(uint8_t addr, uint8_t *spi_data, size_t len) {
+  if (len == 0 || len > 256) return;
+  TRACE_SCOPE(TRACE_SPI_BURST_RX, addr << 16 | len);
+  uint64_t start = _Latency ? SX1276Latency::NowNs() : 0;
+  uint8_t spi_array[257];
+  spi_array[0] = addr;
+  memset(spi_array + 1, 0, len);
+  _Spi.Transfer(spi_array, len + 1);
+  memcpy(spi_data, spi_array + 1, len);
+  if (_Latency) _Latency->Record(LATENCY_SPI, SX1276Latency::NowNs() - start);
+  if (_Metrics) _Metrics->Spi(len + 1);
+  if (_Bus) _Bus->Record(BUS_BURST_RX, addr, spi_data, len, micros());
+}
+// Write len bytes in a single SPI transaction. Address auto-increments, except for RegFifo.
+void SX1276::spi_burst_tx(uint8_t addr, const uint8_t *spi_data, size_t len) {
+  if (len == 0 || len > 256) return;
+  TRACE_SCOPE(TRACE_SPI_BURST_TX, addr << 16 | len);
+  uint64_t start = _Latency ? SX1276Latency::NowNs() : 0;
+  if (addr <= RegPaDAC && addr + len > RegFrMsb && addr != RegFifo)
+  {
+    _TxConfigDirty = 1;
+  }
+  if (addr != RegFifo && addr + len <= SNAPSHOT_LAST + 1u)
+  {
+    memcpy(_Regs.reg + addr, spi_data, len);
+  }
+  uint8_t spi_array[257];
+  spi_array[0] = (addr | 0x80);
+  memcpy(spi_array + 1, spi_data, len);
+  _Spi.Transfer(spi_array, len + 1);
+  if (_Latency) _Latency->Record(LATENCY_SPI, SX1276Latency::NowNs() - start);
+  if (_Metrics) _Metrics->Spi(len + 1);
+  if (_Bus) _Bus->Record(BUS_BURST_TX, addr, spi_data, len, micros());
+}
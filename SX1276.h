@@ -9,6 +9,8 @@
 #ifndef SX1276_h
 #define SX1276_h
 #include <string>
+#include "SX1276Snapshot.h"
+#include "SX1276Bandwidth.h"
 
 #ifdef ESP32
   #include "Arduino.h"
@@ -16,15 +18,29 @@
   #define NSS_PIN_DEFAULT 15
   #define RESET_PIN_DEFAULT 2
 #else
-  #include <wiringPi.h>
-  #include <wiringPiSPI.h>
+  #ifdef SX1276_EMULATOR
+    #include "SX1276Emulator.h" // wiringPi calls drive an emulated radio
+  #else
+    #include <wiringPi.h>
+    #include <wiringPiSPI.h>
+  #endif
   #include <math.h>
   using std::round;
   #define NSS_PIN_DEFAULT 6
   #define RESET_PIN_DEFAULT 0
 #endif
 
+#include "SX1276Transport.h"
+
 #define TIMEOUT_DEFAULT    5000
+#define SPI_TUNE_STEPS     8
+#define SPI_TUNE_MAX_HZ    10000000  // Datasheet maximum SPI clock
+#define SPI_TUNE_ROUNDS    16        // Patterns and FIFO round trips per clock
+
+class SX1276Metrics;
+class SX1276Latency;
+class SX1276BusRecorder;
+class SX1276Profile;
 
 #define SX1276_FSK         0
 #define SX1276_LORA        1
@@ -41,6 +57,90 @@
 #define SX1276_MODE_RXSINGLE      6 
 #define SX1276_MODE_CAD    7 
 
+/*  SX1276Packet
+ *  A received packet and its metadata. See SX1276::PacketInfo().
+ */
+struct SX1276Packet
+{
+  uint64_t timeUs;     // Receive time in us since the epoch. 0 if unknown.
+  uint32_t frequency;  // Hz
+  int16_t  rssi;       // dBm
+  int8_t   snr;        // 0.25dB steps, as PacketSnr()
+  uint8_t  sf;         // SpreadingFactor()
+  uint8_t  bw;         // Bw() code
+  uint8_t  cr;         // RxCodingRate()
+  uint8_t  syncWord;
+  uint8_t  crcError;   // 1 if PayloadCrcError was set
+  uint8_t  crcOn;      // 1 if the packet had a CRC (CrcOnPayload, or RxPayloadCrcOn in implicit header mode)
+  uint8_t  implicitHeader; // 1 if received in implicit header mode (ImplicitHeaderModeOn)
+  uint8_t  len;
+  uint8_t  data[255];
+};
+
+/*  SX1276ModeState
+ *  Tracks the modem operating mode, and counts transitions and time spent in each
+ *  mode. Times are from NowUs(), a 64 bit clock, so a long stay in one mode doesn't
+ *  wrap as micros() does.
+ */
+class SX1276ModeState
+{
+  public:
+    SX1276ModeState   ();
+    uint8_t Current   ();
+    int Request       (uint8_t target);
+    void Enter        (uint8_t mode,
+                       uint64_t now);
+    uint32_t Transitions(uint8_t from,
+                         uint8_t to);
+    uint32_t Transitions();
+    uint32_t SkippedWrites();
+    uint64_t TimeInModeUs(uint8_t mode,
+                          uint64_t now);
+    void ClearCounters(uint64_t now);
+    static uint64_t NowUs();
+
+  private:
+    uint8_t  _Mode;
+    uint64_t _Since;
+    uint32_t _Skipped;
+    uint32_t _Count[8][8];
+    uint64_t _TimeUs[8];
+};
+
+/*  SX1276PacketFilter
+ *  Filter applied to the first few bytes of a received packet, before the rest
+ *  is read from the FIFO. See SX1276::RXFiltered().
+ */
+#define FILTER_MAX_RULES   8
+class SX1276PacketFilter
+{
+  public:
+    SX1276PacketFilter();
+    void Clear        ();
+    void Length       (uint8_t min,
+                       uint8_t max);
+    void AddressOffset(uint8_t offset);
+    void AddAddress   (uint8_t address);
+    int MatchByte     (uint8_t offset,
+                       uint8_t mask,
+                       uint8_t value);
+    uint8_t HeaderBytes();
+    int Match         (const uint8_t *header,
+                       uint8_t len);
+
+  private:
+    uint8_t _MinLen;
+    uint8_t _MaxLen;
+    uint8_t _HeaderLen;
+    uint8_t _AddrOffset;
+    uint8_t _AddrEnabled;
+    uint32_t _AddrSet[8];
+    uint8_t _Rules;
+    uint8_t _RuleOffset[FILTER_MAX_RULES];
+    uint8_t _RuleMask[FILTER_MAX_RULES];
+    uint8_t _RuleValue[FILTER_MAX_RULES];
+};
+
 class SX1276
 {
   public:
@@ -54,18 +154,73 @@ class SX1276
     int Frequency     (uint32_t Freq = 0);
     int Init          (uint8_t PA_Boost = OUTPUT_RFO, 
                        uint8_t BandPlan = BANDPLAN_NONE);
+    int WarmStart     (uint8_t PA_Boost = OUTPUT_RFO,
+                       uint8_t BandPlan = BANDPLAN_NONE,
+                       const SX1276Snapshot *config = NULL);
     int8_t PowerDBm   (int8_t NewPower = -99);
     int32_t BwHz      (int32_t BandWidth = 0);
     int TX            (char  *datain,      
                        size_t datalen);
+    int TXBurst       (char  **datain,
+                       size_t *datalen,
+                       int    count);
+    uint32_t BurstGapUs();
+    uint32_t BurstTimeouts();
+    int StageReply    (char  *datain,
+                       size_t datalen);
+    int RXReply       (char  *rxdata,
+                       size_t datalen,
+                       uint16_t timeout = TIMEOUT_DEFAULT);
+    uint32_t ReplyTurnaroundUs();
+    int RXFiltered    (char  *rxdata,
+                       size_t datalen,
+                       SX1276PacketFilter *filter,
+                       uint16_t timeout = TIMEOUT_DEFAULT);
+    uint32_t FilterRejected();
+    uint32_t FilterBytesSaved();
+    uint32_t TimeOnAirMs(uint8_t payloadlen);
+    uint32_t TimeOnAirMs(const uint8_t *payloadlens,
+                         uint8_t        count);
+    static uint32_t AirtimeMs(uint8_t sf,
+                              uint8_t bw,
+                              uint8_t cr,
+                              uint16_t preamble,
+                              uint8_t ih,
+                              uint8_t crc,
+                              uint8_t ldro,
+                              uint8_t payloadlen);
+    int ModemConfig   (uint8_t sf,
+                       int32_t bwhz,
+                       uint8_t cr,
+                       int8_t  power);
+    int PacketInfo    (SX1276Packet *pkt);
+    int Snapshot      (SX1276Snapshot *snap);
+    int Apply         (const SX1276Profile *profile);
+    float PacketSnrDb ();
+    int16_t PacketRssiDbm();
+    int32_t DutyBudgetMs();
+    uint32_t DutyCycleMsHour();
+    int SetMode       (uint8_t target);
+    SX1276ModeState * ModeState();
+    void Metrics      (SX1276Metrics *metrics);
+    void Latency      (SX1276Latency *latency);
+    void BusRecorder  (SX1276BusRecorder *recorder);
+    int SpiClock      (int hz = 0);
+    int SpiCheck      (int rounds = SPI_TUNE_ROUNDS);
+    int TuneSpi       (int maxHz = SPI_TUNE_MAX_HZ,
+                       int rounds = SPI_TUNE_ROUNDS,
+                       int *errors = NULL);
+    static const int32_t SpiTuneHz[SPI_TUNE_STEPS];
     int RXContinuous  (char  *rxdata,      
                        size_t datalen,         
                        uint16_t timeout = TIMEOUT_DEFAULT);
     int RXContStart   (char *rxdata,     
                        size_t datalen);
+    int RXContPoll    (SX1276Packet *pkt);
     int CAD           (char  *rxdata,      
                        size_t datalen,         
                        uint16_t timeout = TIMEOUT_DEFAULT);
+    int CADOnce       ();
     void ClearFlags();
     int Reset();
     int TxTimer(uint32_t TXTimeToAdd = 0);
@@ -238,9 +393,8 @@ class SX1276
 
 
   private:
-    #ifdef ESP32
-    SPIClass * spi = NULL;
-    #endif
+    SX1276Transport _Spi;
+    uint8_t _SpiError;      // Begin() failed in the constructor
     int _spiClk;    
     uint8_t spi_rx(uint8_t addr,
                    uint8_t bits=8,
@@ -249,6 +403,24 @@ class SX1276
                    uint8_t spi_data,
                    uint8_t bits=8,
                    uint8_t bitshift=0);
+    void spi_burst_rx(uint8_t addr,
+                      uint8_t *spi_data,
+                      size_t len);
+    void spi_burst_tx(uint8_t addr,
+                      const uint8_t *spi_data,
+                      size_t len);
+    int TXCheck(size_t datalen, uint8_t timing = 1);
+    void ReplyRelease();
+    void ClearTxTimer();
+    void BandLimits(uint32_t Freq);
+    int WriteConfig(const uint8_t *want,
+                    const uint8_t *have);
+    void BwErrata(uint8_t bw);
+    int16_t RssiDbm(uint8_t snr,
+                    uint8_t rssi);
+    void TxStandby(uint8_t done);
+    void ModeEntered(uint8_t mode);
+    void RxMetrics(uint8_t irq);
     uint8_t _NSS_pin;
     uint8_t _ResetPin;
     int _BandPlan;
@@ -263,6 +435,29 @@ class SX1276
     uint32_t _TXHoldUntil;
     uint32_t _TXwindowTime[10];
     uint32_t _TXTimerWindowRef;
+    uint8_t _TxConfigDirty;
+    int8_t _TxPowerDBm;
+    uint8_t _TxBw;
+    uint8_t _TxPowerClamped;
+    uint32_t _BurstGapUs;
+    uint32_t _BurstTimeouts;
+    uint8_t _ReplyLen;
+    uint8_t _ReplyRegs[4];  // RegFifoTxBaseAddr, RegFifoRxBaseAddr, RegPayloadLength and
+                            // RegMaxPayloadLength before StageReply()
+    int8_t _ReplyPower;     // Power to restore after the reply, -99 if it wasn't reduced
+    uint8_t _RegOpMode;
+    SX1276Snapshot _Regs;   // Registers as last read by Snapshot() or written since
+    uint8_t _RegsValid;     // 0 until Snapshot() after a reset
+    uint32_t _FilterRejected;
+    uint32_t _FilterBytesSaved;
+    SX1276ModeState _ModeState;
+    SX1276Metrics * _Metrics;
+    SX1276Latency * _Latency;
+    SX1276BusRecorder * _Bus;
+    uint16_t _RxHeaderCnt;
+    uint16_t _RxPacketCnt;
+    uint32_t _TxFrequency;
+    uint32_t _ReplyTurnaroundUs;
     char * _RxDataPtr;
     size_t _RxDataLen;
     const uint8_t RegFifo = 0x00;
@@ -0,0 +1,249 @@
+/*
+  SX1276ADR.cpp - Adaptive data rate for the SX1276 library
+  Released into the public domain.
+
+  For each link the last ADR_HISTORY packet SNRs are kept, normalised to 0dBm TX power
+  and 125kHz bandwidth, along with counts of packets received and lost.
+  The SNR needed at a setting is the demodulator limit for the Spreading Factor
+  (datasheet table 13), plus a margin of:
+    ADR_MARGIN_DB + z * (SNR standard deviation) [+ 3dB if the observed PER is over twice the target]
+  where z is chosen so the chance of the SNR falling below the limit is the target PER.
+  Of the candidate SF/BW/CR settings with enough margin at ADR_POWER_MAX, the one with
+  the lowest airtime is chosen, and the power is then reduced by the spare margin.
+  Coding rate is not modelled as improving sensitivity, so the lowest candidate CR
+  is always picked unless it is the only one allowed.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "SX1276ADR.h"
+
+/* Demodulator SNR limit in dB for SF6 - SF12 */
+static const float _SnrLimit[7] = {-5, -7.5, -10, -12.5, -15, -17.5, -20};
+
+/*  SX1276ADR
+ *
+ *  Class initialisation. Default candidates are SF7 - SF12, 125kHz and CR 4/5.
+ */
+SX1276ADR::
+SX1276ADR (SX1276 * radio,      // Radio to apply settings to
+           float    targetPer,  // [Optional] Target packet error rate. Default: 0.01
+           uint8_t  payloadlen) // [Optional] Typical payload length, for airtime. Default: 20
+{
+  float lo = 0, hi = 6, z;
+  _Radio = radio;
+  _TargetPer = targetPer;
+  _PayloadLen = payloadlen;
+  _Clock = 0;
+  memset(_Links, 0, sizeof(_Links));
+  Candidates(0x1F80, 1 << 7, 1 << 1);
+  /* Solve P(N(0,1) < -z) = targetPer by bisection */
+  for (int n = 0; n < 30; n++)
+  {
+    z = (lo + hi) / 2;
+    if (0.5 * erfc(z / sqrt(2.0)) > targetPer) lo = z;
+    else hi = z;
+  }
+  _Z = hi;
+}
+
+/*  Candidates
+ *  Set the settings ADR may choose from.
+ *  sfmask: bit n set allows SF n (6-12). bwmask: bit n set allows Bw() code n.
+ *  crmask: bit n set allows CodingRate() n (1-4).
+ */
+void SX1276ADR::
+Candidates (uint16_t sfmask,
+            uint16_t bwmask,
+            uint8_t  crmask)
+{
+  _SfMask = sfmask & 0x1FC0;
+  _BwMask = bwmask & 0x03FF;
+  _CrMask = crmask & 0x1E;
+}
+
+/*  Find
+ *  Returns: Link record for link, or NULL if unknown and create is 0.
+ *  A new record replaces the least recently used one.
+ */
+SX1276ADR::Link * SX1276ADR::
+Find (uint16_t link,
+      int      create)
+{
+  Link * oldest = &_Links[0];
+  for (int n = 0; n < ADR_LINKS; n++)
+  {
+    if (_Links[n].used && _Links[n].id == link)
+    {
+      _Links[n].lastUse = ++_Clock;
+      return &_Links[n];
+    }
+    if (!_Links[n].used || (oldest->used && _Links[n].lastUse < oldest->lastUse))
+    {
+      oldest = &_Links[n];
+    }
+  }
+  if (!create)
+  {
+    return NULL;
+  }
+  memset(oldest, 0, sizeof(Link));
+  oldest->id = link;
+  oldest->used = 1;
+  oldest->lastUse = ++_Clock;
+  return oldest;
+}
+
+/*  ObservePacket
+ *  Record the packet just received by the radio on link, sent with txpower dBm.
+ */
+void SX1276ADR::
+ObservePacket (uint16_t link,    // Link identifier, e.g. source address
+               int8_t   txpower) // Power the packet was sent with, in dBm
+{
+  Observe(link, _Radio->PacketSnrDb(), _Radio->PacketRssiDbm(), txpower, _Radio->BwHz());
+}
+
+/*  Observe
+ *  Record a packet received on link with the given SNR and RSSI.
+ */
+void SX1276ADR::
+Observe (uint16_t link,     // Link identifier
+         float    snr,      // Packet SNR in dB
+         int16_t  rssi,     // Packet RSSI in dBm
+         int8_t   txpower,  // Power the packet was sent with, in dBm
+         int32_t  bwhz)     // Bandwidth the packet was sent with, in Hz
+{
+  Link * l = Find(link, 1);
+  l->snr[l->next] = snr - txpower + 10 * log10(bwhz / 125000.0);
+  l->next = (l->next + 1) % ADR_HISTORY;
+  if (l->count < ADR_HISTORY) l->count++;
+  l->rssi = rssi;
+  l->ok++;
+  if (l->ok + l->lost > 256) // decay so the PER follows recent conditions
+  {
+    l->ok /= 2;
+    l->lost /= 2;
+  }
+}
+
+/*  Lost
+ *  Record a packet lost on link (e.g. a missing ACK or a gap in sequence numbers).
+ */
+void SX1276ADR::
+Lost (uint16_t link)
+{
+  Link * l = Find(link, 1);
+  l->lost++;
+}
+
+/*  Per
+ *  Returns: Observed packet error rate on link. 0 if unknown.
+ */
+float SX1276ADR::
+Per (uint16_t link)
+{
+  Link * l = Find(link, 0);
+  if (l == NULL || l->ok + l->lost == 0)
+  {
+    return 0;
+  }
+  return (float) l->lost / (l->ok + l->lost);
+}
+
+/*  Choose
+ *  Pick the settings for link. See top of file.
+ *
+ *  Returns: 0 if settings meeting the target PER were found
+ *           1 if no candidate meets the target. The most robust candidate at full power is returned.
+ *           -1 if there are fewer than 4 SNR samples for link. No settings are returned.
+ */
+int SX1276ADR::
+Choose (uint16_t link,
+        uint8_t *sf,    // Spreading Factor chosen
+        int32_t *bwhz,  // Bandwidth chosen, in Hz
+        uint8_t *cr,    // Coding Rate chosen
+        int8_t  *power) // Power chosen, in dBm
+{
+  Link *   l = Find(link, 0);
+  float    mean = 0, var = 0, margin, spare, bestspare = 0;
+  uint32_t airtime, best = 0xFFFFFFFF;
+  uint8_t  s, b, c;
+
+  if (l == NULL || l->count < 4)
+  {
+    return -1;
+  }
+  for (int n = 0; n < l->count; n++) mean += l->snr[n];
+  mean /= l->count;
+  for (int n = 0; n < l->count; n++) var += (l->snr[n] - mean) * (l->snr[n] - mean);
+  var /= l->count - 1;
+  margin = ADR_MARGIN_DB + _Z * (var < 1 ? 1 : sqrt(var));
+  if (l->ok + l->lost >= 10 && Per(link) > 2 * _TargetPer)
+  {
+    margin += 3;
+  }
+
+  for (s = 6; s <= 12; s++)
+  {
+    if (!(_SfMask & (1 << s))) continue;
+    for (b = 0; b < SX1276_BW_CODES; b++)
+    {
+      if (!(_BwMask & (1 << b))) continue;
+      spare = mean + ADR_POWER_MAX - 10 * log10(SX1276_BW_HZ[b] / 125000.0) - _SnrLimit[s - 6] - margin;
+      if (spare < 0) continue;
+      for (c = 1; c <= 4; c++)
+      {
+        if (!(_CrMask & (1 << c))) continue;
+        airtime = SX1276::AirtimeMs(s, b, c, 8, 0, 1, ((1000000UL << s) / SX1276_BW_HZ[b]) >= 16000, _PayloadLen);
+        if (airtime < best)
+        {
+          best = airtime;
+          bestspare = spare;
+          *sf = s;
+          *bwhz = SX1276_BW_HZ[b];
+          *cr = c;
+        }
+      }
+    }
+  }
+  if (best == 0xFFFFFFFF)
+  {
+    /* Nothing meets the target. Use the most robust setting. */
+    for (s = 12; s > 6 && !(_SfMask & (1 << s)); s--);
+    for (b = 0; b < 9 && !(_BwMask & (1 << b)); b++);
+    for (c = 4; c > 1 && !(_CrMask & (1 << c)); c--);
+    *sf = s;
+    *bwhz = SX1276_BW_HZ[b];
+    *cr = c;
+    *power = ADR_POWER_MAX;
+    return 1;
+  }
+  *power = ADR_POWER_MAX - (int8_t) floor(bestspare);
+  if (*power < ADR_POWER_MIN) *power = ADR_POWER_MIN;
+  return 0;
+}
+
+/*  Apply
+ *  Choose settings for link, and apply them to the radio in one step (see SX1276::ModemConfig).
+ *  Only for the radio that transmits on link: a gateway sends Choose()'s result back instead.
+ *  Returns: As Choose(). Nothing is changed if Choose() returns -1.
+ */
+int SX1276ADR::
+Apply (uint16_t link)
+{
+  uint8_t sf, cr;
+  int32_t bwhz;
+  int8_t  power;
+  int     ret;
+  ret = Choose(link, &sf, &bwhz, &cr, &power);
+  if (ret < 0)
+  {
+    return ret;
+  }
+  if (_Radio->ModemConfig(sf, bwhz, cr, power) < 0)
+  {
+    return -1;
+  }
+  return ret;
+}
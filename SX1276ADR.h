@@ -0,0 +1,70 @@
+/*  SX1276ADR_h - Adaptive data rate for the SX1276 library
+ *
+ *  Keeps SNR statistics per link, and picks the lowest airtime Spreading Factor,
+ *  Bandwidth and Coding Rate, then the lowest TX power, that keep the expected
+ *  packet error rate below a target.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276ADR_h
+#define SX1276ADR_h
+#include "SX1276.h"
+
+#define ADR_LINKS          16
+#define ADR_HISTORY        16   // SNR samples kept per link
+#define ADR_MARGIN_DB      3    // Fixed installation margin in dB
+#define ADR_POWER_MIN      2    // dBm
+#define ADR_POWER_MAX      14   // dBm
+
+class SX1276ADR
+{
+  public:
+    SX1276ADR         (SX1276 * radio,
+                       float    targetPer = 0.01,
+                       uint8_t  payloadlen = 20);
+    void Candidates   (uint16_t sfmask,
+                       uint16_t bwmask,
+                       uint8_t  crmask);
+    void ObservePacket(uint16_t link,
+                       int8_t   txpower);
+    void Observe      (uint16_t link,
+                       float    snr,
+                       int16_t  rssi,
+                       int8_t   txpower,
+                       int32_t  bwhz);
+    void Lost         (uint16_t link);
+    float Per         (uint16_t link);
+    int Choose        (uint16_t link,
+                       uint8_t *sf,
+                       int32_t *bwhz,
+                       uint8_t *cr,
+                       int8_t  *power);
+    int Apply         (uint16_t link);
+
+  private:
+    struct Link
+    {
+      uint16_t id;
+      uint8_t  used;
+      uint8_t  count;
+      uint8_t  next;
+      float    snr[ADR_HISTORY]; // Normalised to 0dBm TX power and 125kHz Bandwidth
+      int16_t  rssi;
+      uint16_t ok;
+      uint16_t lost;
+      uint32_t lastUse;
+    };
+    Link * Find       (uint16_t link,
+                       int      create);
+    SX1276 * _Radio;
+    float    _Z;      // Standard deviations of margin for the target PER
+    float    _TargetPer;
+    uint8_t  _PayloadLen;
+    uint16_t _SfMask;
+    uint16_t _BwMask;
+    uint8_t  _CrMask;
+    uint32_t _Clock;
+    Link     _Links[ADR_LINKS];
+};
+
+#endif
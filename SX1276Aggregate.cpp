@@ -0,0 +1,163 @@
+/*
+  SX1276Aggregate.cpp - Packet aggregation for the SX1276 library
+  Released into the public domain.
+
+  Queue() adds a message to the frame being built. The frame is sent when the next
+  message won't fit, or by Poll() once the oldest queued message has waited for the
+  deadline. AirtimeSavedMs() counts the airtime of sending each message in its own
+  frame, less the airtime of the frames actually sent. It is negative if aggregating
+  cost airtime (e.g. frames of one message, which carry an extra length byte).
+  Queue() doesn't touch the radio unless the frame is full: the airtimes are worked
+  out when the frame is sent.
+*/
+
+#include <string.h>
+#include "SX1276Aggregate.h"
+
+/*  SX1276Aggregator
+ *
+ *  Class initialisation. radio must already be set up with Init() etc.
+ */
+SX1276Aggregator::
+SX1276Aggregator (SX1276 * radio,    // Radio to send with
+                  uint16_t deadline, // [Optional] Max time in ms a message is held. Default: 1000
+                  uint8_t  framelen) // [Optional] Max frame length in bytes. Default: 255
+{
+  _Radio = radio;
+  _Deadline = deadline;
+  _FrameLen = framelen;
+  _Len = 0;
+  _Count = 0;
+  _Messages = 0;
+  _Frames = 0;
+  _AirtimeSavedMs = 0;
+}
+
+/*  Queue
+ *  Add a message to the frame. If it won't fit, the frame is sent first.
+ *  Returns: 0 if queued
+ *           -1 if the message can never fit in a frame
+ *           Negative TX error code if the full frame could not be sent. The message is not queued.
+ */
+int SX1276Aggregator::
+Queue (const char * datain,   // Message
+       uint8_t      datalen)  // Message length
+{
+  int ret;
+  if (datalen == 0 || datalen + 1 > _FrameLen)
+  {
+    return -1;
+  }
+  if (_Len + datalen + 1 > _FrameLen)
+  {
+    ret = Flush();
+    if (ret < 0)
+    {
+      return ret;
+    }
+  }
+  if (_Count == 0)
+  {
+    _Oldest = millis();
+  }
+  _Frame[_Len++] = datalen;
+  memcpy(_Frame + _Len, datain, datalen);
+  _Len += datalen;
+  _Count++;
+  return 0;
+}
+
+/*  Poll
+ *  Send the frame if the oldest message has reached the deadline. Call regularly.
+ *  Returns: As Flush() if the frame was sent, otherwise 0.
+ */
+int SX1276Aggregator::
+Poll ()
+{
+  if (_Count == 0 || (uint32_t) (millis() - _Oldest) < _Deadline)
+  {
+    return 0;
+  }
+  return Flush();
+}
+
+/*  Flush
+ *  Send the frame now, if any messages are queued.
+ *  Returns: As SX1276::TX(). 0 if nothing was queued.
+ *           On error the messages stay queued.
+ */
+int SX1276Aggregator::
+Flush ()
+{
+  int     ret;
+  uint8_t lens[128]; // Messages are at least 2 bytes with their length
+  uint8_t n = 0;
+  if (_Count == 0)
+  {
+    return 0;
+  }
+  ret = _Radio->TX(_Frame, _Len);
+  if (ret < 0)
+  {
+    return ret;
+  }
+  for (uint8_t pos = 0; pos < _Len; pos += 1 + (uint8_t) _Frame[pos])
+  {
+    lens[n++] = _Frame[pos];
+  }
+  _AirtimeSavedMs += (int32_t) _Radio->TimeOnAirMs(lens, n) - (int32_t) _Radio->TimeOnAirMs(_Len);
+  _Messages += _Count;
+  _Frames++;
+  _Len = 0;
+  _Count = 0;
+  return ret;
+}
+
+uint32_t SX1276Aggregator::Messages()
+{ return _Messages; }
+
+uint32_t SX1276Aggregator::Frames()
+{ return _Frames; }
+
+int32_t SX1276Aggregator::AirtimeSavedMs()
+{ return _AirtimeSavedMs; }
+
+
+/*  SX1276Splitter
+ *
+ *  frame / framelen as returned by RXContinuous(). frame must stay valid while in use.
+ */
+SX1276Splitter::
+SX1276Splitter (const char * frame,
+                int          framelen)
+{
+  _Pos = frame;
+  _End = frame + (framelen > 0 ? framelen : 0);
+}
+
+/*  Next
+ *  Get the next message. msg points into the frame.
+ *  Returns: 1 if a message was returned
+ *           0 at the end of the frame
+ *           -1 if the frame is malformed (a length runs past the end)
+ */
+int SX1276Splitter::
+Next (const char ** msg,     // Set to the start of the message
+      uint8_t *     msglen)  // Set to the message length
+{
+  uint8_t len;
+  if (_Pos >= _End)
+  {
+    return 0;
+  }
+  len = *_Pos;
+  if (len == 0 || _Pos + 1 + len > _End)
+  {
+    _Pos = _End;
+    return -1;
+  }
+  *msg = _Pos + 1;
+  *msglen = len;
+  _Pos += 1 + len;
+  return 1;
+}
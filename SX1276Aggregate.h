@@ -0,0 +1,58 @@
+/*  SX1276Aggregate_h - Packet aggregation for the SX1276 library
+ *
+ *  Small messages are queued and sent together in one LoRa frame, saving the
+ *  preamble, header and CRC overhead (and any holdoff) of one frame per message.
+ *  Frame format: repeated [length byte][message bytes], up to the frame size.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Aggregate_h
+#define SX1276Aggregate_h
+#include "SX1276.h"
+
+#define AGGREGATE_DEADLINE_DEFAULT 1000 // ms
+
+class SX1276Aggregator
+{
+  public:
+    SX1276Aggregator  (SX1276 * radio,
+                       uint16_t deadline = AGGREGATE_DEADLINE_DEFAULT,
+                       uint8_t  framelen = 255);
+    int Queue         (const char *datain,
+                       uint8_t     datalen);
+    int Poll          ();
+    int Flush         ();
+    uint32_t Messages ();
+    uint32_t Frames   ();
+    int32_t AirtimeSavedMs();
+
+  private:
+    SX1276 * _Radio;
+    uint16_t _Deadline;
+    uint8_t  _FrameLen;
+    char     _Frame[255];
+    uint8_t  _Len;
+    uint8_t  _Count;
+    uint32_t _Oldest;
+    uint32_t _Messages;
+    uint32_t _Frames;
+    int32_t  _AirtimeSavedMs;
+};
+
+/*  SX1276Splitter
+ *  Walks the messages in a received aggregate frame without copying them.
+ */
+class SX1276Splitter
+{
+  public:
+    SX1276Splitter    (const char *frame,
+                       int         framelen);
+    int Next          (const char **msg,
+                       uint8_t     *msglen);
+
+  private:
+    const char * _Pos;
+    const char * _End;
+};
+
+#endif
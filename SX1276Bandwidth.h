@@ -0,0 +1,18 @@
+/*  SX1276Bandwidth_h - LoRa bandwidth codes for the SX1276 library
+ *
+ *  SX1276_BW_HZ[bw] is the bandwidth in Hz for each Bw() code (RegModemConfig1 bits 7-4,
+ *  datasheet 4.1.1.4). Codes above 9 are reserved. Shared by the driver, the profiles,
+ *  ADR and the emulator, and constexpr so profiles can use it at compile time.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Bandwidth_h
+#define SX1276Bandwidth_h
+#include <stdint.h>
+
+#define SX1276_BW_CODES    10
+
+static constexpr int32_t SX1276_BW_HZ[SX1276_BW_CODES] =
+  {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+
+#endif
@@ -0,0 +1,346 @@
+/*
+  SX1276BusRecorder.cpp - SPI transaction recording for the SX1276 library
+  Released into the public domain.
+
+  Trace files are text, one transaction per line, so golden traces diff cleanly:
+    dir addr data +us
+  dir is rx, tx, brx or btx, addr and data are hex, and +us is the time since the
+  previous transaction (so one extra poll only changes nearby lines). Lines starting
+  with # are comments.
+
+  Compare() matches transactions by direction, address and length, plus the data
+  for writes. Values read are not compared, as they depend on timing. The longest
+  common subsequence of the two recordings is kept; a transaction missing from one
+  place and added at another is reported as reordered, the rest as added or removed.
+*/
+
+#include <stdlib.h>
+#include "SX1276BusRecorder.h"
+
+#define BUS_DIFF_CELLS     (1 << 22) // Largest differing window compared exactly
+#define BUS_REPORT_LINES   20        // Differences listed individually
+
+static const char * _DirName[BUS_DIRS] = {"rx", "tx", "brx", "btx"};
+
+/*  SX1276BusRecorder
+ *
+ *  Class initialisation. Allocates room for BUS_MAX_RECORDS transactions.
+ */
+SX1276BusRecorder::
+SX1276BusRecorder ()
+{
+  _Rec = new SX1276BusRecord[BUS_MAX_RECORDS];
+  _Pool = new uint8_t[BUS_POOL_BYTES];
+  Clear();
+}
+
+SX1276BusRecorder::
+~SX1276BusRecorder ()
+{
+  delete[] _Rec;
+  delete[] _Pool;
+}
+
+/*  Clear
+ *  Forget all transactions recorded.
+ */
+void SX1276BusRecorder::
+Clear ()
+{
+  _Count = 0;
+  _Used = 0;
+  _Dropped = 0;
+}
+
+uint32_t SX1276BusRecorder::Count()
+{ return _Count; }
+
+uint32_t SX1276BusRecorder::Dropped()
+{ return _Dropped; }
+
+/*  Get
+ *  Returns: Transaction n, in the order made. NULL if out of range.
+ */
+const SX1276BusRecord * SX1276BusRecorder::
+Get (uint32_t n)
+{
+  return n < _Count ? &_Rec[n] : NULL;
+}
+
+/*  Data
+ *  Returns: The bytes read or written by a transaction from Get().
+ */
+const uint8_t * SX1276BusRecorder::
+Data (const SX1276BusRecord *rec)
+{
+  return _Pool + rec->data;
+}
+
+const char * SX1276BusRecorder::
+DirName (uint8_t dir)
+{
+  return dir < BUS_DIRS ? _DirName[dir] : "?";
+}
+
+/*  Save
+ *  Write the recording as a trace file.
+ *  Returns: 0 if successful, -1 if the file can't be written.
+ */
+int SX1276BusRecorder::
+Save (const char *path)
+{
+  FILE * f = fopen(path, "w");
+  uint32_t prev;
+  if (f == NULL)
+  {
+    return -1;
+  }
+  fprintf(f, "# SX1276 bus trace: dir addr data +us\n");
+  prev = _Count ? _Rec[0].timeUs : 0;
+  for (uint32_t n = 0; n < _Count; n++)
+  {
+    fprintf(f, "%s %02x ", _DirName[_Rec[n].dir], _Rec[n].addr);
+    for (uint32_t b = 0; b < _Rec[n].len; b++) fprintf(f, "%02x", _Pool[_Rec[n].data + b]);
+    fprintf(f, " +%u\n", _Rec[n].timeUs - prev);
+    prev = _Rec[n].timeUs;
+  }
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+/*  Load
+ *  Replace the recording with a trace file written by Save().
+ *  Returns: Transactions loaded, -1 if the file can't be read, -2 if it is malformed.
+ */
+int SX1276BusRecorder::
+Load (const char *path)
+{
+  FILE * f = fopen(path, "r");
+  char line[700], dir[8], hex[600], byte[3] = {0, 0, 0};
+  unsigned addr, us, t = 0;
+  uint8_t data[256];
+  size_t len;
+  int d;
+  if (f == NULL)
+  {
+    return -1;
+  }
+  Clear();
+  while (fgets(line, sizeof(line), f))
+  {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (sscanf(line, "%7s %x %599s +%u", dir, &addr, hex, &us) != 4)
+    {
+      fclose(f);
+      return -2;
+    }
+    for (d = 0; d < BUS_DIRS && strcmp(dir, _DirName[d]) != 0; d++);
+    len = strlen(hex) / 2;
+    if (d == BUS_DIRS || addr > 0xFF || len > sizeof(data))
+    {
+      fclose(f);
+      return -2;
+    }
+    for (size_t b = 0; b < len; b++)
+    {
+      byte[0] = hex[b * 2];
+      byte[1] = hex[b * 2 + 1];
+      data[b] = strtoul(byte, NULL, 16);
+    }
+    t += us;
+    Record(d, addr, data, len, t);
+  }
+  fclose(f);
+  return _Count;
+}
+
+/*  Same
+ *  Returns: 1 if transaction n of a and m of b match: direction, address and
+ *  length, and data for writes.
+ */
+int SX1276BusRecorder::
+Same (SX1276BusRecorder *a,
+      uint32_t n,
+      SX1276BusRecorder *b,
+      uint32_t m)
+{
+  const SX1276BusRecord * x = &a->_Rec[n];
+  const SX1276BusRecord * y = &b->_Rec[m];
+  if (x->dir != y->dir || x->addr != y->addr || x->len != y->len)
+  {
+    return 0;
+  }
+  if (x->dir == BUS_TX || x->dir == BUS_BURST_TX)
+  {
+    return memcmp(a->_Pool + x->data, b->_Pool + y->data, x->len) == 0;
+  }
+  return 1;
+}
+
+/*  Describe
+ *  Write transaction n as text, e.g. "tx 01 81" or "brx 00 len 64".
+ */
+void SX1276BusRecorder::
+Describe (SX1276BusRecorder *rec,
+          uint32_t n,
+          char *buf,
+          size_t len)
+{
+  const SX1276BusRecord * r = &rec->_Rec[n];
+  const uint8_t * data = rec->_Pool + r->data;
+  size_t used;
+  used = snprintf(buf, len, "%-3s %02x", _DirName[r->dir], r->addr);
+  if (r->dir == BUS_RX || r->dir == BUS_TX)
+  {
+    snprintf(buf + used, len - used, " %02x", data[0]);
+    return;
+  }
+  used += snprintf(buf + used, len - used, " len %u", r->len);
+  if (r->dir == BUS_BURST_TX)
+  {
+    for (uint32_t b = 0; b < r->len && b < 8 && used + 3 < len; b++)
+      used += snprintf(buf + used, len - used, b ? "%02x" : " %02x", data[b]);
+    if (r->len > 8 && used + 3 < len) snprintf(buf + used, len - used, "..");
+  }
+}
+
+/*  Compare
+ *  Compare a recording with a golden one and write a report of the differences:
+ *  totals, counts by direction and register, then the first few transactions that
+ *  differ. report may be NULL.
+ *  Returns: Transactions added + removed + reordered, 0 if the traffic is the same.
+ *           -1 if either recording dropped transactions.
+ */
+int SX1276BusRecorder::
+Compare (SX1276BusRecorder *golden,
+         SX1276BusRecorder *now,
+         FILE *report)
+{
+  uint32_t N = golden->_Count, M = now->_Count;
+  uint32_t p = 0, s = 0, a, b, i, j;
+  uint32_t nremoved = 0, nadded = 0, added = 0, removed = 0, reordered = 0, listed = 0;
+  uint32_t * gone, * extra;
+  uint8_t * gonePaired, * extraPaired;
+  uint16_t * L;
+  uint32_t count[3][BUS_DIRS][256];
+  const char * tag[3] = {"added", "removed", "reordered"};
+  char text[80];
+  int exact = 1;
+
+  if (golden->_Dropped || now->_Dropped)
+  {
+    if (report) fprintf(report, "Recording incomplete: %u golden, %u new transactions dropped\n",
+                        golden->_Dropped, now->_Dropped);
+    return -1;
+  }
+  while (p < N && p < M && Same(golden, p, now, p)) p++;
+  while (s < N - p && s < M - p && Same(golden, N - 1 - s, now, M - 1 - s)) s++;
+  a = N - p - s;
+  b = M - p - s;
+  gone = new uint32_t[a + 1];
+  extra = new uint32_t[b + 1];
+
+/* Longest common subsequence of the window that differs, L[i][j] for golden[p+i..], now[p+j..] */
+  if ((uint64_t) (a + 1) * (b + 1) <= BUS_DIFF_CELLS)
+  {
+    L = new uint16_t[(a + 1) * (b + 1)];
+    for (i = a + 1; i-- > 0;)
+    {
+      for (j = b + 1; j-- > 0;)
+      {
+        if (i == a || j == b)
+          L[i * (b + 1) + j] = 0;
+        else if (Same(golden, p + i, now, p + j))
+          L[i * (b + 1) + j] = L[(i + 1) * (b + 1) + j + 1] + 1;
+        else
+          L[i * (b + 1) + j] = L[(i + 1) * (b + 1) + j] > L[i * (b + 1) + j + 1] ?
+                               L[(i + 1) * (b + 1) + j] : L[i * (b + 1) + j + 1];
+      }
+    }
+    i = 0;
+    j = 0;
+    while (i < a || j < b)
+    {
+      if (i < a && j < b && Same(golden, p + i, now, p + j))
+      {
+        i++;
+        j++;
+      }
+      else if (j == b || (i < a && L[(i + 1) * (b + 1) + j] >= L[i * (b + 1) + j + 1]))
+        gone[nremoved++] = p + i++;
+      else
+        extra[nadded++] = p + j++;
+    }
+    delete[] L;
+  }
+  else
+  {
+    exact = 0; // Too large to align: everything in the window counts as changed
+    for (i = 0; i < a; i++) gone[nremoved++] = p + i;
+    for (j = 0; j < b; j++) extra[nadded++] = p + j;
+  }
+
+/* A transaction removed in one place and added in another was reordered */
+  gonePaired = new uint8_t[nremoved + 1]();
+  extraPaired = new uint8_t[nadded + 1]();
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < nremoved; i++)
+  {
+    for (j = 0; j < nadded && (uint64_t) nremoved * nadded <= BUS_DIFF_CELLS; j++)
+    {
+      if (!extraPaired[j] && Same(golden, gone[i], now, extra[j]))
+      {
+        gonePaired[i] = 1;
+        extraPaired[j] = 1;
+        reordered++;
+        count[2][golden->_Rec[gone[i]].dir][golden->_Rec[gone[i]].addr]++;
+        break;
+      }
+    }
+    if (!gonePaired[i])
+    {
+      removed++;
+      count[1][golden->_Rec[gone[i]].dir][golden->_Rec[gone[i]].addr]++;
+    }
+  }
+  for (j = 0; j < nadded; j++)
+  {
+    if (!extraPaired[j])
+    {
+      added++;
+      count[0][now->_Rec[extra[j]].dir][now->_Rec[extra[j]].addr]++;
+    }
+  }
+
+  if (report)
+  {
+    fprintf(report, "golden %u transactions, now %u: %u added, %u removed, %u reordered%s\n",
+            N, M, added, removed, reordered, exact ? "" : " (window too large to align)");
+    for (int k = 0; k < 3; k++)
+      for (int d = 0; d < BUS_DIRS; d++)
+        for (int r = 0; r < 256; r++)
+          if (count[k][d][r])
+            fprintf(report, "  %-9s %-3s %02x  x%u\n", tag[k], _DirName[d], r, count[k][d][r]);
+    for (i = 0, j = 0; (i < nremoved || j < nadded) && listed < BUS_REPORT_LINES; listed++)
+    {
+      if (j == nadded || (i < nremoved && gone[i] <= extra[j]))
+      {
+        Describe(golden, gone[i], text, sizeof(text));
+        fprintf(report, "  %c golden #%-6u %s\n", gonePaired[i] ? '~' : '-', gone[i], text);
+        i++;
+      }
+      else
+      {
+        Describe(now, extra[j], text, sizeof(text));
+        fprintf(report, "  %c now    #%-6u %s\n", extraPaired[j] ? '~' : '+', extra[j], text);
+        j++;
+      }
+    }
+    if (nremoved + nadded > listed) fprintf(report, "  ... %u more\n", nremoved + nadded - listed);
+  }
+  delete[] gone;
+  delete[] extra;
+  delete[] gonePaired;
+  delete[] extraPaired;
+  return added + removed + reordered;
+}
@@ -0,0 +1,95 @@
+/*  SX1276BusRecorder_h - SPI transaction recording for the SX1276 library
+ *
+ *  Attach an SX1276BusRecorder to a radio with SX1276::BusRecorder() and every SPI
+ *  transaction the library makes is recorded: direction, address, the bytes read or
+ *  written, and micros() at the time. Save() writes the recording as a text trace,
+ *  one transaction per line, and Compare() checks a recording against a stored
+ *  (golden) trace, reporting transactions added, removed and reordered. Run over
+ *  scripted scenarios (see lora-bustrace) this shows extra SPI round trips in review.
+ *
+ *  Storage is allocated once, when the recorder is created. Transactions that do not
+ *  fit are counted in Dropped() and a recording that dropped any is not compared.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276BusRecorder_h
+#define SX1276BusRecorder_h
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BUS_MAX_RECORDS    65536  // Transactions per recording
+#define BUS_POOL_BYTES     (1 << 20)
+
+/* Transaction direction, SX1276BusRecord.dir */
+#define BUS_RX             0      // spi_rx: one register read
+#define BUS_TX             1      // spi_tx: one register written
+#define BUS_BURST_RX       2      // spi_burst_rx: len bytes read
+#define BUS_BURST_TX       3      // spi_burst_tx: len bytes written
+#define BUS_DIRS           4
+
+struct SX1276BusRecord
+{
+  uint32_t timeUs;   // micros()
+  uint32_t data;     // Offset of the bytes in the recorder's pool
+  uint16_t len;
+  uint8_t  addr;
+  uint8_t  dir;
+};
+
+class SX1276BusRecorder
+{
+  public:
+    SX1276BusRecorder ();
+    ~SX1276BusRecorder();
+    inline void Record(uint8_t        dir,
+                       uint8_t        addr,
+                       const uint8_t *data,
+                       size_t         len,
+                       uint32_t       timeUs)
+    {
+      SX1276BusRecord * r;
+      if (_Count == BUS_MAX_RECORDS || _Used + len > BUS_POOL_BYTES)
+      {
+        _Dropped++;
+        return;
+      }
+      r = &_Rec[_Count++];
+      r->timeUs = timeUs;
+      r->data = _Used;
+      r->len = len;
+      r->addr = addr;
+      r->dir = dir;
+      memcpy(_Pool + _Used, data, len);
+      _Used += len;
+    }
+    void Clear        ();
+    uint32_t Count    ();
+    uint32_t Dropped  ();
+    const SX1276BusRecord * Get(uint32_t n);
+    const uint8_t * Data(const SX1276BusRecord *rec);
+    int Save          (const char *path);
+    int Load          (const char *path);
+    static int Compare(SX1276BusRecorder *golden,
+                       SX1276BusRecorder *now,
+                       FILE *report);
+    static const char * DirName(uint8_t dir);
+
+  private:
+    static int Same   (SX1276BusRecorder *a,
+                       uint32_t n,
+                       SX1276BusRecorder *b,
+                       uint32_t m);
+    static void Describe(SX1276BusRecorder *rec,
+                         uint32_t n,
+                         char *buf,
+                         size_t len);
+    SX1276BusRecord * _Rec;
+    uint8_t * _Pool;
+    uint32_t  _Count;
+    uint32_t  _Used;
+    uint32_t  _Dropped;
+};
+
+#endif
@@ -0,0 +1,358 @@
+/*
+  SX1276Capture.cpp - pcap (LoRaTap) capture of received packets (Linux only)
+  Released into the public domain.
+
+  The ring is a bounded multi producer, single consumer queue. Each slot has a sequence
+  number: a producer may claim position pos when the slot's seq is pos, and publishes it
+  by setting seq to pos + 1. The writer thread takes published slots in order, writes up
+  to CAPTURE_BATCH of them with one writev(), then frees them by setting seq to
+  pos + slots. Producers never wait: if the slot at the head isn't free the ring is full.
+
+  A named pipe is opened by the writer thread, which polls until a reader (e.g.
+  Wireshark) attaches. Packets captured meanwhile wait in the ring. If the reader goes
+  away the writer keeps draining the ring so producers never see it fill.
+
+  LoRaTap version 1 header (LORATAP_LEN bytes, big endian):
+    0  uint8  version (1)    9  uint8  sf             15 uint8[8] gateway EUI    29 uint16 datarate
+    1  uint8  padding        10 uint8  packet rssi    23 uint32 timestamp (us)   31 uint8  if channel
+    2  uint16 length         11 uint8  max rssi       27 uint8  flags            32 uint8  rf chain (radio)
+    4  uint32 frequency      12 uint8  current rssi   28 uint8  coding rate      33 uint16 tag
+    8  uint8  bw (125kHz)    13 int8   snr (0.25dB)   14 uint8  sync word
+  Flags: 0x04 implicit header, 0x08 CRC good, 0x10 CRC bad, 0x20 no CRC
+*/
+#ifndef ESP32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <new>
+#include "SX1276Capture.h"
+
+/*  SX1276Capture
+ *
+ *  Class initialisation. Call Open() before Capture().
+ */
+SX1276Capture::
+SX1276Capture ()
+{
+  _Fd = -1;
+  _Ring = NULL;
+  _Mask = 0;
+  _Run = false;
+}
+
+SX1276Capture::
+~SX1276Capture ()
+{
+  Close();
+}
+
+/*  Open
+ *  Start capturing to path, a pcap file (truncated) or a named pipe.
+ *  slots is the ring size in packets, rounded up to a power of 2.
+ *  Returns: 0 on success
+ *           -1 if the file can't be opened or the ring can't be allocated
+ */
+int SX1276Capture::
+Open (const char * path,  // pcap file or named pipe
+      uint32_t     slots) // [Optional] Packets buffered. Default: CAPTURE_SLOTS_DEFAULT
+{
+  struct stat st;
+  uint32_t    n = 1;
+
+  Close();
+  if (strlen(path) >= sizeof(_Path))
+  {
+    return -1;
+  }
+  strcpy(_Path, path);
+  /* Open files now so errors are reported. Pipes are opened by the writer thread. */
+  if (stat(path, &st) < 0 || !S_ISFIFO(st.st_mode))
+  {
+    _Fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_Fd < 0)
+    {
+      return -1;
+    }
+  }
+  while (n < slots) n <<= 1;
+  _Ring = new (std::nothrow) Slot[n];
+  if (_Ring == NULL)
+  {
+    Close();
+    return -1;
+  }
+  for (uint32_t i = 0; i < n; i++)
+  {
+    _Ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  _Mask = n - 1;
+  _Head.store(0, std::memory_order_relaxed);
+  _Tail = 0;
+  _Dropped = 0;
+  _Written = 0;
+  _Run = true;
+  _Thread = std::thread(&SX1276Capture::Writer, this);
+  return 0;
+}
+
+/*  Capture
+ *  Queue a packet for the capture. Never blocks. Safe to call from several threads.
+ *  If pkt->timeUs is 0 the current time is used. radio is recorded as the LoRaTap rf chain.
+ *  Returns: 0 on success
+ *           -1 if the ring was full (or the capture isn't open) and the packet was dropped
+ */
+int SX1276Capture::
+Capture (const SX1276Packet *pkt,   // Packet, as filled in by SX1276::PacketInfo()
+         uint8_t             radio) // [Optional] Radio index. Default: 0
+{
+  Slot *   s;
+  uint32_t pos, seq, t32;
+  uint64_t t = pkt->timeUs;
+  int      rssi;
+  uint8_t *r;
+  struct timeval tv;
+
+  if (_Ring == NULL)
+  {
+    return -1;
+  }
+  pos = _Head.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    s = &_Ring[pos & _Mask];
+    seq = s->seq.load(std::memory_order_acquire);
+    if (seq == pos)
+    {
+      if (_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if ((int32_t) (seq - pos) < 0)
+    {
+      _Dropped.fetch_add(1, std::memory_order_relaxed);
+      return -1;
+    }
+    else
+    {
+      pos = _Head.load(std::memory_order_relaxed);
+    }
+  }
+
+  if (t == 0)
+  {
+    gettimeofday(&tv, NULL);
+    t = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+  /* pcap record header, host byte order */
+  r = s->buf;
+  t32 = t / 1000000;
+  memcpy(r, &t32, 4);
+  t32 = t % 1000000;
+  memcpy(r + 4, &t32, 4);
+  t32 = LORATAP_LEN + pkt->len;
+  memcpy(r + 8, &t32, 4);
+  memcpy(r + 12, &t32, 4);
+
+  /* LoRaTap header */
+  r += PCAP_RECORD_LEN;
+  memset(r, 0, LORATAP_LEN);
+  r[0] = 1;
+  r[3] = LORATAP_LEN;
+  r[4] = pkt->frequency >> 24;
+  r[5] = pkt->frequency >> 16;
+  r[6] = pkt->frequency >> 8;
+  r[7] = pkt->frequency;
+  r[8] = pkt->bw == 7 ? 1 : pkt->bw == 8 ? 2 : pkt->bw == 9 ? 4 : 0;
+  r[9] = pkt->sf;
+  rssi = pkt->rssi + 139;
+  r[10] = rssi < 0 ? 0 : rssi > 255 ? 255 : rssi;
+  r[11] = r[10];
+  r[13] = pkt->snr;
+  r[14] = pkt->syncWord;
+  t32 = (uint32_t) t;
+  r[23] = t32 >> 24;
+  r[24] = t32 >> 16;
+  r[25] = t32 >> 8;
+  r[26] = t32;
+  r[27] = (pkt->implicitHeader ? 0x04 : 0) | (pkt->crcOn ? (pkt->crcError ? 0x10 : 0x08) : 0x20);
+  r[28] = pkt->cr ? pkt->cr + 4 : 0;
+  r[32] = radio;
+  memcpy(r + LORATAP_LEN, pkt->data, pkt->len);
+  s->len = PCAP_RECORD_LEN + LORATAP_LEN + pkt->len;
+
+  s->seq.store(pos + 1, std::memory_order_release);
+  return 0;
+}
+
+/*  Dropped
+ *  Returns: Packets dropped because the ring was full.
+ */
+uint32_t SX1276Capture::
+Dropped ()
+{
+  return _Dropped.load(std::memory_order_relaxed);
+}
+
+/*  Written
+ *  Returns: Packets written to the file or pipe.
+ */
+uint64_t SX1276Capture::
+Written ()
+{
+  return _Written.load(std::memory_order_relaxed);
+}
+
+/*  Close
+ *  Write the packets still in the ring, stop the writer and close the file.
+ *  If no reader ever opened a named pipe, the packets are discarded.
+ */
+void SX1276Capture::
+Close ()
+{
+  if (_Thread.joinable())
+  {
+    _Run = false;
+    _Thread.join();
+  }
+  if (_Fd >= 0) close(_Fd);
+  _Fd = -1;
+  delete[] _Ring;
+  _Ring = NULL;
+}
+
+/*  WriteAll
+ *  writev() the whole of iov, continuing after partial writes (pipes).
+ *  Returns: 0 on success, -1 on error.
+ */
+int SX1276Capture::
+WriteAll (struct iovec *iov,
+          int           count)
+{
+  ssize_t n;
+  while (count > 0)
+  {
+    n = writev(_Fd, iov, count);
+    if (n < 0)
+    {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    while (count > 0 && (size_t) n >= iov->iov_len)
+    {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0)
+    {
+      iov->iov_base = (uint8_t *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+/*  Writer
+ *  Writer thread. Opens a pipe if needed, writes the pcap header, then drains the ring
+ *  until Close() is called and the ring is empty.
+ */
+void SX1276Capture::
+Writer ()
+{
+  struct iovec iov[CAPTURE_BATCH];
+  uint8_t      hdr[24];
+  uint32_t     v32;
+  uint16_t     v16;
+  sigset_t     set;
+  Slot *       s;
+  int          n;
+
+  /* A closed pipe returns EPIPE to this thread instead of killing the process */
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  /* Wait for a reader on a pipe. Opening non blocking fails with ENXIO until there is one. */
+  while (_Fd < 0 && _Run)
+  {
+    _Fd = open(_Path, O_WRONLY | O_NONBLOCK);
+    if (_Fd >= 0)
+    {
+      fcntl(_Fd, F_SETFL, 0);
+    }
+    else if (errno == ENXIO)
+    {
+      usleep(100000);
+    }
+    else
+    {
+      break;
+    }
+  }
+  /* pcap global header, host byte order */
+  memset(hdr, 0, sizeof(hdr));
+  v32 = 0xa1b2c3d4;               // magic, microsecond timestamps
+  memcpy(hdr, &v32, 4);
+  v16 = 2;                        // version 2.4
+  memcpy(hdr + 4, &v16, 2);
+  v16 = 4;
+  memcpy(hdr + 6, &v16, 2);
+  v32 = 65535;                    // snaplen
+  memcpy(hdr + 16, &v32, 4);
+  v32 = LINKTYPE_LORATAP;
+  memcpy(hdr + 20, &v32, 4);
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  if (_Fd >= 0 && WriteAll(iov, 1) < 0)
+  {
+    close(_Fd);
+    _Fd = -1;
+  }
+
+  for (;;)
+  {
+    for (n = 0; n < CAPTURE_BATCH; n++)
+    {
+      s = &_Ring[(_Tail + n) & _Mask];
+      if (s->seq.load(std::memory_order_acquire) != _Tail + n + 1)
+      {
+        break;
+      }
+      iov[n].iov_base = s->buf;
+      iov[n].iov_len = s->len;
+    }
+    if (n == 0)
+    {
+      if (!_Run) break;
+      usleep(1000);
+      continue;
+    }
+    if (_Fd >= 0)
+    {
+      if (WriteAll(iov, n) < 0)
+      {
+        close(_Fd); // reader gone or disk full. Keep draining.
+        _Fd = -1;
+      }
+      else
+      {
+        _Written.fetch_add(n, std::memory_order_relaxed);
+      }
+    }
+    for (int i = 0; i < n; i++)
+    {
+      _Ring[(_Tail + i) & _Mask].seq.store(_Tail + i + _Mask + 1, std::memory_order_release);
+    }
+    _Tail += n;
+  }
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*  SX1276Capture_h - pcap (LoRaTap) capture of received packets (Linux only)
+ *
+ *  Packets are written to a pcap file or named pipe with link type LoRaTap (270),
+ *  so they can be opened in Wireshark, e.g. wireshark -k -i /tmp/lorapipe
+ *  Capture() only copies the packet into a preallocated ring and never blocks, so it is
+ *  safe to call from RX loops on several radios at once. A writer thread drains the
+ *  ring with batched writev(). If the ring is full the packet is dropped and counted.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Capture_h
+#define SX1276Capture_h
+#ifndef ESP32
+#include <atomic>
+#include <thread>
+#include "SX1276.h"
+
+#define CAPTURE_SLOTS_DEFAULT 1024  // Must be a power of 2
+#define CAPTURE_BATCH         64    // Max packets per writev()
+#define LORATAP_LEN           35    // LoRaTap version 1 header
+#define PCAP_RECORD_LEN       16
+#define LINKTYPE_LORATAP      270
+
+class SX1276Capture
+{
+  public:
+    SX1276Capture     ();
+    ~SX1276Capture    ();
+    int Open          (const char *path,
+                       uint32_t slots = CAPTURE_SLOTS_DEFAULT);
+    int Capture       (const SX1276Packet *pkt,
+                       uint8_t radio = 0);
+    uint32_t Dropped  ();
+    uint64_t Written  ();
+    void Close        ();
+
+  private:
+    struct Slot
+    {
+      std::atomic<uint32_t> seq;
+      uint16_t len;
+      uint8_t  buf[PCAP_RECORD_LEN + LORATAP_LEN + 255];
+    };
+    void Writer       ();
+    int WriteAll      (struct iovec *iov,
+                       int count);
+    char   _Path[256];
+    int    _Fd;
+    Slot * _Ring;
+    uint32_t _Mask;
+    std::atomic<uint32_t> _Head;
+    uint32_t _Tail;
+    std::atomic<uint32_t> _Dropped;
+    std::atomic<uint64_t> _Written;
+    std::atomic<bool> _Run;
+    std::thread _Thread;
+};
+
+#endif
+#endif
@@ -0,0 +1,809 @@
+/*
+  SX1276Control.cpp - Web control server for the SX1276 library
+  Released into the public domain.
+
+  Pages:
+    /, /get    Forms, every register field, and the live event log
+    /json      Every register field, and the registers 0x01-0x70 as hex
+    /tx        ?msg=text   Queue a message to send. 503 if the queue is full
+    /rx        The live event log: packets as they are received
+    /relay     The same as /rx. The radio is always receiving when it is idle
+    /cad       Queue CONTROL_CAD_MS of CAD, reported as a cad event
+    /set       ?freq=Hz&power=dBm&sf=n&syncword=n&crc=0|1   Queue new settings
+    /init      Queue Init(1,1)
+    /packets   ?since=n   Events after n, as a JSON array
+    /events    Server-Sent Events, one per event, from the next one (or after
+               Last-Event-ID / ?since=n). Answered by the web server, not Get().
+
+  Event JSON: {"seq":n,"type":"rx"|"tx"|"cad","ms":millis(),"result":r,"len":n,
+  "data":"hex"} and, for rx, "rssi", "snr", "freq", "sf" and "crcError" as in
+  SX1276Packet. result is the return of RXContinuous, TX or CAD.
+
+  The radio thread loops: apply queued settings, then send one queued message, run
+  a queued CAD, or receive for CONTROL_RX_WINDOW_MS, then take a snapshot for the
+  pages. So a queued message waits at most one receive window.
+
+  The Linux server holds up to CONTROL_CLIENTS connections in one poll() loop. Page
+  requests are answered and closed. An event stream that can't take an event
+  straight away (its socket buffer is full) is closed, and the client reconnects
+  with Last-Event-ID to catch up from the ring, so a slow client never holds up
+  the others.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SX1276Control.h"
+#ifdef ESP32
+#include "Arduino.h"
+#else
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.h"
+#else
+#include <wiringPi.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+static const char * _PageHeader = "\
+<h1>Lora TX/RX </h1>\
+<form action='/tx'>\
+<label for='msg'>Message:</label><br>\
+<input type='text' id='msg' name='msg' value=''><br>\
+<input type='submit' value='tx'>\
+</form>\
+<br>\
+<form action='/get'>\
+<input type='submit' value='Update'>\
+</form>\
+<br>\
+<form action='/rx'>\
+<input type='submit' value='RX'>\
+</form>\
+<br>\
+<form action='/cad'>\
+<input type='submit' value='CAD'>\
+</form>\
+<br>\
+<form action='/relay'>\
+<input type='submit' value='Relay'>\
+</form>\
+<br>\
+<form action='/set'>\
+<label for='freq'>Frequency:</label><br>\
+<input type='text' id='freq' name='freq' value=''><br>\
+<label for='power'>Power:</label><br>\
+<input type='text' id='power' name='power' value=''><br>\
+<label for='sf'>SF:</label><br>\
+<input type='text' id='sf' name='sf' value=''><br>\
+<label for='syncword'>syncword:</label><br>\
+<input type='text' id='syncword' name='syncword' value=''><br>\
+<label for='crc'>crc:</label><br>\
+<input type='text' id='crc' name='crc' value=''><br>\
+<input type='submit' value='Set'>\
+</form>";
+
+/* Event log, appended to every page. Shows packet data as text. */
+static const char * _PageLog = "\
+<pre id='log'></pre>\
+<script>\
+var s=new EventSource('/events');\
+s.onmessage=function(e){var p=JSON.parse(e.data),t='';\
+for(var i=0;i<p.data.length;i+=2)t+=String.fromCharCode(parseInt(p.data.substr(i,2),16));\
+document.getElementById('log').textContent+=p.seq+' '+p.type+' '+p.result+\
+(p.rssi!==undefined?' '+p.rssi+'dBm '+p.snr+'dB':'')+' '+t+'\\n';};\
+</script>";
+
+static const char * _SseHeader = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                 "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+static const char * _Busy = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+
+/*  SX1276Control
+ *
+ *  Class initialisation. lora is not owned. Call Start() to run the radio.
+ */
+SX1276Control::
+SX1276Control (SX1276 *lora)
+{
+  _Lora = lora;
+  _Len = 0;
+  _Page[0] = 0;
+  _TxHead = 0;
+  _TxCount = 0;
+  _EventSeq = 0;
+  _HaveSnap = 0;
+  _Run = false;
+  Clear(&_Pending);
+  memset(&_Snap, 0, sizeof(_Snap));
+#ifndef ESP32
+  _Clients = NULL;
+  _Sock = -1;
+  _Wake[0] = -1;
+  _Wake[1] = -1;
+#endif
+}
+
+SX1276Control::
+~SX1276Control ()
+{
+  Stop();
+#ifndef ESP32
+  Close();
+#endif
+}
+
+const char * SX1276Control::Page()
+{ return _Page; }
+
+int SX1276Control::PageLen()
+{ return _Len; }
+
+/*  Start
+ *  Run the radio from a thread of its own. From here on only that thread uses
+ *  the radio, until Stop().
+ *  Returns: 0
+ */
+int SX1276Control::
+Start ()
+{
+  if (_Run)
+  {
+    return 0;
+  }
+  _Run = true;
+  _Thread = std::thread(&SX1276Control::Radio, this);
+  return 0;
+}
+
+/*  Stop
+ *  Stop the radio thread, after the work in hand (at most a TX, a CAD or one
+ *  receive window).
+ */
+void SX1276Control::
+Stop ()
+{
+  if (_Thread.joinable())
+  {
+    _Run = false;
+    _Thread.join();
+  }
+}
+
+/*  Clear
+ *  Settings with nothing to change.
+ */
+void SX1276Control::
+Clear (Settings *set)
+{
+  memset(set, 0, sizeof(*set));
+  set->power = -99;
+  set->sf = -1;
+  set->crc = -1;
+  set->syncWord = -1;
+}
+
+/*  Radio
+ *  Radio thread. See the description at the top.
+ */
+void SX1276Control::
+Radio ()
+{
+  Settings set;
+  uint8_t  tx;
+  int      n;
+
+  while (_Run)
+  {
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      set = _Pending;
+      Clear(&_Pending);
+      tx = _TxCount > 0;
+      if (tx)
+      {
+        _RadioTx = _Tx[_TxHead];
+        _TxHead = (_TxHead + 1) % CONTROL_TX_QUEUE;
+        _TxCount--;
+      }
+    }
+    Apply(&set);
+    if (tx)
+    {
+      n = _Lora->TX(_RadioTx.data, _RadioTx.len);
+      Publish("tx", n, _RadioTx.data, _RadioTx.len, NULL);
+    }
+    else if (set.cad)
+    {
+      n = _Lora->CAD(_RadioRx, sizeof(_RadioRx), CONTROL_CAD_MS);
+      Publish("cad", n, NULL, 0, NULL);
+    }
+    else
+    {
+      n = _Lora->RXContinuous(_RadioRx, sizeof(_RadioRx), CONTROL_RX_WINDOW_MS);
+      if (n != 0)
+      {
+        _Lora->PacketInfo(&_RadioPkt);
+        Publish("rx", n, _RadioRx, n > 0 ? n : 0, &_RadioPkt);
+      }
+    }
+    _Lora->Snapshot(&_RadioSnap);
+    std::lock_guard<std::mutex> guard(_Lock);
+    _Snap = _RadioSnap;
+    _HaveSnap = 1;
+  }
+}
+
+/*  Apply
+ *  Radio thread: make the settings queued by /set and /init.
+ */
+void SX1276Control::
+Apply (const Settings *set)
+{
+  if (set->init) _Lora->Init(1,1);
+  if (set->freq) _Lora->Frequency(set->freq);
+  if (set->power != -99) _Lora->PowerDBm(set->power);
+  if (set->sf >= 0) _Lora->SpreadingFactor(set->sf);
+  if (set->crc >= 0) _Lora->RxPayloadCrcOn(set->crc);
+  if (set->syncWord >= 0) _Lora->SyncWord(set->syncWord);
+}
+
+/*  Publish
+ *  Radio thread: add an event to the ring, formatted as JSON, and wake the server.
+ */
+void SX1276Control::
+Publish (const char *type,
+         int   result,
+         const char *data,
+         int   len,
+         const SX1276Packet *pkt)
+{
+  char * e;
+  size_t n;
+  {
+    std::lock_guard<std::mutex> guard(_Lock);
+    _EventSeq++;
+    e = _Event[_EventSeq % CONTROL_EVENTS];
+    n = snprintf(e, CONTROL_EVENT_SIZE, "{\"seq\":%u,\"type\":\"%s\",\"ms\":%u,\"result\":%d,\"len\":%d",
+                 _EventSeq, type, (unsigned) millis(), result, len);
+    if (pkt)
+    {
+      n += snprintf(e + n, CONTROL_EVENT_SIZE - n,
+                    ",\"rssi\":%d,\"snr\":%.2f,\"freq\":%u,\"sf\":%u,\"crcError\":%u",
+                    pkt->rssi, pkt->snr / 4.0, (unsigned) pkt->frequency, pkt->sf, pkt->crcError);
+    }
+    n += snprintf(e + n, CONTROL_EVENT_SIZE - n, ",\"data\":\"");
+    for (int b = 0; b < len && n + 5 < CONTROL_EVENT_SIZE; b++)
+    {
+      n += snprintf(e + n, CONTROL_EVENT_SIZE - n, "%02x", (uint8_t) data[b]);
+    }
+    snprintf(e + n, CONTROL_EVENT_SIZE - n, "\"}");
+  }
+#ifndef ESP32
+  if (_Wake[1] >= 0 && write(_Wake[1], "", 1) < 0)
+  {
+    // Pipe full: the server is already due to wake
+  }
+#endif
+}
+
+/*  Queue
+ *  Queue a message to send.
+ *  Returns: Messages queued ahead of it, or -1 if the queue is full.
+ */
+int SX1276Control::
+Queue (const char *data,
+       size_t len)
+{
+  TxFrame * f;
+  std::lock_guard<std::mutex> guard(_Lock);
+  if (_TxCount == CONTROL_TX_QUEUE || len > sizeof(f->data))
+  {
+    return -1;
+  }
+  f = &_Tx[(_TxHead + _TxCount) % CONTROL_TX_QUEUE];
+  memcpy(f->data, data, len);
+  f->len = len;
+  return _TxCount++;
+}
+
+/*  EventSeq
+ *  Returns: Number of the latest event, 0 if there have been none.
+ */
+uint32_t SX1276Control::
+EventSeq ()
+{
+  std::lock_guard<std::mutex> guard(_Lock);
+  return _EventSeq;
+}
+
+/*  EventFirst
+ *  Returns: Number of the oldest event still in the ring.
+ */
+uint32_t SX1276Control::
+EventFirst ()
+{
+  std::lock_guard<std::mutex> guard(_Lock);
+  return _EventSeq >= CONTROL_EVENTS ? _EventSeq - CONTROL_EVENTS + 1 : 1;
+}
+
+/*  Event
+ *  Write event seq as a Server-Sent Event: "id: seq\ndata: {json}\n\n".
+ *  Returns: Length, 0 if it hasn't happened yet, -1 if it has left the ring
+ *           (carry on from EventFirst()), -2 if buf is too small.
+ */
+int SX1276Control::
+Event (uint32_t seq,
+       char  *buf,
+       size_t len)
+{
+  int n;
+  std::lock_guard<std::mutex> guard(_Lock);
+  if (seq > _EventSeq)
+  {
+    return 0;
+  }
+  if (seq == 0 || seq + CONTROL_EVENTS <= _EventSeq)
+  {
+    return -1;
+  }
+  n = snprintf(buf, len, "id: %u\ndata: %s\n\n", seq, _Event[seq % CONTROL_EVENTS]);
+  return n < 0 || (size_t) n >= len ? -2 : n;
+}
+
+/*  Packets
+ *  Page: the events after since as a JSON array.
+ *  Returns: Page length.
+ */
+int SX1276Control::
+Packets (uint32_t since)
+{
+  uint32_t seq;
+  std::lock_guard<std::mutex> guard(_Lock);
+  seq = _EventSeq >= CONTROL_EVENTS ? _EventSeq - CONTROL_EVENTS + 1 : 1;
+  if (since + 1 > seq) seq = since + 1;
+  _Len = 0;
+  _Page[_Len++] = '[';
+  for (; seq <= _EventSeq; seq++)
+  {
+    if (_Len + CONTROL_EVENT_SIZE + 3 >= CONTROL_PAGE_SIZE)
+      break;
+    if (_Page[_Len - 1] != '[') _Page[_Len++] = ',';
+    strcpy(_Page + _Len, _Event[seq % CONTROL_EVENTS]);
+    _Len += strlen(_Page + _Len);
+  }
+  _Page[_Len++] = ']';
+  _Page[_Len] = 0;
+  return _Len;
+}
+
+/*  Append
+ *  Add text to the page, HTML escaped if escape is set. Text that does not fit is cut.
+ *  Returns: 0, or -1 if the page is full.
+ */
+int SX1276Control::
+Append (const char *text,
+        uint8_t escape)
+{
+  const char * rep;
+  for (; *text; text++)
+  {
+    rep = NULL;
+    if (escape)
+    {
+      if (*text == '<') rep = "&lt;";
+      else if (*text == '>') rep = "&gt;";
+      else if (*text == '&') rep = "&amp;";
+    }
+    if (rep == NULL)
+    {
+      if (_Len + 1 >= CONTROL_PAGE_SIZE) return -1;
+      _Page[_Len++] = *text;
+    }
+    else
+    {
+      if (_Len + strlen(rep) >= CONTROL_PAGE_SIZE) return -1;
+      strcpy(_Page + _Len, rep);
+      _Len += strlen(rep);
+    }
+  }
+  _Page[_Len] = 0;
+  return 0;
+}
+
+/*  Render
+ *  The page: header and forms, text (escaped), the register fields from the latest
+ *  snapshot if config is set, then the event log.
+ *  Returns: Page length.
+ */
+int SX1276Control::
+Render (const char *text,
+        uint8_t config)
+{
+  SX1276Snapshot snap;
+  uint8_t have;
+  int n;
+  _Len = 0;
+  Append(_PageHeader, 0);
+  Append("<br>", 0);
+  Append(text, 1);
+  if (config)
+  {
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      snap = _Snap;
+      have = _HaveSnap;
+    }
+    if (have)
+    {
+      n = snap.Html(_Page + _Len, CONTROL_PAGE_SIZE - _Len);
+      if (n > 0) _Len += n;
+    }
+  }
+  Append(_PageLog, 0);
+  return _Len;
+}
+
+/*  Arg
+ *  Find name in a query string (a=1&b=2, without the ?) and URL decode its value.
+ *  Returns: Length of value, or -1 if name is not in query.
+ */
+int SX1276Control::
+Arg (const char *query,
+     const char *name,
+     char  *value,
+     size_t len)
+{
+  size_t nlen = strlen(name), n = 0;
+  char   hex[3] = {0, 0, 0};
+  const char * p = query;
+
+  while (p && *p)
+  {
+    if (strncmp(p, name, nlen) == 0 && p[nlen] == '=')
+    {
+      for (p += nlen + 1; *p && *p != '&' && n + 1 < len; p++)
+      {
+        if (*p == '+')
+          value[n++] = ' ';
+        else if (*p == '%' && p[1] && p[2])
+        {
+          hex[0] = p[1];
+          hex[1] = p[2];
+          value[n++] = strtol(hex, NULL, 16);
+          p += 2;
+        }
+        else
+          value[n++] = *p;
+      }
+      value[n] = 0;
+      return n;
+    }
+    p = strchr(p, '&');
+    if (p) p++;
+  }
+  return -1;
+}
+
+/*  Get
+ *  Answer a request for path, with query (without the ?, may be NULL). Never waits
+ *  for the radio. The body is then in Page() / PageLen(), and *type is its content type.
+ *  Returns: HTTP status: 200, 202 (message queued), 404, or 503 (TX queue full).
+ */
+int SX1276Control::
+Get (const char  *path,
+     const char  *query,
+     const char **type)
+{
+  SX1276Snapshot snap;
+  char msg[256];
+  char value[16];
+  int  n;
+
+  *type = "text/html";
+  if (query == NULL) query = "";
+  if (strcmp(path, "/") == 0 || strcmp(path, "/get") == 0)
+  {
+    Render("", 1);
+  }
+  else if (strcmp(path, "/json") == 0)
+  {
+    *type = "application/json";
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      snap = _Snap;
+    }
+    n = snap.Json(_Page, CONTROL_PAGE_SIZE);
+    _Len = n > 0 ? n : 0;
+    _Page[_Len] = 0;
+  }
+  else if (strcmp(path, "/packets") == 0)
+  {
+    *type = "application/json";
+    Packets(Arg(query, "since", value, sizeof(value)) > 0 ? strtoul(value, NULL, 10) : 0);
+  }
+  else if (strcmp(path, "/tx") == 0)
+  {
+    n = Arg(query, "msg", msg, sizeof(msg));
+    if (n > 0)
+    {
+      if (Queue(msg, n) < 0)
+      {
+        Render("TX queue full", 1);
+        return 503;
+      }
+      Render("Queued for sending", 1);
+      return 202;
+    }
+    Render("", 1);
+  }
+  else if (strcmp(path, "/rx") == 0 || strcmp(path, "/relay") == 0)
+  {
+    Render("Receiving", 0);
+  }
+  else if (strcmp(path, "/cad") == 0)
+  {
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      _Pending.cad = 1;
+    }
+    Render("CAD queued", 0);
+  }
+  else if (strcmp(path, "/set") == 0)
+  {
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      if (Arg(query, "freq", value, sizeof(value)) > 0) _Pending.freq = atol(value);
+      if (Arg(query, "power", value, sizeof(value)) > 0) _Pending.power = atoi(value);
+      if (Arg(query, "sf", value, sizeof(value)) > 0) _Pending.sf = atoi(value);
+      if (Arg(query, "crc", value, sizeof(value)) > 0) _Pending.crc = atoi(value);
+      if (Arg(query, "syncword", value, sizeof(value)) > 0) _Pending.syncWord = atoi(value);
+    }
+    Render("Settings queued", 1);
+  }
+  else if (strcmp(path, "/init") == 0)
+  {
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      _Pending.init = 1;
+    }
+    Render("Init queued", 1);
+  }
+  else
+  {
+    _Len = 0;
+    Append("Not Found", 0);
+    return 404;
+  }
+  return 200;
+}
+
+#ifndef ESP32
+/*  Listen
+ *  Accept HTTP connections on a TCP port, answered by Serve().
+ *  Returns: 0 on success, -1 if the socket can't be created.
+ */
+int SX1276Control::
+Listen (uint16_t port)
+{
+  struct sockaddr_in addr;
+  int on = 1;
+
+  Close();
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  _Sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_Sock < 0 || setsockopt(_Sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+      bind(_Sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(_Sock, 128) < 0 ||
+      pipe2(_Wake, O_NONBLOCK | O_CLOEXEC) < 0)
+  {
+    Close();
+    return -1;
+  }
+  _Clients = new Client[CONTROL_CLIENTS];
+  for (int c = 0; c < CONTROL_CLIENTS; c++) _Clients[c].fd = -1;
+  return 0;
+}
+
+/*  Close
+ *  Stop listening and close all connections. Stop() the radio thread first.
+ */
+void SX1276Control::
+Close ()
+{
+  if (_Clients)
+  {
+    for (int c = 0; c < CONTROL_CLIENTS; c++)
+      if (_Clients[c].fd >= 0) close(_Clients[c].fd);
+    delete[] _Clients;
+  }
+  _Clients = NULL;
+  if (_Sock >= 0) close(_Sock);
+  if (_Wake[0] >= 0) close(_Wake[0]);
+  if (_Wake[1] >= 0) close(_Wake[1]);
+  _Sock = -1;
+  _Wake[0] = -1;
+  _Wake[1] = -1;
+}
+
+void SX1276Control::
+Drop (Client *c)
+{
+  close(c->fd);
+  c->fd = -1;
+}
+
+/*  Stream
+ *  Send an event stream the events it hasn't had. Dropped if it can't keep up.
+ */
+void SX1276Control::
+Stream (Client *c)
+{
+  char buf[CONTROL_EVENT_SIZE + 32];
+  int  n;
+  for (;;)
+  {
+    n = Event(c->next, buf, sizeof(buf));
+    if (n == -1)
+    {
+      c->next = EventFirst();
+      continue;
+    }
+    if (n <= 0)
+    {
+      return;
+    }
+    if (send(c->fd, buf, n, MSG_NOSIGNAL | MSG_DONTWAIT) != n)
+    {
+      Drop(c);
+      return;
+    }
+    c->next++;
+  }
+}
+
+/*  Request
+ *  Answer a complete request head: start an event stream, or send a page and close.
+ */
+void SX1276Control::
+Request (Client *c)
+{
+  char   head[160];
+  const char * type;
+  char * path, * query, * end, * last;
+  int    n, status;
+
+  if (strncmp(c->req, "GET ", 4) != 0 || (end = strchr(c->req + 4, ' ')) == NULL)
+  {
+    Drop(c);
+    return;
+  }
+  last = strstr(end + 1, "\r\nLast-Event-ID:");
+  *end = 0;
+  path = c->req + 4;
+  query = strchr(path, '?');
+  if (query) *query++ = 0;
+  if (strcmp(path, "/events") == 0)
+  {
+    if (last)
+      c->next = strtoul(last + 16, NULL, 10) + 1;
+    else if (query && Arg(query, "since", head, sizeof(head)) > 0)
+      c->next = strtoul(head, NULL, 10) + 1;
+    else
+      c->next = EventSeq() + 1;
+    c->sse = 1;
+    n = strlen(_SseHeader);
+    if (send(c->fd, _SseHeader, n, MSG_NOSIGNAL | MSG_DONTWAIT) != n)
+    {
+      Drop(c);
+      return;
+    }
+    Stream(c);
+    return;
+  }
+  status = Get(path, query, &type);
+  n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+               "Connection: close\r\n\r\n", status,
+               status == 200 ? "OK" : status == 202 ? "Accepted" : status == 404 ? "Not Found" :
+               "Service Unavailable", type, _Len);
+  send(c->fd, head, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+  send(c->fd, _Page, _Len, MSG_NOSIGNAL | MSG_DONTWAIT);
+  Drop(c);
+}
+
+/*  Serve
+ *  Wait up to timeoutMs for connections, requests or events, and handle them all.
+ *  Call in a loop, from any one thread.
+ *  Returns: Requests answered, or -1 if not listening.
+ */
+int SX1276Control::
+Serve (int timeoutMs)
+{
+  struct pollfd p[CONTROL_CLIENTS + 2];
+  int   who[CONTROL_CLIENTS + 2];
+  Client * c;
+  char  drain[64];
+  int   np = 0, n, fd, handled = 0, slot = 0;
+
+  if (_Sock < 0)
+  {
+    return -1;
+  }
+  p[np].fd = _Sock;
+  p[np++].events = POLLIN;
+  p[np].fd = _Wake[0];
+  p[np++].events = POLLIN;
+  for (int k = 0; k < CONTROL_CLIENTS; k++)
+  {
+    if (_Clients[k].fd < 0) continue;
+    p[np].fd = _Clients[k].fd;
+    p[np].events = POLLIN;
+    who[np++] = k;
+  }
+  if (poll(p, np, timeoutMs) < 0)
+  {
+    return errno == EINTR ? 0 : -1;
+  }
+  if (p[1].revents)
+  {
+    while (read(_Wake[0], drain, sizeof(drain)) > 0);
+  }
+  for (int k = 2; k < np; k++)
+  {
+    if (p[k].revents == 0) continue;
+    c = &_Clients[who[k]];
+    if (c->sse)
+    {
+      n = recv(c->fd, drain, sizeof(drain), MSG_DONTWAIT);
+      if (n == 0 || (n < 0 && errno != EAGAIN)) Drop(c);
+      continue;
+    }
+    n = recv(c->fd, c->req + c->len, sizeof(c->req) - 1 - c->len, MSG_DONTWAIT);
+    if (n <= 0)
+    {
+      if (n == 0 || errno != EAGAIN) Drop(c);
+      continue;
+    }
+    c->len += n;
+    c->req[c->len] = 0;
+    if (strstr(c->req, "\r\n\r\n"))
+    {
+      Request(c);
+      handled++;
+    }
+    else if (c->len == sizeof(c->req) - 1)
+    {
+      Drop(c);
+    }
+  }
+  if (p[0].revents & POLLIN)
+  {
+    while ((fd = accept4(_Sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+      while (slot < CONTROL_CLIENTS && _Clients[slot].fd >= 0) slot++;
+      if (slot == CONTROL_CLIENTS)
+      {
+        send(fd, _Busy, strlen(_Busy), MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(fd);
+        continue;
+      }
+      c = &_Clients[slot];
+      c->fd = fd;
+      c->sse = 0;
+      c->len = 0;
+      c->next = 0;
+    }
+  }
+  for (int k = 0; k < CONTROL_CLIENTS; k++)
+  {
+    if (_Clients[k].fd >= 0 && _Clients[k].sse) Stream(&_Clients[k]);
+  }
+  return handled;
+}
+#endif
@@ -0,0 +1,140 @@
+/*  SX1276Control_h - Web control server for the SX1276 library
+ *
+ *  The pages of the control server, separate from any web server: Get() answers a
+ *  request path and query string into a buffer allocated with the object, so a
+ *  page load allocates nothing. The register listing is decoded from one
+ *  SX1276::Snapshot() burst, and /json returns the same fields as compact JSON.
+ *
+ *  After Start() the radio is run by a thread of its own, and requests never wait
+ *  for it: messages to send are queued, settings are applied between receive
+ *  windows, and pages show the snapshot taken after the last window. Packets
+ *  received, frames sent and CAD results are events, numbered from 1 and kept in a
+ *  ring of the last CONTROL_EVENTS, which clients stream from /events (Server-Sent
+ *  Events) or poll from /packets?since=n.
+ *
+ *  The ESP32 sketch (ESP32/esp32_lora.ino) passes its WebServer's requests to Get()
+ *  and streams events itself. On Linux Listen() and Serve() run a poll() based HTTP
+ *  server for many concurrent clients, so the same server runs against a Pi's radio
+ *  or the emulator (RaspberryPI/lora-control.cpp).
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Control_h
+#define SX1276Control_h
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "SX1276.h"
+#include "SX1276Snapshot.h"
+
+#define CONTROL_PAGE_SIZE  8192   // Largest page, the config listing is about 4kB
+#define CONTROL_REQUEST_SIZE 2048 // Longest HTTP request head read on Linux
+#define CONTROL_TX_QUEUE   8      // Messages waiting to be sent
+#define CONTROL_EVENTS     32     // Events kept for clients to catch up from
+#define CONTROL_EVENT_SIZE 720    // Longest event, as JSON: a 255 byte packet in hex
+#define CONTROL_RX_WINDOW_MS 100  // Receive window between queued work
+#define CONTROL_CAD_MS     1000   // Length of a /cad request
+#define CONTROL_CLIENTS    512    // Concurrent connections, Linux server
+
+class SX1276Control
+{
+  public:
+    SX1276Control     (SX1276 *lora);
+    ~SX1276Control    ();
+    int Start         ();
+    void Stop         ();
+    int Get           (const char  *path,
+                       const char  *query,
+                       const char **type);
+    const char * Page ();
+    int PageLen       ();
+    int Queue         (const char *data,
+                       size_t len);
+    uint32_t EventSeq ();
+    uint32_t EventFirst();
+    int Event         (uint32_t seq,
+                       char  *buf,
+                       size_t len);
+    static int Arg    (const char *query,
+                       const char *name,
+                       char  *value,
+                       size_t len);
+#ifndef ESP32
+    int Listen        (uint16_t port);
+    int Serve         (int timeoutMs);
+    void Close        ();
+#endif
+
+  private:
+    struct TxFrame
+    {
+      uint8_t len;
+      char    data[255];
+    };
+    struct Settings
+    {
+      uint32_t freq;              // 0: unchanged
+      int16_t  power;             // -99: unchanged
+      int16_t  sf;                // -1: unchanged, for all of these
+      int16_t  crc;
+      int16_t  syncWord;
+      uint8_t  init;
+      uint8_t  cad;
+    };
+    static void Clear (Settings *set);
+    void Radio        ();
+    void Apply        (const Settings *set);
+    void Publish      (const char *type,
+                       int   result,
+                       const char *data,
+                       int   len,
+                       const SX1276Packet *pkt);
+    int Render        (const char *text,
+                       uint8_t config);
+    int Append        (const char *text,
+                       uint8_t escape);
+    int Packets       (uint32_t since);
+    SX1276 * _Lora;
+    SX1276Snapshot _Snap;         // Latest, shared with the radio thread
+    SX1276Snapshot _RadioSnap;    // Radio thread only
+    char     _Page[CONTROL_PAGE_SIZE];
+    int      _Len;
+
+    /* Shared with the radio thread, under _Lock */
+    std::mutex _Lock;
+    TxFrame  _Tx[CONTROL_TX_QUEUE];
+    uint32_t _TxHead;
+    uint32_t _TxCount;
+    Settings _Pending;
+    char     _Event[CONTROL_EVENTS][CONTROL_EVENT_SIZE];
+    uint32_t _EventSeq;
+    uint8_t  _HaveSnap;
+
+    /* Radio thread only */
+    std::atomic<bool> _Run;
+    std::thread _Thread;
+    TxFrame  _RadioTx;
+    char     _RadioRx[255];
+    SX1276Packet _RadioPkt;
+
+#ifndef ESP32
+    struct Client
+    {
+      int      fd;
+      uint8_t  sse;
+      uint32_t next;              // Next event to stream
+      int      len;
+      char     req[CONTROL_REQUEST_SIZE];
+    };
+    void Request      (Client *c);
+    void Drop         (Client *c);
+    void Stream       (Client *c);
+    Client * _Clients;
+    int      _Sock;
+    int      _Wake[2];            // Radio thread writes a byte when it publishes
+#endif
+};
+
+#endif
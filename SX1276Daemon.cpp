@@ -0,0 +1,597 @@
+/*
+  SX1276Daemon.cpp - Local radio daemon for the SX1276 library (Linux)
+  Released into the public domain.
+
+  The ring is a sequence lock per slot. To publish packet n the daemon marks slot
+  n % DAEMON_SLOTS as being written (seq 0), copies the packet in, sets seq to n and
+  then head to n. A reader checks a slot's seq before it uses the packet, and
+  Valid() checks it again after: if it has changed, the daemon has written over the
+  packet while it was being read. The slot being written is always the one after
+  head, so a reader is safe while it stays less than DAEMON_SLOTS - 1 behind.
+
+  The radio thread starts every radio in continuous receive and loops: send the
+  oldest queued request, if any, then poll each radio for a packet with
+  SX1276::RXContPoll(), and sleep DAEMON_POLL_MS when there was nothing to do. While
+  a packet is being sent the other radios are not polled, so a radio can drop a
+  packet if another sends for longer than a packet takes to arrive.
+
+  TX requests are SOCK_SEQPACKET datagrams, so each is read whole or not at all.
+  Every request gets one reply: straight away if it is refused, otherwise once the
+  packet has been sent.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "SX1276Daemon.h"
+#ifdef SX1276_EMULATOR
+#include "SX1276Emulator.h"
+#else
+#include <wiringPi.h>
+#endif
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The shared memory ring needs lock free 64 bit atomics");
+
+/*  SX1276DaemonReader
+ *
+ *  Class initialisation. Open() the ring to read it.
+ */
+SX1276DaemonReader::
+SX1276DaemonReader ()
+{
+  _Ring = NULL;
+  _Next = 1;
+  _Cur = 0;
+  _Lost = 0;
+}
+
+SX1276DaemonReader::
+~SX1276DaemonReader ()
+{
+  Close();
+}
+
+/*  Open
+ *  Map the daemon's ring, and start reading from the next packet published, or
+ *  with oldest, from the oldest packet still in the ring.
+ *  Returns: 0 on success, -1 if there is no daemon running.
+ */
+int SX1276DaemonReader::
+Open (const char *name,    // DAEMON_SHM_NAME, as passed to SX1276Daemon::Start()
+      uint8_t oldest)
+{
+  struct stat st;
+  void * map;
+  uint64_t head;
+  int fd;
+
+  Close();
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(SX1276DaemonRing))
+  {
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, sizeof(SX1276DaemonRing), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return -1;
+  }
+  _Ring = (const SX1276DaemonRing *) map;
+  if (_Ring->magic != DAEMON_MAGIC || _Ring->slots != DAEMON_SLOTS)
+  {
+    Close();
+    return -1;
+  }
+  head = _Ring->head.load(std::memory_order_acquire);
+  _Next = head + 1;
+  if (oldest)
+  {
+    _Next = head + 2 > DAEMON_SLOTS ? head + 2 - DAEMON_SLOTS : 1;
+  }
+  _Cur = 0;
+  _Lost = 0;
+  return 0;
+}
+
+/*  Close
+ *  Unmap the ring.
+ */
+void SX1276DaemonReader::
+Close ()
+{
+  if (_Ring)
+  {
+    munmap((void *) _Ring, sizeof(SX1276DaemonRing));
+  }
+  _Ring = NULL;
+}
+
+/*  Next
+ *  Take the next packet. *pkt points into the ring, and stays good until the daemon
+ *  has published DAEMON_SLOTS - 1 more: copy what you need, then check Valid().
+ *  Returns: 1 with a packet, 0 if there is none yet, -1 if the ring isn't open.
+ */
+int SX1276DaemonReader::
+Next (const SX1276Packet **pkt,  // Set to the packet
+      uint8_t *radio)            // Set to the index of the radio that received it
+{
+  const SX1276DaemonSlot * s;
+  uint64_t head;
+
+  if (_Ring == NULL)
+  {
+    return -1;
+  }
+  for (;;)
+  {
+    head = _Ring->head.load(std::memory_order_acquire);
+    if (_Next > head)
+    {
+      return 0;
+    }
+    if (_Next + DAEMON_SLOTS < head + 2)
+    {
+      _Lost += head + 2 - DAEMON_SLOTS - _Next;
+      _Next = head + 2 - DAEMON_SLOTS;
+    }
+    s = &_Ring->slot[_Next % DAEMON_SLOTS];
+    if (s->seq.load(std::memory_order_acquire) == _Next)
+    {
+      break;
+    }
+    // Written over since head was read: go round again, and skip ahead
+  }
+  *pkt = &s->pkt;
+  *radio = s->radio;
+  _Cur = _Next++;
+  return 1;
+}
+
+/*  Valid
+ *  Returns: 1 if the packet last returned by Next() hasn't been written over since,
+ *           so what was read from it is good, otherwise 0.
+ */
+int SX1276DaemonReader::
+Valid ()
+{
+  if (_Ring == NULL || _Cur == 0)
+  {
+    return 0;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (_Ring->slot[_Cur % DAEMON_SLOTS].seq.load(std::memory_order_relaxed) != _Cur)
+  {
+    _Lost++;
+    _Cur = 0;
+    return 0;
+  }
+  return 1;
+}
+
+/*  Lost
+ *  Returns: Packets skipped or written over because the reader fell behind.
+ */
+uint64_t SX1276DaemonReader::
+Lost ()
+{
+  return _Lost;
+}
+
+/*  SX1276Daemon
+ *
+ *  Class initialisation. Add() the radios, then Start().
+ */
+SX1276Daemon::
+SX1276Daemon ()
+{
+  _Radios = 0;
+  _Ring = NULL;
+  _ShmName[0] = 0;
+  _SockPath[0] = 0;
+  _QHead = 0;
+  _QCount = 0;
+  _DoneCount = 0;
+  _Pending = 0;
+  _Run = false;
+  _Conns = 0;
+  _Sock = -1;
+  _Wake[0] = -1;
+  _Wake[1] = -1;
+  for (int c = 0; c < DAEMON_CLIENTS; c++) _Clients[c].fd = -1;
+}
+
+SX1276Daemon::
+~SX1276Daemon ()
+{
+  Stop();
+}
+
+/*  Add
+ *  Add a radio, set up (Init() or WarmStart()) and not owned. Radios are numbered
+ *  from 0 in the order they are added. Call before Start().
+ *  Returns: The radio's index, or -1 if there are DAEMON_RADIOS already.
+ */
+int SX1276Daemon::
+Add (SX1276 *lora)
+{
+  if (_Radios == DAEMON_RADIOS || _Run)
+  {
+    return -1;
+  }
+  _Lora[_Radios] = lora;
+  return _Radios++;
+}
+
+/*  Start
+ *  Create the ring and the TX socket, replacing any left by a daemon that didn't
+ *  stop cleanly, and start the radio thread. From here on only that thread uses
+ *  the radios, until Stop().
+ *  Returns: 0 on success, -1 if there are no radios or the ring or socket can't be
+ *           created.
+ */
+int SX1276Daemon::
+Start (const char *shmName,
+       const char *sockPath)
+{
+  struct sockaddr_un addr;
+  void * map;
+  int fd;
+
+  if (_Run || _Radios == 0 || strlen(shmName) >= sizeof(_ShmName) ||
+      strlen(sockPath) >= sizeof(addr.sun_path))
+  {
+    return -1;
+  }
+  strcpy(_ShmName, shmName);
+  strcpy(_SockPath, sockPath);
+  shm_unlink(_ShmName);
+  fd = shm_open(_ShmName, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (ftruncate(fd, sizeof(SX1276DaemonRing)) < 0 ||
+      (map = mmap(NULL, sizeof(SX1276DaemonRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+      == MAP_FAILED)
+  {
+    close(fd);
+    shm_unlink(_ShmName);
+    return -1;
+  }
+  close(fd);
+  _Ring = (SX1276DaemonRing *) map;
+  memset(map, 0, sizeof(SX1276DaemonRing));
+  _Ring->slots = DAEMON_SLOTS;
+  std::atomic_thread_fence(std::memory_order_release);
+  _Ring->magic = DAEMON_MAGIC;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, _SockPath);
+  unlink(_SockPath);
+  _Sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_Sock < 0 || bind(_Sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(_Sock, 16) < 0 || pipe2(_Wake, O_NONBLOCK | O_CLOEXEC) < 0)
+  {
+    Stop();
+    return -1;
+  }
+  _Run = true;
+  _Thread = std::thread(&SX1276Daemon::Radio, this);
+  return 0;
+}
+
+/*  Stop
+ *  Stop the radio thread, after the packet in hand, close the socket and remove the
+ *  ring. Readers keep the packets they have mapped.
+ */
+void SX1276Daemon::
+Stop ()
+{
+  if (_Thread.joinable())
+  {
+    _Run = false;
+    _Thread.join();
+  }
+  for (int c = 0; c < DAEMON_CLIENTS; c++)
+    if (_Clients[c].fd >= 0) Drop(&_Clients[c]);
+  if (_Sock >= 0)
+  {
+    close(_Sock);
+    unlink(_SockPath);
+  }
+  if (_Wake[0] >= 0) close(_Wake[0]);
+  if (_Wake[1] >= 0) close(_Wake[1]);
+  _Sock = -1;
+  _Wake[0] = -1;
+  _Wake[1] = -1;
+  if (_Ring)
+  {
+    munmap(_Ring, sizeof(SX1276DaemonRing));
+    shm_unlink(_ShmName);
+  }
+  _Ring = NULL;
+  _QCount = 0;
+  _DoneCount = 0;
+  _Pending = 0;
+}
+
+/*  Published
+ *  Returns: Packets published to the ring since Start().
+ */
+uint64_t SX1276Daemon::
+Published ()
+{
+  return _Ring ? _Ring->head.load(std::memory_order_relaxed) : 0;
+}
+
+/*  Radio
+ *  Radio thread. See the description at the top.
+ */
+void SX1276Daemon::
+Radio ()
+{
+  SX1276 * lora;
+  uint8_t  busy, tx;
+
+  for (int r = 0; r < _Radios; r++)
+  {
+    _Lora[r]->RXContStart(_RadioRx, sizeof(_RadioRx));
+  }
+  while (_Run)
+  {
+    busy = 0;
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      tx = _QCount > 0;
+      if (tx)
+      {
+        _RadioTx = _Queue[_QHead];
+        _QHead = (_QHead + 1) % DAEMON_TX_QUEUE;
+        _QCount--;
+      }
+    }
+    if (tx)
+    {
+      lora = _Lora[_RadioTx.tx.radio];
+      _RadioTx.result = lora->TX((char *) _RadioTx.tx.data, _RadioTx.tx.len);
+      lora->RXContStart(_RadioRx, sizeof(_RadioRx));
+      {
+        std::lock_guard<std::mutex> guard(_Lock);
+        _Done[_DoneCount++] = _RadioTx;
+      }
+      if (write(_Wake[1], "", 1) < 0)
+      {
+        // Pipe full: the server is already due to wake
+      }
+      busy = 1;
+    }
+    for (int r = 0; r < _Radios; r++)
+    {
+      if (_Lora[r]->RXContPoll(&_RadioPkt) != 0)
+      {
+        Publish(r, &_RadioPkt);
+        busy = 1;
+      }
+    }
+    if (!busy)
+    {
+      delay(DAEMON_POLL_MS);
+    }
+  }
+}
+
+/*  Publish
+ *  Radio thread: add a packet to the ring, stamped with the time now. Packets that
+ *  failed their CRC are published too, with crcError set.
+ */
+void SX1276Daemon::
+Publish (uint8_t radio,
+         SX1276Packet *pkt)
+{
+  struct timeval tv;
+  SX1276DaemonSlot * s;
+  uint64_t n;
+
+  gettimeofday(&tv, NULL);
+  pkt->timeUs = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+  n = _Ring->head.load(std::memory_order_relaxed) + 1;
+  s = &_Ring->slot[n % DAEMON_SLOTS];
+  s->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s->radio = radio;
+  memcpy(&s->pkt, pkt, offsetof(SX1276Packet, data) + pkt->len);
+  s->seq.store(n, std::memory_order_release);
+  _Ring->head.store(n, std::memory_order_release);
+}
+
+/*  Reply
+ *  Answer a TX request, if the connection that sent it is still open.
+ */
+void SX1276Daemon::
+Reply (uint16_t client,
+       uint32_t conn,
+       int32_t result)
+{
+  Client * c = &_Clients[client];
+  if (c->fd >= 0 && c->conn == conn &&
+      send(c->fd, &result, sizeof(result), MSG_NOSIGNAL | MSG_DONTWAIT) != sizeof(result))
+  {
+    Drop(c);
+  }
+}
+
+void SX1276Daemon::
+Drop (Client *c)
+{
+  close(c->fd);
+  c->fd = -1;
+}
+
+/*  Serve
+ *  Wait up to timeoutMs for connections, TX requests or sent packets, and handle
+ *  them all. Call in a loop, from any one thread.
+ *  Returns: TX requests taken, or -1 if not started.
+ */
+int SX1276Daemon::
+Serve (int timeoutMs)
+{
+  struct pollfd p[DAEMON_CLIENTS + 2];
+  int   who[DAEMON_CLIENTS + 2];
+  SX1276DaemonTx req;
+  TxJob done[DAEMON_TX_QUEUE];
+  TxJob * job;
+  Client * c;
+  char  drain[64];
+  int   np = 0, n = 0, fd, ndone, handled = 0, slot = 0;
+  int32_t result;
+
+  if (_Sock < 0)
+  {
+    return -1;
+  }
+  p[np].fd = _Sock;
+  p[np++].events = POLLIN;
+  p[np].fd = _Wake[0];
+  p[np++].events = POLLIN;
+  for (int k = 0; k < DAEMON_CLIENTS; k++)
+  {
+    if (_Clients[k].fd < 0) continue;
+    p[np].fd = _Clients[k].fd;
+    p[np].events = POLLIN;
+    who[np++] = k;
+  }
+  if (poll(p, np, timeoutMs) < 0)
+  {
+    return errno == EINTR ? 0 : -1;
+  }
+  if (p[1].revents)
+  {
+    while (read(_Wake[0], drain, sizeof(drain)) > 0) {}
+    {
+      std::lock_guard<std::mutex> guard(_Lock);
+      ndone = _DoneCount;
+      memcpy(done, _Done, ndone * sizeof(TxJob));
+      _DoneCount = 0;
+      _Pending -= ndone;
+    }
+    for (int d = 0; d < ndone; d++)
+    {
+      Reply(done[d].client, done[d].conn, done[d].result);
+    }
+  }
+  for (int k = 2; k < np; k++)
+  {
+    if (p[k].revents == 0) continue;
+    c = &_Clients[who[k]];
+    while (c->fd >= 0 && (n = recv(c->fd, &req, sizeof(req), MSG_DONTWAIT)) != 0)
+    {
+      if (n < 0)
+      {
+        if (errno != EAGAIN) Drop(c);
+        break;
+      }
+      result = 0;
+      if (n < 2 || n != 2 + req.len || req.radio >= _Radios)
+      {
+        result = DAEMON_BAD_REQUEST;
+      }
+      else
+      {
+        std::lock_guard<std::mutex> guard(_Lock);
+        if (_Pending == DAEMON_TX_QUEUE)
+        {
+          result = DAEMON_QUEUE_FULL;
+        }
+        else
+        {
+          job = &_Queue[(_QHead + _QCount++) % DAEMON_TX_QUEUE];
+          job->client = who[k];
+          job->conn = c->conn;
+          memcpy(&job->tx, &req, n);
+          _Pending++;
+          handled++;
+        }
+      }
+      if (result < 0)
+      {
+        Reply(who[k], c->conn, result);
+      }
+    }
+    if (n == 0 && c->fd >= 0)
+    {
+      Drop(c);
+    }
+  }
+  if (p[0].revents & POLLIN)
+  {
+    while ((fd = accept4(_Sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+      while (slot < DAEMON_CLIENTS && _Clients[slot].fd >= 0) slot++;
+      if (slot == DAEMON_CLIENTS)
+      {
+        close(fd);
+        continue;
+      }
+      _Clients[slot].fd = fd;
+      _Clients[slot].conn = ++_Conns;
+    }
+  }
+  return handled;
+}
+
+/*  Send
+ *  Client side: have the daemon send a packet, and wait until it has been sent.
+ *  Returns: As SX1276::TX(), DAEMON_QUEUE_FULL, DAEMON_BAD_REQUEST, or
+ *           DAEMON_NO_DAEMON if the daemon isn't running.
+ */
+int SX1276Daemon::
+Send (uint8_t radio,         // Index of the radio to send on
+      const char *data,
+      size_t len,            // Up to 255
+      const char *sockPath)  // DAEMON_SOCKET, as passed to Start()
+{
+  struct sockaddr_un addr;
+  SX1276DaemonTx req;
+  int32_t result;
+  int fd;
+
+  if (len > sizeof(req.data) || strlen(sockPath) >= sizeof(addr.sun_path))
+  {
+    return DAEMON_BAD_REQUEST;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockPath);
+  fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+  {
+    if (fd >= 0) close(fd);
+    return DAEMON_NO_DAEMON;
+  }
+  req.radio = radio;
+  req.len = len;
+  memcpy(req.data, data, len);
+  if (send(fd, &req, 2 + len, MSG_NOSIGNAL) != (ssize_t) (2 + len) ||
+      recv(fd, &result, sizeof(result), 0) != sizeof(result))
+  {
+    result = DAEMON_NO_DAEMON;
+  }
+  close(fd);
+  return result;
+}
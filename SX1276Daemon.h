@@ -0,0 +1,154 @@
+/*  SX1276Daemon_h - Local radio daemon for the SX1276 library (Linux)
+ *
+ *  One process owns the radios, so any number of programs on the host can share
+ *  them without each opening the SPI bus.
+ *
+ *  Received packets are published to a ring in POSIX shared memory. Readers map it
+ *  read only and each keeps its own cursor: a reader takes packets straight from the
+ *  mapping, with no copy and no system call, and never holds up the daemon or the
+ *  other readers. A reader that falls more than the ring behind skips to the oldest
+ *  packet still there, and counts what it lost.
+ *
+ *  Packets to send come in on a Unix domain socket, one request per datagram. They
+ *  are queued, and sent in order by the one thread that runs the radios, which is
+ *  the only place transmissions are arbitrated. Each request is answered with the
+ *  result of SX1276::TX(), once the packet has been sent.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Daemon_h
+#define SX1276Daemon_h
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "SX1276.h"
+
+#define DAEMON_SHM_NAME    "/sx1276"           // Received packet ring, shm_open() name
+#define DAEMON_SOCKET      "/tmp/sx1276.sock"  // TX request socket
+#define DAEMON_SLOTS       1024   // Packets kept in the ring
+#define DAEMON_RADIOS      4      // Radios one daemon can own
+#define DAEMON_TX_QUEUE    16     // TX requests waiting, all radios
+#define DAEMON_CLIENTS     64     // Connections to the TX socket
+#define DAEMON_POLL_MS     2      // Radio thread sleep when there is nothing to do
+#define DAEMON_MAGIC       0x53583132  // "SX12"
+
+#define DAEMON_QUEUE_FULL  -6     // TX results, after those of SX1276::TX()
+#define DAEMON_BAD_REQUEST -7     // No such radio, or a malformed request
+#define DAEMON_NO_DAEMON   -8     // Send() couldn't reach the daemon
+
+/*  SX1276DaemonSlot, SX1276DaemonRing
+ *  The shared memory layout. seq is the number of the packet held, from 1, and 0
+ *  while the daemon is writing it; head is the number of the latest packet.
+ */
+struct SX1276DaemonSlot
+{
+  std::atomic<uint64_t> seq;
+  uint8_t      radio;       // Index of the radio, in the order of Add()
+  SX1276Packet pkt;
+};
+
+struct SX1276DaemonRing
+{
+  uint32_t     magic;
+  uint32_t     slots;
+  std::atomic<uint64_t> head;
+  SX1276DaemonSlot slot[DAEMON_SLOTS];
+};
+
+/*  SX1276DaemonTx
+ *  A TX request: radio, len, then len bytes of data. The reply is an int32_t.
+ */
+struct SX1276DaemonTx
+{
+  uint8_t      radio;
+  uint8_t      len;
+  uint8_t      data[255];
+};
+
+class SX1276DaemonReader
+{
+  public:
+    SX1276DaemonReader();
+    ~SX1276DaemonReader();
+    int Open          (const char *name = DAEMON_SHM_NAME,
+                       uint8_t oldest = 0);
+    void Close        ();
+    int Next          (const SX1276Packet **pkt,
+                       uint8_t *radio);
+    int Valid         ();
+    uint64_t Lost     ();
+
+  private:
+    const SX1276DaemonRing * _Ring;
+    uint64_t _Next;         // Number of the next packet to read
+    uint64_t _Cur;          // Number of the packet last returned by Next()
+    uint64_t _Lost;
+};
+
+class SX1276Daemon
+{
+  public:
+    SX1276Daemon      ();
+    ~SX1276Daemon     ();
+    int Add           (SX1276 *lora);
+    int Start         (const char *shmName = DAEMON_SHM_NAME,
+                       const char *sockPath = DAEMON_SOCKET);
+    int Serve         (int timeoutMs);
+    void Stop         ();
+    uint64_t Published();
+    static int Send   (uint8_t radio,
+                       const char *data,
+                       size_t len,
+                       const char *sockPath = DAEMON_SOCKET);
+
+  private:
+    struct TxJob
+    {
+      uint16_t client;      // Slot of the connection that sent it
+      uint32_t conn;        // and the connection number, in case the slot is reused
+      int32_t  result;
+      SX1276DaemonTx tx;
+    };
+    struct Client
+    {
+      int      fd;
+      uint32_t conn;
+    };
+    void Radio        ();
+    void Publish      (uint8_t radio,
+                       SX1276Packet *pkt);
+    void Reply        (uint16_t client,
+                       uint32_t conn,
+                       int32_t result);
+    void Drop         (Client *c);
+    SX1276 * _Lora[DAEMON_RADIOS];
+    int      _Radios;
+    SX1276DaemonRing * _Ring;
+    char     _ShmName[64];
+    char     _SockPath[108];
+
+    /* Shared with the radio thread, under _Lock */
+    std::mutex _Lock;
+    TxJob    _Queue[DAEMON_TX_QUEUE];
+    uint32_t _QHead;
+    uint32_t _QCount;
+    TxJob    _Done[DAEMON_TX_QUEUE];
+    uint32_t _DoneCount;
+    uint32_t _Pending;      // Requests not yet answered, queued, sending or done
+
+    /* Radio thread only */
+    std::atomic<bool> _Run;
+    std::thread _Thread;
+    TxJob    _RadioTx;
+    SX1276Packet _RadioPkt;
+    char     _RadioRx[255];
+
+    Client   _Clients[DAEMON_CLIENTS];
+    uint32_t _Conns;
+    int      _Sock;
+    int      _Wake[2];      // Radio thread writes a byte when a TX is done
+};
+
+#endif
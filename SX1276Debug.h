@@ -0,0 +1,28 @@
+/*  SX1276Debug_h - DEBUG() messages for the SX1276 library and its modules
+ *
+ *  DEBUG(category, fmt, ...) and DEBUG_WARN() record debug messages, formatted later
+ *  (see SX1276DebugLog.h). Arguments are only evaluated if the level and category are
+ *  enabled, and must be numbers. On ESP32 messages are printed straight away. Without
+ *  DEBUG_BUILD they compile to nothing.
+ *  For the library's .cpp files only: programs using the library don't see DEBUG.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Debug_h
+#define SX1276Debug_h
+
+#ifdef DEBUG_BUILD
+#  ifdef ESP32
+#    define DEBUG_LEVEL(level, cat, ...) { printf("DEBUG:  "); printf(__VA_ARGS__); printf("\r\n"); }
+#  else
+#    include "SX1276DebugLog.h"
+#    define DEBUG_LEVEL(level, cat, ...) \
+       do { if (SX1276DebugLog::Enabled(cat, level)) SX1276DebugLog::Log(cat, level, __VA_ARGS__); } while (0)
+#  endif
+#else
+#  define DEBUG_LEVEL(level, cat, ...) { do {} while (0); }
+#endif
+#define DEBUG(cat, ...)      DEBUG_LEVEL(DLOG_DEBUG, cat, __VA_ARGS__)
+#define DEBUG_WARN(cat, ...) DEBUG_LEVEL(DLOG_WARN, cat, __VA_ARGS__)
+
+#endif
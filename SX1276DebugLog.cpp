@@ -0,0 +1,400 @@
+/*
+  SX1276DebugLog.cpp - Deferred debug logging for the SX1276 library (Linux only)
+  Released into the public domain.
+
+  The ring is the same bounded multi producer, single consumer queue as SX1276Capture.
+  Once started, the writer thread drains it every DLOG_POLL_US, so messages logged
+  before Start() are kept (up to DLOG_SLOTS of them).
+
+  Text output, one line per message:
+    DEBUG:  <CLOCK_MONOTONIC seconds> <category> <message>
+
+  Binary file (host byte order), written by StartFile():
+    "SXDL" 1 0 0 0
+    'S' uint16 id, uint16 length, format string     the first time a format is used
+    'R' uint64 timeNs, uint16 id, uint8 level, uint8 category, uint8 nargs,
+        uint16 types, nargs x uint64 arg
+  Format strings are identified by address, so a file only needs each once. If more
+  than DLOG_FORMATS are used, the rest are written with id 0xFFFF before every use.
+
+  Formatting: each conversion in the format is given its argument cast to the type
+  printf expects for that conversion and length modifier (%d int, %lu unsigned long,
+  %f double...), so the output matches what printf would have printed at the time.
+  %s, %p and %n are not supported as only numbers are recorded.
+*/
+#ifndef ESP32
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "SX1276DebugLog.h"
+
+#define DLOG_POLL_US       2000
+#define DLOG_FORMATS       1024   // Format strings with an id in a binary file
+#define DLOG_LINE          512
+
+SX1276DebugLog::Slot SX1276DebugLog::_Ring[DLOG_SLOTS];
+std::atomic<uint32_t> SX1276DebugLog::_Head(0);
+uint32_t SX1276DebugLog::_Tail = 0;
+std::atomic<uint8_t>  SX1276DebugLog::_Level(DLOG_DEBUG);
+std::atomic<uint8_t>  SX1276DebugLog::_Categories(DLOG_ALL);
+std::atomic<uint32_t> SX1276DebugLog::_Dropped(0);
+std::atomic<bool> SX1276DebugLog::_Run(false);
+std::thread SX1276DebugLog::_Thread;
+FILE * SX1276DebugLog::_Out = NULL;
+FILE * SX1276DebugLog::_File = NULL;
+
+static const char * _FmtPtr[DLOG_FORMATS];   // Writer thread only
+static const char * _CategoryName[8] = {"init", "config", "tx", "rx", "cad", "relay", "app", "other"};
+
+/*  Level
+ *  Record messages at level and below (DLOG_ERROR .. DLOG_VERBOSE). Default: DLOG_DEBUG.
+ */
+void SX1276DebugLog::
+Level (uint8_t level)
+{
+  _Level.store(level, std::memory_order_relaxed);
+}
+
+/*  Categories
+ *  Record messages in the categories set in mask (DLOG_TX | DLOG_RX ...). Default: DLOG_ALL.
+ */
+void SX1276DebugLog::
+Categories (uint8_t mask)
+{
+  _Categories.store(mask, std::memory_order_relaxed);
+}
+
+/*  Dropped
+ *  Returns: Messages dropped because the ring was full.
+ */
+uint32_t SX1276DebugLog::
+Dropped ()
+{
+  return _Dropped.load(std::memory_order_relaxed);
+}
+
+/*  Start
+ *  Print messages to out (e.g. stdout) from a background thread.
+ *  Returns: 0 on success, -1 if already started.
+ */
+int SX1276DebugLog::
+Start (FILE *out)
+{
+  if (_Thread.joinable())
+  {
+    return -1;
+  }
+  _Out = out;
+  _Run = true;
+  _Thread = std::thread(&SX1276DebugLog::Writer);
+  atexit(Stop);
+  return 0;
+}
+
+/*  StartFile
+ *  Write messages to path in binary, for Decode() later, from a background thread.
+ *  Returns: 0 on success, -1 if already started or the file can't be written.
+ */
+int SX1276DebugLog::
+StartFile (const char *path)
+{
+  const uint8_t magic[8] = {'S', 'X', 'D', 'L', 1, 0, 0, 0};
+  if (_Thread.joinable())
+  {
+    return -1;
+  }
+  _File = fopen(path, "wb");
+  if (_File == NULL || fwrite(magic, 1, sizeof(magic), _File) != sizeof(magic))
+  {
+    if (_File != NULL) fclose(_File);
+    _File = NULL;
+    return -1;
+  }
+  memset(_FmtPtr, 0, sizeof(_FmtPtr));
+  return Start(NULL);
+}
+
+/*  Stop
+ *  Write out the messages still in the ring and stop the background thread.
+ *  Called at exit if Start() was used.
+ */
+void SX1276DebugLog::
+Stop ()
+{
+  if (_Thread.joinable())
+  {
+    _Run = false;
+    _Thread.join();
+  }
+  if (_File != NULL) fclose(_File);
+  _File = NULL;
+  if (_Out != NULL) fflush(_Out);
+  _Out = NULL;
+}
+
+/*  Writer
+ *  Background thread. Drains the ring until Stop() is called and the ring is empty.
+ */
+void SX1276DebugLog::
+Writer ()
+{
+  Slot *   s;
+  uint32_t base;
+  int      n;
+
+  for (;;)
+  {
+    for (n = 0; ; n++)
+    {
+      s = &_Ring[_Tail & (DLOG_SLOTS - 1)];
+      base = _Tail & ~(uint32_t) (DLOG_SLOTS - 1);
+      if (s->seq.load(std::memory_order_acquire) != base + 1)
+      {
+        break;
+      }
+      Write(&s->rec);
+      s->seq.store(base + DLOG_SLOTS, std::memory_order_release);
+      _Tail++;
+    }
+    if (n > 0)
+    {
+      if (_Out != NULL) fflush(_Out);
+      if (_File != NULL) fflush(_File);
+    }
+    else if (!_Run)
+    {
+      break;
+    }
+    else
+    {
+      usleep(DLOG_POLL_US);
+    }
+  }
+}
+
+/*  Write
+ *  Output one message, as text or binary.
+ */
+void SX1276DebugLog::
+Write (const SX1276DebugRecord *rec)
+{
+  char     line[DLOG_LINE];
+  uint8_t  hdr[17];
+  uint16_t id, len;
+  uint32_t h;
+  int      cat;
+
+  if (_Out != NULL)
+  {
+    Format(rec, line, sizeof(line));
+    for (cat = 0; cat < 7 && (rec->category & (1 << cat)) == 0; cat++);
+    fprintf(_Out, "DEBUG:  %.6f %-6s %s\n", rec->timeNs / 1e9, _CategoryName[cat], line);
+    return;
+  }
+  /* Find or add the format's id, open addressing on its address */
+  h = (uint32_t) (((uintptr_t) rec->fmt >> 3) * 2654435761u) % DLOG_FORMATS;
+  for (id = 0; id < DLOG_FORMATS; id++, h = (h + 1) % DLOG_FORMATS)
+  {
+    if (_FmtPtr[h] == rec->fmt || _FmtPtr[h] == NULL) break;
+  }
+  if (id == DLOG_FORMATS || _FmtPtr[h] == NULL)
+  {
+    if (id < DLOG_FORMATS) _FmtPtr[h] = rec->fmt;
+    id = id < DLOG_FORMATS ? h : 0xFFFF;
+    len = strlen(rec->fmt);
+    hdr[0] = 'S';
+    memcpy(hdr + 1, &id, 2);
+    memcpy(hdr + 3, &len, 2);
+    fwrite(hdr, 1, 5, _File);
+    fwrite(rec->fmt, 1, len, _File);
+  }
+  else
+  {
+    id = h;
+  }
+  hdr[0] = 'R';
+  memcpy(hdr + 1, &rec->timeNs, 8);
+  memcpy(hdr + 9, &id, 2);
+  hdr[11] = rec->level;
+  hdr[12] = rec->category;
+  hdr[13] = rec->nargs;
+  memcpy(hdr + 14, &rec->types, 2);
+  fwrite(hdr, 1, 16, _File);
+  fwrite(rec->arg, 8, rec->nargs, _File);
+}
+
+/*  Format
+ *  Format a message as printf would have.
+ *  Returns: Length of the text (truncated to fit buf).
+ */
+int SX1276DebugLog::
+Format (const SX1276DebugRecord *rec,
+        char  *buf,
+        size_t len)
+{
+  const char * p = rec->fmt;
+  char     spec[32];
+  char     lenmod[3];
+  size_t   used = 0;
+  int      n, a = 0, s, l;
+  uint8_t  type;
+  uint64_t v;
+  double   d;
+
+  if (len == 0)
+  {
+    return 0;
+  }
+  buf[0] = 0;
+  while (*p && used < len - 1)
+  {
+    if (*p != '%' || p[1] == '%')
+    {
+      buf[used++] = *p;
+      p += (*p == '%') ? 2 : 1;
+      continue;
+    }
+    /* %[flags][width][.precision][length]conversion */
+    s = 0;
+    spec[s++] = *p++;
+    while (*p && strchr("-+ #0123456789.", *p) && s < 20) spec[s++] = *p++;
+    l = 0;
+    while (*p && strchr("hlLqjzt", *p) && l < 2) lenmod[l++] = *p++;
+    lenmod[l] = 0;
+    if (*p == 0)
+    {
+      break;
+    }
+    if (a >= rec->nargs || strchr("diouxXcfFeEgGaA", *p) == NULL)
+    {
+      n = snprintf(buf + used, len - used, "(?)");
+      p++;
+    }
+    else
+    {
+      v = rec->arg[a];
+      type = (rec->types >> (a * 2)) & 3;
+      memcpy(&d, &v, sizeof(d));
+      if (strchr("fFeEgGaA", *p))
+      {
+        spec[s++] = *p++;
+        spec[s] = 0;
+        n = snprintf(buf + used, len - used, spec,
+                     type == DLOG_DOUBLE ? d : type == DLOG_SIGNED ? (double) (int64_t) v : (double) v);
+      }
+      else
+      {
+        if (type == DLOG_DOUBLE) v = (uint64_t) (int64_t) d;
+        if (strcmp(lenmod, "ll") == 0 || strcmp(lenmod, "q") == 0 || strcmp(lenmod, "j") == 0)
+        {
+          spec[s++] = 'l';
+          spec[s++] = 'l';
+          spec[s++] = *p;
+          spec[s] = 0;
+          n = (*p == 'd' || *p == 'i') ? snprintf(buf + used, len - used, spec, (long long) v)
+                                       : snprintf(buf + used, len - used, spec, (unsigned long long) v);
+        }
+        else if (lenmod[0] == 'l' || lenmod[0] == 'z' || lenmod[0] == 't')
+        {
+          spec[s++] = 'l';
+          spec[s++] = *p;
+          spec[s] = 0;
+          n = (*p == 'd' || *p == 'i') ? snprintf(buf + used, len - used, spec, (long) v)
+                                       : snprintf(buf + used, len - used, spec, (unsigned long) v);
+        }
+        else
+        {
+          spec[s++] = *p;
+          spec[s] = 0;
+          if (lenmod[0] == 'h' && lenmod[1] == 'h') v = (*p == 'd' || *p == 'i') ? (int64_t) (int8_t) v : (uint8_t) v;
+          else if (lenmod[0] == 'h') v = (*p == 'd' || *p == 'i') ? (int64_t) (int16_t) v : (uint16_t) v;
+          n = (*p == 'd' || *p == 'i') ? snprintf(buf + used, len - used, spec, (int) v)
+                                       : snprintf(buf + used, len - used, spec, (unsigned int) v);
+        }
+        p++;
+      }
+      a++;
+    }
+    if (n < 0)
+    {
+      break;
+    }
+    used += n;
+    if (used >= len)
+    {
+      used = len - 1;
+    }
+  }
+  buf[used] = 0;
+  return used;
+}
+
+/*  Decode
+ *  Print a binary file written by StartFile() to out, as Start() would have.
+ *  Returns: Number of messages, or -1 if the file can't be read or is not a debug log.
+ */
+int SX1276DebugLog::
+Decode (const char *path,
+        FILE       *out)
+{
+  static char * fmts[0x10000];
+  SX1276DebugRecord rec;
+  uint8_t  hdr[16];
+  uint16_t id, len;
+  char     line[DLOG_LINE];
+  int      count = 0, cat, c;
+  FILE *   f;
+
+  f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  for (c = 0; c < 0x10000; c++)
+  {
+    free(fmts[c]);
+    fmts[c] = NULL;
+  }
+  if (fread(hdr, 1, 8, f) != 8 || memcmp(hdr, "SXDL\1", 5) != 0)
+  {
+    fclose(f);
+    return -1;
+  }
+  while ((c = fgetc(f)) != EOF)
+  {
+    if (c == 'S')
+    {
+      if (fread(hdr, 1, 4, f) != 4) break;
+      memcpy(&id, hdr, 2);
+      memcpy(&len, hdr + 2, 2);
+      free(fmts[id]);
+      fmts[id] = (char *) malloc(len + 1);
+      if (fmts[id] == NULL || fread(fmts[id], 1, len, f) != len) break;
+      fmts[id][len] = 0;
+    }
+    else if (c == 'R')
+    {
+      if (fread(hdr, 1, 15, f) != 15) break;
+      memcpy(&rec.timeNs, hdr, 8);
+      memcpy(&id, hdr + 8, 2);
+      rec.level = hdr[10];
+      rec.category = hdr[11];
+      rec.nargs = hdr[12] <= DLOG_MAX_ARGS ? hdr[12] : DLOG_MAX_ARGS;
+      memcpy(&rec.types, hdr + 13, 2);
+      if (fread(rec.arg, 8, rec.nargs, f) != rec.nargs) break;
+      rec.fmt = fmts[id] ? fmts[id] : "(unknown format)";
+      Format(&rec, line, sizeof(line));
+      for (cat = 0; cat < 7 && (rec.category & (1 << cat)) == 0; cat++);
+      fprintf(out, "DEBUG:  %.6f %-6s %s\n", rec.timeNs / 1e9, _CategoryName[cat], line);
+      count++;
+    }
+    else
+    {
+      break; // corrupt
+    }
+  }
+  fclose(f);
+  return count;
+}
+
+#endif
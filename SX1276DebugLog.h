@@ -0,0 +1,178 @@
+/*  SX1276DebugLog_h - Deferred debug logging for the SX1276 library (Linux only)
+ *
+ *  With DEBUG_BUILD defined the library's DEBUG() messages are recorded here instead
+ *  of being printed: the caller stores the format string pointer and its raw numeric
+ *  arguments in a fixed ring, and formatting happens later, in a background thread
+ *  (Start) or offline from a binary file (StartFile, then Decode or lora-debugdump).
+ *  Recording takes no locks, never allocates and never blocks: if the ring is full the
+ *  message is dropped and counted. Messages can be filtered at run time by level and
+ *  category, and a filtered message costs two relaxed loads.
+ *  Arguments must be numbers (no strings or pointers), as they are formatted later.
+ *
+ *  Tools built with DEBUG_BUILD include SX1276DebugLog.cpp and call Start(stdout).
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276DebugLog_h
+#define SX1276DebugLog_h
+#ifndef ESP32
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#define DLOG_SLOTS         4096   // Messages buffered, power of 2
+#define DLOG_MAX_ARGS      5
+
+/* Levels */
+#define DLOG_ERROR         0
+#define DLOG_WARN          1
+#define DLOG_INFO          2
+#define DLOG_DEBUG         3
+#define DLOG_VERBOSE       4      // Per byte and per poll messages
+
+/* Categories, a bit each */
+#define DLOG_INIT          0x01
+#define DLOG_CONFIG        0x02
+#define DLOG_TX            0x04
+#define DLOG_RX            0x08
+#define DLOG_CAD           0x10
+#define DLOG_RELAY         0x20
+#define DLOG_APP           0x40
+#define DLOG_ALL           0xFF
+
+/* Argument types, 2 bits each in SX1276DebugRecord.types */
+#define DLOG_UNSIGNED      0
+#define DLOG_SIGNED        1
+#define DLOG_DOUBLE        2
+
+struct SX1276DebugRecord
+{
+  uint64_t    timeNs;             // CLOCK_MONOTONIC
+  const char *fmt;
+  uint64_t    arg[DLOG_MAX_ARGS]; // Integers, or the bits of a double
+  uint16_t    types;
+  uint8_t     level;
+  uint8_t     category;
+  uint8_t     nargs;
+};
+
+class SX1276DebugLog
+{
+  public:
+    static inline bool Enabled(uint8_t category,
+                               uint8_t level)
+    {
+      return level <= _Level.load(std::memory_order_relaxed) &&
+             (category & _Categories.load(std::memory_order_relaxed)) != 0;
+    }
+    template <typename... A>
+    static inline void Log(uint8_t     category,
+                           uint8_t     level,
+                           const char *fmt,
+                           A...        args)
+    {
+      static_assert(sizeof...(A) <= DLOG_MAX_ARGS, "Too many DEBUG arguments");
+      Slot *   s;
+      uint32_t pos, seq, base;
+      struct timespec ts;
+
+      pos = _Head.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        s = &_Ring[pos & (DLOG_SLOTS - 1)];
+        base = pos & ~(uint32_t) (DLOG_SLOTS - 1);
+        seq = s->seq.load(std::memory_order_acquire);
+        if (seq == base)
+        {
+          if (_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if ((int32_t) (seq - base) < 0)
+        {
+          _Dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        else
+        {
+          pos = _Head.load(std::memory_order_relaxed);
+        }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      s->rec.timeNs = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+      s->rec.fmt = fmt;
+      s->rec.level = level;
+      s->rec.category = category;
+      s->rec.nargs = sizeof...(A);
+      s->rec.types = 0;
+      Pack(&s->rec, 0, args...);
+      s->seq.store(base + 1, std::memory_order_release);
+    }
+    static void Level (uint8_t level);
+    static void Categories(uint8_t mask);
+    static uint32_t Dropped();
+    static int Start  (FILE *out);
+    static int StartFile(const char *path);
+    static void Stop  ();
+    static int Format (const SX1276DebugRecord *rec,
+                       char  *buf,
+                       size_t len);
+    static int Decode (const char *path,
+                       FILE *out);
+
+  private:
+    /* Sequence numbers as SX1276Capture, less the slot's index so the zero-initialised
+       ring needs no setup: a slot is free for position pos when seq is pos minus its index,
+       holds a message when it is one more, and is freed for the next lap by adding
+       DLOG_SLOTS. Compared as signed differences, so they wrap with the positions. */
+    struct Slot
+    {
+      std::atomic<uint32_t> seq;
+      SX1276DebugRecord rec;
+    };
+    static inline void Pack(SX1276DebugRecord * /* rec */,
+                            int /* n */)
+    {
+    }
+    template <typename T, typename... A>
+    static inline void Pack(SX1276DebugRecord *rec,
+                            int n,
+                            T   a,
+                            A...rest)
+    {
+      static_assert(std::is_arithmetic<T>::value, "DEBUG arguments must be numbers");
+      if (std::is_floating_point<T>::value)
+      {
+        double d = a;
+        memcpy(&rec->arg[n], &d, sizeof(d));
+        rec->types |= DLOG_DOUBLE << (n * 2);
+      }
+      else if (std::is_signed<T>::value)
+      {
+        rec->arg[n] = (int64_t) a;
+        rec->types |= DLOG_SIGNED << (n * 2);
+      }
+      else
+      {
+        rec->arg[n] = (uint64_t) a;
+      }
+      Pack(rec, n + 1, rest...);
+    }
+    static void Writer ();
+    static void Write (const SX1276DebugRecord *rec);
+    static Slot _Ring[DLOG_SLOTS];
+    static std::atomic<uint32_t> _Head;
+    static uint32_t _Tail;
+    static std::atomic<uint8_t>  _Level;
+    static std::atomic<uint8_t>  _Categories;
+    static std::atomic<uint32_t> _Dropped;
+    static std::atomic<bool> _Run;
+    static std::thread _Thread;
+    static FILE * _Out;
+    static FILE * _File;
+};
+
+#endif
+#endif
@@ -0,0 +1,673 @@
+/*
+  SX1276Emulator.cpp - Register level SX1276 emulator, for building without a radio
+  Released into the public domain.
+
+  Only LoRa mode is emulated. Registers hold their LoRa mode reset values; FSK mode
+  registers are not modelled, so Init() should be called before anything else.
+
+  Mode timing:
+    TX          TxDone and Standby after the time on air (SX1276::AirtimeMs), then the
+                packet is passed to the OnTransmit() callback.
+    CAD         CadDone and Standby after 2 symbols. CadDetected if a packet is queued
+                to arrive by then.
+    RXSINGLE    RxTimeout and Standby after SymbTimeout symbols with no packet.
+  Events are checked at the start of every SPI transfer, so a radio that isn't
+  accessed doesn't change state.
+
+  Received packets are queued with Inject(pkt, atUs). atUs is the emulator time the
+  packet finishes arriving (when RxDone is set). A packet arriving when the radio
+  isn't receiving, or (with MatchConfig on) on a different frequency, SF, BW or
+  sync word, is missed. atUs 0 means "as soon as the radio is receiving and RxDone
+  is clear", which replays a queue without losses at whatever rate the reader runs.
+  With MatchConfig off the radio takes the packet's frequency, SF, BW, CR and sync
+  word, as if it had been tuned to it, so PacketInfo() reports the original metadata.
+*/
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "SX1276Emulator.h"
+#include "SX1276Bandwidth.h"
+
+struct SX1276Emulator::Arrival
+{
+  uint64_t     at;
+  SX1276Packet pkt;
+};
+
+/* Register values after reset. LoRa mode values where they differ from FSK mode. */
+static const uint8_t _EmuResetReg[][2] = {
+  {0x01, 0x01}, {0x06, 0x6C}, {0x07, 0x80}, {0x09, 0x4F}, {0x0A, 0x09}, {0x0B, 0x2B},
+  {0x0C, 0x20}, {0x0E, 0x80}, {0x1D, 0x72}, {0x1E, 0x70}, {0x1F, 0x64}, {0x21, 0x08},
+  {0x22, 0x01}, {0x23, 0xFF}, {0x26, 0x04}, {0x2F, 0x20}, {0x31, 0xC3}, {0x33, 0x27},
+  {0x36, 0x03}, {0x37, 0x0A}, {0x39, 0x12}, {0x3A, 0x52}, {0x3B, 0x1D}, {0x42, 0x12},
+  {0x4B, 0x09}, {0x4D, 0x84}, {0x61, 0x19}, {0x62, 0x0C}, {0x63, 0x4B}, {0x64, 0xCC},
+  {0x70, 0xD0}};
+
+/* Radios by NSS pin, the radio selected by its NSS pin, and the clock. Shared by
+   all threads, except those that have called Partition(), which have their own. */
+struct EmuWorld
+{
+  SX1276Emulator * radios[256];
+  SX1276Emulator * selected;
+  float    speed;
+  uint64_t baseUs;
+  uint64_t baseNs;
+};
+static EmuWorld _EmuShared = {{NULL}, NULL, 1, 0, 0};
+static thread_local EmuWorld * _Emu = &_EmuShared;
+static thread_local EmuWorld _EmuLocal;
+static int      _EmuSpiHz = 0;
+static int      _EmuMaxSpiHz = 0;    // 0: any clock works
+static uint32_t _EmuSpiErrors = 0;
+
+/*  SX1276Emulator
+ *
+ *  Class initialisation. The radio answers SPI transfers while NSS_Pin is low,
+ *  and is reset when ResetPin is pulled low.
+ */
+SX1276Emulator::
+SX1276Emulator (uint8_t NSS_Pin,  // [Optional] Default: NSS_PIN_DEFAULT
+                uint8_t ResetPin) // [Optional] Default: RESET_PIN_DEFAULT
+{
+  _NSS_pin = NSS_Pin;
+  _ResetPin = ResetPin;
+  _Queue = new Arrival[EMU_QUEUE];
+  _QHead = 0;
+  _QCount = 0;
+  _MatchConfig = 1;
+  _Delivered = 0;
+  _Missed = 0;
+  _Transmitted = 0;
+  _Transactions = 0;
+  _SpiBytes = 0;
+  _DeliveredNs = 0;
+  _OnTransmit = NULL;
+  _OnTransmitCtx = NULL;
+  _Emu->radios[_NSS_pin] = this;
+  Reset();
+}
+
+SX1276Emulator::
+~SX1276Emulator ()
+{
+  if (_Emu->radios[_NSS_pin] == this) _Emu->radios[_NSS_pin] = NULL;
+  if (_Emu->selected == this) _Emu->selected = NULL;
+  delete[] _Queue;
+}
+
+/*  Reset
+ *  Set all registers to their reset values and clear the FIFO. Queued packets are kept.
+ */
+void SX1276Emulator::
+Reset ()
+{
+  memset(_Reg, 0, sizeof(_Reg));
+  memset(_Fifo, 0, sizeof(_Fifo));
+  for (size_t n = 0; n < sizeof(_EmuResetReg) / sizeof(_EmuResetReg[0]); n++)
+  {
+    _Reg[_EmuResetReg[n][0]] = _EmuResetReg[n][1];
+  }
+  _RxWrite = 0;
+  _EventUs = 0;
+  _ModeUs = 0;
+  _HeaderCnt = 0;
+  _PacketCnt = 0;
+}
+
+/*  Inject
+ *  Queue a packet to be received at emulator time atUs (see NowUs()), or, if atUs
+ *  is 0, as soon as the radio can take it. Packets must be queued in time order.
+ *  Returns: 0 on success, -1 if the queue is full.
+ */
+int SX1276Emulator::
+Inject (const SX1276Packet *pkt,  // Packet to receive. Only used fields are len, data, rssi, snr,
+                                  // cr, crcOn, crcError, and frequency, sf, bw, syncWord (see MatchConfig)
+        uint64_t            atUs) // [Optional] Arrival time. Default: 0 (as soon as receiving)
+{
+  Arrival * a;
+  if (_QCount == EMU_QUEUE)
+  {
+    return -1;
+  }
+  a = &_Queue[(_QHead + _QCount) % EMU_QUEUE];
+  a->at = atUs;
+  memcpy(&a->pkt, pkt, sizeof(SX1276Packet));
+  _QCount++;
+  return 0;
+}
+
+/*  MatchConfig
+ *  1 (default): packets are only received if they match the radio's frequency, SF, BW and sync word.
+ *  0: every packet is received, and the radio takes the packet's settings.
+ */
+void SX1276Emulator::
+MatchConfig (uint8_t on)
+{
+  _MatchConfig = on;
+}
+
+/*  OnTransmit
+ *  Call fn(ctx, pkt) for each packet transmitted, when TxDone is set.
+ *  pkt->timeUs is the time TX started. rssi and snr are 0.
+ */
+void SX1276Emulator::
+OnTransmit (void (*fn)(void *ctx, const SX1276Packet *pkt),
+            void *ctx)
+{
+  _OnTransmit = fn;
+  _OnTransmitCtx = ctx;
+}
+
+/*  Register
+ *  Returns: Register value, without the side effects of an SPI read.
+ */
+uint8_t SX1276Emulator::
+Register (uint8_t addr)
+{
+  if (addr == 0x00)
+  {
+    return _Fifo[_Reg[0x0D]];
+  }
+  return _Reg[addr & 0x7F];
+}
+
+/*  Pending
+ *  Returns: Packets queued and not yet received or missed.
+ */
+uint32_t SX1276Emulator::
+Pending ()
+{ return _QCount; }
+
+/*  Delivered
+ *  Returns: Packets received into the FIFO.
+ */
+uint32_t SX1276Emulator::
+Delivered ()
+{ return _Delivered; }
+
+/*  Missed
+ *  Returns: Packets that arrived while the radio wasn't receiving, or didn't match its settings.
+ */
+uint32_t SX1276Emulator::
+Missed ()
+{ return _Missed; }
+
+/*  Transmitted
+ *  Returns: Packets transmitted.
+ */
+uint32_t SX1276Emulator::
+Transmitted ()
+{ return _Transmitted; }
+
+/*  Transactions
+ *  Returns: SPI transactions (NSS low periods with a transfer) so far.
+ */
+uint32_t SX1276Emulator::
+Transactions ()
+{ return _Transactions; }
+
+/*  SpiBytes
+ *  Returns: Bytes transferred over SPI so far, including address bytes.
+ */
+uint64_t SX1276Emulator::
+SpiBytes ()
+{ return _SpiBytes; }
+
+/*  DeliveredNs
+ *  Returns: RealNs() when the last packet was put in the FIFO, for latency measurement.
+ */
+uint64_t SX1276Emulator::
+DeliveredNs ()
+{ return _DeliveredNs; }
+
+/*  DataRW
+ *  One SPI transaction, as wiringPiSPIDataRW(). data[0] is the address (bit 7 set to write),
+ *  and the rest is written, or replaced by the data read. Writes return the old register value.
+ *  The address auto-increments, except for RegFifo.
+ *  Returns: len
+ */
+int SX1276Emulator::
+DataRW (uint8_t *data,
+        int      len)
+{
+  uint8_t addr = data[0] & 0x7F;
+  uint8_t write = data[0] & 0x80;
+
+  Update();
+  _Transactions++;
+  _SpiBytes += len;
+  data[0] = 0;
+  for (int n = 1; n < len; n++)
+  {
+    data[n] = write ? WriteReg(addr, data[n]) : ReadReg(addr);
+    if (addr != 0x00)
+    {
+      addr = (addr + 1) & 0x7F;
+    }
+  }
+  return len;
+}
+
+/*  Speed
+ *  Set the speed of the emulator clock. 1 is real time, n is n times real time,
+ *  0 is virtual time, which only advances on delay() / delayMicroseconds().
+ */
+void SX1276Emulator::
+Speed (float speed)
+{
+  _Emu->baseUs = NowUs();
+  _Emu->baseNs = RealNs();
+  _Emu->speed = speed < 0 ? 0 : speed;
+}
+
+/*  Partition
+ *  Give the calling thread radios and a clock of its own, starting from none and
+ *  time 0 at Speed(1), so threads can each run emulated radios at the same time.
+ *  Call before creating the thread's radios, and use them only from that thread.
+ */
+void SX1276Emulator::
+Partition ()
+{
+  memset(&_EmuLocal, 0, sizeof(_EmuLocal));
+  _EmuLocal.speed = 1;
+  _Emu = &_EmuLocal;
+}
+
+/*  Clock
+ *  Set virtual time (Speed(0)) to us. For a discrete event simulation, which runs
+ *  each radio's calls at their own times: time may go back, but must not go back
+ *  for a radio from one of its calls to the next.
+ */
+void SX1276Emulator::
+Clock (uint64_t us)
+{
+  _Emu->baseUs = us;
+}
+
+/*  Attach
+ *  Answer on this radio's NSS pin again, in place of any radio created on the pin
+ *  since. Lets a simulation run more radios than there are pins, one at a time.
+ */
+void SX1276Emulator::
+Attach ()
+{
+  if (_Emu->selected == _Emu->radios[_NSS_pin]) _Emu->selected = NULL;
+  _Emu->radios[_NSS_pin] = this;
+}
+
+/*  NowUs
+ *  Returns: Emulator time in us. Starts at 0.
+ */
+uint64_t SX1276Emulator::
+NowUs ()
+{
+  if (_Emu->speed == 0)
+  {
+    return _Emu->baseUs;
+  }
+  if (_Emu->baseNs == 0)
+  {
+    _Emu->baseNs = RealNs();
+  }
+  return _Emu->baseUs + (uint64_t) ((RealNs() - _Emu->baseNs) * _Emu->speed / 1000);
+}
+
+/*  Sleep
+ *  Wait us of emulator time: sleep us / Speed() in real time, or advance virtual time.
+ */
+void SX1276Emulator::
+Sleep (uint64_t us)
+{
+  if (_Emu->speed == 0)
+  {
+    _Emu->baseUs += us;
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t) (us * 1000 / _Emu->speed)));
+}
+
+/*  RealNs
+ *  Returns: Monotonic real time in ns, for measuring the host.
+ */
+uint64_t SX1276Emulator::
+RealNs ()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*  Pin
+ *  A GPIO pin was set. NSS low selects a radio for Transfer(); reset low resets it.
+ */
+void SX1276Emulator::
+Pin (int pin,
+     int value)
+{
+  if (pin < 0 || pin > 255)
+  {
+    return;
+  }
+  if (_Emu->radios[pin] != NULL)
+  {
+    if (value == LOW) _Emu->selected = _Emu->radios[pin];
+    else if (_Emu->selected == _Emu->radios[pin]) _Emu->selected = NULL;
+  }
+  if (value == LOW)
+  {
+    for (int n = 0; n < 256; n++)
+    {
+      if (_Emu->radios[n] != NULL && _Emu->radios[n]->_ResetPin == pin)
+      {
+        _Emu->radios[n]->Reset();
+      }
+    }
+  }
+}
+
+/*  Transfer
+ *  SPI transaction with the selected radio. With none selected, reads return 0.
+ *  Returns: len
+ */
+int SX1276Emulator::
+Transfer (uint8_t *data,
+          int      len)
+{
+  if (_Emu->selected == NULL)
+  {
+    memset(data, 0, len);
+    return len;
+  }
+  _Emu->selected->DataRW(data, len);
+  if (_EmuMaxSpiHz != 0 && _EmuSpiHz > _EmuMaxSpiHz)
+  {
+    for (int n = 1; n < len; n++)
+    {
+      if (++_EmuSpiErrors % 3 == 0) data[n] ^= 0x01; // MISO sampled late
+    }
+  }
+  return len;
+}
+
+/*  SpiClock
+ *  The SPI clock the library set, from wiringPiSPISetup().
+ */
+void SX1276Emulator::
+SpiClock (int hz)
+{
+  _EmuSpiHz = hz;
+}
+
+/*  MaxSpiHz
+ *  Corrupt reads when the SPI clock is above hz, as marginal wiring would. 0 (the
+ *  default) for no limit.
+ */
+void SX1276Emulator::
+MaxSpiHz (int hz)
+{
+  _EmuMaxSpiHz = hz;
+}
+
+/*  SymbolUs
+ *  Returns: Symbol time in us for the current SF and BW.
+ */
+uint32_t SX1276Emulator::
+SymbolUs ()
+{
+  uint8_t bw = _Reg[0x1D] >> 4;
+  uint8_t sf = _Reg[0x1E] >> 4;
+  if (bw > 9) bw = 9;
+  if (sf < 6) sf = 6;
+  return ((uint64_t) 1000000 << sf) / SX1276_BW_HZ[bw];
+}
+
+/*  Enter
+ *  Change to mode, starting the mode's timer.
+ */
+void SX1276Emulator::
+Enter (uint8_t mode)
+{
+  uint8_t  prev = _Reg[0x01] & 0x07;
+  uint64_t now = NowUs();
+
+  _Reg[0x01] = (_Reg[0x01] & 0xF8) | mode;
+  if (!(_Reg[0x01] & 0x80) || mode == prev)
+  {
+    return;
+  }
+  _ModeUs = now;
+  switch (mode)
+  {
+    case SX1276_MODE_TX:
+      _EventUs = now + (uint64_t) 1000 *
+                 SX1276::AirtimeMs(_Reg[0x1E] >> 4, _Reg[0x1D] >> 4, (_Reg[0x1D] >> 1) & 0x07,
+                                   _Reg[0x20] * 0x100 + _Reg[0x21], _Reg[0x1D] & 0x01,
+                                   (_Reg[0x1E] >> 2) & 0x01, (_Reg[0x26] >> 3) & 0x01, _Reg[0x22]);
+      break;
+    case SX1276_MODE_CAD:
+      _EventUs = now + 2 * SymbolUs();
+      break;
+    case SX1276_MODE_RXSINGLE:
+      _EventUs = now + (uint64_t) SymbolUs() * (((_Reg[0x1E] & 0x03) << 8) | _Reg[0x1F]);
+      /* fall through */
+    case SX1276_MODE_RXCONTINUOUS:
+      if (prev != SX1276_MODE_RXCONTINUOUS && prev != SX1276_MODE_RXSINGLE)
+      {
+        _RxWrite = _Reg[0x0F];
+        _HeaderCnt = 0; // ValidHeaderCnt and ValidPacketCnt restart on entering RX
+        _PacketCnt = 0;
+        memset(_Reg + 0x14, 0, 4);
+      }
+      break;
+  }
+}
+
+/*  Update
+ *  Process mode timers and packet arrivals up to now.
+ */
+void SX1276Emulator::
+Update ()
+{
+  uint64_t     now = NowUs();
+  uint8_t      mode = _Reg[0x01] & 0x07;
+  uint8_t      rx;
+  uint32_t     freq, bwhz;
+  Arrival *    a;
+  SX1276Packet pkt;
+
+  if (!(_Reg[0x01] & 0x80))
+  {
+    return;
+  }
+  if (mode == SX1276_MODE_TX && now >= _EventUs)
+  {
+    pkt.timeUs = _ModeUs;
+    pkt.frequency = (uint64_t) (_Reg[0x06] * 0x10000 + _Reg[0x07] * 0x100 + _Reg[0x08]) * 61035 / 1000;
+    pkt.rssi = 0;
+    pkt.snr = 0;
+    pkt.sf = _Reg[0x1E] >> 4;
+    pkt.bw = _Reg[0x1D] >> 4;
+    pkt.cr = (_Reg[0x1D] >> 1) & 0x07;
+    pkt.syncWord = _Reg[0x39];
+    pkt.crcError = 0;
+    pkt.crcOn = (_Reg[0x1E] >> 2) & 0x01;
+    pkt.implicitHeader = _Reg[0x1D] & 0x01;
+    pkt.len = _Reg[0x22];
+    for (int n = 0; n < pkt.len; n++)
+    {
+      pkt.data[n] = _Fifo[(uint8_t) (_Reg[0x0E] + n)];
+    }
+    _Reg[0x12] |= 0x08;
+    Enter(SX1276_MODE_STDBY);
+    _Transmitted++;
+    if (_OnTransmit != NULL)
+    {
+      _OnTransmit(_OnTransmitCtx, &pkt);
+    }
+    return;
+  }
+  if (mode == SX1276_MODE_CAD)
+  {
+    if (now >= _EventUs) // Packets arriving during CAD are left for CadDetected
+    {
+      _Reg[0x12] |= 0x04;
+      if (_QCount > 0 && _Queue[_QHead].at <= _EventUs)
+      {
+        _Reg[0x12] |= 0x01;
+      }
+      Enter(SX1276_MODE_STDBY);
+    }
+    return;
+  }
+
+  while (_QCount > 0)
+  {
+    a = &_Queue[_QHead];
+    rx = (mode == SX1276_MODE_RXCONTINUOUS || mode == SX1276_MODE_RXSINGLE);
+    if (a->at == 0)
+    {
+      if (!rx || (_Reg[0x12] & 0x40))
+      {
+        break; // wait until the radio can take it
+      }
+    }
+    else if (a->at > now)
+    {
+      break;
+    }
+    if (_MatchConfig && rx)
+    {
+      freq = (uint64_t) (_Reg[0x06] * 0x10000 + _Reg[0x07] * 0x100 + _Reg[0x08]) * 61035 / 1000;
+      bwhz = SX1276_BW_HZ[(_Reg[0x1D] >> 4) > 9 ? 9 : (_Reg[0x1D] >> 4)];
+      rx = a->pkt.sf == (_Reg[0x1E] >> 4) && a->pkt.bw == (_Reg[0x1D] >> 4) &&
+           a->pkt.syncWord == _Reg[0x39] &&
+           (a->pkt.frequency > freq ? a->pkt.frequency - freq : freq - a->pkt.frequency) < bwhz / 4;
+    }
+    if (rx)
+    {
+      Deliver(&a->pkt);
+    }
+    else
+    {
+      _Missed++;
+    }
+    _QHead = (_QHead + 1) % EMU_QUEUE;
+    _QCount--;
+    if (rx && mode == SX1276_MODE_RXSINGLE)
+    {
+      Enter(SX1276_MODE_STDBY);
+      return;
+    }
+  }
+  if (mode == SX1276_MODE_RXSINGLE && now >= _EventUs)
+  {
+    _Reg[0x12] |= 0x80;
+    Enter(SX1276_MODE_STDBY);
+  }
+}
+
+/*  Deliver
+ *  Put a received packet in the FIFO and set the RX status registers and IRQ flags.
+ */
+void SX1276Emulator::
+Deliver (const SX1276Packet *pkt)
+{
+  uint32_t frf;
+  int      offset = (_Reg[0x01] & 0x08) ? -164 : -157;
+  int      rssi;
+
+  if (!_MatchConfig)
+  {
+    if (pkt->frequency != 0)
+    {
+      frf = ((uint64_t) pkt->frequency * 1000 + 61035 / 2) / 61035; // nearest, inverse of the decode
+      _Reg[0x06] = frf >> 16;
+      _Reg[0x07] = frf >> 8;
+      _Reg[0x08] = frf;
+    }
+    if (pkt->sf != 0) _Reg[0x1E] = (pkt->sf << 4) | (_Reg[0x1E] & 0x0F);
+    if (pkt->cr != 0) _Reg[0x1D] = (_Reg[0x1D] & 0xF1) | ((pkt->cr & 0x07) << 1);
+    _Reg[0x1D] = (pkt->bw << 4) | (_Reg[0x1D] & 0x0F);
+    _Reg[0x39] = pkt->syncWord;
+  }
+  for (int n = 0; n < pkt->len; n++)
+  {
+    _Fifo[(uint8_t) (_RxWrite + n)] = pkt->data[n];
+  }
+  _Reg[0x10] = _RxWrite;
+  _Reg[0x13] = pkt->len;
+  _RxWrite += pkt->len;
+
+  /* Inverse of SX1276::RssiDbm() */
+  if (pkt->snr < 0) rssi = pkt->rssi - offset - pkt->snr / 4;
+  else rssi = ((pkt->rssi - offset) * 15 + 15) / 16;
+  _Reg[0x1A] = rssi < 0 ? 0 : rssi > 255 ? 255 : rssi;
+  _Reg[0x19] = pkt->snr;
+  _Reg[0x18] = (pkt->cr & 0x07) << 5;
+  _Reg[0x1C] = (pkt->crcOn ? 0x40 : 0);
+  _Reg[0x12] |= 0x50 | (pkt->crcError ? 0x20 : 0);
+  _HeaderCnt++;
+  if (!pkt->crcError) _PacketCnt++;
+  _Reg[0x14] = _HeaderCnt >> 8;
+  _Reg[0x15] = _HeaderCnt;
+  _Reg[0x16] = _PacketCnt >> 8;
+  _Reg[0x17] = _PacketCnt;
+  _Delivered++;
+  _DeliveredNs = RealNs();
+}
+
+/*  ReadReg
+ *  SPI register read. RegFifo reads advance FifoAddrPtr.
+ */
+uint8_t SX1276Emulator::
+ReadReg (uint8_t addr)
+{
+  int offset = (_Reg[0x01] & 0x08) ? -164 : -157;
+  switch (addr)
+  {
+    case 0x00:
+      return _Fifo[_Reg[0x0D]++];
+    case 0x1B:
+      return EMU_NOISE_DBM - offset;
+    case 0x25:
+      return _RxWrite;
+  }
+  return _Reg[addr];
+}
+
+/*  WriteReg
+ *  SPI register write.
+ *  Returns: The old value of the register.
+ */
+uint8_t SX1276Emulator::
+WriteReg (uint8_t addr,
+          uint8_t value)
+{
+  uint8_t old = _Reg[addr];
+  switch (addr)
+  {
+    case 0x00:
+      if ((_Reg[0x01] & 0x07) != SX1276_MODE_SLEEP)
+      {
+        _Fifo[_Reg[0x0D]++] = value;
+      }
+      return 0;
+    case 0x01:
+      if ((old ^ value) & 0x80 && (old & 0x07) != SX1276_MODE_SLEEP)
+      {
+        value = (value & 0x7F) | (old & 0x80); // LongRangeMode only changes in Sleep
+      }
+      _Reg[0x01] = (value & 0xF8) | (old & 0x07);
+      Enter(value & 0x07);
+      return old;
+    case 0x12:
+      _Reg[0x12] &= ~value; // write 1 to clear
+      return old;
+    case 0x10: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17: case 0x18:
+    case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x25: case 0x28: case 0x29:
+    case 0x2A: case 0x2C: case 0x42:
+      return old; // read only
+  }
+  _Reg[addr] = value;
+  return old;
+}
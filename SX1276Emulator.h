@@ -0,0 +1,136 @@
+/*  SX1276Emulator_h - Register level SX1276 emulator, for building without a radio
+ *
+ *  Build with -DSX1276_EMULATOR and the library uses this instead of wiringPi.
+ *  The wiringPi calls the library makes (SPI transfers, chip select and reset pins,
+ *  millis/micros/delay) are provided here and drive emulated radios, so the library's
+ *  own routines (RXContinuous, TX, CAD...) run unchanged.
+ *
+ *  Each SX1276Emulator answers on the NSS pin it was created with: construct it
+ *  before the SX1276 using the same pins. Emulated radios keep the LoRa register map,
+ *  FIFO, IRQ flags and mode changes (TxDone after the time on air, CadDone, RxDone
+ *  and RxTimeout). Received packets are queued with Inject().
+ *
+ *  Time comes from one clock shared by all emulated radios. Speed(1) is real time,
+ *  Speed(n) runs n times faster, Speed(0) is virtual time which only moves on delay(),
+ *  so code runs as fast as the CPU allows.
+ *  MaxSpiHz(hz) models board wiring that can't take a faster SPI clock: with the bus
+ *  set above hz (wiringPiSPISetup), bytes read back are corrupted.
+ *  Not thread safe: use the emulator and the radios on it from one thread, or give
+ *  each thread radios and a clock of its own with Partition(). For simulating many
+ *  radios, Clock() sets virtual time and Attach() lets radios share an NSS pin.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Emulator_h
+#define SX1276Emulator_h
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef EMU_QUEUE
+#define EMU_QUEUE          256   // Packets waiting to be received, per radio
+#endif
+#define EMU_NOISE_DBM      -120  // RssiValue when no packet is being received
+
+struct SX1276Packet;
+
+class SX1276Emulator
+{
+  public:
+    SX1276Emulator    (uint8_t NSS_Pin = 6,     // NSS_PIN_DEFAULT on the Pi
+                       uint8_t ResetPin = 0);   // RESET_PIN_DEFAULT
+    ~SX1276Emulator   ();
+    void Reset        ();
+    int Inject        (const SX1276Packet *pkt,
+                       uint64_t atUs = 0);
+    void MatchConfig  (uint8_t on);
+    void OnTransmit   (void (*fn)(void *ctx, const SX1276Packet *pkt),
+                       void *ctx);
+    uint8_t Register  (uint8_t addr);
+    uint32_t Pending  ();
+    uint32_t Delivered();
+    uint32_t Missed   ();
+    uint32_t Transmitted();
+    uint32_t Transactions();
+    uint64_t SpiBytes ();
+    uint64_t DeliveredNs();
+    int DataRW        (uint8_t *data,
+                       int len);
+
+    static void Speed (float speed);
+    static uint64_t NowUs();
+    static void Sleep (uint64_t us);
+    static uint64_t RealNs();
+    static void Pin   (int pin,
+                       int value);
+    static int Transfer(uint8_t *data,
+                        int len);
+    static void SpiClock(int hz);
+    static void MaxSpiHz(int hz);
+    static void Partition();
+    static void Clock (uint64_t us);
+    void Attach       ();
+
+  private:
+    struct Arrival;
+    void Update       ();
+    void Enter        (uint8_t mode);
+    void Deliver      (const SX1276Packet *pkt);
+    uint32_t SymbolUs ();
+    uint8_t ReadReg   (uint8_t addr);
+    uint8_t WriteReg  (uint8_t addr,
+                       uint8_t value);
+    uint8_t  _NSS_pin;
+    uint8_t  _ResetPin;
+    uint8_t  _Reg[0x80];
+    uint8_t  _Fifo[256];
+    uint8_t  _RxWrite;      // Where the next received packet goes in the FIFO
+    uint8_t  _MatchConfig;
+    uint64_t _EventUs;      // TxDone, CadDone or RxTimeout time for the current mode
+    uint64_t _ModeUs;       // Time the current mode was entered
+    uint16_t _HeaderCnt;
+    uint16_t _PacketCnt;
+    Arrival * _Queue;
+    uint32_t _QHead;
+    uint32_t _QCount;
+    uint32_t _Delivered;
+    uint32_t _Missed;
+    uint32_t _Transmitted;
+    uint32_t _Transactions;
+    uint64_t _SpiBytes;
+    uint64_t _DeliveredNs;
+    void (*_OnTransmit)(void *ctx, const SX1276Packet *pkt);
+    void * _OnTransmitCtx;
+};
+
+/*  wiringPi compatible calls used by the library  */
+
+#define INPUT  0
+#define OUTPUT 1
+#define LOW    0
+#define HIGH   1
+
+inline int wiringPiSetup ()
+{ return 0; }
+inline int wiringPiSPISetup (int /* channel */, int speed)
+{ SX1276Emulator::SpiClock(speed); return 0; }
+inline int wiringPiSPIGetFd (int /* channel */)
+{ return -1; }
+inline int wiringPiSPIDataRW (int /* channel */, unsigned char *data, int len)
+{ return SX1276Emulator::Transfer(data, len); }
+inline void pinMode (int pin, int mode)
+{ if (mode == INPUT) SX1276Emulator::Pin(pin, HIGH); }
+inline void digitalWrite (int pin, int value)
+{ SX1276Emulator::Pin(pin, value); }
+inline unsigned int millis ()
+{ return SX1276Emulator::NowUs() / 1000; }
+inline unsigned int micros ()
+{ return SX1276Emulator::NowUs(); }
+inline void delay (unsigned int ms)
+{ SX1276Emulator::Sleep((uint64_t) ms * 1000); }
+inline void delayMicroseconds (unsigned int us)
+{ SX1276Emulator::Sleep(us); }
+
+/*  After the calls above, which the library's SPI transport is built on  */
+#include "SX1276.h"
+
+#endif
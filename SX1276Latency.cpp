@@ -0,0 +1,187 @@
+/*
+  SX1276Latency.cpp - Latency histograms for the SX1276 library
+  Released into the public domain.
+
+  Bucketing: values below 128ns have a bucket each. Above that each power of 2 is
+  split into 64 buckets, so a bucket is at most 1/64 of its value wide. Percentiles
+  report the highest value in their bucket (never less than the true value),
+  capped at the largest value recorded.
+
+  Where the library takes its timings:
+    spi    spi_rx / spi_tx / spi_burst_rx / spi_burst_tx, the transfer itself
+    tx     TX: start of the FIFO load to TxDone. TXBurst and RXReply: each TX request to
+           TxDone, as their frames are already in the FIFO. Timed with micros(), so
+           polling granularity (10ms in TX, 100us in TXBurst / RXReply) is included.
+    rx     RXContinuous / RXFiltered: RxDone seen to the call returning. RXReply: RxDone
+           seen to the payload being read, before the reply is sent.
+    cad    Each CAD request to CadDone seen, timed with micros().
+    mode   Each SetMode() that writes RegOpMode. LoRa mode has no flag for the modem
+           having settled, so this is the time the caller waits for the mode change.
+*/
+
+#include <stdio.h>
+#include "SX1276Latency.h"
+
+static const char * _StageName[LATENCY_STAGES] = {"spi", "tx", "rx", "cad", "mode"};
+
+/*  SX1276Histogram
+ *
+ *  Class initialisation. Empty.
+ */
+SX1276Histogram::
+SX1276Histogram ()
+{
+  Clear();
+}
+
+/*  Clear
+ *  Empty the histogram. Only the writer may call this while recording.
+ */
+void SX1276Histogram::
+Clear ()
+{
+  for (int b = 0; b < HIST_BUCKETS; b++) _Count[b] = 0;
+  _Total = 0;
+  _Sum = 0;
+  _Min = UINT64_MAX;
+  _Max = 0;
+}
+
+/*  BucketHigh
+ *  Returns: Highest value that falls in bucket.
+ */
+uint64_t SX1276Histogram::
+BucketHigh (uint32_t bucket)
+{
+  uint32_t shift;
+  if (bucket < (2 << HIST_SUB_BITS))
+  {
+    return bucket;
+  }
+  shift = (bucket >> HIST_SUB_BITS) - 1;
+  return ((uint64_t) ((bucket & ((1 << HIST_SUB_BITS) - 1)) + (1 << HIST_SUB_BITS) + 1) << shift) - 1;
+}
+
+uint64_t SX1276Histogram::Count()
+{ return _Total.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Histogram::Min()
+{ return Count() ? _Min.load(std::memory_order_relaxed) : 0; }
+
+uint64_t SX1276Histogram::Max()
+{ return _Max.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Histogram::Mean()
+{ return Count() ? _Sum.load(std::memory_order_relaxed) / Count() : 0; }
+
+/*  Percentile
+ *  p: 0-100, e.g. 99.9
+ *  Returns: Value in ns that p% of recorded values are at or below. 0 if empty.
+ */
+uint64_t SX1276Histogram::
+Percentile (float p)
+{
+  uint64_t total = 0;
+  uint64_t target, seen = 0;
+  uint64_t max = Max();
+  uint64_t v;
+
+  for (int b = 0; b < HIST_BUCKETS; b++) total += _Count[b].load(std::memory_order_relaxed);
+  if (total == 0)
+  {
+    return 0;
+  }
+  target = (uint64_t) (p / 100 * total + 0.5);
+  if (target < 1) target = 1;
+  if (target > total) target = total;
+  for (int b = 0; b < HIST_BUCKETS; b++)
+  {
+    seen += _Count[b].load(std::memory_order_relaxed);
+    if (seen >= target)
+    {
+      v = BucketHigh(b);
+      return v < max ? v : max;
+    }
+  }
+  return max;
+}
+
+/*  SX1276Latency
+ *
+ *  Class initialisation. Attach to a radio with SX1276::Latency().
+ */
+SX1276Latency::
+SX1276Latency ()
+{
+  for (int s = 0; s < LATENCY_STAGES; s++) _Timeouts[s] = 0;
+}
+
+/*  Clear
+ *  Empty all histograms. Only the radio's thread may call this while it is in use.
+ */
+void SX1276Latency::
+Clear ()
+{
+  for (int s = 0; s < LATENCY_STAGES; s++)
+  {
+    _Stage[s].Clear();
+    _Timeouts[s] = 0;
+  }
+}
+
+/*  Stage
+ *  Returns: Histogram for a LATENCY_xxx stage, NULL if out of range.
+ */
+SX1276Histogram * SX1276Latency::
+Stage (uint8_t stage)
+{
+  return stage < LATENCY_STAGES ? &_Stage[stage] : NULL;
+}
+
+/*  Timeouts
+ *  Returns: Times a LATENCY_xxx stage timed out. These aren't in its histogram.
+ */
+uint64_t SX1276Latency::
+Timeouts (uint8_t stage)
+{
+  return stage < LATENCY_STAGES ? _Timeouts[stage].load(std::memory_order_relaxed) : 0;
+}
+
+/*  StageName
+ *  Returns: Short name of a LATENCY_xxx stage.
+ */
+const char * SX1276Latency::
+StageName (uint8_t stage)
+{
+  return stage < LATENCY_STAGES ? _StageName[stage] : "?";
+}
+
+/*  Format
+ *  Write a table of count, min, p50, p99, p99.9 and max (us), and timeouts, for each
+ *  stage, e.g. to print every few seconds.
+ *  Returns: Length of the text, or -1 if buf is too small.
+ */
+int SX1276Latency::
+Format (char  *buf,
+        size_t len)
+{
+  size_t used = 0;
+  int    n;
+  SX1276Histogram * h;
+
+  n = snprintf(buf, len, "%-5s %10s %10s %10s %10s %10s %10s %10s  (times in us)\n",
+               "stage", "count", "min", "p50", "p99", "p99.9", "max", "timeouts");
+  if (n < 0 || (size_t) n >= len) return -1;
+  used = n;
+  for (int s = 0; s < LATENCY_STAGES; s++)
+  {
+    h = &_Stage[s];
+    n = snprintf(buf + used, len - used, "%-5s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f %10llu\n",
+                 _StageName[s], (unsigned long long) h->Count(), h->Min() / 1e3,
+                 h->Percentile(50) / 1e3, h->Percentile(99) / 1e3, h->Percentile(99.9) / 1e3,
+                 h->Max() / 1e3, (unsigned long long) Timeouts(s));
+    if (n < 0 || (size_t) n >= len - used) return -1;
+    used += n;
+  }
+  return used;
+}
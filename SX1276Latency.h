@@ -0,0 +1,118 @@
+/*  SX1276Latency_h - Latency histograms for the SX1276 library
+ *
+ *  Attach an SX1276Latency to a radio with SX1276::Latency() and the library records
+ *  how long SPI transactions, transmissions, packet delivery, CAD cycles and mode
+ *  changes take, in high dynamic range histograms: 1ns to 18 minutes, within 1.6%.
+ *  Histograms are fixed arrays, so recording never allocates. Counts are relaxed
+ *  atomics written only by the thread using the radio, so percentiles can be read
+ *  from any other thread, e.g. for a periodic dump.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Latency_h
+#define SX1276Latency_h
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#ifdef ESP32
+  #include "Arduino.h"
+#else
+  #include <time.h>
+#endif
+
+#define HIST_SUB_BITS      6      // 64 sub-buckets per power of 2
+#define HIST_MAX_BITS      40     // Values up to 2^40 ns, larger values are clamped
+#define HIST_BUCKETS       ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+/*  SX1276Histogram
+ *  Log-linear histogram of values in ns. One writer, any number of readers.
+ */
+class SX1276Histogram
+{
+  public:
+    SX1276Histogram   ();
+    void Clear        ();
+    inline void Record(uint64_t ns)
+    {
+      uint32_t b = Bucket(ns);
+      _Count[b].store(_Count[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      _Total.store(_Total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      _Sum.store(_Sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if (ns > _Max.load(std::memory_order_relaxed)) _Max.store(ns, std::memory_order_relaxed);
+      if (ns < _Min.load(std::memory_order_relaxed)) _Min.store(ns, std::memory_order_relaxed);
+    }
+    static inline uint32_t Bucket(uint64_t ns)
+    {
+      uint32_t shift;
+      if (ns < (2 << HIST_SUB_BITS))
+      {
+        return ns;
+      }
+      if (ns >= (1ULL << HIST_MAX_BITS))
+      {
+        return HIST_BUCKETS - 1;
+      }
+      shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS;
+      return ((shift + 1) << HIST_SUB_BITS) + (ns >> shift) - (1 << HIST_SUB_BITS);
+    }
+    static uint64_t BucketHigh(uint32_t bucket);
+    uint64_t Count    ();
+    uint64_t Min      ();
+    uint64_t Max      ();
+    uint64_t Mean     ();
+    uint64_t Percentile(float p);
+
+  private:
+    std::atomic<uint32_t> _Count[HIST_BUCKETS];
+    std::atomic<uint64_t> _Total;
+    std::atomic<uint64_t> _Sum;
+    std::atomic<uint64_t> _Min;
+    std::atomic<uint64_t> _Max;
+};
+
+/* Stages timed by the library */
+#define LATENCY_SPI        0      // One SPI transaction
+#define LATENCY_TX         1      // FIFO load (TX) or TX request (TXBurst, RXReply) to TxDone seen
+#define LATENCY_RX         2      // RxDone seen to the payload being in rxdata
+#define LATENCY_CAD        3      // CAD request to CadDone seen
+#define LATENCY_MODE       4      // SetMode() call to its last RegOpMode write
+#define LATENCY_STAGES     5
+
+class SX1276Latency
+{
+  public:
+    SX1276Latency     ();
+    void Clear        ();
+    inline void Record(uint8_t  stage,
+                       uint64_t ns)
+    {
+      _Stage[stage].Record(ns);
+    }
+    inline void Timeout(uint8_t stage) // Gave up waiting: counted, not recorded as a time
+    {
+      _Timeouts[stage].store(_Timeouts[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    SX1276Histogram * Stage(uint8_t stage);
+    uint64_t Timeouts (uint8_t stage);
+    static const char * StageName(uint8_t stage);
+    int Format        (char  *buf,
+                       size_t len);
+
+    /* Clock used for the timings */
+    static inline uint64_t NowNs()
+    {
+#ifdef ESP32
+      return (uint64_t) micros() * 1000;
+#else
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+  private:
+    SX1276Histogram _Stage[LATENCY_STAGES];
+    std::atomic<uint64_t> _Timeouts[LATENCY_STAGES];
+};
+
+#endif
@@ -0,0 +1,477 @@
+/*
+  SX1276Log.cpp - Binary packet log for the SX1276 library (Linux only)
+  Released into the public domain.
+
+  The writer appends records to a memory buffer, and writes the buffer with one
+  write() to a file opened O_APPEND when it fills, or on the first Append() after
+  flushms has passed. fsync() is called at most every fsyncms. Index entries are
+  written after the data they point to, so the index never points past the data.
+  A write that fails part way is cut back off the file, so a torn record or index
+  entry is never left for the next write to land after. Call Flush() when idle so
+  buffered packets don't wait for the next one.
+
+  The reader maps the log and index read only. Seek() binary searches the index, then
+  steps forward over at most LOG_INDEX_EVERY records.
+
+  Record header (LOG_RECORD_HEADER bytes, little endian):
+    0  uint16 record length     4  uint64 timeUs      18 int8  snr      21 uint8 cr
+    2  uint8  data length       12 uint32 frequency   19 uint8 sf       22 uint8 syncWord
+    3  uint8  flags             16 int16  rssi        20 uint8 bw       23 reserved
+  Flags: 1 = CRC error, 2 = CRC on, 4 = implicit header
+*/
+#ifndef ESP32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "SX1276Log.h"
+
+static const char _LogMagic[8] = {'S','X','1','2','7','6','L','G'};
+
+/* Little endian field access, so logs move between hosts */
+static void _LogPut (uint8_t *p, uint64_t v, int n)
+{
+  for (int i = 0; i < n; i++) p[i] = v >> (8 * i);
+}
+
+static uint64_t _LogGet (const uint8_t *p, int n)
+{
+  uint64_t v = 0;
+  for (int i = n - 1; i >= 0; i--) v = v << 8 | p[i];
+  return v;
+}
+
+/*  SX1276LogWriter
+ *
+ *  Class initialisation. Call Open() before Append().
+ */
+SX1276LogWriter::
+SX1276LogWriter ()
+{
+  _Fd = -1;
+  _IdxFd = -1;
+  _Used = 0;
+  _IdxUsed = 0;
+}
+
+SX1276LogWriter::
+~SX1276LogWriter ()
+{
+  Close();
+}
+
+/*  Open
+ *  Open a log for appending, creating it if needed. The index is <path>.idx.
+ *  Returns: 0 on success
+ *           -1 if the file can't be opened, or is not a log
+ */
+int SX1276LogWriter::
+Open (const char * path,    // Log file
+      uint32_t     flushms, // [Optional] Max time in ms packets are buffered. Default: 1000
+      uint32_t     fsyncms) // [Optional] Min time in ms between fsync(). Default: 10000
+{
+  uint8_t     header[LOG_FILE_HEADER];
+  char        idxpath[512];
+  struct stat st;
+
+  Close();
+  if (strlen(path) + 5 > sizeof(idxpath))
+  {
+    return -1;
+  }
+  _Fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (_Fd < 0 || fstat(_Fd, &st) < 0)
+  {
+    Close();
+    return -1;
+  }
+  if (st.st_size == 0)
+  {
+    memset(header, 0, sizeof(header));
+    memcpy(header, _LogMagic, sizeof(_LogMagic));
+    header[8] = LOG_VERSION;
+    header[10] = LOG_FILE_HEADER;
+    if (write(_Fd, header, sizeof(header)) != sizeof(header))
+    {
+      Close();
+      return -1;
+    }
+    _Offset = LOG_FILE_HEADER;
+  }
+  else
+  {
+    if (pread(_Fd, header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header, _LogMagic, sizeof(_LogMagic)) != 0 || header[8] != LOG_VERSION)
+    {
+      Close();
+      return -1;
+    }
+    _Offset = st.st_size;
+  }
+  strcpy(idxpath, path);
+  strcat(idxpath, ".idx");
+  _IdxFd = open(idxpath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (_IdxFd < 0 || fstat(_IdxFd, &st) < 0)
+  {
+    Close();
+    return -1;
+  }
+  _IdxOffset = st.st_size - st.st_size % LOG_INDEX_ENTRY;
+  if ((uint64_t) st.st_size != _IdxOffset && ftruncate(_IdxFd, _IdxOffset) < 0) // torn entry
+  {
+    Close();
+    return -1;
+  }
+  _Records = 0;
+  _FlushMs = flushms;
+  _FsyncMs = fsyncms;
+  _LastFlush = millis();
+  _LastSync = _LastFlush;
+  return 0;
+}
+
+/*  Append
+ *  Add a packet to the log. If pkt->timeUs is 0 the current time is used.
+ *  Returns: 0 on success
+ *           -1 if a write failed or the log isn't open
+ */
+int SX1276LogWriter::
+Append (const SX1276Packet *pkt)
+{
+  uint8_t *  r;
+  uint16_t   reclen = LOG_RECORD_HEADER + pkt->len;
+  uint64_t   t = pkt->timeUs;
+  struct timeval tv;
+
+  if (_Fd < 0)
+  {
+    return -1;
+  }
+  if (_Used + reclen > sizeof(_Buffer) && Flush() < 0)
+  {
+    return -1;
+  }
+  if (t == 0)
+  {
+    gettimeofday(&tv, NULL);
+    t = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+  if (_Records++ % LOG_INDEX_EVERY == 0 && _IdxUsed < LOG_INDEX_MAX)
+  {
+    _Idx[_IdxUsed].timeUs = t;
+    _Idx[_IdxUsed].offset = _Offset + _Used;
+    _IdxUsed++;
+  }
+  r = _Buffer + _Used;
+  _LogPut(r, reclen, 2);
+  r[2] = pkt->len;
+  r[3] = (pkt->crcError ? 1 : 0) | (pkt->crcOn ? 2 : 0) | (pkt->implicitHeader ? 4 : 0);
+  _LogPut(r + 4, t, 8);
+  _LogPut(r + 12, pkt->frequency, 4);
+  _LogPut(r + 16, (uint16_t) pkt->rssi, 2);
+  r[18] = pkt->snr;
+  r[19] = pkt->sf;
+  r[20] = pkt->bw;
+  r[21] = pkt->cr;
+  r[22] = pkt->syncWord;
+  r[23] = 0;
+  memcpy(r + LOG_RECORD_HEADER, pkt->data, pkt->len);
+  _Used += reclen;
+  if ((uint32_t) (millis() - _LastFlush) >= _FlushMs)
+  {
+    return Flush();
+  }
+  return 0;
+}
+
+/*  Flush
+ *  Write buffered records, then their index entries. fsync() if fsyncms has passed.
+ *  If the records can't all be written, what was written is cut off again and they stay
+ *  buffered for the next Flush(). If the index entries can't, they are dropped: Seek()
+ *  then steps from an earlier entry. If a partial write can't be cut off the log is closed.
+ *  Returns: 0 on success, -1 if a write failed.
+ */
+int SX1276LogWriter::
+Flush ()
+{
+  uint8_t entries[LOG_INDEX_MAX * LOG_INDEX_ENTRY];
+  ssize_t n;
+
+  if (_Fd < 0)
+  {
+    return -1;
+  }
+  _LastFlush = millis();
+  if (_Used > 0)
+  {
+    n = write(_Fd, _Buffer, _Used);
+    if (n != (ssize_t) _Used)
+    {
+      if (n > 0 && ftruncate(_Fd, _Offset) < 0)
+      {
+        _Used = 0; // Nothing more can be appended safely
+        _IdxUsed = 0;
+        Close();
+      }
+      return -1;
+    }
+    _Offset += _Used;
+    _Used = 0;
+  }
+  if (_IdxUsed > 0)
+  {
+    for (uint32_t i = 0; i < _IdxUsed; i++)
+    {
+      _LogPut(entries + i * LOG_INDEX_ENTRY, _Idx[i].timeUs, 8);
+      _LogPut(entries + i * LOG_INDEX_ENTRY + 8, _Idx[i].offset, 8);
+    }
+    n = write(_IdxFd, entries, _IdxUsed * LOG_INDEX_ENTRY);
+    if (n != (ssize_t) (_IdxUsed * LOG_INDEX_ENTRY))
+    {
+      _IdxUsed = 0;
+      if (n > 0 && ftruncate(_IdxFd, _IdxOffset) < 0)
+      {
+        Close();
+      }
+      return -1;
+    }
+    _IdxOffset += n;
+    _IdxUsed = 0;
+  }
+  if ((uint32_t) (_LastFlush - _LastSync) >= _FsyncMs)
+  {
+    return Sync();
+  }
+  return 0;
+}
+
+/*  Sync
+ *  fsync() the log and index now. Does not flush the buffer.
+ *  Returns: 0 on success, -1 on failure.
+ */
+int SX1276LogWriter::
+Sync ()
+{
+  _LastSync = millis();
+  if (fdatasync(_Fd) < 0 || fdatasync(_IdxFd) < 0)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/*  Close
+ *  Flush, sync and close the log.
+ */
+void SX1276LogWriter::
+Close ()
+{
+  if (_Fd >= 0 && _IdxFd >= 0)
+  {
+    Flush();
+    Sync();
+  }
+  if (_Fd >= 0) close(_Fd);
+  if (_IdxFd >= 0) close(_IdxFd);
+  _Fd = -1;
+  _IdxFd = -1;
+  _Used = 0;
+  _IdxUsed = 0;
+}
+
+
+/*  SX1276LogReader
+ *
+ *  Class initialisation. Call Open() before Next().
+ */
+SX1276LogReader::
+SX1276LogReader ()
+{
+  _Data = NULL;
+  _Idx = NULL;
+  _DataLen = 0;
+  _IdxLen = 0;
+  _IdxMapLen = 0;
+  _Pos = 0;
+}
+
+SX1276LogReader::
+~SX1276LogReader ()
+{
+  Close();
+}
+
+/*  Open
+ *  Map a log, and its index if there is one, for reading.
+ *  Reading starts at the first record. Records appended later are not seen.
+ *  Returns: 0 on success
+ *           -1 if the file can't be opened, or is not a log
+ */
+int SX1276LogReader::
+Open (const char *path) // Log file
+{
+  char        idxpath[512];
+  struct stat st;
+  int         fd;
+  void *      map;
+
+  Close();
+  if (strlen(path) + 5 > sizeof(idxpath))
+  {
+    return -1;
+  }
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < LOG_FILE_HEADER)
+  {
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return -1;
+  }
+  _Data = (const uint8_t *) map;
+  _DataLen = st.st_size;
+  if (memcmp(_Data, _LogMagic, sizeof(_LogMagic)) != 0 || _Data[8] != LOG_VERSION)
+  {
+    Close();
+    return -1;
+  }
+  _Pos = _Data[10];
+
+  strcpy(idxpath, path);
+  strcat(idxpath, ".idx");
+  fd = open(idxpath, O_RDONLY);
+  if (fd >= 0)
+  {
+    if (fstat(fd, &st) == 0 && st.st_size >= LOG_INDEX_ENTRY)
+    {
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map != MAP_FAILED)
+      {
+        _Idx = (const uint8_t *) map;
+        _IdxLen = st.st_size / LOG_INDEX_ENTRY;
+        _IdxMapLen = st.st_size;
+      }
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+/*  Seek
+ *  Move to the first record at or after timeUs.
+ *  Returns: 0 on success, -1 if the log isn't open.
+ */
+int SX1276LogReader::
+Seek (uint64_t timeUs) // Time in us since the epoch
+{
+  size_t   lo = 0, hi = _IdxLen, mid;
+  uint64_t t;
+  if (_Data == NULL)
+  {
+    return -1;
+  }
+  _Pos = _Data[10];
+  /* Last index entry with time <= timeUs */
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (_LogGet(_Idx + mid * LOG_INDEX_ENTRY, 8) <= timeUs) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo > 0 && _LogGet(_Idx + (lo - 1) * LOG_INDEX_ENTRY + 8, 8) < _DataLen)
+  {
+    _Pos = _LogGet(_Idx + (lo - 1) * LOG_INDEX_ENTRY + 8, 8);
+  }
+  /* Step over earlier records */
+  while (_Pos + LOG_RECORD_HEADER <= _DataLen)
+  {
+    t = _LogGet(_Data + _Pos + 4, 8);
+    if (t >= timeUs)
+    {
+      break;
+    }
+    uint16_t reclen = _LogGet(_Data + _Pos, 2);
+    if (reclen < LOG_RECORD_HEADER)
+    {
+      break;
+    }
+    _Pos += reclen;
+  }
+  return 0;
+}
+
+/*  Next
+ *  Read the next record into pkt.
+ *  Returns: 1 if a packet was read
+ *           0 at the end of the log, or if the next record is after endUs
+ *           -1 if the log is corrupt or not open
+ */
+int SX1276LogReader::
+Next (SX1276Packet *pkt,   // Packet to fill in
+      uint64_t      endUs) // [Optional] Stop at records after this time
+{
+  const uint8_t * r;
+  uint16_t        reclen;
+  if (_Data == NULL)
+  {
+    return -1;
+  }
+  if (_Pos + LOG_RECORD_HEADER > _DataLen)
+  {
+    return 0;
+  }
+  r = _Data + _Pos;
+  reclen = _LogGet(r, 2);
+  if (reclen != LOG_RECORD_HEADER + r[2] || _Pos + reclen > _DataLen)
+  {
+    return -1;
+  }
+  pkt->timeUs = _LogGet(r + 4, 8);
+  if (pkt->timeUs > endUs)
+  {
+    return 0;
+  }
+  pkt->len = r[2];
+  pkt->crcError = r[3] & 1;
+  pkt->crcOn = (r[3] >> 1) & 1;
+  pkt->implicitHeader = (r[3] >> 2) & 1;
+  pkt->frequency = _LogGet(r + 12, 4);
+  pkt->rssi = (int16_t) _LogGet(r + 16, 2);
+  pkt->snr = r[18];
+  pkt->sf = r[19];
+  pkt->bw = r[20];
+  pkt->cr = r[21];
+  pkt->syncWord = r[22];
+  memcpy(pkt->data, r + LOG_RECORD_HEADER, pkt->len);
+  _Pos += reclen;
+  return 1;
+}
+
+/*  Close
+ *  Unmap the log.
+ */
+void SX1276LogReader::
+Close ()
+{
+  if (_Data != NULL) munmap((void *) _Data, _DataLen);
+  if (_Idx != NULL) munmap((void *) _Idx, _IdxMapLen);
+  _Data = NULL;
+  _Idx = NULL;
+  _DataLen = 0;
+  _IdxLen = 0;
+  _IdxMapLen = 0;
+  _Pos = 0;
+}
+
+#endif
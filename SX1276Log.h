@@ -0,0 +1,83 @@
+/*  SX1276Log_h - Binary packet log for the SX1276 library (Linux only)
+ *
+ *  File layout (little endian, whatever the host):
+ *    Header, 32 bytes: "SX1276LG", version, header size, reserved
+ *    Records: LOG_RECORD_HEADER bytes of metadata (see SX1276Packet) then len data bytes
+ *  Time index sidecar (<file>.idx): LOG_INDEX_ENTRY byte {uint64 timeUs, uint64 offset}
+ *  entries, one every LOG_INDEX_EVERY records, so readers can find a time range without
+ *  parsing the whole log.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Log_h
+#define SX1276Log_h
+#ifndef ESP32
+#include "SX1276.h"
+
+#define LOG_VERSION          1
+#define LOG_FILE_HEADER      32
+#define LOG_RECORD_HEADER    24
+#define LOG_INDEX_EVERY      64
+#define LOG_INDEX_ENTRY      16
+#define LOG_BUFFER_SIZE      65536
+#define LOG_INDEX_MAX        (LOG_BUFFER_SIZE / (LOG_RECORD_HEADER * LOG_INDEX_EVERY) + 1) // Per buffer
+#define LOG_FLUSH_MS         1000
+#define LOG_FSYNC_MS         10000
+
+struct SX1276LogIndex
+{
+  uint64_t timeUs;
+  uint64_t offset;
+};
+
+class SX1276LogWriter
+{
+  public:
+    SX1276LogWriter   ();
+    ~SX1276LogWriter  ();
+    int Open          (const char *path,
+                       uint32_t flushms = LOG_FLUSH_MS,
+                       uint32_t fsyncms = LOG_FSYNC_MS);
+    int Append        (const SX1276Packet *pkt);
+    int Flush         ();
+    int Sync          ();
+    void Close        ();
+
+  private:
+    int      _Fd;
+    int      _IdxFd;
+    uint64_t _Offset;      // File offset of the next record
+    uint64_t _IdxOffset;   // Index file size
+    uint32_t _Records;
+    uint32_t _FlushMs;
+    uint32_t _FsyncMs;
+    uint32_t _LastFlush;
+    uint32_t _LastSync;
+    uint32_t _Used;
+    uint32_t _IdxUsed;
+    uint8_t  _Buffer[LOG_BUFFER_SIZE];
+    SX1276LogIndex _Idx[LOG_INDEX_MAX];
+};
+
+class SX1276LogReader
+{
+  public:
+    SX1276LogReader   ();
+    ~SX1276LogReader  ();
+    int Open          (const char *path);
+    int Seek          (uint64_t timeUs);
+    int Next          (SX1276Packet *pkt,
+                       uint64_t endUs = 0xFFFFFFFFFFFFFFFFULL);
+    void Close        ();
+
+  private:
+    const uint8_t *        _Data;
+    size_t                 _DataLen;
+    const uint8_t *        _Idx;   // LOG_INDEX_ENTRY bytes each
+    size_t                 _IdxLen;
+    size_t                 _IdxMapLen;
+    size_t                 _Pos;
+};
+
+#endif
+#endif
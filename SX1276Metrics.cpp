@@ -0,0 +1,317 @@
+/*
+  SX1276Metrics.cpp - Radio metrics for the SX1276 library
+  Released into the public domain.
+
+  What is counted, and where:
+    rx_packets, rx_crc_errors   Every RxDone seen by RXContinuous, RXFiltered and RXReply.
+    rx_valid_headers/packets    Increase in ValidHeaderCnt / ValidPacketCnt, read in one burst
+                                at each RxDone. The modem clears them on entering RX.
+    rx_headers_no_rxdone        Valid headers with no RxDone for them (payload lost to a
+                                collision or corruption): the ValidHeaderCnt increase at an
+                                RxDone, less the one for that packet. Headers that fail their
+                                own CRC aren't counted anywhere: the SX1276 has no flag for them.
+    tx_packets, airtime         Each frame sent by TX, TXBurst and RXReply, by EU868 sub-band.
+    duty_budget                 TX time left in the duty cycle window, when it was last checked.
+    spi_transactions, bytes     Every SPI transaction, including address bytes.
+    mode_transitions            Every change of operating mode, written or seen on read.
+
+  The exporter formats into a preallocated buffer. The socket server answers each
+  connection with the current values and closes it, so e.g.
+    socat - UNIX-CONNECT:/run/sx1276.metrics
+  or a scraper behind a proxy can read it.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "SX1276Metrics.h"
+#ifndef ESP32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/* Sub-band labels, see SX1276Metrics::SubBand() */
+static const char * _SubBandName[METRICS_SUBBANDS] =
+  {"863-865", "865-868", "868.0-868.6", "868.7-869.2", "869.4-869.65", "869.7-870.0", "other"};
+static const char * _ModeName[8] = {"sleep", "stdby", "fstx", "tx", "fsrx", "rxcontinuous", "rxsingle", "cad"};
+
+/*  SX1276Metrics
+ *
+ *  Class initialisation. All values start at 0.
+ */
+SX1276Metrics::
+SX1276Metrics ()
+{
+  Clear();
+}
+
+/*  Clear
+ *  Set all values to 0.
+ */
+void SX1276Metrics::
+Clear ()
+{
+  _RxPackets = 0;
+  _RxCrcErrors = 0;
+  _RxHeadersNoRxDone = 0;
+  _RxValidHeaders = 0;
+  _RxValidPackets = 0;
+  _TxPackets = 0;
+  for (int b = 0; b < METRICS_SUBBANDS; b++) _AirtimeMs[b] = 0;
+  _DutyBudgetMs = 0;
+  _SpiTransactions = 0;
+  _SpiBytes = 0;
+  for (int f = 0; f < 8; f++)
+    for (int t = 0; t < 8; t++) _Transitions[f][t] = 0;
+}
+
+uint64_t SX1276Metrics::RxPackets()
+{ return _RxPackets.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::RxCrcErrors()
+{ return _RxCrcErrors.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::RxHeadersNoRxDone()
+{ return _RxHeadersNoRxDone.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::TxPackets()
+{ return _TxPackets.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::AirtimeMs(uint8_t band)
+{ return band < METRICS_SUBBANDS ? _AirtimeMs[band].load(std::memory_order_relaxed) : 0; }
+
+int32_t SX1276Metrics::DutyBudgetMs()
+{ return _DutyBudgetMs.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::SpiTransactions()
+{ return _SpiTransactions.load(std::memory_order_relaxed); }
+
+uint64_t SX1276Metrics::SpiBytes()
+{ return _SpiBytes.load(std::memory_order_relaxed); }
+
+uint32_t SX1276Metrics::Transitions(uint8_t from, uint8_t to)
+{ return _Transitions[from & 7][to & 7].load(std::memory_order_relaxed); }
+
+/*  SubBandName
+ *  Returns: Name of a sub-band, as used in the band label.
+ */
+const char * SX1276Metrics::
+SubBandName (uint8_t band)
+{
+  return _SubBandName[band < METRICS_SUBBANDS ? band : METRICS_SUBBANDS - 1];
+}
+
+#ifndef ESP32
+
+/*  SX1276MetricsExporter
+ *
+ *  Class initialisation. Add() radios, then Format(), WriteFile() or Listen().
+ */
+SX1276MetricsExporter::
+SX1276MetricsExporter ()
+{
+  _Count = 0;
+  _Sock = -1;
+  _Run = false;
+}
+
+SX1276MetricsExporter::
+~SX1276MetricsExporter ()
+{
+  Close();
+}
+
+/*  Add
+ *  Export metrics with the label radio="radio".
+ *  Returns: 0 on success, -1 if METRICS_RADIOS radios have been added.
+ */
+int SX1276MetricsExporter::
+Add (SX1276Metrics *metrics,
+     const char    *radio)
+{
+  if (_Count == METRICS_RADIOS)
+  {
+    return -1;
+  }
+  _Metrics[_Count] = metrics;
+  snprintf(_Radio[_Count], sizeof(_Radio[0]), "%s", radio);
+  _Count++;
+  return 0;
+}
+
+/*  Format
+ *  Render all radios in Prometheus text format.
+ *  Returns: Length of the text, or -1 if buf is too small.
+ */
+int SX1276MetricsExporter::
+Format (char  *buf,
+        size_t len)
+{
+  size_t used = 0;
+  int    n;
+  uint32_t count;
+
+#define METRIC_OUT(...) \
+  { n = snprintf(buf + used, len - used, __VA_ARGS__); \
+    if (n < 0 || (size_t) n >= len - used) return -1; \
+    used += n; }
+#define METRIC_COUNTER(name, help, field) \
+  { METRIC_OUT("# HELP sx1276_%s %s\n# TYPE sx1276_%s counter\n", name, help, name); \
+    for (int r = 0; r < _Count; r++) \
+      METRIC_OUT("sx1276_%s{radio=\"%s\"} %llu\n", name, _Radio[r], \
+                 (unsigned long long) _Metrics[r]->field.load(std::memory_order_relaxed)); }
+
+  METRIC_COUNTER("rx_packets_total", "Packets received (RxDone).", _RxPackets);
+  METRIC_COUNTER("rx_crc_errors_total", "Packets received with a payload CRC error.", _RxCrcErrors);
+  METRIC_COUNTER("rx_headers_no_rxdone_total", "Valid headers with no RxDone for their payload.", _RxHeadersNoRxDone);
+  METRIC_COUNTER("rx_valid_headers_total", "Sum of ValidHeaderCnt increases.", _RxValidHeaders);
+  METRIC_COUNTER("rx_valid_packets_total", "Sum of ValidPacketCnt increases.", _RxValidPackets);
+  METRIC_COUNTER("tx_packets_total", "Packets transmitted.", _TxPackets);
+  METRIC_COUNTER("spi_transactions_total", "SPI transactions.", _SpiTransactions);
+  METRIC_COUNTER("spi_bytes_total", "SPI bytes transferred, including address bytes.", _SpiBytes);
+
+  METRIC_OUT("# HELP sx1276_airtime_ms_total TX time on air in ms by EU868 sub-band.\n"
+             "# TYPE sx1276_airtime_ms_total counter\n");
+  for (int r = 0; r < _Count; r++)
+    for (int b = 0; b < METRICS_SUBBANDS; b++)
+      METRIC_OUT("sx1276_airtime_ms_total{radio=\"%s\",band=\"%s\"} %llu\n", _Radio[r], _SubBandName[b],
+                 (unsigned long long) _Metrics[r]->_AirtimeMs[b].load(std::memory_order_relaxed));
+
+  METRIC_OUT("# HELP sx1276_duty_budget_ms TX time in ms left in the duty cycle window.\n"
+             "# TYPE sx1276_duty_budget_ms gauge\n");
+  for (int r = 0; r < _Count; r++)
+    METRIC_OUT("sx1276_duty_budget_ms{radio=\"%s\"} %d\n", _Radio[r],
+               (int) _Metrics[r]->_DutyBudgetMs.load(std::memory_order_relaxed));
+
+  METRIC_OUT("# HELP sx1276_mode_transitions_total Operating mode changes.\n"
+             "# TYPE sx1276_mode_transitions_total counter\n");
+  for (int r = 0; r < _Count; r++)
+    for (int f = 0; f < 8; f++)
+      for (int t = 0; t < 8; t++)
+      {
+        count = _Metrics[r]->_Transitions[f][t].load(std::memory_order_relaxed);
+        if (count != 0)
+          METRIC_OUT("sx1276_mode_transitions_total{radio=\"%s\",from=\"%s\",to=\"%s\"} %u\n",
+                     _Radio[r], _ModeName[f], _ModeName[t], count);
+      }
+#undef METRIC_COUNTER
+#undef METRIC_OUT
+  return used;
+}
+
+/*  WriteFile
+ *  Write the metrics to path, e.g. for the node_exporter textfile collector.
+ *  The file is replaced atomically (written to path.tmp, then renamed).
+ *  Returns: 0 on success, -1 on failure.
+ */
+int SX1276MetricsExporter::
+WriteFile (const char *path)
+{
+  char buf[METRICS_BUFFER_SIZE]; // not _Buffer, which the socket thread uses
+  char tmp[512];
+  int  len, fd;
+
+  len = Format(buf, sizeof(buf));
+  if (len < 0 || snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp))
+  {
+    return -1;
+  }
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (write(fd, buf, len) != len)
+  {
+    close(fd);
+    unlink(tmp);
+    return -1;
+  }
+  close(fd);
+  return rename(tmp, path);
+}
+
+/*  Listen
+ *  Serve the metrics on a Unix socket at path, from a background thread.
+ *  Each connection is sent the current metrics and closed.
+ *  Returns: 0 on success, -1 if the socket can't be created.
+ */
+int SX1276MetricsExporter::
+Listen (const char *path)
+{
+  struct sockaddr_un addr;
+
+  Close();
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  strcpy(_Path, path);
+  unlink(path);
+  _Sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_Sock < 0 || bind(_Sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(_Sock, 8) < 0)
+  {
+    Close();
+    return -1;
+  }
+  _Run = true;
+  _Thread = std::thread(&SX1276MetricsExporter::Serve, this);
+  return 0;
+}
+
+/*  Close
+ *  Stop serving and remove the socket.
+ */
+void SX1276MetricsExporter::
+Close ()
+{
+  if (_Thread.joinable())
+  {
+    _Run = false;
+    _Thread.join();
+  }
+  if (_Sock >= 0)
+  {
+    close(_Sock);
+    unlink(_Path);
+  }
+  _Sock = -1;
+}
+
+/*  Serve
+ *  Socket thread. Polls so Close() is noticed within 100ms.
+ */
+void SX1276MetricsExporter::
+Serve ()
+{
+  struct pollfd p;
+  int fd, len;
+
+  p.fd = _Sock;
+  p.events = POLLIN;
+  while (_Run)
+  {
+    if (poll(&p, 1, 100) <= 0)
+    {
+      continue;
+    }
+    fd = accept(_Sock, NULL, NULL);
+    if (fd < 0)
+    {
+      continue;
+    }
+    len = Format(_Buffer, sizeof(_Buffer));
+    if (len > 0)
+    {
+      send(fd, _Buffer, len, MSG_NOSIGNAL);
+    }
+    close(fd);
+  }
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*  SX1276Metrics_h - Radio metrics for the SX1276 library
+ *
+ *  Attach an SX1276Metrics to a radio with SX1276::Metrics() and the library counts
+ *  packets, errors, airtime, SPI traffic and mode transitions as it runs.
+ *  All values are relaxed atomics, updated by the thread using the radio and read
+ *  by any other thread without locks or SPI access, so they can be scraped at any rate.
+ *  SX1276MetricsExporter (Linux only) renders one or more radios in Prometheus text
+ *  format to a file or a Unix socket.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Metrics_h
+#define SX1276Metrics_h
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#ifndef ESP32
+#include <thread>
+#endif
+
+#define METRICS_SUBBANDS        7     // EU868 sub-bands, plus "other"
+#define METRICS_RADIOS          8     // Radios per exporter
+#define METRICS_BUFFER_SIZE     16384
+
+class SX1276Metrics
+{
+  public:
+    SX1276Metrics     ();
+    void Clear        ();
+
+    /* Called by the library */
+    inline void Spi   (uint32_t bytes)
+    {
+      _SpiTransactions.fetch_add(1, std::memory_order_relaxed);
+      _SpiBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    inline void Transition(uint8_t from,
+                           uint8_t to)
+    {
+      _Transitions[from & 7][to & 7].fetch_add(1, std::memory_order_relaxed);
+    }
+    inline void RxDone(uint8_t  irq,      // RegIrqFlags
+                       uint16_t headers,  // ValidHeaderCnt increase
+                       uint16_t packets)  // ValidPacketCnt increase
+    {
+      _RxPackets.fetch_add(1, std::memory_order_relaxed);
+      if (irq & 0x20) _RxCrcErrors.fetch_add(1, std::memory_order_relaxed);
+      _RxValidHeaders.fetch_add(headers, std::memory_order_relaxed);
+      _RxValidPackets.fetch_add(packets, std::memory_order_relaxed);
+      if (headers > 1) _RxHeadersNoRxDone.fetch_add(headers - 1, std::memory_order_relaxed); // All but this one
+    }
+    inline void TxDone(uint32_t frequency,
+                       uint32_t airtimeMs)
+    {
+      _TxPackets.fetch_add(1, std::memory_order_relaxed);
+      _AirtimeMs[SubBand(frequency)].fetch_add(airtimeMs, std::memory_order_relaxed);
+    }
+    inline void DutyBudget(int32_t budgetMs)
+    {
+      _DutyBudgetMs.store(budgetMs, std::memory_order_relaxed);
+    }
+
+    /* Read from any thread */
+    uint64_t RxPackets();
+    uint64_t RxCrcErrors();
+    uint64_t RxHeadersNoRxDone();
+    uint64_t TxPackets();
+    uint64_t AirtimeMs(uint8_t band);
+    int32_t DutyBudgetMs();
+    uint64_t SpiTransactions();
+    uint64_t SpiBytes();
+    uint32_t Transitions(uint8_t from,
+                         uint8_t to);
+    static inline uint8_t SubBand(uint32_t frequency) // EU868 sub-band (ERC 70-03 annex 1)
+    {
+      if (frequency >= 863000000 && frequency < 865000000) return 0;
+      if (frequency >= 865000000 && frequency < 868000000) return 1;
+      if (frequency >= 868000000 && frequency < 868600000) return 2;
+      if (frequency >= 868700000 && frequency < 869200000) return 3;
+      if (frequency >= 869400000 && frequency < 869650000) return 4;
+      if (frequency >= 869700000 && frequency < 870000000) return 5;
+      return METRICS_SUBBANDS - 1;
+    }
+    static const char * SubBandName(uint8_t band);
+
+  private:
+    friend class SX1276MetricsExporter;
+    std::atomic<uint64_t> _RxPackets;
+    std::atomic<uint64_t> _RxCrcErrors;
+    std::atomic<uint64_t> _RxHeadersNoRxDone;
+    std::atomic<uint64_t> _RxValidHeaders;
+    std::atomic<uint64_t> _RxValidPackets;
+    std::atomic<uint64_t> _TxPackets;
+    std::atomic<uint64_t> _AirtimeMs[METRICS_SUBBANDS];
+    std::atomic<int32_t>  _DutyBudgetMs;
+    std::atomic<uint64_t> _SpiTransactions;
+    std::atomic<uint64_t> _SpiBytes;
+    std::atomic<uint32_t> _Transitions[8][8];
+};
+
+#ifndef ESP32
+class SX1276MetricsExporter
+{
+  public:
+    SX1276MetricsExporter();
+    ~SX1276MetricsExporter();
+    int Add           (SX1276Metrics *metrics,
+                       const char    *radio);
+    int Format        (char  *buf,
+                       size_t len);
+    int WriteFile     (const char *path);
+    int Listen        (const char *path);
+    void Close        ();
+
+  private:
+    void Serve        ();
+    SX1276Metrics * _Metrics[METRICS_RADIOS];
+    char     _Radio[METRICS_RADIOS][32];
+    int      _Count;
+    int      _Sock;
+    std::atomic<bool> _Run;
+    std::thread _Thread;
+    char     _Path[108];
+    char     _Buffer[METRICS_BUFFER_SIZE];
+};
+#endif
+
+#endif
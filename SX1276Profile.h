@@ -0,0 +1,127 @@
+/*  SX1276Profile_h - Radio configuration profiles for the SX1276 library
+ *
+ *  A profile is a complete operating point: frequency, spreading factor, bandwidth,
+ *  coding rate, power, preamble, sync word, CRC, header mode and IQ inversion, with
+ *  the low data rate optimisation and the errata IF settings that go with them. The
+ *  constructor works out the register values once, and is constexpr, so a profile
+ *  declared constexpr costs nothing at run time:
+ *
+ *    static constexpr SX1276Profile uplink(868.1e6, 9, 125e3, 1, 14, OUTPUT_PA_BOOST);
+ *
+ *  SX1276::Apply() then writes only the registers that differ from the modem's,
+ *  which it keeps a copy of, in bursts: switching between two profiles usually takes
+ *  one or two SPI transactions, against a dozen read-modify-writes through the
+ *  setters. The register values are worked out only by the constructor, so build a
+ *  new profile to change a setting rather than changing a field.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Profile_h
+#define SX1276Profile_h
+#include <stdint.h>
+#include "SX1276Bandwidth.h"
+
+#define PROFILE_REGS       0x4E   // Registers up to RegPaDac
+#define PROFILE_IQ_RX      0x01   // invertIQ: receive inverted IQ
+#define PROFILE_IQ_TX      0x02   // invertIQ: transmit inverted IQ
+
+class SX1276Profile
+{
+  public:
+    constexpr SX1276Profile (uint32_t freq,             // Hz, 137-1020MHz
+                             uint8_t  sf,               // 6-12
+                             int32_t  bwhz,             // As BwHz(), e.g. 125000
+                             uint8_t  cr,               // 1-4 (4/5 - 4/8)
+                             int8_t   power,            // dBm, as PowerDBm()
+                             uint8_t  paBoost = 0,      // OUTPUT_RFO or OUTPUT_PA_BOOST, as Init()
+                             uint16_t preamble = 8,
+                             uint8_t  syncWord = 0x12,
+                             uint8_t  crc = 1,
+                             uint8_t  implicitHeader = 0,
+                             uint8_t  invertIQ = 0)     // PROFILE_IQ_xx
+      : freq(freq), sf(sf), bwhz(bwhz), cr(cr), power(power), paBoost(paBoost),
+        preamble(preamble), syncWord(syncWord), crc(crc), implicitHeader(implicitHeader),
+        invertIQ(invertIQ), ldro(0), valid(0), value{}, mask{}
+    {
+      uint8_t  bw = 0;
+      uint32_t frf = 0;
+      int8_t   p = power;
+      while (bw < SX1276_BW_CODES && SX1276_BW_HZ[bw] != bwhz) bw++;
+      if (bw == SX1276_BW_CODES || sf < 6 || sf > 12 || cr < 1 || cr > 4 || paBoost > 1 ||
+          freq < 137000000 || freq > 1020000000)
+      {
+        return;
+      }
+      valid = 1;
+      ldro = ((1000000UL << sf) / bwhz) >= 16000;
+
+      frf = (uint32_t) (freq / 61.035 + 0.5);     // As Frequency()
+      Set(0x06, 0xFF, frf >> 16);
+      Set(0x07, 0xFF, frf >> 8);
+      Set(0x08, 0xFF, frf);
+      if (freq < 525000000) Set(0x01, 0x08, 0x08);  // LowFrequencyModeOn
+      if (freq > 779000000) Set(0x01, 0x08, 0x00);
+
+      if (paBoost)                                 // As PowerDBm()
+      {
+        if (p > 17) p = 17;
+        if (p < 2)  p = 2;
+        Set(0x09, 0x8F, 0x80 | (p - 2));
+      }
+      else
+      {
+        if (p > 14) p = 14;
+        if (p < -3) p = -3;
+        Set(0x09, 0xFF, p < 0 ? 0x20 | (p + 3) : 0x70 | p);
+      }
+      Set(0x4D, 0x07, 0x04);                       // PaDac: +20dBm mode off
+
+      Set(0x1D, 0xFF, bw << 4 | cr << 1 | (implicitHeader & 1));
+      Set(0x1E, 0xF4, sf << 4 | (crc & 1) << 2);
+      Set(0x20, 0xFF, preamble >> 8);
+      Set(0x21, 0xFF, preamble & 0xFF);
+      Set(0x26, 0x08, ldro << 3);
+      Set(0x39, 0xFF, syncWord);
+      Set(0x33, 0x41, (invertIQ & PROFILE_IQ_RX ? 0x40 : 0x00) |
+                      (invertIQ & PROFILE_IQ_TX ? 0x00 : 0x01));
+      Set(0x3B, 0xFF, invertIQ ? 0x19 : 0x1D);
+
+      if (bw < 9)                                  // As BwErrata()
+      {
+        Set(0x31, 0x80, 0x00);
+        Set(0x2F, 0xFF, bw == 0 ? 0x48 : bw < 6 ? 0x44 : 0x40);
+        Set(0x30, 0xFF, 0x00);
+      }
+      else
+      {
+        Set(0x31, 0x80, 0x80);
+      }
+    }
+
+    uint32_t freq;
+    uint8_t  sf;
+    int32_t  bwhz;
+    uint8_t  cr;
+    int8_t   power;
+    uint8_t  paBoost;
+    uint16_t preamble;
+    uint8_t  syncWord;
+    uint8_t  crc;
+    uint8_t  implicitHeader;
+    uint8_t  invertIQ;
+    uint8_t  ldro;                 // LowDataRateOptimize, from sf and bwhz
+    uint8_t  valid;                // 0 if a setting was out of range
+    uint8_t  value[PROFILE_REGS];  // Register bits set by the profile,
+    uint8_t  mask[PROFILE_REGS];   // and which bits those are
+
+  private:
+    constexpr void Set (uint8_t addr,
+                        uint8_t bits,
+                        uint8_t v)
+    {
+      value[addr] = v & bits;
+      mask[addr]  = bits;
+    }
+};
+
+#endif
@@ -0,0 +1,324 @@
+/*
+  SX1276Relay.cpp - Flooding relay / mesh mode for the SX1276 library
+  Released into the public domain.
+
+  Frames carry a source address, sequence number and hop count (see SX1276Relay.h).
+  Each node delivers a frame to the application once, and rebroadcasts it once
+  (if hops remain) after a random delay, unless:
+   - a copy is overheard from another relay during the delay (it has already been relayed)
+   - the rebroadcast would eat into the RELAY_DUTY_RESERVE % of the hourly duty cycle
+     kept for our own frames, or is refused by the duty cycle rules.
+  The duplicate cache stops frames being re-flooded forever.
+*/
+
+#include <string.h>
+#include "SX1276Relay.h"
+
+#include "SX1276Debug.h"
+
+#define RELAY_EMPTY 0xFFFFFFFF // Key of an empty cache entry (source 0xFFFF is reserved)
+
+/*  RelayCache
+ *
+ *  Class initialisation. Cache starts empty.
+ */
+RelayCache::
+RelayCache ()
+{
+  Clear();
+}
+
+void RelayCache::Clear()
+{
+  for (int n = 0; n < (1 << RELAY_CACHE_BITS); n++)
+  {
+    _Entry[n].key = RELAY_EMPTY;
+    _Entry[n].time = 0;
+  }
+  _Evictions = 0;
+}
+
+/*  Seen
+ *  Check whether a frame has been seen within the last RELAY_CACHE_TTL ms, and record it if not.
+ *  The key is hashed (Fibonacci hashing) to a slot, then up to RELAY_CACHE_PROBES
+ *  consecutive slots are checked. A new key goes in the first empty or expired slot,
+ *  or replaces the oldest entry probed if all are in use.
+ *
+ *  Returns: 1 if the frame is a duplicate
+ *           0 if it is new (and has now been recorded)
+ */
+int RelayCache::
+Seen (uint16_t src, // Source address
+      uint16_t seq, // Sequence number
+      uint32_t now) // millis()
+{
+  uint32_t key = (uint32_t) src << 16 | seq;
+  uint32_t slot = (key * 2654435769u) >> (32 - RELAY_CACHE_BITS);
+  uint32_t mask = (1 << RELAY_CACHE_BITS) - 1;
+  Entry *  free = NULL;
+  Entry *  oldest = NULL;
+  Entry *  e;
+
+  for (int p = 0; p < RELAY_CACHE_PROBES; p++)
+  {
+    e = &_Entry[(slot + p) & mask];
+    if (e->key == RELAY_EMPTY || (uint32_t) (now - e->time) >= RELAY_CACHE_TTL)
+    {
+      if (free == NULL) free = e;
+      continue;
+    }
+    if (e->key == key)
+    {
+      return 1;
+    }
+    if (oldest == NULL || (int32_t) (e->time - oldest->time) < 0)
+    {
+      oldest = e;
+    }
+  }
+  if (free == NULL)
+  {
+    free = oldest;
+    _Evictions++;
+  }
+  free->key = key;
+  free->time = now;
+  return 0;
+}
+
+/* Number of unexpired entries replaced because their probe sequence was full */
+uint32_t RelayCache::Evictions()
+{ return _Evictions; }
+
+
+/*  SX1276Relay
+ *
+ *  Class initialisation. radio must already be set up with Init() etc.
+ */
+SX1276Relay::
+SX1276Relay (SX1276 * radio,    // Radio to relay with
+             uint16_t address,  // Our source address. Not 0xFFFF.
+             uint8_t  hops,     // [Optional] Hop limit for frames we send. Default: 3.
+             uint32_t seed)     // [Optional] Seed for the rebroadcast delays. Give each node a
+                                //            different one, e.g. from its address and the time.
+{
+  _Radio = radio;
+  _Address = address;
+  _Hops = hops;
+  _Seq = 0;
+  _PendingCount = 0;
+  _Forwarded = 0;
+  _Duplicates = 0;
+  _Suppressed = 0;
+  _DutyDropped = 0;
+  _PendingFull = 0;
+  _Rand = seed ? seed : 1; // xorshift state must not be 0
+}
+
+/*  Send
+ *  Originate a frame. datain is sent after the relay header.
+ *  Returns: As SX1276::TX(). -1 if datain is too long to fit with the header.
+ */
+int SX1276Relay::
+Send (char *  datain,     // Array of chars to transmit
+      size_t  datalen)    // Length of array
+{
+  char frame[255];
+  if (datalen > sizeof(frame) - RELAY_HEADER_LEN)
+  {
+    DEBUG_WARN (DLOG_RELAY, "Relay Error: Data too long");
+    return -1;
+  }
+  _Seq++;
+  frame[0] = _Address >> 8;
+  frame[1] = _Address & 0xFF;
+  frame[2] = _Seq >> 8;
+  frame[3] = _Seq & 0xFF;
+  frame[4] = _Hops;
+  memcpy(frame + RELAY_HEADER_LEN, datain, datalen);
+  _Cache.Seen(_Address, _Seq, millis()); // so our own frame is ignored when relayed back
+  return _Radio->TX(frame, datalen + RELAY_HEADER_LEN);
+}
+
+/*  Poll
+ *  Receive and relay frames for up to timeout ms.
+ *  Rebroadcasts that fall due while waiting are sent.
+ *  New frames from other nodes are returned to the caller, including the relay header
+ *  (payload starts at rxdata + RELAY_HEADER_LEN). Duplicates are not returned.
+ *
+ *  Returns: Length of a new frame received, or 0 if none arrived before timeout.
+ */
+int SX1276Relay::
+Poll (char *    rxdata,    // char array to write frame to
+      size_t    datalen,   // set to sizeof(rxdata)
+      uint16_t  timeout)   // Timeout period in ms. Default: 5000.
+{
+  uint32_t end = millis() + timeout;
+  uint32_t now;
+  int32_t  wait;
+  int      ret;
+
+  while (1)
+  {
+    now = millis();
+    Forward(now);
+    wait = (int32_t) (end - now);
+    for (int p = 0; p < _PendingCount; p++)
+    {
+      if ((int32_t) (_PendingDue[p] - now) < wait)
+      {
+        wait = (int32_t) (_PendingDue[p] - now);
+      }
+    }
+    if (wait <= 0)
+    {
+      if ((int32_t) (end - now) <= 0)
+      {
+        return 0;
+      }
+      continue;
+    }
+    ret = Receive(rxdata, datalen, wait);
+    if (ret > 0)
+    {
+      return ret;
+    }
+  }
+}
+
+/*  Receive
+ *  Listen for one frame, and handle it.
+ *  Returns: Length of the frame if it is new and should be delivered, otherwise 0.
+ */
+int SX1276Relay::
+Receive (char *    rxdata,
+         size_t    datalen,
+         uint16_t  timeout)
+{
+  int      len;
+  uint16_t src, seq;
+  uint8_t  hops;
+  uint32_t key;
+
+  len = _Radio->RXContinuous(rxdata, datalen, timeout);
+  if (len < RELAY_HEADER_LEN)
+  {
+    return 0;
+  }
+  src = (uint8_t) rxdata[0] << 8 | (uint8_t) rxdata[1];
+  seq = (uint8_t) rxdata[2] << 8 | (uint8_t) rxdata[3];
+  hops = rxdata[4];
+  key = (uint32_t) src << 16 | seq;
+  if (src == 0xFFFF || _Cache.Seen(src, seq, millis()))
+  {
+    _Duplicates++;
+    for (int p = 0; p < _PendingCount; p++)
+    {
+      if (_PendingKey[p] == key)
+      {
+        _PendingHeard[p]++; // Another relay has covered this one
+      }
+    }
+    return 0;
+  }
+  if (hops > 1 && _PendingCount >= RELAY_PENDING)
+  {
+    _PendingFull++; // Delivered, but not rebroadcast
+    DEBUG_WARN (DLOG_RELAY, "Relay: frame %x:%d not queued, pending list full", src, seq);
+  }
+  else if (hops > 1)
+  {
+    int p = _PendingCount++;
+    _PendingKey[p] = key;
+    _PendingDue[p] = millis() + Random() % (RELAY_MAX_DELAY + 1);
+    _PendingHeard[p] = 0;
+    _PendingLen[p] = len;
+    memcpy(_PendingData[p], rxdata, len);
+    _PendingData[p][4] = hops - 1;
+    DEBUG (DLOG_RELAY, "Relay: frame %x:%d queued", src, seq);
+  }
+  return len;
+}
+
+/*  Random
+ *  xorshift32, so the relay doesn't disturb the program's rand() sequence.
+ */
+uint32_t SX1276Relay::
+Random ()
+{
+  _Rand ^= _Rand << 13;
+  _Rand ^= _Rand >> 17;
+  _Rand ^= _Rand << 5;
+  return _Rand;
+}
+
+/*  Forward
+ *  Send or drop any rebroadcasts that are due.
+ */
+void SX1276Relay::
+Forward (uint32_t now) // millis()
+{
+  int p = 0;
+  int ret;
+  while (p < _PendingCount)
+  {
+    if ((int32_t) (_PendingDue[p] - now) > 0)
+    {
+      p++;
+      continue;
+    }
+    if (_PendingHeard[p] >= RELAY_SUPPRESS)
+    {
+      _Suppressed++;
+    }
+    else if ((int32_t) _Radio->TimeOnAirMs(_PendingLen[p]) >
+             _Radio->DutyBudgetMs() - (int32_t) (_Radio->DutyCycleMsHour() * RELAY_DUTY_RESERVE / 100))
+    {
+      _DutyDropped++;
+    }
+    else
+    {
+      ret = _Radio->TX(_PendingData[p], _PendingLen[p]);
+      if (ret == -2) // Holdoff. Try again shortly.
+      {
+        _PendingDue[p] = now + 10;
+        p++;
+        continue;
+      }
+      if (ret == -3) // Duty cycle limit. It won't free up in time to be worth waiting.
+      {
+        _DutyDropped++;
+        DEBUG_WARN (DLOG_RELAY, "Relay: rebroadcast dropped, duty cycle limit");
+      }
+      if (ret >= 0)
+      {
+        _Forwarded++;
+      }
+    }
+    /* Remove from pending list */
+    _PendingCount--;
+    if (p != _PendingCount)
+    {
+      _PendingKey[p] = _PendingKey[_PendingCount];
+      _PendingDue[p] = _PendingDue[_PendingCount];
+      _PendingHeard[p] = _PendingHeard[_PendingCount];
+      _PendingLen[p] = _PendingLen[_PendingCount];
+      memcpy(_PendingData[p], _PendingData[_PendingCount], _PendingLen[_PendingCount]);
+    }
+  }
+}
+
+uint32_t SX1276Relay::Forwarded()
+{ return _Forwarded; }
+
+uint32_t SX1276Relay::Duplicates()
+{ return _Duplicates; }
+
+uint32_t SX1276Relay::Suppressed()
+{ return _Suppressed; }
+
+uint32_t SX1276Relay::DutyDropped()
+{ return _DutyDropped; }
+
+uint32_t SX1276Relay::PendingFull()
+{ return _PendingFull; }
@@ -0,0 +1,94 @@
+/*  SX1276Relay_h - Flooding relay / mesh mode for the SX1276 library
+ *
+ *  Every relayed frame starts with a 5 byte header:
+ *    [0-1] Source address (0xFFFF reserved)
+ *    [2-3] Sequence number
+ *    [4]   Hops remaining
+ *  Frames are forwarded once by each node, after a random delay. If a copy is
+ *  overheard from another relay during the delay, the rebroadcast is suppressed.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Relay_h
+#define SX1276Relay_h
+#include "SX1276.h"
+
+#define RELAY_HEADER_LEN       5
+#define RELAY_HOPS_DEFAULT     3
+#define RELAY_CACHE_BITS       10    // 1024 entries
+#define RELAY_CACHE_PROBES     8
+#define RELAY_CACHE_TTL        60000 // ms
+#define RELAY_MAX_DELAY        500   // ms. Rebroadcast delay is random in 0 - RELAY_MAX_DELAY
+#define RELAY_SUPPRESS         1     // Overheard copies needed to cancel a rebroadcast
+#define RELAY_DUTY_RESERVE     25    // % of the hourly duty cycle kept for our own traffic
+#define RELAY_PENDING          4
+
+/*  RelayCache
+ *  Fixed size duplicate cache keyed by source and sequence number.
+ *  Open addressing with a short linear probe, so a lookup touches one or two cache lines.
+ *  Entries expire RELAY_CACHE_TTL ms after they were first seen.
+ */
+class RelayCache
+{
+  public:
+    RelayCache        ();
+    void Clear        ();
+    int Seen          (uint16_t src,
+                       uint16_t seq,
+                       uint32_t now);
+    uint32_t Evictions();
+
+  private:
+    struct Entry
+    {
+      uint32_t key;
+      uint32_t time;
+    };
+    Entry _Entry[1 << RELAY_CACHE_BITS];
+    uint32_t _Evictions;
+};
+
+class SX1276Relay
+{
+  public:
+    SX1276Relay       (SX1276 * radio,
+                       uint16_t address,
+                       uint8_t  hops = RELAY_HOPS_DEFAULT,
+                       uint32_t seed = 1);
+    int Send          (char  *datain,
+                       size_t datalen);
+    int Poll          (char  *rxdata,
+                       size_t datalen,
+                       uint16_t timeout = TIMEOUT_DEFAULT);
+    uint32_t Forwarded();
+    uint32_t Duplicates();
+    uint32_t Suppressed();
+    uint32_t DutyDropped();
+    uint32_t PendingFull();
+
+  private:
+    int Receive       (char  *rxdata,
+                       size_t datalen,
+                       uint16_t timeout);
+    void Forward      (uint32_t now);
+    uint32_t Random   ();
+    SX1276 * _Radio;
+    uint16_t _Address;
+    uint16_t _Seq;
+    uint8_t  _Hops;
+    RelayCache _Cache;
+    uint8_t  _PendingCount;
+    uint32_t _PendingKey[RELAY_PENDING];
+    uint32_t _PendingDue[RELAY_PENDING];
+    uint8_t  _PendingHeard[RELAY_PENDING];
+    uint8_t  _PendingLen[RELAY_PENDING];
+    char     _PendingData[RELAY_PENDING][255];
+    uint32_t _Forwarded;
+    uint32_t _Duplicates;
+    uint32_t _Suppressed;
+    uint32_t _DutyDropped;
+    uint32_t _PendingFull;
+    uint32_t _Rand;
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*
+  SX1276Replay.cpp - Replay captured packets into an emulated radio (Linux only)
+  Released into the public domain.
+
+  Packets are read one ahead, and Pump() moves as many as fit into the emulator's
+  queue. With a speed set, packet n arrives at emulator time
+    start + (capture time n - capture time of the first packet)
+  and the emulator clock runs at that speed, so the receiver sees the original
+  gaps (scaled). With speed 0 each packet arrives as soon as the radio is
+  receiving with RxDone clear, so nothing is missed however fast the receiver runs.
+  The emulator is set to take the settings of each packet (MatchConfig(0)).
+*/
+#ifndef ESP32
+
+#include <string.h>
+#include "SX1276Replay.h"
+
+/*  SX1276Replay
+ *
+ *  Class initialisation. Call Open() then Pump() from the receive loop.
+ */
+SX1276Replay::
+SX1276Replay (SX1276Emulator * emu) // Emulated radio to receive the packets
+{
+  _Emu = emu;
+  _Pcap = NULL;
+  _Open = 0;
+  _HaveNext = 0;
+  _Speed = 1;
+}
+
+SX1276Replay::
+~SX1276Replay ()
+{
+  Close();
+}
+
+/*  Open
+ *  Open a binary log or LoRaTap pcap file for replay.
+ *  Returns: 0 on success
+ *           -1 if the file can't be opened or is not a log or LoRaTap pcap
+ */
+int SX1276Replay::
+Open (const char *path)
+{
+  uint8_t  hdr[24];
+  uint32_t magic, linktype;
+
+  Close();
+  if (_Log.Open(path) == 0)
+  {
+    _Open = 1;
+  }
+  else
+  {
+    _Pcap = fopen(path, "rb");
+    if (_Pcap == NULL || fread(hdr, 1, sizeof(hdr), _Pcap) != sizeof(hdr))
+    {
+      Close();
+      return -1;
+    }
+    memcpy(&magic, hdr, 4);
+    memcpy(&linktype, hdr + 20, 4);
+    _Swap = (magic == 0xd4c3b2a1);
+    if (_Swap)
+    {
+      linktype = __builtin_bswap32(linktype);
+    }
+    else if (magic != 0xa1b2c3d4)
+    {
+      Close();
+      return -1;
+    }
+    if (linktype != LINKTYPE_LORATAP)
+    {
+      Close();
+      return -1;
+    }
+    _Open = 2;
+  }
+  _Emu->MatchConfig(0);
+  _Started = 0;
+  _Injected = 0;
+  _HaveNext = (Read(&_Next) > 0);
+  _FirstUs = _Next.timeUs;
+  return 0;
+}
+
+/*  Speed
+ *  Replay speed: 1 (default) real time, n for n times real time, 0 as fast as possible.
+ *  Sets the emulator clock speed. Call before the first Pump().
+ */
+void SX1276Replay::
+Speed (float speed)
+{
+  _Speed = speed < 0 ? 0 : speed;
+  SX1276Emulator::Speed(_Speed);
+}
+
+/*  Pump
+ *  Queue packets on the emulator until its queue is full or the file ends.
+ *  Call it before each receive.
+ *  Returns: Packets queued
+ *           -1 if the file has ended (packets already queued may still be waiting)
+ */
+int SX1276Replay::
+Pump ()
+{
+  int n = 0;
+  if (!_HaveNext)
+  {
+    return -1;
+  }
+  if (!_Started)
+  {
+    _StartUs = SX1276Emulator::NowUs() + REPLAY_LEAD_US;
+    _Started = 1;
+  }
+  while (_HaveNext)
+  {
+    if (_Emu->Inject(&_Next, _Speed == 0 ? 0 : _StartUs + (_Next.timeUs - _FirstUs)) < 0)
+    {
+      break;
+    }
+    n++;
+    _Injected++;
+    _HaveNext = (Read(&_Next) > 0);
+  }
+  return n;
+}
+
+/*  Injected
+ *  Returns: Packets queued on the emulator so far.
+ */
+uint32_t SX1276Replay::
+Injected ()
+{
+  return _Injected;
+}
+
+/*  Close
+ *  Close the file. Packets already queued on the emulator stay queued.
+ */
+void SX1276Replay::
+Close ()
+{
+  _Log.Close();
+  if (_Pcap != NULL) fclose(_Pcap);
+  _Pcap = NULL;
+  _Open = 0;
+  _HaveNext = 0;
+}
+
+/*  Read
+ *  Read the next packet from the file.
+ *  Returns: 1 if a packet was read, 0 at the end of the file, -1 if it is corrupt.
+ */
+int SX1276Replay::
+Read (SX1276Packet *pkt)
+{
+  if (_Open == 1)
+  {
+    return _Log.Next(pkt);
+  }
+  if (_Open == 2)
+  {
+    return ReadPcap(pkt);
+  }
+  return 0;
+}
+
+/*  ReadPcap
+ *  Read the next pcap record and decode its LoRaTap header (see SX1276Capture.cpp).
+ *  Returns: As Read().
+ */
+int SX1276Replay::
+ReadPcap (SX1276Packet *pkt)
+{
+  uint8_t  rec[PCAP_RECORD_LEN];
+  uint8_t  tap[LORATAP_LEN];
+  uint32_t sec, usec, len;
+  uint16_t taplen;
+
+  if (fread(rec, 1, sizeof(rec), _Pcap) != sizeof(rec))
+  {
+    return 0;
+  }
+  memcpy(&sec, rec, 4);
+  memcpy(&usec, rec + 4, 4);
+  memcpy(&len, rec + 8, 4);
+  if (_Swap)
+  {
+    sec = __builtin_bswap32(sec);
+    usec = __builtin_bswap32(usec);
+    len = __builtin_bswap32(len);
+  }
+  if (len < LORATAP_LEN || fread(tap, 1, LORATAP_LEN, _Pcap) != LORATAP_LEN)
+  {
+    return -1;
+  }
+  taplen = tap[2] * 0x100 + tap[3];
+  if (tap[0] != 1 || taplen < LORATAP_LEN || len - taplen > sizeof(pkt->data) ||
+      fseek(_Pcap, taplen - LORATAP_LEN, SEEK_CUR) != 0)
+  {
+    return -1;
+  }
+  pkt->len = len - taplen;
+  if (fread(pkt->data, 1, pkt->len, _Pcap) != pkt->len)
+  {
+    return -1;
+  }
+  pkt->timeUs = (uint64_t) sec * 1000000 + usec;
+  pkt->frequency = ((uint32_t) tap[4] << 24) | (tap[5] << 16) | (tap[6] << 8) | tap[7];
+  pkt->bw = tap[8] == 1 ? 7 : tap[8] == 2 ? 8 : tap[8] == 4 ? 9 : 7;
+  pkt->sf = tap[9];
+  pkt->rssi = tap[10] - 139;
+  pkt->snr = (int8_t) tap[13];
+  pkt->syncWord = tap[14];
+  pkt->crcOn = (tap[27] & 0x18) != 0;
+  pkt->crcError = (tap[27] & 0x10) != 0;
+  pkt->implicitHeader = (tap[27] & 0x04) != 0;
+  pkt->cr = tap[28] >= 5 ? tap[28] - 4 : 0;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*  SX1276Replay_h - Replay captured packets into an emulated radio (Linux only)
+ *
+ *  Reads a binary log (SX1276Log.h) or a LoRaTap pcap (SX1276Capture.h) and queues
+ *  the packets on an SX1276Emulator with their original metadata, so they are
+ *  received through the library's normal RX routines (RXContinuous etc).
+ *  Speed(1) replays with the original timing, Speed(n) n times faster, and
+ *  Speed(0) as fast as the receiver takes them, with no packets missed.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Replay_h
+#define SX1276Replay_h
+#ifndef ESP32
+#include <stdio.h>
+#include "SX1276.h"
+#include "SX1276Emulator.h"
+#include "SX1276Log.h"
+#include "SX1276Capture.h"
+
+#define REPLAY_LEAD_US     10000  // Delay before the first packet arrives
+
+class SX1276Replay
+{
+  public:
+    SX1276Replay      (SX1276Emulator * emu);
+    ~SX1276Replay     ();
+    int Open          (const char *path);
+    void Speed        (float speed);
+    int Pump          ();
+    uint32_t Injected ();
+    void Close        ();
+
+  private:
+    int Read          (SX1276Packet *pkt);
+    int ReadPcap      (SX1276Packet *pkt);
+    SX1276Emulator * _Emu;
+    SX1276LogReader  _Log;
+    FILE *   _Pcap;
+    uint8_t  _Swap;       // pcap written with the other byte order
+    uint8_t  _Open;
+    uint8_t  _HaveNext;
+    uint8_t  _Started;
+    float    _Speed;
+    uint64_t _FirstUs;    // Capture time of the first packet
+    uint64_t _StartUs;    // Emulator time the first packet arrives
+    uint32_t _Injected;
+    SX1276Packet _Next;
+};
+
+#endif
+#endif
@@ -0,0 +1,660 @@
+/*
+  SX1276Sim.cpp - Discrete event LoRa network simulator on the SX1276 library (Linux)
+  Released into the public domain.
+
+  Each thread keeps a queue of its nodes' next events in virtual time. To run an
+  event it attaches the node's emulated radio, sets the emulator clock to the
+  event's time and calls the driver: TX() (which waits on the emulator clock for
+  TxDone, so time moves on by the time on air), or CADOnce() first for LBT. A
+  node's next event is never earlier than the time its last call finished.
+
+  Transmissions are collected per thread and merged between windows, in start
+  order. A transmission is resolved once the window it ends in is done: by then
+  every transmission that could overlap it has started, so has been seen.
+
+  Reception at a gateway, for a packet at P dBm:
+    P below SensitivityDbm(sf)                                 lost (weak)
+    P - (sum of overlapping same SF, same channel packets) < SIM_CAPTURE_DB
+                                                               lost (collided)
+    P - (any overlapping other SF packet) < _SfRejectDb        lost (collided)
+  A packet is delivered if any gateway receives it.
+
+  Per node random numbers, seeded from the node number, make the results the same
+  for any number of threads, except with LBT (see SX1276Sim.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include "SX1276Sim.h"
+#include "SX1276Profile.h"
+#include "SX1276Emulator.h"
+
+#define SIM_START_US       1000000  // Nodes start sending 1s in, after Init()
+
+struct SX1276Sim::Radio
+{
+  SX1276Emulator * emu;
+  SX1276 * lora;
+  SX1276Sim * sim;
+  Part *   part;
+  uint32_t node;
+  uint64_t rng;
+  uint64_t nextReady;     // Time the next packet is ready
+  uint64_t attempt;       // Time to try to send the pending packet
+  uint64_t readyUs;       // Time the pending packet was ready
+  uint8_t  pending;
+  uint8_t  backoffs;      // LBT: times the pending packet has backed off
+  uint32_t seq;
+};
+
+struct SX1276Sim::Part
+{
+  std::vector<Radio> radios;
+  std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t> >,
+                      std::greater<std::pair<uint64_t, uint32_t> > > events;  // time, radio
+  std::vector<Air> batch; // Transmissions this window
+  std::thread thread;
+};
+
+static const uint32_t _SimFreq[SIM_CHANNELS] = {868100000, 868300000, 868500000};
+
+/* Demodulation floor, SNR dB, SF7 - SF12 */
+static const float _SimSnrDb[6] = {-7.5, -10, -12.5, -15, -17.5, -20};
+
+/* Signal to interference ratio needed against another SF, dB. Wanted SF7 - SF12 by
+   interfering SF7 - SF12 (Goursaud et al.). The same SF uses SIM_CAPTURE_DB. */
+static const int8_t _SfRejectDb[6][6] = {
+  {  0,  -8,  -9,  -9,  -9,  -9},
+  {-11,   0, -11, -12, -13, -13},
+  {-15, -13,   0, -13, -14, -15},
+  {-19, -18, -17,   0, -17, -18},
+  {-22, -22, -21, -20,   0, -20},
+  {-25, -25, -25, -24, -23,   0}};
+
+/* xorshift64* */
+static inline uint64_t SimRand (uint64_t *s)
+{
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return *s * 2685821657736338717ULL;
+}
+
+static inline double SimUniform (uint64_t *s)
+{
+  return (SimRand(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline uint64_t SimExpUs (uint64_t *s,
+                                 uint32_t meanS)
+{
+  return (uint64_t) (-log(1 - SimUniform(s)) * meanS * 1000000) + 1;
+}
+
+/*  Defaults
+ *  Fill in the default settings (see SX1276SimConfig).
+ */
+void SX1276Sim::
+Defaults (SX1276SimConfig *cfg)
+{
+  cfg->nodes = 10000;
+  cfg->gateways = 1;
+  cfg->radiusM = 5000;
+  cfg->seconds = 3600;
+  cfg->periodS = 600;
+  cfg->payload = 20;
+  cfg->sf = 0;
+  cfg->mac = SIM_ALOHA;
+  cfg->channels = SIM_CHANNELS;
+  cfg->power = 14;
+  cfg->pathExponent = 2.32;
+  cfg->shadowingDb = 7.8;
+  cfg->threads = 0;
+  cfg->windowMs = 100;
+  cfg->seed = 1;
+}
+
+/*  SX1276Sim
+ *
+ *  Class initialisation: place the nodes and gateways, and choose each node's SF
+ *  and channel. Settings out of range are brought into range.
+ */
+SX1276Sim::
+SX1276Sim (const SX1276SimConfig *cfg)
+{
+  uint64_t rng;
+  double   u, v, r, a, best;
+  uint8_t  sf;
+
+  _Cfg = *cfg;
+  if (_Cfg.nodes == 0) _Cfg.nodes = 1;
+  if (_Cfg.gateways == 0) _Cfg.gateways = 1;
+  if (_Cfg.gateways > SIM_MAX_GATEWAYS) _Cfg.gateways = SIM_MAX_GATEWAYS;
+  if (_Cfg.channels == 0 || _Cfg.channels > SIM_CHANNELS) _Cfg.channels = SIM_CHANNELS;
+  if (_Cfg.sf != 0 && _Cfg.sf < 7) _Cfg.sf = 7;
+  if (_Cfg.sf > 12) _Cfg.sf = 12;
+  if (_Cfg.payload < 8) _Cfg.payload = 8;
+  if (_Cfg.periodS == 0) _Cfg.periodS = 1;
+  if (_Cfg.windowMs == 0) _Cfg.windowMs = 1;
+  if (_Cfg.threads == 0) _Cfg.threads = std::thread::hardware_concurrency();
+  if (_Cfg.threads == 0) _Cfg.threads = 1;
+  if (_Cfg.threads > SIM_MAX_THREADS) _Cfg.threads = SIM_MAX_THREADS;
+  if (_Cfg.threads > _Cfg.nodes) _Cfg.threads = _Cfg.nodes;
+  _Threads = _Cfg.threads;
+  _EndUs = SIM_START_US + (uint64_t) _Cfg.seconds * 1000000;
+
+  for (sf = 7; sf <= 12; sf++)
+  {
+    _AirUs[sf] = SX1276::AirtimeMs(sf, 7, 1, 8, 0, 1, sf >= 11, _Cfg.payload) * 1000;
+  }
+  _MaxAirUs = _AirUs[_Cfg.sf ? _Cfg.sf : 12];
+  _SlotUs = _MaxAirUs + SIM_TDMA_GUARD_MS * 1000;
+
+  for (int g = 0; g < _Cfg.gateways; g++)
+  {
+    a = 2 * M_PI * g / _Cfg.gateways;
+    r = _Cfg.gateways == 1 ? 0 : _Cfg.radiusM / 2.0;
+    _Gw[g][0] = r * cos(a);
+    _Gw[g][1] = r * sin(a);
+  }
+
+  _Node = new SX1276SimNode[_Cfg.nodes];
+  _Loss = new float[(size_t) _Cfg.nodes * _Cfg.gateways];
+  memset(_Node, 0, sizeof(SX1276SimNode) * _Cfg.nodes);
+  rng = 0x9E3779B97F4A7C15ULL * (_Cfg.seed + 1);
+  for (uint32_t n = 0; n < _Cfg.nodes; n++)
+  {
+    SX1276SimNode * node = &_Node[n];
+    r = _Cfg.radiusM * sqrt(SimUniform(&rng));
+    a = 2 * M_PI * SimUniform(&rng);
+    node->x = r * cos(a);
+    node->y = r * sin(a);
+    best = 1e9;
+    for (int g = 0; g < _Cfg.gateways; g++)
+    {
+      u = SimUniform(&rng);   // Shadowing, Box-Muller
+      v = SimUniform(&rng);
+      _Loss[(size_t) n * _Cfg.gateways + g] = LossDb(node->x - _Gw[g][0], node->y - _Gw[g][1]) +
+        _Cfg.shadowingDb * sqrt(-2 * log(1 - u)) * cos(2 * M_PI * v);
+      best = std::min(best, (double) _Loss[(size_t) n * _Cfg.gateways + g]);
+    }
+    node->lossDb = best;
+    node->sf = _Cfg.sf;
+    if (node->sf == 0)
+    {
+      for (node->sf = 7; node->sf < 12; node->sf++)
+        if (_Cfg.power - best - SensitivityDbm(node->sf) >= SIM_ADR_MARGIN_DB) break;
+    }
+    node->channel = n % _Cfg.channels;
+  }
+
+  _AirFirst = 0;
+  memset(_ChannelUs, 0, sizeof(_ChannelUs));
+  memset(_Part, 0, sizeof(_Part));
+  _WindowEnd = 0;
+  _Window = 0;
+  _Running = 0;
+  _Stop = 0;
+}
+
+SX1276Sim::
+~SX1276Sim ()
+{
+  for (uint32_t t = 0; t < _Threads; t++) delete _Part[t];
+  delete[] _Node;
+  delete[] _Loss;
+}
+
+/*  SensitivityDbm
+ *  Returns: Weakest packet an SF can receive at 125kHz: the noise floor plus the
+ *           SF's demodulation floor.
+ */
+float SX1276Sim::
+SensitivityDbm (uint8_t sf)
+{
+  if (sf < 7) sf = 7;
+  if (sf > 12) sf = 12;
+  return -174 + 10 * log10(125000.0) + SIM_NOISE_FIGURE_DB + _SimSnrDb[sf - 7];
+}
+
+/*  LossDb
+ *  Returns: Path loss over a distance, without shadowing.
+ */
+float SX1276Sim::
+LossDb (float dx,
+        float dy)
+{
+  float d = sqrtf(dx * dx + dy * dy);
+  if (d < 1) d = 1;
+  return SIM_PL_D0_DB + 10 * _Cfg.pathExponent * log10f(d / SIM_PL_D0_M);
+}
+
+float SX1276Sim::
+RxDbm (uint32_t node,
+       uint8_t gateway)
+{
+  return _Cfg.power - _Loss[(size_t) node * _Cfg.gateways + gateway];
+}
+
+/*  Run
+ *  Run the simulation: set up every node's driver, then simulate seconds of
+ *  virtual time. Call once.
+ *  Returns: 0
+ */
+int SX1276Sim::
+Run ()
+{
+  std::vector<Air> merged;
+  uint64_t end;
+
+  for (uint32_t t = 0; t < _Threads; t++)
+  {
+    _Part[t] = new Part;
+    _Part[t]->radios.resize(_Cfg.nodes / _Threads + (t < _Cfg.nodes % _Threads));
+  }
+  _Running = _Threads;
+  for (uint32_t t = 0; t < _Threads; t++)
+  {
+    _Part[t]->thread = std::thread(&SX1276Sim::Worker, this, t);
+  }
+  for (end = SIM_START_US; ; )
+  {
+    {
+      std::unique_lock<std::mutex> lock(_Lock);
+      _Idle.wait(lock, [this]{ return _Running == 0; });
+      if (end > _EndUs)
+      {
+        _Stop = 1;
+        _Go.notify_all();
+        break;
+      }
+      end = std::min(end + (uint64_t) _Cfg.windowMs * 1000, _EndUs + 1);
+      _WindowEnd = end;
+      _Window++;
+      _Running = _Threads;
+      _Go.notify_all();
+    }
+    {
+      std::unique_lock<std::mutex> lock(_Lock);
+      _Idle.wait(lock, [this]{ return _Running == 0; });
+    }
+    merged.clear();
+    for (uint32_t t = 0; t < _Threads; t++)
+    {
+      merged.insert(merged.end(), _Part[t]->batch.begin(), _Part[t]->batch.end());
+      _Part[t]->batch.clear();
+    }
+    std::sort(merged.begin(), merged.end(), [](const Air &a, const Air &b)
+              { return a.start != b.start ? a.start < b.start : a.node < b.node; });
+    for (size_t m = 0; m < merged.size(); m++)
+    {
+      _ChannelUs[merged[m].channel] += merged[m].end - merged[m].start;
+    }
+    _Air.insert(_Air.end(), merged.begin(), merged.end());
+    Resolve(end);
+  }
+  for (uint32_t t = 0; t < _Threads; t++)
+  {
+    _Part[t]->thread.join();
+  }
+  Resolve(UINT64_MAX);
+  std::sort(_Latency.begin(), _Latency.end());
+  return 0;
+}
+
+/*  Worker
+ *  Thread t: set up its nodes, then run a window of events each time Run() says.
+ *  Node n belongs to thread n % threads.
+ */
+void SX1276Sim::
+Worker (uint32_t t)
+{
+  Part * part = _Part[t];
+  uint32_t window = 0;
+  uint64_t end;
+
+  SX1276Emulator::Partition();
+  SX1276Emulator::Speed(0);
+  for (size_t k = 0; k < part->radios.size(); k++)
+  {
+    part->radios[k].node = t + k * _Threads;
+  }
+  Setup(part);
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(_Lock);
+      if (--_Running == 0) _Idle.notify_one();
+      _Go.wait(lock, [this, window]{ return _Stop || _Window != window; });
+      if (_Stop) break;
+      window = _Window;
+      end = _WindowEnd;
+    }
+    while (!part->events.empty() && part->events.top().first < end)
+    {
+      std::pair<uint64_t, uint32_t> e = part->events.top();
+      part->events.pop();
+      Step(part, &part->radios[e.second], e.first);
+    }
+  }
+  for (size_t k = 0; k < part->radios.size(); k++)
+  {
+    delete part->radios[k].lora;
+    delete part->radios[k].emu;
+  }
+}
+
+/*  Setup
+ *  Worker thread: create and configure each node's radio, as a real node would
+ *  (Init() with the EU868 band plan, then Apply() its settings), and schedule its
+ *  first packet.
+ */
+void SX1276Sim::
+Setup (Part *part)
+{
+  Radio * r;
+  SX1276SimNode * node;
+
+  for (size_t k = 0; k < part->radios.size(); k++)
+  {
+    r = &part->radios[k];
+    node = &_Node[r->node];
+    r->sim = this;
+    r->part = part;
+    r->rng = 0x9E3779B97F4A7C15ULL * (((uint64_t) _Cfg.seed << 32) + r->node + 1);
+    r->pending = 0;
+    r->backoffs = 0;
+    r->seq = 0;
+    SX1276Emulator::Clock(0);
+    r->emu = new SX1276Emulator(NSS_PIN_DEFAULT, RESET_PIN_DEFAULT);
+    r->emu->OnTransmit(Transmitted, r);
+    r->lora = new SX1276(1000000, NSS_PIN_DEFAULT, RESET_PIN_DEFAULT);
+    r->lora->Init(OUTPUT_PA_BOOST, BANDPLAN_EU868);
+    SX1276Profile profile(_SimFreq[node->channel], node->sf, 125000, 1, _Cfg.power, OUTPUT_PA_BOOST);
+    r->lora->Apply(&profile);
+    r->nextReady = SIM_START_US + (uint64_t) (SimUniform(&r->rng) * _Cfg.periodS * 1000000);
+    if (r->nextReady < _EndUs)
+    {
+      part->events.push(std::make_pair(r->nextReady, (uint32_t) k));
+    }
+  }
+}
+
+/*  Step
+ *  Worker thread: run a node's event at now. A packet becomes ready at its time,
+ *  replacing one still waiting, and is sent, or tried again later.
+ */
+void SX1276Sim::
+Step (Part *part,
+      Radio *r,
+      uint64_t now)
+{
+  SX1276SimNode * node = &_Node[r->node];
+  uint64_t next, frame;
+
+  r->emu->Attach();
+  SX1276Emulator::Clock(now);
+  if (now >= r->nextReady)
+  {
+    if (r->pending) node->dropped++;
+    node->generated++;
+    r->pending = 1;
+    r->backoffs = 0;
+    r->readyUs = r->nextReady;
+    r->seq++;
+    r->attempt = now;
+    if (_Cfg.mac == SIM_TDMA)
+    {
+      // Slot (node / channels) of the frame, next time round
+      frame = (uint64_t) _Cfg.periodS * 1000000;
+      r->attempt = now / frame * frame +
+                   (r->node / _Cfg.channels) % std::max<uint64_t>(frame / _SlotUs, 1) * _SlotUs;
+      if (r->attempt < now) r->attempt += frame;
+    }
+    r->nextReady += SimExpUs(&r->rng, _Cfg.periodS);
+  }
+  if (r->pending && now >= r->attempt)
+  {
+    Attempt(part, r, now);
+  }
+  next = r->nextReady;
+  if (r->pending && r->attempt < next) next = r->attempt;
+  next = std::max(next, SX1276Emulator::NowUs());  // After the driver calls just made
+  if (next < _EndUs)
+  {
+    part->events.push(std::make_pair(next, (uint32_t) (r - &part->radios[0])));
+  }
+}
+
+/*  Attempt
+ *  Worker thread: try to send the pending packet, through the driver.
+ */
+void SX1276Sim::
+Attempt (Part *part,
+         Radio *r,
+         uint64_t now)
+{
+  SX1276SimNode * node = &_Node[r->node];
+  char data[255];
+  int  n;
+
+  if (_Cfg.mac == SIM_LBT && Busy(part, r, now) != 0)
+  {
+    node->busy++;
+    r->attempt = SX1276Emulator::NowUs() + 1 +
+                 SimUniform(&r->rng) * (SIM_LBT_BACKOFF_MS * 1000 << std::min<uint8_t>(r->backoffs, 6));
+    r->backoffs++;
+    return;
+  }
+  memset(data, 0, _Cfg.payload);
+  memcpy(data, &r->node, 4);
+  memcpy(data + 4, &r->seq, 4);
+  n = r->lora->TX(data, _Cfg.payload);
+  if (n == -2 || n == -3)
+  {
+    node->blocked++;
+    r->attempt = SX1276Emulator::NowUs() + SIM_RETRY_MS * 1000;
+    return;
+  }
+  if (n < 0)
+  {
+    node->dropped++;
+  }
+  r->pending = 0;
+}
+
+/*  Busy
+ *  Worker thread: LBT. If a packet this node can hear is on the air on its
+ *  channel and SF, give the emulated radio a preamble to detect, then run CADOnce().
+ *  Returns: As CADOnce().
+ */
+int SX1276Sim::
+Busy (Part *part,
+      Radio *r,
+      uint64_t now)
+{
+  SX1276SimNode * node = &_Node[r->node];
+  SX1276SimNode * other;
+  SX1276Packet pkt;
+  uint64_t cad = (uint64_t) 2000000 * (1 << node->sf) / 125000;
+  const Air * a;
+  size_t i, n = part->batch.size();
+  uint8_t heard = 0;
+
+  for (i = _Air.size() + n; i-- > 0 && !heard; )
+  {
+    a = i >= _Air.size() ? &part->batch[i - _Air.size()] : &_Air[i];
+    if (i < _Air.size() && a->start + _MaxAirUs <= now) break;
+    if (a->channel != node->channel || a->sf != node->sf || a->start >= now + cad ||
+        a->end <= now || a->node == r->node)
+    {
+      continue;
+    }
+    other = &_Node[a->node];
+    heard = _Cfg.power - LossDb(other->x - node->x, other->y - node->y) >= SensitivityDbm(a->sf);
+  }
+  if (heard)
+  {
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.len = 1;
+    r->emu->Inject(&pkt, now + 1);
+  }
+  return r->lora->CADOnce();
+}
+
+/*  Transmitted
+ *  Worker thread, from the emulator: a node's packet has been sent.
+ */
+void SX1276Sim::
+Transmitted (void *ctx,
+             const SX1276Packet *pkt)
+{
+  Radio * r = (Radio *) ctx;
+  SX1276Sim * sim = r->sim;
+  SX1276SimNode * node = &sim->_Node[r->node];
+  Air a;
+
+  a.start = pkt->timeUs;
+  a.end = pkt->timeUs + sim->_AirUs[node->sf];
+  a.readyUs = r->readyUs;
+  a.node = r->node;
+  a.sf = node->sf;
+  a.channel = node->channel;
+  a.resolved = 0;
+  r->part->batch.push_back(a);
+  node->sent++;
+  node->airtimeUs += a.end - a.start;
+}
+
+/*  Resolve
+ *  Between windows: decide the fate of each transmission that has ended by upTo,
+ *  and forget those too old to overlap any still to be resolved.
+ */
+void SX1276Sim::
+Resolve (uint64_t upTo)
+{
+  size_t i, keep;
+
+  for (i = _AirFirst; i < _Air.size() && _Air[i].start < upTo; i++)
+  {
+    if (!_Air[i].resolved && _Air[i].end <= upTo)
+    {
+      Receive(i);
+      _Air[i].resolved = 1;
+    }
+  }
+  while (_AirFirst < _Air.size() && _Air[_AirFirst].resolved) _AirFirst++;
+  if (_AirFirst > 65536)
+  {
+    keep = _AirFirst;
+    while (keep > 0 && _Air[keep - 1].start + 2 * _MaxAirUs > _Air[_AirFirst - 1].start) keep--;
+    _Air.erase(_Air.begin(), _Air.begin() + keep);
+    _AirFirst -= keep;
+  }
+}
+
+/*  Receive
+ *  Between windows: is transmission i received by a gateway? See the top.
+ */
+void SX1276Sim::
+Receive (size_t i)
+{
+  const Air * a = &_Air[i];
+  const Air * b;
+  SX1276SimNode * node = &_Node[a->node];
+  uint8_t heard = 0, ok = 0, lost;
+  float   p, pb;
+  double  sameMw;
+  size_t  j;
+
+  for (int g = 0; g < _Cfg.gateways && !ok; g++)
+  {
+    p = RxDbm(a->node, g);
+    if (p < SensitivityDbm(a->sf))
+    {
+      continue;
+    }
+    heard = 1;
+    lost = 0;
+    sameMw = 0;
+    for (j = i; j-- > 0 && _Air[j].start + _MaxAirUs > a->start; )
+    {
+      b = &_Air[j];
+      if (b->channel != a->channel || b->end <= a->start) continue;
+      pb = RxDbm(b->node, g);
+      if (b->sf == a->sf) sameMw += pow(10, pb / 10);
+      else if (p - pb < _SfRejectDb[a->sf - 7][b->sf - 7]) lost = 1;
+    }
+    for (j = i + 1; j < _Air.size() && _Air[j].start < a->end; j++)
+    {
+      b = &_Air[j];
+      if (b->channel != a->channel) continue;
+      pb = RxDbm(b->node, g);
+      if (b->sf == a->sf) sameMw += pow(10, pb / 10);
+      else if (p - pb < _SfRejectDb[a->sf - 7][b->sf - 7]) lost = 1;
+    }
+    if (sameMw > 0 && p - 10 * log10(sameMw) < SIM_CAPTURE_DB) lost = 1;
+    ok = !lost;
+  }
+  if (ok)
+  {
+    node->delivered++;
+    node->latencyUs += a->end - a->readyUs;
+    node->latencyMaxUs = std::max(node->latencyMaxUs, a->end - a->readyUs);
+    _Latency.push_back((a->end - a->readyUs) / 1000);
+  }
+  else if (heard)
+  {
+    node->collided++;
+  }
+  else
+  {
+    node->weak++;
+  }
+}
+
+uint32_t SX1276Sim::
+Nodes ()
+{
+  return _Cfg.nodes;
+}
+
+const SX1276SimNode * SX1276Sim::
+Node (uint32_t n)
+{
+  return n < _Cfg.nodes ? &_Node[n] : NULL;
+}
+
+uint32_t SX1276Sim::
+Threads ()
+{
+  return _Threads;
+}
+
+/*  LatencyMs
+ *  After Run(): latency of delivered packets at a percentile, 0 - 100.
+ *  Returns: ms, 0 if nothing was delivered.
+ */
+uint32_t SX1276Sim::
+LatencyMs (float percentile)
+{
+  size_t i;
+  if (_Latency.empty())
+  {
+    return 0;
+  }
+  i = (size_t) (percentile / 100 * (_Latency.size() - 1) + 0.5);
+  return _Latency[std::min(i, _Latency.size() - 1)];
+}
+
+/*  ChannelAirtimeUs
+ *  Returns: Total time on air of every transmission on a channel.
+ */
+uint64_t SX1276Sim::
+ChannelAirtimeUs (uint8_t channel)
+{
+  return channel < SIM_CHANNELS ? _ChannelUs[channel] : 0;
+}
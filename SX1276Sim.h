@@ -0,0 +1,168 @@
+/*  SX1276Sim_h - Discrete event LoRa network simulator on the SX1276 library (Linux)
+ *
+ *  Simulates thousands of end nodes sending uplinks to gateways, each node an
+ *  SX1276 driver on an emulated radio (SX1276Emulator), so the configuration, time
+ *  on air and the duty cycle rules of the band plan (Init(), Frequency(), TX())
+ *  are the library's own. Runs on virtual time, as fast as the CPU allows.
+ *
+ *  The channel models log-distance path loss with shadowing, the demodulation
+ *  floor of each SF, the capture effect between packets on the same SF and the
+ *  imperfect orthogonality of different SFs. Gateways are modelled as concentrators
+ *  that receive every channel and SF at once, as LoRaWAN gateways do, rather than
+ *  as SX1276s, which can only receive one.
+ *
+ *  MAC strategies: ALOHA (send when a packet is ready), LBT (a CAD, CADOnce(),
+ *  before sending, and a random backoff while the channel is busy) and TDMA (each
+ *  node sends in a slot of its own in a frame of periodS). SF is fixed, or with
+ *  ADR the smallest SF that reaches the nearest gateway with SIM_ADR_MARGIN_DB.
+ *
+ *  Nodes are partitioned across threads, each with an emulator of its own (see
+ *  SX1276Emulator::Partition()). Threads run windowMs of virtual time at a time and
+ *  then exchange transmissions, so LBT doesn't hear transmissions that started in
+ *  another thread during the current window. One thread, or a short window, is
+ *  exact. Results don't depend on the number of threads otherwise.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Sim_h
+#define SX1276Sim_h
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SX1276.h"
+
+#define SIM_MAX_THREADS    64
+#define SIM_MAX_GATEWAYS   16
+#define SIM_CHANNELS       3      // EU868 868.1, 868.3 and 868.5MHz
+#define SIM_CAPTURE_DB     6      // Same SF: a packet survives this much above interference
+#define SIM_ADR_MARGIN_DB  10     // ADR: link margin over the SF's sensitivity
+#define SIM_NOISE_FIGURE_DB 6
+#define SIM_PL_D0_M        1000   // Path loss: PL(d) = SIM_PL_D0_DB + 10 n log10(d / d0)
+#define SIM_PL_D0_DB       128.95 // Measured for nodes near the ground, 868MHz
+#define SIM_TDMA_GUARD_MS  50     // TDMA: gap between slots
+#define SIM_LBT_BACKOFF_MS 1000   // LBT: backoff is random, up to this, doubling each time
+#define SIM_RETRY_MS       1000   // Retry after a TX refused by the duty cycle rules
+
+#define SIM_ALOHA          0
+#define SIM_LBT            1
+#define SIM_TDMA           2
+
+/*  SX1276SimConfig
+ *  Simulation settings. SX1276Sim::Defaults() fills in the defaults.
+ */
+struct SX1276SimConfig
+{
+  uint32_t nodes;           // 10000
+  uint8_t  gateways;        // 1, at the centre. More are spread on a ring at half radiusM
+  uint32_t radiusM;         // 5000. Nodes are placed at random in the disc
+  uint32_t seconds;         // 3600. Virtual time simulated
+  uint32_t periodS;         // 600. Mean time between uplinks from a node (Poisson)
+  uint8_t  payload;         // 20 bytes, at least 8
+  uint8_t  sf;              // 7-12, or 0 for ADR. Default 0
+  uint8_t  mac;             // SIM_ALOHA, SIM_LBT or SIM_TDMA
+  uint8_t  channels;        // 1 - SIM_CHANNELS. Default 3. Nodes are shared out
+  int8_t   power;           // 14 dBm
+  float    pathExponent;    // 2.32
+  float    shadowingDb;     // 7.8. Standard deviation, per node and gateway
+  uint32_t threads;         // 0 for one per core
+  uint32_t windowMs;        // 100
+  uint32_t seed;            // 1
+};
+
+/*  SX1276SimNode
+ *  A node's position, settings and results.
+ */
+struct SX1276SimNode
+{
+  float    x, y;            // m from the centre
+  float    lossDb;          // Path loss to the nearest gateway, with shadowing
+  uint8_t  sf;
+  uint8_t  channel;
+  uint32_t generated;       // Packets ready to send
+  uint32_t sent;            // Transmitted
+  uint32_t delivered;       // Received by a gateway
+  uint32_t collided;        // Lost to interference at every gateway that could hear it
+  uint32_t weak;            // Below sensitivity at every gateway
+  uint32_t dropped;         // Replaced by the next packet before it could be sent
+  uint32_t blocked;         // TX() refused by the duty cycle rules (retried)
+  uint32_t busy;            // LBT found the channel busy (backed off)
+  uint64_t airtimeUs;
+  uint64_t latencyUs;       // Total, from ready to the end of reception
+  uint64_t latencyMaxUs;
+};
+
+class SX1276Sim
+{
+  public:
+    SX1276Sim         (const SX1276SimConfig *cfg);
+    ~SX1276Sim        ();
+    static void Defaults(SX1276SimConfig *cfg);
+    int Run           ();
+    uint32_t Nodes    ();
+    const SX1276SimNode * Node(uint32_t n);
+    uint32_t LatencyMs(float percentile);
+    uint64_t ChannelAirtimeUs(uint8_t channel);
+    uint32_t Threads  ();
+    static float SensitivityDbm(uint8_t sf);
+
+  private:
+    struct Air              // A transmission
+    {
+      uint64_t start;
+      uint64_t end;
+      uint64_t readyUs;     // When the packet was ready to send
+      uint32_t node;
+      uint8_t  sf;
+      uint8_t  channel;
+      uint8_t  resolved;
+    };
+    struct Radio;
+    struct Part;
+    void Worker       (uint32_t t);
+    void Setup        (Part *part);
+    void Step         (Part *part,
+                       Radio *r,
+                       uint64_t now);
+    void Attempt      (Part *part,
+                       Radio *r,
+                       uint64_t now);
+    int Busy          (Part *part,
+                       Radio *r,
+                       uint64_t now);
+    void Resolve      (uint64_t upTo);
+    void Receive      (size_t i);
+    float RxDbm       (uint32_t node,
+                       uint8_t gateway);
+    float LossDb      (float dx,
+                       float dy);
+    static void Transmitted(void *ctx,
+                            const SX1276Packet *pkt);
+    SX1276SimConfig _Cfg;
+    SX1276SimNode * _Node;
+    float *  _Loss;         // Path loss by node and gateway
+    float    _Gw[SIM_MAX_GATEWAYS][2];
+    Part *   _Part[SIM_MAX_THREADS];
+    uint32_t _Threads;
+    std::vector<Air> _Air;  // Transmissions of past windows, in start order
+    size_t   _AirFirst;     // First that may be unresolved
+    uint64_t _MaxAirUs;
+    uint64_t _EndUs;
+    uint32_t _AirUs[13];    // Time on air by SF
+    uint64_t _SlotUs;       // TDMA slot
+    std::vector<uint32_t> _Latency;
+    uint64_t _ChannelUs[SIM_CHANNELS];
+
+    /* Workers run a window at a time, under _Lock */
+    std::mutex _Lock;
+    std::condition_variable _Go;
+    std::condition_variable _Idle;
+    uint64_t _WindowEnd;
+    uint32_t _Window;
+    uint32_t _Running;
+    uint8_t  _Stop;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+  SX1276Snapshot.cpp - Register map snapshot for the SX1276 library
+  Released into the public domain.
+
+  The field table mirrors the read accessors in SX1276.cpp, in the order the
+  control server has always listed them. A field added to the library should be
+  added here too.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "SX1276Snapshot.h"
+
+static const SX1276Field _Fields[] = {
+  {"LongRangeMode",         0x01, 1, 7, 1},
+  {"AccessSharedReg",       0x01, 1, 6, 1},
+  {"LowFrequencyModeOn",    0x01, 1, 3, 1},
+  {"Mode",                  0x01, 3, 0, 1},
+  {"Frf",                   0x06, 8, 0, 3},
+  {"PaSelect",              0x09, 1, 7, 1},
+  {"MaxPower",              0x09, 3, 4, 1},
+  {"OutputPower",           0x09, 4, 0, 1},
+  {"PaRamp",                0x0A, 4, 0, 1},
+  {"OcpOn",                 0x0B, 1, 5, 1},
+  {"OcpTrim",               0x0B, 5, 0, 1},
+  {"LnaGain",               0x0C, 3, 5, 1},
+  {"LnaBoostLf",            0x0C, 2, 3, 1},
+  {"LnaBoostHf",            0x0C, 2, 0, 1},
+  {"FifoAddrPtr",           0x0D, 8, 0, 1},
+  {"FifoTxBaseAddr",        0x0E, 8, 0, 1},
+  {"FifoRxBaseAddr",        0x0F, 8, 0, 1},
+  {"FifoRxCurrentAddr",     0x10, 8, 0, 1},
+  {"RxTimeoutMask",         0x11, 1, 7, 1},
+  {"RxDoneMask",            0x11, 1, 6, 1},
+  {"PayloadCrcErrorMask",   0x11, 1, 5, 1},
+  {"ValidHeaderMask",       0x11, 1, 4, 1},
+  {"TxDoneMask",            0x11, 1, 3, 1},
+  {"CadDoneMask",           0x11, 1, 2, 1},
+  {"FhssChangeChannelMask", 0x11, 1, 1, 1},
+  {"CadDetectedMask",       0x11, 1, 0, 1},
+  {"RxTimeout",             0x12, 1, 7, 1},
+  {"RxDone",                0x12, 1, 6, 1},
+  {"PayloadCrcError",       0x12, 1, 5, 1},
+  {"ValidHeader",           0x12, 1, 4, 1},
+  {"TxDone",                0x12, 1, 3, 1},
+  {"CadDone",               0x12, 1, 2, 1},
+  {"FhssChangeChannel",     0x12, 1, 1, 1},
+  {"CadDetected",           0x12, 1, 0, 1},
+  {"FifoRxBytesNb",         0x13, 8, 0, 1},
+  {"ValidHeaderCnt",        0x14, 8, 0, 2},
+  {"ValidPacketCnt",        0x16, 8, 0, 2},
+  {"RxCodingRate",          0x18, 3, 5, 1},
+  {"ModemStatus",           0x18, 5, 0, 1},
+  {"PacketSnr",             0x19, 8, 0, 1},
+  {"PacketRssi",            0x1A, 8, 0, 1},
+  {"Rssi",                  0x1B, 8, 0, 1},
+  {"PllTimeout",            0x1C, 1, 7, 1},
+  {"CrcOnPayload",          0x1C, 1, 6, 1},
+  {"FhssPresentChannel",    0x1C, 6, 0, 1},
+  {"Bw",                    0x1D, 4, 4, 1},
+  {"CodingRate",            0x1D, 3, 1, 1},
+  {"ImplicitHeaderModeOn",  0x1D, 1, 0, 1},
+  {"SpreadingFactor",       0x1E, 4, 4, 1},
+  {"TxContinuousMode",      0x1E, 1, 3, 1},
+  {"RxPayloadCrcOn",        0x1E, 1, 2, 1},
+  {"SymbTimeout",           0x1E, 2, 0, 2},
+  {"PreambleLength",        0x20, 8, 0, 2},
+  {"PayloadLength",         0x22, 8, 0, 1},
+  {"PayloadMaxLength",      0x23, 8, 0, 1},
+  {"FreqHoppingPeriod",     0x24, 8, 0, 1},
+  {"FifoRxByteAddrPtr",     0x25, 8, 0, 1},
+  {"LowDataRateOptimize",   0x26, 1, 3, 1},
+  {"AgcAutoOn",             0x26, 1, 2, 1},
+  {"PpmCorrection",         0x27, 8, 0, 1},
+  {"FreqError",             0x28, 4, 0, 3},
+  {"RssiWideband",          0x2C, 8, 0, 1},
+  {"IfFreq2",               0x2F, 8, 0, 1},
+  {"IfFreq1",               0x30, 8, 0, 1},
+  {"AutomaticIFOn",         0x31, 1, 7, 1},
+  {"DetectionOptimize",     0x31, 3, 0, 1},
+  {"InvertIQ_RX",           0x33, 1, 6, 1},
+  {"InvertIQ_TX",           0x33, 1, 0, 1},
+  {"HighBWOptimize1",       0x36, 8, 0, 1},
+  {"DetectionThreshold",    0x37, 8, 0, 1},
+  {"SyncWord",              0x39, 8, 0, 1},
+  {"HighBWOptimize2",       0x3A, 8, 0, 1},
+  {"InvertIQ2",             0x3B, 8, 0, 1},
+  {"Dio0Mapping",           0x40, 2, 6, 1},
+  {"Dio1Mapping",           0x40, 2, 4, 1},
+  {"Dio2Mapping",           0x40, 2, 2, 1},
+  {"Dio3Mapping",           0x40, 2, 0, 1},
+  {"Dio4Mapping",           0x41, 2, 6, 1},
+  {"Dio5Mapping",           0x41, 2, 4, 1},
+  {"Version",               0x42, 8, 0, 1},
+  {"PaDac",                 0x4D, 3, 0, 1},
+  {"FormerTemp",            0x5B, 8, 0, 1},
+  {"AgcReferenceLevel",     0x62, 6, 0, 1},
+  {"AgcStep1",              0x62, 4, 0, 1},
+  {"AgcStep2",              0x63, 4, 4, 1},
+  {"AgcStep3",              0x63, 4, 0, 1},
+  {"AgcStep4",              0x64, 4, 4, 1},
+  {"AgcStep5",              0x64, 4, 0, 1},
+  {"PllBandwidth",          0x70, 4, 0, 1},
+};
+
+#define SNAPSHOT_FIELDS    ((int) (sizeof(_Fields) / sizeof(_Fields[0])))
+
+const SX1276Field * SX1276Snapshot::Fields()
+{ return _Fields; }
+
+int SX1276Snapshot::FieldCount()
+{ return SNAPSHOT_FIELDS; }
+
+/*  Value
+ *  Returns: field decoded from the snapshot, as its accessor would read it.
+ */
+uint32_t SX1276Snapshot::
+Value (const SX1276Field *field)
+{
+  uint32_t v = (reg[field->addr] >> field->shift) & (0xFF >> (8 - field->bits));
+  for (int b = 1; b < field->bytes; b++)
+  {
+    v = v << 8 | reg[field->addr + b];
+  }
+  return v;
+}
+
+/*  Value
+ *  Look up a field by its accessor's name, e.g. "SpreadingFactor".
+ *  Returns: 0 if found, -1 if there is no such field.
+ */
+int SX1276Snapshot::
+Value (const char *name,
+       uint32_t *value)
+{
+  for (int f = 0; f < SNAPSHOT_FIELDS; f++)
+  {
+    if (strcmp(_Fields[f].name, name) == 0)
+    {
+      *value = Value(&_Fields[f]);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*  Html
+ *  Write every field as "<br>Name = value", value in hex.
+ *  Returns: Length of the text, or -1 if buf is too small.
+ */
+int SX1276Snapshot::
+Html (char  *buf,
+      size_t len)
+{
+  size_t used = 0;
+  int    n;
+  for (int f = 0; f < SNAPSHOT_FIELDS; f++)
+  {
+    n = snprintf(buf + used, len - used, "<br>%s = %x", _Fields[f].name, (unsigned) Value(&_Fields[f]));
+    if (n < 0 || (size_t) n >= len - used) return -1;
+    used += n;
+  }
+  return used;
+}
+
+/*  Json
+ *  Write every field, and the registers as one hex string from SNAPSHOT_FIRST:
+ *  {"LongRangeMode":1,...,"regs":"81..."}
+ *  Returns: Length of the text, or -1 if buf is too small.
+ */
+int SX1276Snapshot::
+Json (char  *buf,
+      size_t len)
+{
+  size_t used = 0;
+  int    n;
+  if (len < 2 * SNAPSHOT_LEN + 12) return -1;
+  for (int f = 0; f < SNAPSHOT_FIELDS; f++)
+  {
+    n = snprintf(buf + used, len - used, "%c\"%s\":%u", f ? ',' : '{', _Fields[f].name,
+                 (unsigned) Value(&_Fields[f]));
+    if (n < 0 || (size_t) n >= len - used) return -1;
+    used += n;
+  }
+  if (used + 2 * SNAPSHOT_LEN + 11 >= len) return -1;
+  used += snprintf(buf + used, len - used, ",\"regs\":\"");
+  for (int r = SNAPSHOT_FIRST; r <= SNAPSHOT_LAST; r++)
+  {
+    used += snprintf(buf + used, len - used, "%02x", reg[r]);
+  }
+  used += snprintf(buf + used, len - used, "\"}");
+  return used;
+}
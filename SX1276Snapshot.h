@@ -0,0 +1,80 @@
+/*  SX1276Snapshot_h - Register map snapshot for the SX1276 library
+ *
+ *  SX1276::Snapshot() reads registers 0x01 to 0x70 in one SPI burst, and every
+ *  accessor's field can then be decoded from the copy without touching the bus:
+ *  one transaction instead of one or more per field. RegFifo (0x00) is not read, as
+ *  reading it advances FifoAddrPtr. Html() and Json() format all fields into a
+ *  caller's buffer, for the control server's pages.
+ *
+ *  Config() marks the registers that hold configuration, as against status,
+ *  counters and FIFO pointers, so that a saved snapshot can be written back to a
+ *  radio with only the registers that differ (see SX1276::WarmStart()). ReadOnly()
+ *  marks registers that ignore writes, which a write burst may run over.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Snapshot_h
+#define SX1276Snapshot_h
+#include <stdint.h>
+#include <stddef.h>
+
+#define SNAPSHOT_FIRST     0x01   // RegOpMode
+#define SNAPSHOT_LAST      0x70   // RegPll
+#define SNAPSHOT_LEN       (SNAPSHOT_LAST - SNAPSHOT_FIRST + 1)
+#define SNAPSHOT_BURST_GAP 8      // Unchanged registers a write burst runs on over
+
+/*  SX1276Field
+ *  A field as read by its accessor: bits at shift in register addr, followed by
+ *  bytes - 1 whole registers for multi-register values such as Frf.
+ */
+struct SX1276Field
+{
+  const char * name;
+  uint8_t addr;
+  uint8_t bits;
+  uint8_t shift;
+  uint8_t bytes;
+};
+
+class SX1276Snapshot
+{
+  public:
+    uint8_t reg[SNAPSHOT_LAST + 1];   // reg[addr], reg[0] unused
+
+    uint32_t Value    (const SX1276Field *field);
+    int Value         (const char *name,
+                       uint32_t *value);
+    int Html          (char  *buf,
+                       size_t len);
+    int Json          (char  *buf,
+                       size_t len);
+    static const SX1276Field * Fields();
+    static int FieldCount();
+    static int Config (uint8_t addr);
+    static int ReadOnly (uint8_t addr);
+};
+
+/*  Config
+ *  Returns: 1 if register addr holds configuration (RegFrMsb to RegPaDac, the AGC
+ *  and PLL settings), 0 for status, counters, FIFO pointers and RegOpMode.
+ */
+inline int SX1276Snapshot::
+Config (uint8_t addr)
+{
+  static const uint32_t config[4] = {0xE002DFC0, 0x0ECB80DF, 0x00002803, 0x0001001E};
+  return addr < 0x80 && (config[addr >> 5] >> (addr & 31)) & 1;
+}
+
+/*  ReadOnly
+ *  Returns: 1 if register addr is status that ignores writes (RegFifoRxCurrentAddr,
+ *  RegRxNbBytes to RegHopChannel, RegFifoRxByteAddr, RegFei, RegRssiWideband and
+ *  RegVersion), 0 otherwise.
+ */
+inline int SX1276Snapshot::
+ReadOnly (uint8_t addr)
+{
+  static const uint32_t status[4] = {0x1FF90000, 0x00001720, 0x00000004, 0x00000000};
+  return addr < 0x80 && (status[addr >> 5] >> (addr & 31)) & 1;
+}
+
+#endif
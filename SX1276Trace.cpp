@@ -0,0 +1,224 @@
+/*
+  SX1276Trace.cpp - Event tracing for the SX1276 library (Linux only)
+  Released into the public domain.
+
+  Each thread gets a ring of TRACE_RING_SIZE records on its first event. The ring is
+  linked into a global list and never freed, so the events of threads that have
+  exited can still be exported. When a ring is full the oldest records are overwritten.
+
+  Recording costs a timestamp read (rdtsc on x86, the ARM generic timer on
+  a Pi, clock_gettime elsewhere) and four stores into the thread's ring. Ticks are
+  converted to time at export, from the ticks and CLOCK_MONOTONIC at the first
+  event and at export.
+
+  Export() can run while other threads record: a record that may have been
+  overwritten while it was copied is dropped. Clear() must only be called while
+  no thread is recording.
+
+  Typical use: build with -DSX1276_TRACE, include SX1276Trace.cpp, run, then
+  SX1276Trace::Export("trace.json") and open the file in ui.perfetto.dev.
+  See "make replaytrace" in RaspberryPI.
+*/
+#ifndef ESP32
+
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "SX1276Trace.h"
+
+static std::mutex _TraceLock;
+static std::atomic<SX1276TraceRing *> _TraceRings(NULL);
+static uint64_t _TraceTicks0;  // Ticks() at the first event
+static uint64_t _TraceNs0;     // CLOCK_MONOTONIC at the first event
+static const char * _TraceName[TRACE_EVENTS] =
+  {"spi_rx", "spi_tx", "spi_burst_rx", "spi_burst_tx", "mode", "irq", "wait",
+   "TX", "TXBurst", "RXContinuous", "RXReply", "RXFiltered", "CAD"};
+static const char * _TraceModeName[8] = {"sleep", "stdby", "fstx", "tx", "fsrx", "rxcontinuous", "rxsingle", "cad"};
+
+static uint64_t TraceMonotonicNs ()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Write s as a JSON string. Thread and event names come from the application. */
+static void TraceJsonString (FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; s++)
+  {
+    if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20) fprintf(f, "\\u%04x", (unsigned char) *s);
+    else fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+/*  Name
+ *  Name an application event id (TRACE_APP and up), for use with TRACE_SCOPE()
+ *  and TRACE_INSTANT(). name is not copied.
+ */
+void SX1276Trace::
+Name (uint16_t    id,
+      const char *name)
+{
+  if (id < TRACE_EVENTS)
+  {
+    _TraceName[id] = name;
+  }
+}
+
+/*  ThreadName
+ *  Name the calling thread in the trace. Defaults to its name when it first recorded.
+ */
+void SX1276Trace::
+ThreadName (const char *name)
+{
+  SX1276TraceRing * ring = Ring();
+  if (ring == NULL) ring = Attach();
+  snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+/*  Clear
+ *  Discard all recorded events. No thread may be recording.
+ */
+void SX1276Trace::
+Clear ()
+{
+  for (SX1276TraceRing * ring = _TraceRings.load(); ring != NULL; ring = ring->next)
+  {
+    ring->head.store(0, std::memory_order_relaxed);
+  }
+}
+
+/*  Attach
+ *  Allocate the calling thread's ring, on its first event.
+ */
+SX1276TraceRing * SX1276Trace::
+Attach ()
+{
+  std::lock_guard<std::mutex> lock(_TraceLock);
+  SX1276TraceRing * ring = new SX1276TraceRing;
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->tid = syscall(SYS_gettid);
+  if (pthread_getname_np(pthread_self(), ring->name, sizeof(ring->name)) != 0)
+  {
+    ring->name[0] = 0;
+  }
+  if (_TraceRings.load() == NULL)
+  {
+    _TraceTicks0 = Ticks();
+    _TraceNs0 = TraceMonotonicNs();
+  }
+  ring->next = _TraceRings.load();
+  _TraceRings.store(ring);
+  Ring() = ring;
+  return ring;
+}
+
+/*  Export
+ *  Write all recorded events to path in Chrome trace event JSON format.
+ *  Returns: Number of events written, or -1 if the file can't be written.
+ */
+int SX1276Trace::
+Export (const char *path)
+{
+  SX1276TraceRecord r;
+  uint32_t head, first, idx;
+  uint64_t ticks, ns;
+  double   usPerTick = 0.001;
+  const char * name;
+  char     unnamed[16];
+  int      pid = getpid();
+  int      count = 0;
+  FILE *   f;
+
+  f = fopen(path, "w");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_TraceLock);
+    ticks = Ticks() - _TraceTicks0;
+    ns = TraceMonotonicNs() - _TraceNs0;
+  }
+  if (ticks > 0 && ns > 0)
+  {
+    usPerTick = (double) ns / ticks / 1000;
+  }
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"SX1276\"}}", pid);
+  for (SX1276TraceRing * ring = _TraceRings.load(); ring != NULL; ring = ring->next)
+  {
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, ring->tid);
+    TraceJsonString(f, ring->name[0] ? ring->name : "thread");
+    fprintf(f, "}}");
+    head = ring->head.load(std::memory_order_acquire);
+    first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (idx = first; idx != head; idx++)
+    {
+      r = ring->rec[idx & (TRACE_RING_SIZE - 1)];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (ring->head.load(std::memory_order_relaxed) - idx >= TRACE_RING_SIZE)
+      {
+        continue; // overwritten while being copied
+      }
+      name = r.id < TRACE_EVENTS ? _TraceName[r.id] : NULL;
+      if (name == NULL)
+      {
+        snprintf(unnamed, sizeof(unnamed), "event%u", r.id);
+        name = unnamed;
+      }
+      fprintf(f, ",\n{\"name\":");
+      TraceJsonString(f, name);
+      fprintf(f, ",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+              r.id <= TRACE_SPI_BURST_TX ? "spi" : r.id < TRACE_APP ? "radio" : "app",
+              pid, ring->tid, (int64_t) (r.start - _TraceTicks0) * usPerTick);
+      if (r.instant)
+      {
+        fprintf(f, "\"ph\":\"i\",\"s\":\"t\",");
+      }
+      else
+      {
+        fprintf(f, "\"ph\":\"X\",\"dur\":%.3f,", (r.end - r.start) * usPerTick);
+      }
+      switch (r.id)
+      {
+        case TRACE_SPI_RX:
+        case TRACE_SPI_TX:
+          fprintf(f, "\"args\":{\"reg\":\"0x%02x\",\"value\":\"0x%02x\"}}", (r.arg >> 8) & 0xFF, r.arg & 0xFF);
+          break;
+        case TRACE_SPI_BURST_RX:
+        case TRACE_SPI_BURST_TX:
+          fprintf(f, "\"args\":{\"reg\":\"0x%02x\",\"len\":%u}}", (r.arg >> 16) & 0xFF, r.arg & 0xFFFF);
+          break;
+        case TRACE_MODE:
+          fprintf(f, "\"args\":{\"from\":\"%s\",\"to\":\"%s\"}}", _TraceModeName[(r.arg >> 8) & 7], _TraceModeName[r.arg & 7]);
+          break;
+        case TRACE_IRQ:
+          fprintf(f, "\"args\":{\"flags\":\"0x%02x\"}}", r.arg & 0xFF);
+          break;
+        case TRACE_WAIT:
+          fprintf(f, "\"args\":{\"us\":%u}}", r.arg);
+          break;
+        default:
+          fprintf(f, "\"args\":{\"arg\":%d}}", (int32_t) r.arg);
+          break;
+      }
+      count++;
+    }
+  }
+  fprintf(f, "\n]}\n");
+  if (fclose(f) != 0)
+  {
+    return -1;
+  }
+  return count;
+}
+
+#endif
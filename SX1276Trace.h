@@ -0,0 +1,163 @@
+/*  SX1276Trace_h - Event tracing for the SX1276 library (Linux only)
+ *
+ *  Build with -DSX1276_TRACE (and include SX1276Trace.cpp) to record where the time
+ *  goes: SPI transactions, mode changes, TX, RX and CAD calls, IRQ flags seen and
+ *  delay() polling. Each event is a fixed size record written to a ring buffer
+ *  owned by the calling thread, so no locks are taken and nothing is allocated
+ *  after a thread's first event. SX1276Trace::Export() writes the rings as
+ *  Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open directly.
+ *  Without SX1276_TRACE the TRACE_ macros compile to nothing.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Trace_h
+#define SX1276Trace_h
+
+#ifdef SX1276_TRACE
+#  ifdef ESP32
+#    error "SX1276_TRACE is only supported on Linux"
+#  endif
+#  define TRACE_SCOPE(id, arg)  SX1276TraceScope _TraceScope(id, arg)
+#  define TRACE_ARG(arg)        _TraceScope.Arg(arg)
+#  define TRACE_INSTANT(id, arg) SX1276Trace::Instant(id, arg)
+#else
+#  define TRACE_SCOPE(id, arg)  do {} while (0)
+#  define TRACE_ARG(arg)        do {} while (0)
+#  define TRACE_INSTANT(id, arg) do {} while (0)
+#endif
+
+#ifndef ESP32
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+#define TRACE_RING_SIZE    16384  // Records per thread, power of 2
+#define TRACE_EVENTS       64     // Event ids
+
+/* Event ids. arg is shown in the trace. */
+#define TRACE_SPI_RX       0      // arg: addr << 8 | value read
+#define TRACE_SPI_TX       1      // arg: addr << 8 | value written
+#define TRACE_SPI_BURST_RX 2      // arg: addr << 16 | length
+#define TRACE_SPI_BURST_TX 3      // arg: addr << 16 | length
+#define TRACE_MODE         4      // instant, arg: from << 8 | to
+#define TRACE_IRQ          5      // instant, arg: RegIrqFlags acted on
+#define TRACE_WAIT         6      // delay() while polling, arg: us
+#define TRACE_TX           7      // arg: datalen
+#define TRACE_TX_BURST     8      // arg: frames
+#define TRACE_RX_CONTINUOUS 9     // arg: timeout ms
+#define TRACE_RX_REPLY     10     // arg: timeout ms
+#define TRACE_RX_FILTERED  11     // arg: timeout ms
+#define TRACE_CAD          12     // arg: timeout ms
+#define TRACE_APP          32     // First id for application events, see Name()
+
+/*  SX1276TraceRecord
+ *  One event. start == end for instant events. Times are in Ticks().
+ */
+struct SX1276TraceRecord
+{
+  uint64_t start;
+  uint64_t end;
+  uint32_t arg;
+  uint16_t id;
+  uint16_t instant;
+};
+
+struct SX1276TraceRing
+{
+  std::atomic<uint32_t> head;    // Records written, ever
+  int      tid;
+  char     name[16];
+  SX1276TraceRing * next;
+  SX1276TraceRecord rec[TRACE_RING_SIZE];
+};
+
+class SX1276Trace
+{
+  public:
+    /* Timestamp: the CPU counter where user space can read it, else CLOCK_MONOTONIC ns */
+    static inline uint64_t Ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+      uint64_t t;
+      asm volatile("mrs %0, cntvct_el0" : "=r" (t));
+      return t;
+#elif defined(__ARM_ARCH_7A__)
+      uint64_t t;
+      asm volatile("mrrc p15, 1, %Q0, %R0, c14" : "=r" (t)); // CNTVCT, user access enabled by Linux
+      return t;
+#else
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    }
+    static inline void Record(uint16_t id,
+                              uint64_t start,
+                              uint64_t end,
+                              uint32_t arg,
+                              uint16_t instant = 0)
+    {
+      SX1276TraceRing * ring = Ring();
+      if (ring == NULL) ring = Attach();
+      uint32_t head = ring->head.load(std::memory_order_relaxed);
+      SX1276TraceRecord * r = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+      r->start = start;
+      r->end = end;
+      r->arg = arg;
+      r->id = id;
+      r->instant = instant;
+      ring->head.store(head + 1, std::memory_order_release);
+    }
+    static inline void Instant(uint16_t id,
+                               uint32_t arg)
+    {
+      uint64_t now = Ticks();
+      Record(id, now, now, arg, 1);
+    }
+    static void Name  (uint16_t id,
+                       const char *name);
+    static void ThreadName(const char *name);
+    static int Export (const char *path);
+    static void Clear ();
+
+  private:
+    static inline SX1276TraceRing *& Ring()
+    {
+      static thread_local SX1276TraceRing * ring = NULL;
+      return ring;
+    }
+    static SX1276TraceRing * Attach();
+};
+
+/*  SX1276TraceScope
+ *  Records one event covering its own lifetime. Used by TRACE_SCOPE().
+ */
+class SX1276TraceScope
+{
+  public:
+    inline SX1276TraceScope(uint16_t id,
+                            uint32_t arg)
+    {
+      _Id = id;
+      _Arg = arg;
+      _Start = SX1276Trace::Ticks();
+    }
+    inline ~SX1276TraceScope()
+    {
+      SX1276Trace::Record(_Id, _Start, SX1276Trace::Ticks(), _Arg);
+    }
+    inline void Arg(uint32_t arg)
+    {
+      _Arg = arg;
+    }
+
+  private:
+    uint64_t _Start;
+    uint32_t _Arg;
+    uint16_t _Id;
+};
+
+#endif
+#endif
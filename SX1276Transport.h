@@ -0,0 +1,161 @@
+/*  SX1276Transport_h - SPI transports for the SX1276 library
+ *
+ *  The driver reaches the modem only through its transport's Transfer(): one SPI
+ *  transaction, chip select included, full duplex in place in buf. The transport is
+ *  chosen at compile time, so every register access inlines down to the platform
+ *  call, with no virtual dispatch and no platform #ifdef in the driver:
+ *
+ *    ESP32            SX1276ArduinoSpi  Arduino SPIClass on HSPI
+ *    -DSX1276_SPIDEV  SX1276Spidev      Linux spidev ioctl, wiringPi for the pins
+ *    default (Pi)     SX1276WiringPiSpi wiringPiSPIDataRW
+ *
+ *  Begin() returns -1 if the bus can't be opened; the driver reports it from Init().
+ *  Clock() changes the SPI clock, for SX1276::TuneSpi().
+ *
+ *  The emulator (-DSX1276_EMULATOR) provides the wiringPi calls, so it runs under
+ *  SX1276WiringPiSpi. Time (millis(), micros(), delay()) has the same Arduino names
+ *  on every platform, and needs no policy of its own.
+ *
+ *  Released into the public domain.
+ */
+#ifndef SX1276Transport_h
+#define SX1276Transport_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef ESP32
+  #include <unistd.h>
+#endif
+#if defined(SX1276_SPIDEV) && !defined(ESP32) && !defined(SX1276_EMULATOR)
+  #include <fcntl.h>
+  #include <sys/ioctl.h>
+  #include <linux/spi/spidev.h>
+  #define SPIDEV_DEVICE    "/dev/spidev0.0"
+#endif
+
+#ifdef ESP32
+/*  SX1276ArduinoSpi
+ *  ESP32: SPIClass on HSPI, chip select on a GPIO.
+ */
+class SX1276ArduinoSpi
+{
+  public:
+    int Begin (int clk, uint8_t nss, uint8_t sck, uint8_t miso, uint8_t mosi)
+    {
+      _Clk = clk;
+      _Nss = nss;
+      pinMode (_Nss, OUTPUT);
+      _Spi = new SPIClass(HSPI);
+      _Spi->begin(sck, miso, mosi, nss);
+      return 0;
+    }
+    inline void Transfer (uint8_t *buf, size_t len)
+    {
+      _Spi->beginTransaction(SPISettings(_Clk, MSBFIRST, SPI_MODE0));
+      digitalWrite(_Nss, LOW);
+      _Spi->transfer(buf, len);
+      digitalWrite(_Nss, HIGH);
+      _Spi->endTransaction();
+    }
+    int Clock (int clk)
+    {
+      _Clk = clk;
+      return 0;
+    }
+
+  private:
+    SPIClass * _Spi = NULL;
+    int      _Clk;
+    uint8_t  _Nss;
+};
+typedef SX1276ArduinoSpi SX1276Transport;
+
+#elif defined(SX1276_SPIDEV) && !defined(SX1276_EMULATOR)
+/*  SX1276Spidev
+ *  Linux: SPI_IOC_MESSAGE on SPIDEV_DEVICE, straight to the kernel driver. The chip
+ *  select and reset pins are still driven through wiringPi.
+ */
+class SX1276Spidev
+{
+  public:
+    int Begin (int clk, uint8_t nss, uint8_t /* sck */, uint8_t /* miso */, uint8_t /* mosi */)
+    {
+      uint8_t mode = SPI_MODE_0;
+      uint8_t bits = 8;
+      _Clk = clk;
+      _Nss = nss;
+      wiringPiSetup();
+      pinMode (_Nss, OUTPUT);
+      _Fd = open(SPIDEV_DEVICE, O_RDWR);
+      if (_Fd < 0) return -1;
+      if (ioctl(_Fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+          ioctl(_Fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+          ioctl(_Fd, SPI_IOC_WR_MAX_SPEED_HZ, &_Clk) < 0)
+      {
+        close(_Fd);
+        _Fd = -1;
+        return -1;
+      }
+      return 0;
+    }
+    inline void Transfer (uint8_t *buf, size_t len)
+    {
+      struct spi_ioc_transfer tr;
+      memset(&tr, 0, sizeof(tr));
+      tr.tx_buf = (unsigned long) buf;
+      tr.rx_buf = (unsigned long) buf;
+      tr.len = len;
+      tr.speed_hz = _Clk;
+      tr.bits_per_word = 8;
+      digitalWrite(_Nss, LOW);
+      ioctl(_Fd, SPI_IOC_MESSAGE(1), &tr);
+      digitalWrite(_Nss, HIGH);
+    }
+    int Clock (int clk)
+    {
+      _Clk = clk;
+      return 0;
+    }
+
+  private:
+    int      _Fd = -1;
+    uint32_t _Clk;
+    uint8_t  _Nss;
+};
+typedef SX1276Spidev SX1276Transport;
+
+#else
+/*  SX1276WiringPiSpi
+ *  Raspberry Pi through wiringPi, channel 0, or the emulator's wiringPi calls.
+ */
+class SX1276WiringPiSpi
+{
+  public:
+    int Begin (int clk, uint8_t nss, uint8_t /* sck */, uint8_t /* miso */, uint8_t /* mosi */)
+    {
+      _Nss = nss;
+      wiringPiSetup();
+      pinMode (_Nss, OUTPUT);
+      return wiringPiSPISetup(0, clk) < 0 ? -1 : 0;
+    }
+    inline void Transfer (uint8_t *buf, size_t len)
+    {
+      digitalWrite(_Nss, LOW);
+      wiringPiSPIDataRW(0, buf, len);
+      digitalWrite(_Nss, HIGH);
+    }
+    int Clock (int clk)
+    {
+      int fd = wiringPiSPIGetFd(0); // wiringPi sets the clock when it opens the bus
+      if (fd >= 0) close(fd);
+      return wiringPiSPISetup(0, clk) < 0 ? -1 : 0;
+    }
+
+  private:
+    uint8_t  _Nss;
+};
+typedef SX1276WiringPiSpi SX1276Transport;
+#endif
+
+#endif